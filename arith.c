@@ -224,6 +224,34 @@ bool evaluate_index(wchar_t *exp, ssize_t *valuep)
     return ok;
 }
 
+/* Evaluates the specified string as an arithmetic expression.
+ * The argument string is freed in this function.
+ * The result is truncated to an integer and assigned to `*valuep'.
+ * Returns true iff successful. On error, an error message is printed. */
+bool evaluate_integer(wchar_t *exp, long *valuep)
+{
+    value_T result;
+    evalinfo_T info;
+
+    evaluate(exp, &result, &info, true);
+
+    bool ok;
+    if (info.error) {
+        ok = false;
+    } else if (info.atoken.type == TT_NULL) {
+        coerce_integer(&info, &result);
+        assert(result.type == VT_LONG);
+        *valuep = result.v_long;
+        ok = true;
+    } else {
+        if (info.atoken.type != TT_INVALID)
+            xerror(0, Ngt("arithmetic: invalid syntax"));
+        ok = false;
+    }
+    free(exp);
+    return ok;
+}
+
 void evaluate(
         const wchar_t *exp, value_T *result, evalinfo_T *info, bool coerce)
 {
@@ -283,13 +311,18 @@ void parse_assignment(evalinfo_T *info, value_T *result)
  * Returns false on error. */
 bool do_assignment(const word_T *word, const value_T *value)
 {
-    wchar_t *vstr = value_to_string(value);
-    if (vstr == NULL)
-        return false;
-
     wchar_t name[word->length + 1];
     wmemcpy(name, word->contents, word->length);
     name[word->length] = L'\0';
+
+    /* An integer result is stored without conversion to a string if the
+     * variable has the integer attribute. */
+    if (value->type == VT_LONG)
+        return set_variable_long(name, value->v_long, SCOPE_GLOBAL, false);
+
+    wchar_t *vstr = value_to_string(value);
+    if (vstr == NULL)
+        return false;
     return set_variable(name, vstr, SCOPE_GLOBAL, false);
 }
 
@@ -1140,7 +1173,10 @@ void coerce_number(evalinfo_T *info, value_T *value)
         wchar_t namestr[name->length + 1];
         wmemcpy(namestr, name->contents, name->length);
         namestr[name->length] = L'\0';
-        varvalue = getvar(namestr);
+        if (getvar_long(namestr, &value->v_long, &varvalue)) {
+            value->type = VT_LONG;
+            return;
+        }
 
         if (varvalue == NULL && !shopt_unset) {
             xerror(0, Ngt("arithmetic: parameter `%ls' is not set"), namestr);
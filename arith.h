@@ -27,6 +27,8 @@ extern wchar_t *evaluate_arithmetic(wchar_t *exp)
     __attribute__((nonnull,malloc,warn_unused_result));
 extern _Bool evaluate_index(wchar_t *exp, ssize_t *valuep)
     __attribute__((nonnull));
+extern _Bool evaluate_integer(wchar_t *exp, long *valuep)
+    __attribute__((nonnull));
 
 
 #endif /* YASH_ARITH_H */
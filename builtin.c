@@ -124,11 +124,11 @@ void init_builtin(void)
     DEFBUILTIN("typeset", typeset_builtin, BI_ELECTIVE, typeset_help,
             typeset_syntax, typeset_options);
     DEFBUILTIN("export", typeset_builtin, BI_SPECIAL, export_help,
-            export_syntax, typeset_options);
+            export_syntax, export_options);
     DEFBUILTIN("local", typeset_builtin, BI_ELECTIVE, local_help,
             local_syntax, local_options);
     DEFBUILTIN("readonly", typeset_builtin, BI_SPECIAL, readonly_help,
-            readonly_syntax, typeset_options);
+            readonly_syntax, export_options);
 #if YASH_ENABLE_ARRAY
     DEFBUILTIN("array", array_builtin, BI_EXTENSION, array_help, array_syntax,
             array_options);
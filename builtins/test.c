@@ -786,7 +786,6 @@ int eval_dbexp(const dbexp_T *e)
 
     free(lhs);
     free(rhs.value);
-    free(rhs.cc);
     if (yash_error_message_count > 0)
         return Exit_TESTERROR;
     return result ? Exit_TRUE : Exit_FALSE;
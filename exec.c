@@ -1284,8 +1284,17 @@ void exec_for(const command_T *c, bool finally_exit)
 
     int count;
     void **words;
-
-    if (c->c_forwords != NULL) {
+    braceseq_T *seqs = NULL;
+    size_t seqcount, si = 0;
+
+    if (c->c_forwords != NULL &&
+            (seqs = get_brace_sequences(c->c_forwords, &seqcount)) != NULL) {
+        /* The words are all numeric brace expansions like "{1..100}".
+         * Their values are generated one by one during the loop rather than
+         * expanded all at once. */
+        count = 0;
+        words = NULL;
+    } else if (c->c_forwords != NULL) {
         /* expand the words between "in" and "do" of the for command. */
         if (!expand_line(c->c_forwords, &count, &words)) {
             laststatus = Exit_EXPERROR;
@@ -1313,9 +1322,23 @@ void exec_for(const command_T *c, bool finally_exit)
         goto done;                                      \
     } else (void) 0
 
-    int i;
-    for (i = 0; i < count; i++) {
-        if (!set_variable(c->c_forname, words[i],
+    int i = 0;
+    for (;;) {
+        wchar_t *word;
+        bool last;
+        if (seqs == NULL) {
+            if (i >= count)
+                break;
+            word = words[i++];
+            last = (i == count);
+        } else {
+            if (seqs[si].done && ++si == seqcount)
+                break;
+            word = next_brace_sequence_value(&seqs[si]);
+            last = seqs[si].done && si + 1 == seqcount;
+        }
+
+        if (!set_variable(c->c_forname, word,
                     shopt_forlocal && !posixly_correct ?
                         SCOPE_LOCAL : SCOPE_GLOBAL,
                     false)) {
@@ -1325,7 +1348,7 @@ void exec_for(const command_T *c, bool finally_exit)
                 finally_exit = true;
             goto done;
         }
-        exec_and_or_lists(c->c_forcmds, finally_exit && i + 1 == count);
+        exec_and_or_lists(c->c_forcmds, finally_exit && last);
 
         if (c->c_forcmds == NULL)
             handle_signals();
@@ -1333,11 +1356,12 @@ void exec_for(const command_T *c, bool finally_exit)
     }
 
 done:
-    while (++i < count)  /* free unused words */
-        free(words[i]);
+    while (i < count)  /* free unused words */
+        free(words[i++]);
     free(words);
-    if (count == 0 && c->c_forcmds != NULL)
+    if (count == 0 && seqs == NULL && c->c_forcmds != NULL)
         laststatus = Exit_SUCCESS;
+    free(seqs);
 finish:
     execstate.loopnest--;
     if (finally_exit)
@@ -1739,8 +1763,8 @@ bool autoload_completion_function_file(
     if (mbsfilename == NULL)
         return false;
 
-    char *path = which(mbsfilename, get_path_array(PA_LOADPATH),
-            is_readable_regular);
+    char *code;
+    char *path = which_autoload(mbsfilename, &code);
     if (path == NULL) {
         le_compdebug("file \"%s\" was not found in $YASH_LOADPATH",
                 mbsfilename);
@@ -1748,11 +1772,15 @@ bool autoload_completion_function_file(
         return false;
     }
 
-    int fd = move_to_shellfd(open(path, O_RDONLY));
-    if (fd < 0) {
-        le_compdebug("cannot open file \"%s\"", path);
-        free(path);
-        return false;
+    int fd = -1;
+    if (code == NULL) {
+        fd = move_to_shellfd(open(path, O_RDONLY));
+        if (fd < 0) {
+            le_compdebug("cannot open file \"%s\"", path);
+            free(path);
+            free(mbsfilename);
+            return false;
+        }
     }
 
     execstate_T *saveexecstate = save_execstate();
@@ -1763,8 +1791,12 @@ bool autoload_completion_function_file(
     open_new_environment(false);
     set_positional_parameters((void *[]) { (void *) cmdname, NULL });
 
-    le_compdebug("executing file \"%s\" (autoload)", path);
-    exec_input(fd, mbsfilename, 0);
+    le_compdebug("executing file \"%s\" (autoload%s)",
+            path, code != NULL ? " from bundle" : "");
+    if (code != NULL)
+        exec_mbs(code, mbsfilename, 0);
+    else
+        exec_input(fd, mbsfilename, 0);
     le_compdebug("finished executing file \"%s\"", path);
 
     close_current_environment();
@@ -1772,8 +1804,11 @@ bool autoload_completion_function_file(
     laststatus = savelaststatus;
     cancel_return();
     restore_execstate(saveexecstate);
-    remove_shellfd(fd);
-    xclose(fd);
+    if (fd >= 0) {
+        remove_shellfd(fd);
+        xclose(fd);
+    }
+    free(code);
     free(path);
     free(mbsfilename);
     return true;
@@ -2090,10 +2125,9 @@ int dot_builtin(int argc, void **argv)
         return Exit_ERROR;
     }
 
-    char *path;
+    char *path, *code = NULL;
     if (autoload) {
-        path = which(mbsfilename, get_path_array(PA_LOADPATH),
-                is_readable_regular);
+        path = which_autoload(mbsfilename, &code);
         if (path == NULL) {
             xerror(0, Ngt("file `%s' was not found in $YASH_LOADPATH"),
                     mbsfilename);
@@ -2113,13 +2147,18 @@ int dot_builtin(int argc, void **argv)
         path = mbsfilename;
     }
 
-    int fd = move_to_shellfd(open(path, O_RDONLY));
+    int fd = -1;
+    if (code == NULL) {
+        fd = move_to_shellfd(open(path, O_RDONLY));
+        if (fd < 0) {
+            xerror(errno, Ngt("cannot open file `%s'"), mbsfilename);
+            if (path != mbsfilename)
+                free(path);
+            goto error;
+        }
+    }
     if (path != mbsfilename)
         free(path);
-    if (fd < 0) {
-        xerror(errno, Ngt("cannot open file `%s'"), mbsfilename);
-        goto error;
-    }
 
     if (has_args) {
         open_new_environment(false);
@@ -2132,13 +2171,19 @@ int dot_builtin(int argc, void **argv)
     bool saveser = suppresserrreturn;
     suppresserrreturn = false;
 
-    exec_input(fd, mbsfilename, enable_alias ? XIO_SUBST_ALIAS : 0);
+    if (code != NULL)
+        exec_mbs(code, mbsfilename, enable_alias ? XIO_SUBST_ALIAS : 0);
+    else
+        exec_input(fd, mbsfilename, enable_alias ? XIO_SUBST_ALIAS : 0);
 
     cancel_return();
     suppresserrreturn = saveser;
     restore_execstate(saveexecstate);
-    remove_shellfd(fd);
-    xclose(fd);
+    if (fd >= 0) {
+        remove_shellfd(fd);
+        xclose(fd);
+    }
+    free(code);
     free(mbsfilename);
 
     if (has_args) {
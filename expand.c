@@ -43,24 +43,72 @@
 #include "yash.h"
 
 
+/* An "expansion word" is a wide string that is immediately followed by the
+ * corresponding charcategory_T string in the same memory block:
+ *     value[0] ... value[n-1] L'\0' cc[0] ... cc[n-1] '\0'
+ * The charcategory_T string has the same length as the wide string. Both are
+ * freed by a single call to `free'. Use `word_cc' to get the pointer to the
+ * charcategory_T string of an expansion word. */
+
+/* buffer to construct an expansion word */
+typedef struct ccbuf_T {
+    wchar_t *contents;
+    size_t length, maxlength;
+} ccbuf_T;
+/* `contents' points to a memory block that can hold `maxlength + 1' wide
+ * characters followed by `maxlength + 1' bytes of charcategory_T values, the
+ * latter of which can be accessed by `cb_cc'. The first `length' characters
+ * and bytes of them are valid. They are not null-terminated until the buffer
+ * is converted into an expansion word by `cb_toword'. */
+
 /* result of word expansion */
 struct expand_four_T {
-    plist_T valuelist, cclist;
+    plist_T words;
 };
-/* `valuelist' is a list of pointers to newly malloced wide strings that contain
- * the expanded word value. `cclist' is a list of pointers to newly malloced
- * single-byte strings whose values are charcategory_T cast to char. `cclist'
- * must have as many strings as `valuelist' and each string in `cclist' must
- * have the same length as the corresponding wide string in `valuelist'. */
+/* `words' is a list of pointers to newly malloced expansion words. */
 
 static plist_T expand_word(const wordunit_T *w)
     __attribute__((warn_unused_result));
 static struct expand_four_T expand_four(const wordunit_T *restrict w,
         tildetype_T tilde, quoting_T quoting, charcategory_T defaultcc)
     __attribute__((warn_unused_result));
-static inline void fill_ccbuf(
-        const xwcsbuf_T *restrict valuebuf, xstrbuf_T *restrict ccbuf,
-        charcategory_T c)
+
+static inline char *word_cc(const wchar_t *word)
+    __attribute__((nonnull,pure));
+static inline char *cb_cc(const ccbuf_T *buf)
+    __attribute__((nonnull,pure));
+static ccbuf_T *cb_initwithmax(ccbuf_T *buf, size_t max)
+    __attribute__((nonnull));
+static inline ccbuf_T *cb_init(ccbuf_T *buf)
+    __attribute__((nonnull));
+static inline ccbuf_T *cb_initwithword(
+        ccbuf_T *restrict buf, wchar_t *restrict word)
+    __attribute__((nonnull));
+static ccbuf_T *cb_initwithwcs(
+        ccbuf_T *restrict buf, wchar_t *restrict s, charcategory_T c)
+    __attribute__((nonnull));
+static inline void cb_destroy(ccbuf_T *buf)
+    __attribute__((nonnull));
+static wchar_t *cb_toword(ccbuf_T *buf)
+    __attribute__((nonnull));
+static ccbuf_T *cb_setmax(ccbuf_T *buf, size_t newmax)
+    __attribute__((nonnull));
+static inline ccbuf_T *cb_ensuremax(ccbuf_T *buf, size_t max)
+    __attribute__((nonnull));
+static inline ccbuf_T *cb_clear(ccbuf_T *buf)
+    __attribute__((nonnull));
+static ccbuf_T *cb_ncat(ccbuf_T *restrict buf,
+        const wchar_t *restrict s, const char *restrict cc, size_t n)
+    __attribute__((nonnull));
+static ccbuf_T *cb_ncat_uniform(ccbuf_T *restrict buf,
+        const wchar_t *restrict s, size_t n, charcategory_T c)
+    __attribute__((nonnull));
+static ccbuf_T *cb_ccat(ccbuf_T *buf, wchar_t c, charcategory_T cc)
+    __attribute__((nonnull));
+static ccbuf_T *cb_catwcsfree(
+        ccbuf_T *restrict buf, wchar_t *restrict s, charcategory_T c)
+    __attribute__((nonnull));
+static ccbuf_T *cb_catword(ccbuf_T *restrict buf, wchar_t *restrict word)
     __attribute__((nonnull));
 
 static wchar_t *expand_tilde(const wchar_t **ss,
@@ -94,7 +142,7 @@ static void subst_length_each(void **slist)
 static void merge_expand_four(
         struct expand_four_T *restrict from,
         struct expand_four_T *restrict to,
-        xwcsbuf_T *restrict valuebuf, xstrbuf_T *restrict ccbuf)
+        ccbuf_T *restrict buf)
     __attribute__((nonnull));
 
 /* data used in brace expansion */
@@ -102,37 +150,52 @@ struct brace_expand_T {
     const wchar_t *word;  /* the word to expand */
     const char *cc;       /* the corresponding charcategory_T string */
     void *const *graph;   /* see the comment in the `expand_brace` function */
-    plist_T *valuelist;   /* the list to add the results (words) */
-    plist_T *cclist;      /* the list to add the results (charcategory_T) */
+    plist_T *words;       /* the list to add the results (expansion words) */
 };
 
 static void expand_brace_each(
-        void *const *restrict values, void *const *restrict ccs,
-        plist_T *restrict valuelist, plist_T *restrict cclist)
+        void *const *restrict words, plist_T *restrict results)
     __attribute__((nonnull));
-static void expand_brace(
-        wchar_t *restrict word, char *restrict cc,
-        plist_T *restrict valuelist, plist_T *restrict cclist)
+static void expand_brace(wchar_t *restrict word, plist_T *restrict results)
     __attribute__((nonnull));
 static void generate_brace_expand_results(
         const struct brace_expand_T *restrict e, size_t ci,
-        xwcsbuf_T *restrict valuebuf, xstrbuf_T *restrict ccbuf)
+        ccbuf_T *restrict buf)
     __attribute__((nonnull));
 static bool try_expand_brace_sequence(
         const struct brace_expand_T *restrict e, size_t ci,
-        xwcsbuf_T *restrict valuebuf, xstrbuf_T *restrict ccbuf)
+        ccbuf_T *restrict buf)
+    __attribute__((nonnull));
+static const wchar_t *parse_brace_sequence(
+        const wchar_t *restrict s, braceseq_T *restrict seq)
+    __attribute__((nonnull));
+static int wb_brace_sequence_value(
+        xwcsbuf_T *restrict buf, braceseq_T *restrict seq)
     __attribute__((nonnull));
 static bool has_leading_zero(const wchar_t *restrict s, bool *restrict sign)
     __attribute__((nonnull));
 
-static void fieldsplit(void **restrict valuelist, void **restrict cclist,
-        plist_T *restrict outvaluelist, plist_T *restrict outcclist)
+/* set of IFS characters used in field splitting */
+struct ifsset_T {
+    const wchar_t *ifs;          /* the value of $IFS */
+    bool nonascii;               /* true if `ifs' has a non-ASCII character */
+    unsigned char ascii[128];    /* IFS_* flags of each ASCII character */
+};
+enum {
+    IFS_CHAR       = 1 << 0,  /* The character is in $IFS. */
+    IFS_WHITESPACE = 1 << 1,  /* The character is an IFS whitespace. */
+};
+
+static void fieldsplit(void **restrict words, plist_T *restrict outwords)
     __attribute__((nonnull));
-static bool is_ifs_char(wchar_t c, charcategory_T cc, const wchar_t *ifs)
-    __attribute__((nonnull,pure));
-static bool is_ifs_whitespace(wchar_t c, charcategory_T cc, const wchar_t *ifs)
-    __attribute__((nonnull,pure));
-static bool is_non_ifs_char(wchar_t c, charcategory_T cc, const wchar_t *ifs)
+static void init_ifsset(
+        struct ifsset_T *restrict set, const wchar_t *restrict ifs)
+    __attribute__((nonnull));
+static wchar_t *split_fields(const wchar_t *restrict s, const char *restrict cc,
+        const struct ifsset_T *restrict set, plist_T *restrict dest)
+    __attribute__((nonnull));
+static inline int ifs_class(
+        wchar_t c, charcategory_T cc, const struct ifsset_T *set)
     __attribute__((nonnull,pure));
 static void add_empty_field(plist_T *dest, const wchar_t *p)
     __attribute__((nonnull));
@@ -142,9 +205,14 @@ static inline void add_sq(
     __attribute__((nonnull));
 static inline bool should_escape(charcategory_T cc, escaping_T escaping)
     __attribute__((const));
-static wchar_t *quote_removal_free(
-        wchar_t *restrict s, char *restrict cc, escaping_T escaping)
+static wchar_t *quote_removal_free(wchar_t *word, escaping_T escaping)
+    __attribute__((nonnull,malloc,warn_unused_result));
+static wchar_t *quote_removal_scratch(
+        const wchar_t *restrict s, const char *restrict cc, escaping_T escaping)
     __attribute__((nonnull,malloc,warn_unused_result));
+static wchar_t *remove_quotes(wchar_t *restrict result,
+        const wchar_t *restrict s, const char *restrict cc, escaping_T escaping)
+    __attribute__((nonnull));
 
 static enum wglobflags_T get_wglobflags(void)
     __attribute__((pure));
@@ -152,6 +220,9 @@ static void glob_all(
         struct expand_four_T *restrict e, plist_T *restrict results)
     __attribute__((nonnull));
 
+static wchar_t *expand_single_scratch(const wordunit_T *w,
+        tildetype_T tilde, quoting_T quoting, escaping_T escaping)
+    __attribute__((malloc,warn_unused_result));
 static void maybe_exit_on_error(void);
 
 
@@ -192,42 +263,41 @@ bool expand_line(void *const *restrict args,
  * On error in a non-interactive shell, the shell exits. */
 bool expand_multiple(const wordunit_T *w, plist_T *list)
 {
-    /* four expansions (w -> valuelist) */
+    /* four expansions (w -> words) */
     struct expand_four_T expand = expand_four(w, TT_SINGLE, Q_WORD, CC_LITERAL);
-    if (expand.valuelist.contents == NULL) {
+    if (expand.words.contents == NULL) {
         maybe_exit_on_error();
         return false;
     }
 
-    /* brace expansion (valuelist -> valuelist2) */
-    plist_T valuelist2, cclist2;
+    /* brace expansion and pathname expansion use the scratch arena */
+    scratchmark_T mark = scratch_mark();
+
+    /* brace expansion (words -> words2) */
+    plist_T words2;
     if (shopt_braceexpand) {
-        pl_init(&valuelist2);
-        pl_init(&cclist2);
-        expand_brace_each(expand.valuelist.contents, expand.cclist.contents,
-                &valuelist2, &cclist2);
-        pl_truncate(&expand.valuelist, 0);
-        pl_truncate(&expand.cclist, 0);
+        pl_init(&words2);
+        expand_brace_each(expand.words.contents, &words2);
+        pl_truncate(&expand.words, 0);
     } else {
-        valuelist2 = expand.valuelist;
-        cclist2 = expand.cclist;
-        pl_init(&expand.valuelist);
-        pl_init(&expand.cclist);
+        words2 = expand.words;
+        pl_init(&expand.words);
     }
 
-    /* field splitting (valuelist2 -> valuelist) */
-    fieldsplit(pl_toary(&valuelist2), pl_toary(&cclist2),
-            &expand.valuelist, &expand.cclist);
-    assert(expand.valuelist.length == expand.cclist.length);
+    /* field splitting (words2 -> words) */
+    fieldsplit(pl_toary(&words2), &expand.words);
 
     /* pathname expansion (and quote removal) */
     glob_all(&expand, list);
 
+    scratch_release(mark);
     return true;
 }
 
 /* Expands a word to a single field.
- * If successful, the result is a pair of newly malloced strings.
+ * If successful, the result is a newly malloced expansion word: `value' is the
+ * word and `cc' is the charcategory_T string that resides in the same memory
+ * block. Only `value' should be freed.
  * On error, an error message is printed and a NULL pair is returned.
  * On error in a non-interactive shell, the shell exits. */
 /* This function first expands the word into (possibly many) fields and then
@@ -237,41 +307,40 @@ struct cc_word_T expand_single_cc(
 {
     struct expand_four_T e = expand_four(w, tilde, quoting, CC_LITERAL);
 
-    if (e.valuelist.contents == NULL) {
+    if (e.words.contents == NULL) {
         maybe_exit_on_error();
         return (struct cc_word_T) { NULL, NULL };
     }
 
-    const wchar_t *ifs = getvar(L VAR_IFS);
-    wchar_t separator = ifs != NULL ? ifs[0] : L' ';
-
-    size_t totallength;
-    if (e.valuelist.length == 0)
-        totallength = 0;
-    else {
-        totallength = e.valuelist.length - 1;
-        for (size_t i = 0; i < e.valuelist.length; i++)
-            totallength = add(totallength, wcslen(e.valuelist.contents[i]));
-    }
+    wchar_t *word;
+    if (e.words.length == 1) {
+        /* The only word can be used as is. */
+        word = e.words.contents[0];
+    } else {
+        const wchar_t *ifs = getvar(L VAR_IFS);
+        wchar_t separator = ifs != NULL ? ifs[0] : L' ';
+
+        size_t totallength;
+        if (e.words.length == 0)
+            totallength = 0;
+        else {
+            totallength = e.words.length - 1;
+            for (size_t i = 0; i < e.words.length; i++)
+                totallength = add(totallength, wcslen(e.words.contents[i]));
+        }
 
-    xwcsbuf_T valuebuf;
-    xstrbuf_T ccbuf;
-    wb_initwithmax(&valuebuf, totallength);
-    sb_initwithmax(&ccbuf, totallength);
-    for (size_t i = 0; i < e.valuelist.length; i++) {
-        if (i > 0 && separator != L'\0') {
-            wb_wccat(&valuebuf, separator);
-            sb_ccat(&ccbuf, CC_SOFT_EXPANSION);
+        ccbuf_T buf;
+        cb_initwithmax(&buf, totallength);
+        for (size_t i = 0; i < e.words.length; i++) {
+            if (i > 0 && separator != L'\0')
+                cb_ccat(&buf, separator, CC_SOFT_EXPANSION);
+            cb_catword(&buf, e.words.contents[i]);
         }
-        wb_catfree(&valuebuf, e.valuelist.contents[i]);
-        sb_ncat_force(
-                &ccbuf, e.cclist.contents[i], valuebuf.length - ccbuf.length);
-        free(e.cclist.contents[i]);
+        word = cb_toword(&buf);
     }
 
-    pl_destroy(&e.valuelist);
-    pl_destroy(&e.cclist);
-    return (struct cc_word_T) { wb_towcs(&valuebuf), sb_tostr(&ccbuf) };
+    pl_destroy(&e.words);
+    return (struct cc_word_T) { word, word_cc(word) };
 }
 
 /* Expands a word to (possibly any number of) fields.
@@ -285,13 +354,11 @@ plist_T expand_word(const wordunit_T *w)
     struct expand_four_T expand = expand_four(w, TT_NONE, Q_WORD, CC_LITERAL);
 
     /* quote removal */
-    for (size_t i = 0; i < expand.valuelist.length; i++)
-        expand.valuelist.contents[i] = quote_removal_free(
-            expand.valuelist.contents[i], expand.cclist.contents[i], ES_NONE);
-
-    pl_destroy(&expand.cclist);
+    for (size_t i = 0; i < expand.words.length; i++)
+        expand.words.contents[i] =
+            quote_removal_free(expand.words.contents[i], ES_NONE);
 
-    return expand.valuelist;
+    return expand.words;
 }
 
 /* Expands a single word: the four expansions and quote removal.
@@ -305,7 +372,20 @@ wchar_t *expand_single(const wordunit_T *w,
     cc_word_T e = expand_single_cc(w, tilde, quoting);
     if (e.value == NULL)
         return NULL;
-    return quote_removal_free(e.value, e.cc, escaping);
+    return quote_removal_free(e.value, escaping);
+}
+
+/* Like `expand_single', but the result is allocated in the scratch arena.
+ * The caller must have made a mark in the arena to release the result. */
+wchar_t *expand_single_scratch(const wordunit_T *w,
+        tildetype_T tilde, quoting_T quoting, escaping_T escaping)
+{
+    cc_word_T e = expand_single_cc(w, tilde, quoting);
+    if (e.value == NULL)
+        return NULL;
+    wchar_t *result = quote_removal_scratch(e.value, e.cc, escaping);
+    free(e.value);
+    return result;
 }
 
 /* Expands a single word: the four expansions, pathname expansion, and quote
@@ -328,9 +408,10 @@ char *expand_single_with_glob(const wordunit_T *arg)
     if (!shopt_glob)
         goto quote_removal;
 
-    wchar_t *pattern = quote_removal(e.value, e.cc, ES_QUOTED_HARD);
+    scratchmark_T mark = scratch_mark();
+    wchar_t *pattern = quote_removal_scratch(e.value, e.cc, ES_QUOTED_HARD);
     if (!is_pathname_matching_pattern(pattern)) {
-        free(pattern);
+        scratch_release(mark);
         goto quote_removal;
     }
 
@@ -342,7 +423,7 @@ char *expand_single_with_glob(const wordunit_T *arg)
     set_interruptible_by_sigint(true);
     ok = wglob(pattern, get_wglobflags(), &globresults);
     set_interruptible_by_sigint(false);
-    free(pattern);
+    scratch_release(mark);
     if (!ok) {
         plfree(pl_toary(&globresults), free);
         xerror(EINTR, Ngt("redirection"));
@@ -370,42 +451,219 @@ quote_removal:
     if (mbresult == NULL)
         xerror(EILSEQ, Ngt("redirection"));
     free(e.value);
-    free(e.cc);
     return mbresult;
 
 return_null:
     free(e.value);
-    free(e.cc);
     return NULL;
 }
 
 
+/********** Expansion Words **********/
+
+/* Returns a pointer to the charcategory_T string of the specified expansion
+ * word. */
+char *word_cc(const wchar_t *word)
+{
+    return (char *) &word[wcslen(word) + 1];
+}
+
+/* Returns a pointer to the charcategory_T values in the specified buffer. */
+char *cb_cc(const ccbuf_T *buf)
+{
+    return (char *) &buf->contents[buf->maxlength + 1];
+}
+
+/* Initializes the specified buffer as an empty word with the specified max
+ * length. */
+ccbuf_T *cb_initwithmax(ccbuf_T *buf, size_t max)
+{
+    buf->contents = xmallocn(add(max, 1), sizeof (wchar_t) + 1);
+    buf->length = 0;
+    buf->maxlength = max;
+    return buf;
+}
+
+/* Initializes the specified buffer as an empty word. */
+ccbuf_T *cb_init(ccbuf_T *buf)
+{
+    return cb_initwithmax(buf, XWCSBUF_INITSIZE);
+}
+
+/* Initializes the specified buffer with the specified expansion word.
+ * `word' must not be modified or freed after the call to this function. */
+ccbuf_T *cb_initwithword(ccbuf_T *restrict buf, wchar_t *restrict word)
+{
+    buf->contents = word;
+    buf->length = buf->maxlength = wcslen(word);
+    return buf;
+}
+
+/* Initializes the specified buffer with the specified wide string whose
+ * characters are all given charcategory_T `c'.
+ * `s' must be a `free'able string. It is reallocated to make room for the
+ * charcategory_T values, so it must not be used after the call to this
+ * function. */
+ccbuf_T *cb_initwithwcs(
+        ccbuf_T *restrict buf, wchar_t *restrict s, charcategory_T c)
+{
+    size_t len = wcslen(s);
+    buf->contents = xreallocn(s, add(len, 1), sizeof (wchar_t) + 1);
+    buf->length = buf->maxlength = len;
+    memset(cb_cc(buf), c, len);
+    return buf;
+}
+
+/* Frees the specified buffer. The contents are lost. */
+void cb_destroy(ccbuf_T *buf)
+{
+    free(buf->contents);
+}
+
+/* Terminates the contents of the specified buffer and returns it as an
+ * expansion word. The charcategory_T values are moved to just after the
+ * terminating null character, so no reallocation occurs.
+ * The caller must `free' the return value. */
+wchar_t *cb_toword(ccbuf_T *buf)
+{
+    wchar_t *word = buf->contents;
+    size_t len = buf->length;
+    char *cc = memmove(&word[len + 1], cb_cc(buf), len);
+    word[len] = L'\0';
+    cc[len] = '\0';
+    return word;
+}
+
+/* Changes the max length of the buffer.
+ * `newmax' must not be less than the current length. */
+ccbuf_T *cb_setmax(ccbuf_T *buf, size_t newmax)
+{
+    assert(newmax >= buf->length);
+    if (newmax < buf->maxlength) {
+        memmove((char *) &buf->contents[newmax + 1], cb_cc(buf), buf->length);
+        buf->contents =
+            xreallocn(buf->contents, newmax + 1, sizeof (wchar_t) + 1);
+        buf->maxlength = newmax;
+    } else if (newmax > buf->maxlength) {
+        buf->contents =
+            xreallocn(buf->contents, add(newmax, 1), sizeof (wchar_t) + 1);
+        char *oldcc = cb_cc(buf);
+        buf->maxlength = newmax;
+        memmove(cb_cc(buf), oldcc, buf->length);
+    }
+    return buf;
+}
+
+/* If `buf->maxlength' is less than `max', reallocates the buffer so that
+ * `buf->maxlength' is no less than `max'. */
+ccbuf_T *cb_ensuremax(ccbuf_T *buf, size_t max)
+{
+    if (max <= buf->maxlength)
+        return buf;
+
+    size_t len15 = buf->maxlength + (buf->maxlength >> 1);
+    if (max < len15)
+        max = len15;
+    if (max < buf->maxlength + 8)
+        max = buf->maxlength + 8;
+    return cb_setmax(buf, max);
+}
+
+/* Clears the contents of the specified buffer.
+ * `maxlength' of the buffer is not changed. */
+ccbuf_T *cb_clear(ccbuf_T *buf)
+{
+    buf->length = 0;
+    return buf;
+}
+
+/* Appends the first `n' characters of `s' and the corresponding `n'
+ * charcategory_T values in `cc' to the buffer.
+ * No boundary checks are done and null characters are not considered special.
+ * `s' and `cc' must not be part of `buf->contents'. */
+ccbuf_T *cb_ncat(ccbuf_T *restrict buf,
+        const wchar_t *restrict s, const char *restrict cc, size_t n)
+{
+    cb_ensuremax(buf, add(buf->length, n));
+    wmemcpy(&buf->contents[buf->length], s, n);
+    memcpy(&cb_cc(buf)[buf->length], cc, n);
+    buf->length += n;
+    return buf;
+}
+
+/* Appends the first `n' characters of `s' to the buffer, giving all of them
+ * charcategory_T `c'.
+ * No boundary checks are done and null characters are not considered special.
+ * `s' must not be part of `buf->contents'. */
+ccbuf_T *cb_ncat_uniform(ccbuf_T *restrict buf,
+        const wchar_t *restrict s, size_t n, charcategory_T c)
+{
+    cb_ensuremax(buf, add(buf->length, n));
+    wmemcpy(&buf->contents[buf->length], s, n);
+    memset(&cb_cc(buf)[buf->length], c, n);
+    buf->length += n;
+    return buf;
+}
+
+/* Appends wide character `c' of charcategory_T `cc' to the buffer. */
+ccbuf_T *cb_ccat(ccbuf_T *buf, wchar_t c, charcategory_T cc)
+{
+    cb_ensuremax(buf, add(buf->length, 1));
+    buf->contents[buf->length] = c;
+    cb_cc(buf)[buf->length] = cc;
+    buf->length++;
+    return buf;
+}
+
+/* Appends wide string `s' to the buffer, giving all the characters
+ * charcategory_T `c'. `s' is freed in this function. */
+ccbuf_T *cb_catwcsfree(
+        ccbuf_T *restrict buf, wchar_t *restrict s, charcategory_T c)
+{
+    cb_ncat_uniform(buf, s, wcslen(s), c);
+    free(s);
+    return buf;
+}
+
+/* Appends expansion word `word' to the buffer. `word' is freed in this
+ * function. If the buffer is empty, `word' takes the place of the buffer
+ * contents without copying. */
+ccbuf_T *cb_catword(ccbuf_T *restrict buf, wchar_t *restrict word)
+{
+    if (buf->length == 0) {
+        cb_destroy(buf);
+        return cb_initwithword(buf, word);
+    }
+
+    size_t len = wcslen(word);
+    cb_ncat(buf, word, (char *) &word[len + 1], len);
+    free(word);
+    return buf;
+}
+
+
 /********** Four Expansions **********/
 
 /* Performs the four expansions, i.e., tilde expansion, parameter expansion,
  * command substitution, and arithmetic expansion.
- * If successful, `valuelist' in the return value is the list of the resultant
- * fields, which are newly malloced wide strings, and `cclist' is the list of
- * the corresponding charcategory_T strings, which are also newly malloced.
+ * If successful, `words' in the return value is the list of the resultant
+ * fields, which are newly malloced expansion words.
  * Usually this function produces one or more fields, but it may produce zero
  * fields if "$@" is expanded with no positional parameters.
- * If unsuccessful, `valuelist' and `cclist' are empty and have NULL `contents'.
- */
+ * If unsuccessful, `words' is empty and has NULL `contents'. */
 struct expand_four_T expand_four(const wordunit_T *restrict w,
         tildetype_T tilde, quoting_T quoting, charcategory_T defaultcc)
 {
-    /* lists to insert the final results into */
+    /* list to insert the final results into */
     struct expand_four_T e;
-    pl_init(&e.valuelist);
-    pl_init(&e.cclist);
+    pl_init(&e.words);
 
     /* intermediate value of the currently expanded word */
-    xwcsbuf_T valuebuf;
-    wb_init(&valuebuf);
+    ccbuf_T buf;
+    cb_init(&buf);
 
-    /* charcategory_T string corresponding to `valuebuf' */
-    xstrbuf_T ccbuf;
-    sb_init(&ccbuf);
+    /* temporaries used in parameter expansion are freed at once at the end */
+    scratchmark_T mark = scratch_mark();
 
     bool indq = false;  /* in a double quote? */
     bool first = true;  /* is the first word unit? */
@@ -428,11 +686,9 @@ struct expand_four_T expand_four(const wordunit_T *restrict w,
             ss = w->wu_string;
             if (first && tilde != TT_NONE) {
                 s = expand_tilde(&ss, w->next, tilde);
-                if (s != NULL) {
-                    wb_catfree(&valuebuf, s);
-                    fill_ccbuf(&valuebuf, &ccbuf,
+                if (s != NULL)
+                    cb_catwcsfree(&buf, s,
                             CC_HARD_EXPANSION | (defaultcc & CC_QUOTED));
-                }
             }
             while (*ss != L'\0') {
                 switch (*ss) {
@@ -448,32 +704,29 @@ struct expand_four_T expand_four(const wordunit_T *restrict w,
                         removedq = false;
                     } else {
                         indq = false; /* leaving a quotation */
-                        if (removedq && e.valuelist.length == 0 &&
-                                wcscmp(valuebuf.contents, L"\"") == 0 &&
-                                (ccbuf.contents[0] & CC_QUOTATION)) {
+                        if (removedq && e.words.length == 0 &&
+                                buf.length == 1 && buf.contents[0] == L'"' &&
+                                (cb_cc(&buf)[0] & CC_QUOTATION)) {
                             /* remove the corresponding opening double-quote */
-                            wb_clear(&valuebuf);
-                            sb_clear(&ccbuf);
+                            cb_clear(&buf);
                             removeempty = true;
                             break; /* and ignore the closing double-quote */
                         }
                     }
-                    wb_wccat(&valuebuf, L'"');
-                    sb_ccat(&ccbuf, defaultcc | CC_QUOTATION);
+                    cb_ccat(&buf, L'"', defaultcc | CC_QUOTATION);
                     break;
                 case L'\'':
                     if (quoting != Q_WORD || indq)
                         goto default_;
 
-                    wb_wccat(&valuebuf, L'\'');
-                    sb_ccat(&ccbuf, defaultcc | CC_QUOTATION);
+                    cb_ccat(&buf, L'\'', defaultcc | CC_QUOTATION);
 
-                    add_sq(&ss, &valuebuf, false);
+                    size_t sqlen = wcscspn(&ss[1], L"'");
+                    cb_ncat_uniform(&buf, &ss[1], sqlen, defaultcc | CC_QUOTED);
+                    ss += sqlen + 1;
                     assert(*ss == L'\'');
-                    fill_ccbuf(&valuebuf, &ccbuf, defaultcc | CC_QUOTED);
 
-                    wb_wccat(&valuebuf, L'\'');
-                    sb_ccat(&ccbuf, defaultcc | CC_QUOTATION);
+                    cb_ccat(&buf, L'\'', defaultcc | CC_QUOTATION);
                     break;
                 case L'\\':
                     switch (quoting) {
@@ -493,32 +746,25 @@ struct expand_four_T expand_four(const wordunit_T *restrict w,
                             goto default_;
                     }
 
-                    wb_wccat(&valuebuf, L'\\');
-                    sb_ccat(&ccbuf, defaultcc | CC_QUOTATION);
+                    cb_ccat(&buf, L'\\', defaultcc | CC_QUOTATION);
                     ss++;
-                    if (*ss != L'\0') {
-                        wb_wccat(&valuebuf, *ss++);
-                        sb_ccat(&ccbuf, defaultcc | CC_QUOTED);
-                    }
+                    if (*ss != L'\0')
+                        cb_ccat(&buf, *ss++, defaultcc | CC_QUOTED);
                     continue;
                 case L':':
                     if (indq || tilde != TT_MULTI)
                         goto default_;
 
                     /* perform tilde expansion after a colon */
-                    wb_wccat(&valuebuf, L':');
-                    sb_ccat(&ccbuf, defaultcc);
+                    cb_ccat(&buf, L':', defaultcc);
                     ss++;
                     s = expand_tilde(&ss, w->next, tilde);
-                    if (s != NULL) {
-                        wb_catfree(&valuebuf, s);
-                        fill_ccbuf(&valuebuf, &ccbuf, CC_HARD_EXPANSION);
-                    }
+                    if (s != NULL)
+                        cb_catwcsfree(&buf, s, CC_HARD_EXPANSION);
                     continue;
 default_:
                 default:
-                    wb_wccat(&valuebuf, *ss);
-                    sb_ccat(&ccbuf, defaultcc | (indq * CC_QUOTED));
+                    cb_ccat(&buf, *ss, defaultcc | (indq * CC_QUOTED));
                     break;
                 }
                 ss++;
@@ -527,15 +773,15 @@ default_:
         case WT_PARAM:;
             struct expand_four_T e2 = expand_param(w->wu_param,
                     indq || quoting == Q_LITERAL || (defaultcc & CC_QUOTED));
-            if (e2.valuelist.contents == NULL)
+            if (e2.words.contents == NULL)
                 goto failure;
-            if (e2.valuelist.length == 0) {
+            if (e2.words.length == 0) {
                 if (indq)
                     removedq = true;
                 else
                     removeempty = true;
             }
-            merge_expand_four(&e2, &e, &valuebuf, &ccbuf);
+            merge_expand_four(&e2, &e, &buf);
             break;
         case WT_CMDSUB:
             s = exec_command_substitution(&w->wu_cmdsub);
@@ -547,41 +793,29 @@ default_:
 cat_s:
             if (s == NULL)
                 goto failure;
-            wb_catfree(&valuebuf, s);
-            fill_ccbuf(&valuebuf, &ccbuf, CC_SOFT_EXPANSION |
+            cb_catwcsfree(&buf, s, CC_SOFT_EXPANSION |
                     (indq * CC_QUOTED) | (defaultcc & CC_QUOTED));
             break;
         }
     }
 
     /* empty field removal */
-    if (removeempty && e.valuelist.length == 0 && valuebuf.length == 0) {
-        wb_destroy(&valuebuf);
-        sb_destroy(&ccbuf);
-    } else {
-        pl_add(&e.valuelist, wb_towcs(&valuebuf));
-        pl_add(&e.cclist, sb_tostr(&ccbuf));
-    }
+    if (removeempty && e.words.length == 0 && buf.length == 0)
+        cb_destroy(&buf);
+    else
+        pl_add(&e.words, cb_toword(&buf));
 
+    scratch_release(mark);
     return e;
 
 failure:
-    sb_destroy(&ccbuf);
-    wb_destroy(&valuebuf);
-    plfree(pl_toary(&e.cclist), free);
-    plfree(pl_toary(&e.valuelist), free);
-    e.valuelist.contents = e.cclist.contents = NULL;
+    scratch_release(mark);
+    cb_destroy(&buf);
+    plfree(pl_toary(&e.words), free);
+    e.words.contents = NULL;
     return e;
 }
 
-/* Appends to `e->ccbuf' as many `c's as needed to match the length with
- * `e->valuebuf'. */
-void fill_ccbuf(const xwcsbuf_T *restrict valuebuf, xstrbuf_T *restrict ccbuf,
-        charcategory_T c)
-{
-    sb_ccat_repeat(ccbuf, c, valuebuf->length - ccbuf->length);
-}
-
 /* Performs tilde expansion.
  * `ss' is a pointer to a pointer to the tilde character. The pointer is
  * increased so that it points to the character right after the expanded string.
@@ -649,9 +883,9 @@ finish:
 }
 
 /* Performs parameter expansion.
- * If successful, the return value contains valid lists of pointers to newly
- * malloced strings. Note that the lists may contain no strings.
- * If unsuccessful, the lists have NULL `contents'. */
+ * If successful, the return value contains a valid list of pointers to newly
+ * malloced expansion words. Note that the list may contain no words.
+ * If unsuccessful, the list has NULL `contents'. */
 struct expand_four_T expand_param(const paramexp_T *p, bool indq)
 {
     /* parse indices first */
@@ -874,24 +1108,21 @@ subst:
     wchar_t *match;
     switch (p->pe_type & PT_MASK) {
     case PT_MATCH:
-        match = expand_single(p->pe_match, TT_SINGLE, Q_WORD, ES_QUOTED);
+        match = expand_single_scratch(p->pe_match, TT_SINGLE, Q_WORD,
+                ES_QUOTED);
         if (match == NULL)
             goto failure2;
         match_each(values, match, p->pe_type);
-        free(match);
         break;
     case PT_SUBST:
-        match = expand_single(p->pe_match, TT_SINGLE, Q_WORD, ES_QUOTED);
+        match = expand_single_scratch(p->pe_match, TT_SINGLE, Q_WORD,
+                ES_QUOTED);
         if (match == NULL)
             goto failure2;
-        subst = expand_single(p->pe_subst, TT_SINGLE, Q_WORD, ES_NONE);
-        if (subst == NULL) {
-            free(match);
+        subst = expand_single_scratch(p->pe_subst, TT_SINGLE, Q_WORD, ES_NONE);
+        if (subst == NULL)
             goto failure2;
-        }
         subst_each(values, match, subst, p->pe_type);
-        free(match);
-        free(subst);
         break;
     }
 
@@ -905,25 +1136,18 @@ subst:
 
     struct expand_four_T e;
 
-    pl_initwith(&e.valuelist, values, plcount(values));
-    pl_initwithmax(&e.cclist, e.valuelist.length);
+    pl_initwith(&e.words, values, plcount(values));
 
-    /* create `e.cclist' contents */
+    /* convert the values into expansion words */
     charcategory_T cc = CC_SOFT_EXPANSION | (indq * CC_QUOTED);
-    for (size_t i = 0; i < e.valuelist.length; i++) {
-        xwcsbuf_T sbuf;
-        wb_initwith(&sbuf, e.valuelist.contents[i]);
-        size_t n = sbuf.length;
-        xstrbuf_T ccbuf;
-        sb_initwithmax(&ccbuf, n + 1);
-        sb_ccat_repeat(&ccbuf, cc, n);
-        if (indq && e.valuelist.length > 1) {
+    for (size_t i = 0; i < e.words.length; i++) {
+        ccbuf_T buf;
+        cb_initwithwcs(&buf, e.words.contents[i], cc);
+        if (indq && e.words.length > 1) {
             // keep the field from empty field removal by adding a dummy quote
-            wb_wccat(&sbuf, L'"');
-            sb_ccat(&ccbuf, cc | CC_QUOTATION);
+            cb_ccat(&buf, L'"', cc | CC_QUOTATION);
         }
-        e.valuelist.contents[i] = wb_towcs(&sbuf);
-        pl_add(&e.cclist, sb_tostr(&ccbuf));
+        e.words.contents[i] = cb_toword(&buf);
     }
 
     return e;
@@ -931,7 +1155,7 @@ subst:
 failure2:
     plfree(values, free);
 failure1:
-    e.valuelist.contents = e.cclist.contents = NULL;
+    e.words.contents = NULL;
     return e;
 }
 
@@ -1155,76 +1379,53 @@ void subst_length_each(void **slist)
 }
 
 /* Merge a result of `expand_param' into another expand_four_T value.
- * All the values in `from->valuelist' and `from->cclist' except the last one
- * are moved into `to->valuelist' and `to->cclist', respectively, and the last
- * one is left in `valuebuf' and `ccbuf'.
- * `from->valuelist' and `from->cclist' are destroyed in this function. */
+ * All the words in `from->words' except the last one are moved into
+ * `to->words', and the last one is left in `buf'.
+ * `from->words' is destroyed in this function. */
 void merge_expand_four(
         struct expand_four_T *restrict from,
         struct expand_four_T *restrict to,
-        xwcsbuf_T *restrict valuebuf, xstrbuf_T *restrict ccbuf)
+        ccbuf_T *restrict buf)
 {
-    assert(from->valuelist.length == from->cclist.length);
-    assert(to->valuelist.length == to->cclist.length);
-    assert(valuebuf->length == ccbuf->length);
-
-    if (from->valuelist.length > 0) {
+    if (from->words.length > 0) {
         /* add the first element */
-        wb_catfree(valuebuf, from->valuelist.contents[0]);
-        sb_ncat_force(ccbuf, from->cclist.contents[0],
-                valuebuf->length - ccbuf->length);
-        free(from->cclist.contents[0]);
+        cb_catword(buf, from->words.contents[0]);
 
-        if (from->valuelist.length > 1) {
-            pl_add(&to->valuelist, wb_towcs(valuebuf));
-            pl_add(&to->cclist, sb_tostr(ccbuf));
+        if (from->words.length > 1) {
+            pl_add(&to->words, cb_toword(buf));
 
             /* add the other elements but last */
-            pl_ncat(&to->valuelist,
-                    &from->valuelist.contents[1], from->valuelist.length - 2);
-            pl_ncat(&to->cclist,
-                    &from->cclist.contents[1], from->cclist.length - 2);
+            pl_ncat(&to->words,
+                    &from->words.contents[1], from->words.length - 2);
 
             /* add the last element */
-            size_t i = from->valuelist.length - 1;
-            wb_initwith(valuebuf, from->valuelist.contents[i]);
-            sb_initwithmax(ccbuf, valuebuf->length);
-            sb_ncat_force(ccbuf, from->cclist.contents[i], valuebuf->length);
-            free(from->cclist.contents[i]);
+            cb_initwithword(buf, from->words.contents[from->words.length - 1]);
         }
     }
 
-    pl_destroy(&from->valuelist);
-    pl_destroy(&from->cclist);
+    pl_destroy(&from->words);
 }
 
 
 /********** Brace Expansions **********/
 
 /* Performs brace expansion in each element of the specified array.
- * `values' is an array of pointers to `free'able wide strings to be expanded.
- * `ccs' is an array of pointers to `free'able charcategory_T strings.
- * `values' and `ccs' must contain the same number of elements and be NULL-
- * terminated. Their elements are freed in this function. The arrays themselves
- * are not freed.
- * Newly malloced results are added to `valuelist' and `cclist'. */
-void expand_brace_each(
-        void *const *restrict values, void *const *restrict ccs,
-        plist_T *restrict valuelist, plist_T *restrict cclist)
-{
-    while (*values != NULL) {
-        expand_brace(*values, *ccs, valuelist, cclist);
-        values++, ccs++;
+ * `words' is a NULL-terminated array of pointers to expansion words to be
+ * expanded. The elements are freed in this function. The array itself is not
+ * freed.
+ * Newly malloced results are added to `results'. */
+void expand_brace_each(void *const *restrict words, plist_T *restrict results)
+{
+    while (*words != NULL) {
+        expand_brace(*words, results);
+        words++;
     }
 }
 
-/* Performs brace expansion in the specified single word.
- * `cc' is the charcategory_T string corresponding to `word'.
- * `word' and `cc' are freed in this function.
- * `Free'able results are added to `valuelist' and `cclist'. */
-void expand_brace(
-        wchar_t *restrict const word, char *restrict const cc,
-        plist_T *restrict valuelist, plist_T *restrict cclist)
+/* Performs brace expansion in the specified single expansion word.
+ * `word' is freed in this function.
+ * `Free'able results are added to `results'. */
+void expand_brace(wchar_t *restrict const word, plist_T *restrict results)
 {
 #define idx(p) ((size_t) ((wchar_t *) (p) - word))
 
@@ -1232,11 +1433,12 @@ void expand_brace(
     const wchar_t *c;
     if ((c = wcschr(word, L'{')) == NULL || (c = wcschr(c + 1, L'}')) == NULL) {
 no_expansion:
-        pl_add(valuelist, word);
-        pl_add(cclist, cc);
+        pl_add(results, word);
         return;
     }
 
+    const char *const cc = word_cc(word);
+
     /* First, we create a `graph' by scanning all the characters in the `word'.
      * The graph is a list of pointers that has the same length as the word,
      * which means each element in the graph corresponds to the character at the
@@ -1252,48 +1454,49 @@ no_expansion:
      * during the scan. The two pointers are popped out of the stack when a
      * matching L'}' is found. */
     bool pairfound = false;
-    plist_T graph;
+    size_t n = 0;  /* number of graph elements filled so far */
+    void **graph = scratch_allocn(
+            idx(c) + wcslen(c) /* = wcslen(word) */, sizeof *graph);
     plist_T stack;
-    pl_initwithmax(&graph, idx(c) + wcslen(c) /* = wcslen(word) */);
     pl_init(&stack);
-    while (word[graph.length] != L'\0') {
-        if (cc[graph.length] == CC_LITERAL) {
-            switch (word[graph.length]) {
+    while (word[n] != L'\0') {
+        if (cc[n] == CC_LITERAL) {
+            switch (word[n]) {
                 case L'{':
-                    pl_add(&stack, &word[graph.length]);
-                    pl_add(&stack, &word[graph.length]);
+                    pl_add(&stack, &word[n]);
+                    pl_add(&stack, &word[n]);
                     break;
                 case L',':
                     if (stack.length > 0) {
                         size_t ci = idx(stack.contents[stack.length - 1]);
-                        assert(ci < graph.length);
-                        graph.contents[ci] = &word[graph.length];
-                        stack.contents[stack.length - 1] = &word[graph.length];
+                        assert(ci < n);
+                        graph[ci] = &word[n];
+                        stack.contents[stack.length - 1] = &word[n];
                     }
                     break;
                 case L'}':
                     if (stack.length > 0) {
                         size_t ci = idx(stack.contents[stack.length - 1]);
-                        assert(ci < graph.length);
-                        graph.contents[ci] = &word[graph.length];
+                        assert(ci < n);
+                        graph[ci] = &word[n];
                         assert(stack.length % 2 == 0);
                         pl_truncate(&stack, stack.length - 2);
                         pairfound = true;
                         if (word[ci] == L',') {
-                            pl_add(&graph, &word[graph.length]);
+                            graph[n] = &word[n];
+                            n++;
                             continue;
                         }
                     }
                     break;
             }
         }
-        pl_add(&graph, NULL);
+        graph[n++] = NULL;
     }
 
     /* If no pairs of braces were found, we don't need to expand anything. */
     if (!pairfound) {
         pl_destroy(&stack);
-        pl_destroy(&graph);
         goto no_expansion;
     }
 
@@ -1304,8 +1507,8 @@ no_expansion:
         assert(stack.length % 2 == 0);
         size_t ci = idx(stack.contents[stack.length - 2]);
         const wchar_t *cnext;
-        while ((cnext = graph.contents[ci]) != NULL) {
-            graph.contents[ci] = NULL;
+        while ((cnext = graph[ci]) != NULL) {
+            graph[ci] = NULL;
             ci = idx(cnext);
         }
         pl_truncate(&stack, stack.length - 2);
@@ -1316,45 +1519,38 @@ no_expansion:
     struct brace_expand_T e = {
         .word = word,
         .cc = cc,
-        .graph = graph.contents,
-        .valuelist = valuelist,
-        .cclist = cclist,
+        .graph = graph,
+        .words = results,
     };
-    xwcsbuf_T valuebuf;
-    xstrbuf_T ccbuf;
-    wb_init(&valuebuf);
-    sb_init(&ccbuf);
-    generate_brace_expand_results(&e, 0, &valuebuf, &ccbuf);
-    pl_destroy(&graph);
+    ccbuf_T buf;
+    cb_init(&buf);
+    generate_brace_expand_results(&e, 0, &buf);
     free(word);
-    free(cc);
 #undef idx
 }
 
 /* Generates results of brace expansion.
  * Part of `e->word' that has been processed before calling this function
- * may have been added to `valuebuf' and `ccbuf'.
- * This function modifies `valuebuf' and `ccbuf' in place to construct the
- * results, and finally destroys them.
- * The results are added to `e->valuelist' and `e->cclist'. */
+ * may have been added to `buf'.
+ * This function modifies `buf' in place to construct the results, and finally
+ * destroys it.
+ * The results are added to `e->words'. */
 void generate_brace_expand_results(
         const struct brace_expand_T *restrict e, size_t ci,
-        xwcsbuf_T *restrict valuebuf, xstrbuf_T *restrict ccbuf)
+        ccbuf_T *restrict buf)
 {
 start:
     /* add normal characters up to the next delimiter */
     while (e->word[ci] != L'\0' && e->graph[ci] == NULL) {
 normal:
-        wb_wccat(valuebuf, e->word[ci]);
-        sb_ccat(ccbuf, e->cc[ci]);
+        cb_ccat(buf, e->word[ci], e->cc[ci]);
         ci++;
     }
 
     switch (e->word[ci]) {
         case L'\0':
             /* No more characters: we're done! */
-            pl_add(e->valuelist, wb_towcs(valuebuf));
-            pl_add(e->cclist, sb_tostr(ccbuf));
+            pl_add(e->words, cb_toword(buf));
             return;
         case L',':
             /* skip up to next L'}' and go on */
@@ -1374,7 +1570,7 @@ normal:
     const wchar_t *nextdelimiter = e->graph[ci];
     if (*nextdelimiter == L'}') {
         /* No commas between the braces: try numeric brace expansion */
-        if (try_expand_brace_sequence(e, ci, valuebuf, ccbuf))
+        if (try_expand_brace_sequence(e, ci, buf))
             return;
 
         /* No numeric brace expansion happened.
@@ -1385,14 +1581,11 @@ normal:
 
     /* Now generate the results (except the last one) */
     while (*nextdelimiter == L',') {
-        xwcsbuf_T valuebuf2;
-        xstrbuf_T ccbuf2;
-        wb_initwithmax(&valuebuf2, valuebuf->maxlength);
-        wb_ncat_force(&valuebuf2, valuebuf->contents, valuebuf->length);
-        sb_initwithmax(&ccbuf2, ccbuf->maxlength);
-        sb_ncat_force(&ccbuf2, ccbuf->contents, ccbuf->length);
+        ccbuf_T buf2;
+        cb_initwithmax(&buf2, buf->maxlength);
+        cb_ncat(&buf2, buf->contents, cb_cc(buf), buf->length);
         ci++;
-        generate_brace_expand_results(e, ci, &valuebuf2, &ccbuf2);
+        generate_brace_expand_results(e, ci, &buf2);
         ci = nextdelimiter - e->word;
         nextdelimiter = e->graph[ci];
     }
@@ -1400,31 +1593,75 @@ normal:
 
     /* Generate the last one */
     ci++;
-    goto start; // generate_brace_expand_results(e, ci, valuebuf, ccbuf);
+    goto start; // generate_brace_expand_results(e, ci, buf);
 }
 
 /* Tries numeric brace expansion like "{01..05}".
  * `ci' must be the index of the L'{' character in `e->word'.
  * If unsuccessful, this function returns false without any side effects.
- * If successful, the results are added to `e->valuelist' and `e->cclist'.
- * In that case, this function modifies `valuebuf' and `ccbuf' in place to
- * construct the results, and finally destroys them. */
+ * If successful, the results are added to `e->words'.
+ * In that case, this function modifies `buf' in place to construct the
+ * results, and finally destroys it. */
 bool try_expand_brace_sequence(
         const struct brace_expand_T *restrict e, size_t ci,
-        xwcsbuf_T *restrict valuebuf, xstrbuf_T *restrict ccbuf)
+        ccbuf_T *restrict buf)
 {
     assert(e->word[ci] == L'{');
     ci++;
 
     size_t starti = ci;
 
+    braceseq_T seq;
+    const wchar_t *cp = parse_brace_sequence(&e->word[ci], &seq);
+    if (cp == NULL)
+        return false;
+
+    /* validate charcategory_T */
+    size_t bracei = cp - e->word;
+    if (e->cc[bracei] != CC_LITERAL)
+        return false;
+    for (ci = starti; ci < bracei; ci++)
+        if (e->cc[ci] & CC_QUOTED)
+            return false;
+
+    /* expand the sequence */
+    ci = bracei + 1;
+    xwcsbuf_T numbuf;
+    wb_init(&numbuf);
+    do {
+        ccbuf_T buf2;
+        cb_initwithmax(&buf2, buf->maxlength);
+        cb_ncat(&buf2, buf->contents, cb_cc(buf), buf->length);
+
+        /* format the number */
+        wb_clear(&numbuf);
+        if (wb_brace_sequence_value(&numbuf, &seq) >= 0)
+            cb_ncat_uniform(&buf2, numbuf.contents, numbuf.length,
+                    CC_HARD_EXPANSION);
+
+        /* expand the remaining portion recursively */
+        generate_brace_expand_results(e, ci, &buf2);
+    } while (!seq.done);
+
+    wb_destroy(&numbuf);
+    cb_destroy(buf);
+    return true;
+}
+
+/* Parses a numeric brace sequence.
+ * `s' must point to the character right after the L'{'.
+ * If successful, `*seq' is initialized to generate the sequence and the return
+ * value is a pointer to the closing L'}'. Otherwise, NULL is returned. */
+const wchar_t *parse_brace_sequence(
+        const wchar_t *restrict s, braceseq_T *restrict seq)
+{
     /* parse the starting point */
-    const wchar_t *c = &e->word[ci];
+    const wchar_t *c = s;
     wchar_t *cp;
     errno = 0;
     long start = wcstol(c, &cp, 10);
     if (c == cp || errno != 0 || cp[0] != L'.' || cp[1] != L'.')
-        return false;
+        return NULL;
 
     bool sign = false;
     int startlen = has_leading_zero(c, &sign) ? (cp - c) : 0;
@@ -1434,71 +1671,104 @@ bool try_expand_brace_sequence(
     errno = 0;
     long end = wcstol(c, &cp, 10);
     if (c == cp || errno != 0)
-        return false;
+        return NULL;
     int endlen = has_leading_zero(c, &sign) ? (cp - c) : 0;
 
     /* parse the delta */
     long delta;
     if (cp[0] == L'.') {
         if (cp[1] != L'.')
-            return false;
+            return NULL;
 
         c = cp + 2;
         errno = 0;
         delta = wcstol(c, &cp, 10);
         if (delta == 0 || c == cp || errno != 0 || cp[0] != L'}')
-            return false;
+            return NULL;
     } else if (cp[0] == L'}') {
         if (start <= end)
             delta = 1;
         else
             delta = -1;
     } else {
-        return false;
+        return NULL;
     }
 
-    /* validate charcategory_T */
-    size_t bracei = cp - e->word;
-    if (e->cc[bracei] != CC_LITERAL)
-        return false;
-    for (ci = starti; ci < bracei; ci++)
-        if (e->cc[ci] & CC_QUOTED)
-            return false;
+    seq->value = start;
+    seq->end = end;
+    seq->delta = delta;
+    seq->width = (startlen > endlen) ? startlen : endlen;
+    seq->sign = sign;
+    seq->done = false;
+    return cp;
+}
 
-    /* expand the sequence */
-    long value = start;
-    int len = (startlen > endlen) ? startlen : endlen;
-    ci = cp - e->word + 1;
-    do {
-        xwcsbuf_T valuebuf2;
-        xstrbuf_T ccbuf2;
-        wb_initwithmax(&valuebuf2, valuebuf->maxlength);
-        wb_ncat_force(&valuebuf2, valuebuf->contents, valuebuf->length);
-        sb_initwithmax(&ccbuf2, ccbuf->maxlength);
-        sb_ncat_force(&ccbuf2, ccbuf->contents, ccbuf->length);
+/* Appends the current value of the brace sequence to `buf' and advances the
+ * sequence to the next value. If the appended value is the last one,
+ * `seq->done' is set to true.
+ * Returns the number of characters appended or a negative value on error. */
+int wb_brace_sequence_value(
+        xwcsbuf_T *restrict buf, braceseq_T *restrict seq)
+{
+    assert(!seq->done);
 
-        /* format the number */
-        int plen =
-            wb_wprintf(&valuebuf2, sign ? L"%0+*ld" : L"%0*ld", len, value);
-        if (plen >= 0)
-            sb_ccat_repeat(&ccbuf2, CC_HARD_EXPANSION, plen);
+    int result = wb_wprintf(buf, seq->sign ? L"%0+*ld" : L"%0*ld",
+            seq->width, seq->value);
 
-        /* expand the remaining portion recursively */
-        generate_brace_expand_results(e, ci, &valuebuf2, &ccbuf2);
+    long delta = seq->delta;
+    if (delta >= 0 ? LONG_MAX - delta < seq->value
+                   : LONG_MIN - delta > seq->value) {
+        seq->done = true;
+    } else {
+        seq->value += delta;
+        seq->done = delta >= 0 ? seq->value > seq->end : seq->value < seq->end;
+    }
+    return result;
+}
 
-        if (delta >= 0) {
-            if (LONG_MAX - delta < value)
-                break;
-        } else {
-            if (LONG_MIN - delta > value)
-                break;
-        }
-        value += delta;
-    } while (delta >= 0 ? value <= end : value >= end);
+/* Checks if each of the specified words consists of a single numeric brace
+ * expansion like "{1..100}" and nothing else. If so, returns a newly malloced
+ * array of generators that yield the results of expansion of the words, and
+ * assigns the number of the words to `*countp'. Otherwise, returns NULL.
+ * `words' is a NULL-terminated array of pointers to `const wordunit_T'.
+ * Such words contain no parameter expansion, command substitution, etc., so
+ * their values can be generated lazily without changing the semantics. */
+braceseq_T *get_brace_sequences(
+        void *const *restrict words, size_t *restrict countp)
+{
+    if (!shopt_braceexpand || words[0] == NULL)
+        return NULL;
 
-    wb_destroy(valuebuf);
-    sb_destroy(ccbuf);
-    return true;
+    size_t count = plcount(words);
+    braceseq_T *seqs = xmallocn(count, sizeof *seqs);
+    for (size_t i = 0; i < count; i++) {
+        const wordunit_T *w = words[i];
+        if (w->next != NULL || w->wu_type != WT_STRING ||
+                w->wu_string[0] != L'{')
+            goto fail;
+
+        const wchar_t *cp = parse_brace_sequence(&w->wu_string[1], &seqs[i]);
+        if (cp == NULL || cp[1] != L'\0')
+            goto fail;
+    }
+    *countp = count;
+    return seqs;
+
+fail:
+    free(seqs);
+    return NULL;
+}
+
+/* Returns the current value of the brace sequence as a newly malloced string
+ * and advances the sequence to the next value.
+ * `seq->done' must be false when this function is called. It becomes true when
+ * the last value has been returned. */
+wchar_t *next_brace_sequence_value(braceseq_T *seq)
+{
+    xwcsbuf_T buf;
+    wb_init(&buf);
+    wb_brace_sequence_value(&buf, seq);
+    return wb_towcs(&buf);
 }
 
 /* Checks if the specified numeral starts with a L'0'.
@@ -1522,49 +1792,49 @@ bool has_leading_zero(const wchar_t *restrict s, bool *restrict sign)
 /********** Field Splitting **********/
 
 /* Performs field splitting.
- * `valuelist' is a NULL-terminated array of pointers to wide strings to split.
- * `cclist' is an array of pointers to corresponding charcategory_T strings.
- * `valuelist' and `cclist' are `plfree'ed in this function.
- * The results are added to `outvaluelist' and `outcclist'. */
-void fieldsplit(void **restrict const valuelist, void **restrict const cclist,
-        plist_T *restrict outvaluelist, plist_T *restrict outcclist)
+ * `words' is a NULL-terminated array of pointers to expansion words to split.
+ * `words' is `plfree'ed in this function.
+ * The results are added to `outwords'. */
+void fieldsplit(void **restrict const words, plist_T *restrict outwords)
 {
     const wchar_t *ifs = getvar(L VAR_IFS);
     if (ifs == NULL)
         ifs = DEFAULT_IFS;
 
+    struct ifsset_T set;
+    init_ifsset(&set, ifs);
+
     plist_T fields;
     pl_init(&fields);
 
-    for (size_t i = 0; valuelist[i] != NULL; i++) {
-        wchar_t *s = valuelist[i];
-        char *cc = cclist[i];
-        extract_fields(s, cc, ifs, &fields);
+    for (size_t i = 0; words[i] != NULL; i++) {
+        wchar_t *s = words[i];
+        const char *cc = word_cc(s);
+        split_fields(s, cc, &set, &fields);
         assert(fields.length % 2 == 0);
 
         if (fields.length == 2 && fields.contents[0] == s &&
                 *(wchar_t *) fields.contents[1] == L'\0') {
             /* The result is the same as the original field. */
-            pl_add(outvaluelist, s);
-            pl_add(outcclist, cc);
+            pl_add(outwords, s);
         } else {
             /* Produce new fields. */
             for (size_t j = 0; j < fields.length; j += 2) {
                 const wchar_t *start = fields.contents[j];
                 const wchar_t *end = fields.contents[j + 1];
                 size_t idx = start - s, len = end - start;
-                pl_add(outvaluelist, xwcsndup(start, len));
-                pl_add(outcclist, memcpy(xmalloc(len), &cc[idx], len));
+                ccbuf_T buf;
+                cb_initwithmax(&buf, len);
+                cb_ncat(&buf, start, &cc[idx], len);
+                pl_add(outwords, cb_toword(&buf));
             }
             free(s);
-            free(cc);
         }
 
         pl_truncate(&fields, 0);
     }
     pl_destroy(&fields);
-    free(valuelist);
-    free(cclist);
+    free(words);
 }
 
 /* Extracts fields from a string.
@@ -1601,6 +1871,30 @@ void fieldsplit(void **restrict const valuelist, void **restrict const cclist,
  */
 wchar_t *extract_fields(const wchar_t *restrict s, const char *restrict cc,
         const wchar_t *restrict ifs, plist_T *restrict dest)
+{
+    struct ifsset_T set;
+    init_ifsset(&set, ifs);
+    return split_fields(s, cc, &set, dest);
+}
+
+/* Initializes `set' for the IFS value `ifs'.
+ * `ifs' must remain valid while `set' is used. */
+void init_ifsset(struct ifsset_T *restrict set, const wchar_t *restrict ifs)
+{
+    set->ifs = ifs;
+    set->nonascii = false;
+    memset(set->ascii, 0, sizeof set->ascii);
+    for (const wchar_t *c = ifs; *c != L'\0'; c++) {
+        if ((unsigned long) *c < sizeof set->ascii)
+            set->ascii[*c] = IFS_CHAR | (iswspace(*c) ? IFS_WHITESPACE : 0);
+        else
+            set->nonascii = true;
+    }
+}
+
+/* Like `extract_fields', but takes a pre-computed IFS set. */
+wchar_t *split_fields(const wchar_t *restrict s, const char *restrict cc,
+        const struct ifsset_T *restrict set, plist_T *restrict dest)
 {
     size_t index = 0;
     size_t ifswhitestartindex;
@@ -1612,12 +1906,13 @@ wchar_t *extract_fields(const wchar_t *restrict s, const char *restrict cc,
 
     for (;;) {
         ifswhitestartindex = index;
-        while (is_ifs_whitespace(s[index], cc[index], ifs))
+        while (ifs_class(s[index], cc[index], set) & IFS_WHITESPACE)
             index++;
 
         /* extract next field, if any */
         size_t fieldstartindex = index;
-        while (is_non_ifs_char(s[index], cc[index], ifs))
+        while (s[index] != L'\0' &&
+                !(ifs_class(s[index], cc[index], set) & IFS_CHAR))
             index++;
         if (index != fieldstartindex) {
             pl_add(pl_add(dest, &s[fieldstartindex]), &s[index]);
@@ -1634,8 +1929,7 @@ wchar_t *extract_fields(const wchar_t *restrict s, const char *restrict cc,
             break;
 
         /* skip (only) one IFS non-whitespace */
-        assert(is_ifs_char(s[index], cc[index], ifs));
-        assert(!is_ifs_whitespace(s[index], cc[index], ifs));
+        assert(ifs_class(s[index], cc[index], set) == IFS_CHAR);
         index++;
         afterfield = false;
     }
@@ -1651,22 +1945,19 @@ wchar_t *extract_fields(const wchar_t *restrict s, const char *restrict cc,
     return (wchar_t *) &s[ifswhitestartindex];
 }
 
-/* Returns true if `c' is a non-null, IFS character. */
-bool is_ifs_char(wchar_t c, charcategory_T cc, const wchar_t *ifs)
-{
-    return cc == CC_SOFT_EXPANSION && c != L'\0' && wcschr(ifs, c) != NULL;
-}
-
-/* Returns true if `c' is a non-null, IFS-whitespace character. */
-bool is_ifs_whitespace(wchar_t c, charcategory_T cc, const wchar_t *ifs)
+/* Returns the IFS_* flags for character `c' of category `cc'.
+ * Only CC_SOFT_EXPANSION characters are subject to field splitting.
+ * The null character is never an IFS character. ASCII characters are looked up
+ * in the table; others are searched for in the IFS string. */
+int ifs_class(wchar_t c, charcategory_T cc, const struct ifsset_T *set)
 {
-    return is_ifs_char(c, cc, ifs) && iswspace(c);
-}
-
-/* Returns true if `c' is a non-null, non-IFS character. */
-bool is_non_ifs_char(wchar_t c, charcategory_T cc, const wchar_t *ifs)
-{
-    return c != L'\0' && !is_ifs_char(c, cc, ifs);
+    if (cc != CC_SOFT_EXPANSION)
+        return 0;
+    if ((unsigned long) c < sizeof set->ascii)
+        return set->ascii[c];
+    if (set->nonascii && wcschr(set->ifs, c) != NULL)
+        return IFS_CHAR | (iswspace(c) ? IFS_WHITESPACE : 0);
+    return 0;
 }
 
 void add_empty_field(plist_T *dest, const wchar_t *p)
@@ -1880,25 +2171,42 @@ bool should_escape(charcategory_T cc, escaping_T escaping)
 wchar_t *quote_removal(
         const wchar_t *restrict s, const char *restrict cc, escaping_T escaping)
 {
-    xwcsbuf_T result;
-    wb_initwithmax(&result, mul(wcslen(s), 2));
+    wchar_t *result = xmalloce(mul(wcslen(s), 2), 1, sizeof *result);
+    return remove_quotes(result, s, cc, escaping);
+}
+
+/* Like `quote_removal', but takes an expansion word and frees it. */
+wchar_t *quote_removal_free(wchar_t *word, escaping_T escaping)
+{
+    wchar_t *result = quote_removal(word, word_cc(word), escaping);
+    free(word);
+    return result;
+}
+
+/* Like `quote_removal', but the result is allocated in the scratch arena. */
+wchar_t *quote_removal_scratch(
+        const wchar_t *restrict s, const char *restrict cc, escaping_T escaping)
+{
+    wchar_t *result =
+        scratch_allocn(add(mul(wcslen(s), 2), 1), sizeof *result);
+    return remove_quotes(result, s, cc, escaping);
+}
+
+/* Copies `s' into `result' performing quote removal as `quote_removal' does.
+ * `result' must be large enough to hold `2 * wcslen(s) + 1' characters.
+ * Returns `result'. */
+wchar_t *remove_quotes(wchar_t *restrict result,
+        const wchar_t *restrict s, const char *restrict cc, escaping_T escaping)
+{
+    wchar_t *r = result;
     for (size_t i = 0; s[i] != L'\0'; i++) {
         if (cc[i] & CC_QUOTATION)
             continue;
         if (should_escape(cc[i], escaping))
-            wb_wccat(&result, L'\\');
-        wb_wccat(&result, s[i]);
+            *r++ = L'\\';
+        *r++ = s[i];
     }
-    return wb_towcs(&result);
-}
-
-/* Like `quote_removal', but frees the arguments. */
-wchar_t *quote_removal_free(
-        wchar_t *restrict s, char *restrict cc, escaping_T escaping)
-{
-    wchar_t *result = quote_removal(s, cc, escaping);
-    free(s);
-    free(cc);
+    *r = L'\0';
     return result;
 }
 
@@ -1919,17 +2227,18 @@ enum wglobflags_T get_wglobflags(void)
 /* Performs pathname expansion.
  * If `shopt_glob' is off or a field is not a pattern, quote removal is
  * performed instead.
- * The input lists and their contents in `e' are freed in this function.
+ * The input list and its contents in `e' are freed in this function.
  * The results are added to `results' as newly-malloced wide strings. */
 void glob_all(struct expand_four_T *restrict e, plist_T *restrict results)
 {
     enum wglobflags_T flags = get_wglobflags();
     bool unblock = false;
 
-    for (size_t i = 0; i < e->valuelist.length; i++) {
-        wchar_t *field = e->valuelist.contents[i];
-        char *cc = e->cclist.contents[i];
-        wchar_t *pattern = quote_removal(field, cc, ES_QUOTED_HARD);
+    for (size_t i = 0; i < e->words.length; i++) {
+        wchar_t *field = e->words.contents[i];
+        const char *cc = word_cc(field);
+        scratchmark_T mark = scratch_mark();
+        wchar_t *pattern = quote_removal_scratch(field, cc, ES_QUOTED_HARD);
         if (shopt_glob && is_pathname_matching_pattern(pattern)) {
             if (!unblock) {
                 set_interruptible_by_sigint(true);
@@ -1947,13 +2256,11 @@ quote_removal:
             pl_add(results, quote_removal(field, cc, ES_NONE));
         }
         free(field);
-        free(cc);
-        free(pattern);
+        scratch_release(mark);
     }
     if (unblock)
         set_interruptible_by_sigint(false);
-    pl_destroy(&e->valuelist);
-    pl_destroy(&e->cclist);
+    pl_destroy(&e->words);
 }
 
 
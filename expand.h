@@ -81,6 +81,18 @@ typedef struct cc_word_T {
     wchar_t *value;  /* word value */
     char *cc;        /* corresponding charcategory_T string */
 } cc_word_T;
+/* `cc' points into the same memory block as `value', so only `value' is to be
+ * freed. */
+
+/* generator of the results of numeric brace expansion like "{1..9}" */
+typedef struct braceseq_T {
+    long value;   /* the next value */
+    long end;     /* the last value (may not be generated) */
+    long delta;   /* the increment */
+    int width;    /* the minimum number of digits */
+    _Bool sign;   /* whether positive values are prefixed with a plus sign */
+    _Bool done;   /* whether all the values have been generated */
+} braceseq_T;
 
 struct wordunit_T;
 struct plist_T;
@@ -102,6 +114,12 @@ extern wchar_t *expand_single(
 extern char *expand_single_with_glob(const struct wordunit_T *arg)
     __attribute__((malloc,warn_unused_result));
 
+extern braceseq_T *get_brace_sequences(
+        void *const *restrict words, size_t *restrict countp)
+    __attribute__((nonnull,malloc,warn_unused_result));
+extern wchar_t *next_brace_sequence_value(braceseq_T *seq)
+    __attribute__((nonnull,malloc,warn_unused_result));
+
 extern wchar_t *extract_fields(
         const wchar_t *restrict s, const char *restrict cc,
         const wchar_t *restrict ifs, struct plist_T *restrict dest)
@@ -28,25 +28,33 @@
 #include <limits.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 #include <wchar.h>
 #include <wctype.h>
 #include "builtin.h"
 #include "exec.h"
+#include "hashtable.h"
 #include "job.h"
 #include "option.h"
 #include "path.h"
+#include "plist.h"
 #include "redir.h"
 #include "sig.h"
 #include "strbuf.h"
 #include "util.h"
 #include "variable.h"
 #include "yash.h"
+#if YASH_ENABLE_LINEEDIT
+# include "lineedit/editing.h"
+#endif
 
 
 /* The maximum size of history list (<= INT_MAX / 10) */
@@ -81,6 +89,12 @@
 #define HISTORY_DEFAULT_LINE_LENGTH 127
 #endif
 
+/* When this many lines or more are read from the history file at a time, the
+ * entries are allocated from a slab rather than one by one. */
+#ifndef HISTSLAB_MIN_ENTRIES
+#define HISTSLAB_MIN_ENTRIES 256
+#endif
+
 
 /* The main history list. */
 histlist_T histlist = {
@@ -112,6 +126,23 @@ static long histfilerev = -1;
 static size_t histfilelines = 0;
 /* Indicates if the history file should be flushed before it is unlocked. */
 static bool histneedflush = false;
+/* The type of the lock currently held for the history file. */
+static short histlocktype = F_UNLCK;
+
+/* If true, the history file is shared as an append-only log (the "histlog"
+ * option). Each line is appended to the file by a single `write' so that the
+ * file can be read without locking it. The file is never truncated; instead it
+ * is replaced with a new file when refreshed. */
+static bool histlog = false;
+/* The pathname of the history file. Used in the log mode to make a new file
+ * and to detect that the file has been replaced by another shell. */
+static char *histfilepath = NULL;
+/* In the log mode, the offset of the history file up to which the file has been
+ * read. */
+static off_t histlogpos = 0;
+/* The revision of the history file for which a background compaction has been
+ * started, or -1. */
+static long histcompactrev = -1;
 
 /* The current time returned by `time' */
 static time_t now = (time_t) -1;
@@ -119,15 +150,119 @@ static time_t now = (time_t) -1;
 /* If true, the history is locked, that is, readonly. */
 static bool hist_lock = false;
 
+/* A slab is a single memory block that contains many history entries.
+ * Entries read from the history file in bulk are allocated from a slab so that
+ * loading a large file does not call `malloc' for every entry. The slab is
+ * freed when all the entries in it have been removed. */
+struct histslab_T {
+    size_t live;  /* the number of entries in the slab that are not removed */
+    size_t size;  /* the size of `data' */
+    size_t used;  /* the number of bytes in `data' allocated to entries */
+    char *data;
+};
+/* Every entry in a slab starts at a multiple of the size of this union. */
+union histslabalign_T {
+    histlink_T link;
+    unsigned number;
+    time_t time;
+};
+/* The list of all existing slabs (`struct histslab_T *'). */
+static plist_T histslabs;
+/* The slab from which `new_entry' allocates entries. Non-NULL only while the
+ * history file is being read. */
+static struct histslab_T *loadslab = NULL;
+
+/* In addition to the linked list, history entries are indexed by an array used
+ * as a ring buffer so that an entry can be found by its number or position
+ * without walking through `histlist'. The slots from the `head'th to the
+ * (`head' + `used' - 1)th (modulo `capacity') are in use and correspond to the
+ * entries from the oldest to the newest. When an entry other than the oldest or
+ * newest is removed, its slot is left with a null `entry' pointer, which we
+ * call a hole, until the array is compacted. A hole keeps the number of the
+ * removed entry so that the numbers in the used slots are always in ascending
+ * order (counting from the oldest entry's number and wrapping around at
+ * `max_number'). The first and last used slots are never holes.
+ * The `seq' member is the serial number used in the substring search index
+ * (see below), which increases from the oldest to the newest. */
+struct histslot_T {
+    histentry_T *entry;
+    unsigned number;
+    unsigned seq;
+};
+static struct {
+    struct histslot_T *slots;
+    size_t capacity, head, used;
+} histring = { NULL, 0, 0, 0, };
+
+/* The minimum capacity of `histring'. */
+#define HISTRING_MIN_CAPACITY 16
+
+/* The substring search index maps each trigram (sequence of three bytes) to the
+ * list of the serial numbers (`seq') of the entries whose values contain it.
+ * Since serial numbers are given in ascending order, each list is sorted.
+ * Building the index costs about as much as a few linear scans of the whole
+ * history, so the index is not built until history search has examined as many
+ * entries as there are in the history without it. Once built, the index is
+ * updated as entries are added. Removed entries are left in the lists until the
+ * index is rebuilt. */
+struct histpostings_T {
+    uint_least32_t trigram;  /* the key in `histindex.lists' */
+    size_t count, capacity;
+    unsigned *seqs;
+};
+static struct {
+    bool built;
+    hashtable_T lists;  /* trigrams to `struct histpostings_T *' */
+    size_t removed;     /* the number of removed entries left in the lists */
+    size_t scanned;     /* the number of entries examined without the index */
+} histindex = { .built = false, };
+/* The serial number of the next new entry. */
+static unsigned nextseq = 0;
+/* The maximum number of posting lists intersected in one index search. Only
+ * the shortest list is picked from the trigrams beyond this many. */
+#define HISTINDEX_MAX_LISTS 32
+
+/* The duplicate index maps each entry value to the list of the entries having
+ * the value, which is used to remove duplicates (see `remove_duplicates').
+ * Each list is sorted from oldest to newest. The key of a list is the value of
+ * its oldest entry. The index is built when duplicates are first removed and is
+ * then updated as entries are added and removed. */
+struct histdups_T {
+    size_t count;
+    histentry_T *entries[];
+};
+static struct {
+    bool built;
+    hashtable_T lists;  /* entry values to `struct histdups_T *' */
+    const histentry_T *boundary;
+        /* the oldest of the `histrmdup' newest entries, or NULL if all the
+         * entries are among them */
+} histdups = { .built = false, };
+
 
 struct search_result_T {
     histlink_T *prev, *next;
 };
 
+/* Part of the history file loaded into memory by `load_histfile'. */
+struct histfiledata_T {
+    char *contents;
+    size_t size;
+    void *map;       /* the mapped region, or NULL if not mapped */
+    size_t mapsize;  /* the size of `map' */
+};
+
 static void update_time(void);
 static void set_histsize(unsigned newsize);
-static histentry_T *new_entry(unsigned number, time_t time, const char *line)
+static histentry_T *new_entry(
+        unsigned number, time_t time, const char *line, size_t length)
     __attribute__((nonnull));
+static histentry_T *alloc_entry(size_t length)
+    __attribute__((malloc,warn_unused_result));
+static void free_entry(histentry_T *entry)
+    __attribute__((nonnull));
+static void begin_slab(size_t entrycount, size_t datasize);
+static void end_slab(void);
 static bool need_remove_entry(unsigned number)
     __attribute__((pure));
 static void remove_entry(histentry_T *e)
@@ -136,8 +271,46 @@ static void remove_last_entry(void);
 static void clear_all_entries(void);
 static struct search_result_T search_entry_by_number(unsigned number)
     __attribute__((pure));
-static histlink_T *get_nth_newest_entry(unsigned n)
+static histlink_T *get_nth_newest_entry(unsigned n);
+static struct histslot_T *ring_slot(size_t index)
+    __attribute__((pure));
+static void ring_append(histentry_T *entry)
+    __attribute__((nonnull));
+static void ring_remove(const histentry_T *entry)
+    __attribute__((nonnull));
+static void ring_rebuild(size_t capacity);
+static void ring_compact(void);
+static unsigned ring_key(unsigned number)
+    __attribute__((pure));
+static size_t ring_find(unsigned key)
     __attribute__((pure));
+static const histentry_T *ring_find_seq(unsigned seq)
+    __attribute__((pure));
+static void build_index(void);
+static void drop_index(void);
+static void free_postings(kvpair_T kv);
+static void index_entry(unsigned seq, const char *value)
+    __attribute__((nonnull));
+static inline uint_least32_t trigram_at(const char *s)
+    __attribute__((nonnull,pure));
+static hashval_T hashtrigram(const void *key)
+    __attribute__((nonnull,pure));
+static int trigramcmp(const void *key1, const void *key2)
+    __attribute__((nonnull,pure));
+static bool postings_contain(const struct histpostings_T *p, unsigned seq)
+    __attribute__((nonnull,pure));
+static size_t postings_find(const struct histpostings_T *p, unsigned seq)
+    __attribute__((nonnull,pure));
+static bool is_indexable(const char *literal)
+    __attribute__((nonnull));
+static void build_dups_index(void);
+static void drop_dups_index(void);
+static void dups_add_entry(histentry_T *entry)
+    __attribute__((nonnull));
+static void dups_remove_entry(const histentry_T *entry)
+    __attribute__((nonnull));
+static unsigned entry_age(const histentry_T *entry, unsigned newest)
+    __attribute__((nonnull,pure));
 static histlink_T *search_entry_by_prefix(const char *prefix)
     __attribute__((nonnull,pure));
 static bool search_result_is_newer(
@@ -152,33 +325,63 @@ static void clear_histfile_pids(void);
 static void write_histfile_pids(void);
 
 static FILE *open_histfile(void);
+static FILE *open_histfile_at(const char *path)
+    __attribute__((nonnull));
+static bool reopen_histfile(void);
+static bool histfile_replaced(void);
+static void flush_histfile(void);
 static bool lock_histfile(short type);
+static bool lock_file(int fd, short type);
 static bool read_line(FILE *restrict f, xwcsbuf_T *restrict buf)
     __attribute__((nonnull));
 static bool try_read_line(FILE *restrict f, xwcsbuf_T *restrict buf)
     __attribute__((nonnull));
-static long read_signature(void);
+static bool load_histfile(off_t offset, struct histfiledata_T *data)
+    __attribute__((nonnull));
+static void unload_histfile(struct histfiledata_T *data)
+    __attribute__((nonnull));
+static long read_signature(off_t *offsetp)
+    __attribute__((nonnull));
 static void read_history_raw(void);
-static void read_history(void);
-static void parse_history_entry(const wchar_t *line)
+static bool read_history(off_t offset);
+static size_t count_lines(const char *s, const char *end)
+    __attribute__((nonnull,pure));
+static bool is_valid_history_value(const char *s, const char *end)
+    __attribute__((nonnull,pure));
+static void parse_history_entry(const char *line, const char *end)
+    __attribute__((nonnull));
+static void parse_removed_entry(const char *numstr, const char *end)
     __attribute__((nonnull));
-static void parse_removed_entry(const wchar_t *numstr)
+static void parse_process_id(const char *numstr, const char *end)
     __attribute__((nonnull));
-static void parse_process_id(const wchar_t *numstr)
+static bool parse_hex(const char **sp, const char *end,
+        unsigned long long *resultp)
+    __attribute__((nonnull));
+static inline bool is_ascii_space(char c)
+    __attribute__((const));
+static bool read_compaction_marker(off_t offset, long oldrev, off_t oldsize,
+        off_t *endp)
     __attribute__((nonnull));
 static void update_history(bool refresh);
+static bool follow_replaced_histfile(off_t *posp)
+    __attribute__((nonnull));
 static void maybe_refresh_file(void);
+static void start_compaction(void);
 static int wprintf_histfile(const wchar_t *format, ...)
     __attribute__((nonnull));
+static int vwrite_histlog(const wchar_t *format, va_list ap)
+    __attribute__((nonnull));
 static void write_signature(void);
 static void write_history_entry(const histentry_T *entry)
     __attribute__((nonnull));
 static void refresh_file(void);
+static bool replace_histfile(bool compaction);
 
 static void add_history_line(const wchar_t *line, size_t maxlen)
     __attribute__((nonnull));
 static void remove_duplicates(const char *line)
     __attribute__((nonnull));
+static void compact_duplicates(void);
 
 
 /* Updates the value of `now'. */
@@ -205,9 +408,12 @@ void set_histsize(unsigned newsize)
 }
 
 /* Adds a new history entry to the end of `histlist'.
+ * The value of the new entry is the first `length' bytes of `line', which must
+ * not contain null bytes.
  * Some oldest entries may be removed in this function if they conflict with the
  * new one or the list is full. */
-histentry_T *new_entry(unsigned number, time_t time, const char *line)
+histentry_T *new_entry(
+        unsigned number, time_t time, const char *line, size_t length)
 {
     assert(!hist_lock);
     assert(number > 0);
@@ -216,18 +422,24 @@ histentry_T *new_entry(unsigned number, time_t time, const char *line)
     while (need_remove_entry(number))
         remove_entry(ashistentry(histlist.Oldest));
 
-    histentry_T *new = xmallocs(sizeof *new,
-            add(strlen(line), 1), sizeof *new->value);
+    histentry_T *new = alloc_entry(length);
     new->Prev = histlist.Newest;
     new->Next = Histlist;
     histlist.Newest = new->Prev->next = &new->link;
     new->number = number;
     new->time = time;
-    strcpy(new->value, line);
+    memcpy(new->value, line, length);
+    new->value[length] = '\0';
+    ring_append(new);
 
     histlist.count++;
     assert(histlist.count <= histsize);
+    if (histdups.built)
+        dups_add_entry(new);
 
+#if YASH_ENABLE_LINEEDIT
+    le_prediction_add_entry(new);
+#endif
     return new;
 }
 
@@ -251,10 +463,16 @@ void remove_entry(histentry_T *entry)
 {
     assert(!hist_lock);
     assert(&entry->link != Histlist);
+#if YASH_ENABLE_LINEEDIT
+    le_prediction_remove_entry(entry);
+#endif
+    if (histdups.built)
+        dups_remove_entry(entry);
     entry->Prev->next = entry->Next;
     entry->Next->prev = entry->Prev;
     histlist.count--;
-    free(entry);
+    ring_remove(entry);
+    free_entry(entry);
 }
 
 /* Removes the newest entry. */
@@ -271,8 +489,11 @@ void renumber_all_entries(void)
 
     if (histlist.count > 0) {
         unsigned num = 0;
-        for (histlink_T *l = histlist.Oldest; l != Histlist; l = l->next)
-            ashistentry(l)->number = ++num;
+        ring_compact();
+        for (size_t i = 0; i < histring.used; i++) {
+            struct histslot_T *slot = ring_slot(i);
+            slot->entry->number = slot->number = ++num;
+        }
         assert(num == histlist.count);
     }
 }
@@ -285,11 +506,101 @@ void clear_all_entries(void)
     histlink_T *l = histlist.Oldest;
     while (l != Histlist) {
         histlink_T *next = l->next;
-        free(ashistentry(l));
+        free_entry(ashistentry(l));
         l = next;
     }
     histlist.Oldest = histlist.Newest = Histlist;
     histlist.count = 0;
+    histring.head = histring.used = 0;
+    drop_index();
+    drop_dups_index();
+#if YASH_ENABLE_LINEEDIT
+    le_prediction_reset();
+#endif
+}
+
+/* Allocates memory for a history entry whose value is `length' bytes long
+ * (not including the terminating null byte).
+ * The memory is taken from `loadslab' if it has enough room. */
+histentry_T *alloc_entry(size_t length)
+{
+    if (loadslab != NULL) {
+        size_t align = sizeof (union histslabalign_T);
+        size_t size = add(sizeof (histentry_T), add(length, align));
+        size -= size % align;
+        if (loadslab->size - loadslab->used >= size) {
+            char *entry = &loadslab->data[loadslab->used];
+            loadslab->used += size;
+            loadslab->live++;
+            return (histentry_T *) entry;
+        }
+    }
+    return xmallocs(sizeof (histentry_T), add(length, 1), sizeof (char));
+}
+
+/* Frees the memory for the specified entry, which must have been allocated by
+ * `alloc_entry'. */
+void free_entry(histentry_T *entry)
+{
+    const char *p = (const char *) entry;
+
+    for (size_t i = histslabs.length; i-- > 0; ) {
+        struct histslab_T *slab = histslabs.contents[i];
+        if (slab->data <= p && p < slab->data + slab->size) {
+            assert(slab->live > 0);
+            if (--slab->live == 0 && slab != loadslab) {
+                free(slab->data);
+                free(slab);
+                pl_remove(&histslabs, i, 1);
+            }
+            return;
+        }
+    }
+    free(entry);
+}
+
+/* Creates a new slab and makes it `loadslab' if `entrycount' is large enough.
+ * The slab is made large enough to hold `entrycount' entries whose values are
+ * `datasize' bytes in total. */
+void begin_slab(size_t entrycount, size_t datasize)
+{
+    assert(loadslab == NULL);
+    if (entrycount < HISTSLAB_MIN_ENTRIES)
+        return;
+
+    size_t size = add(datasize, mul(entrycount,
+                sizeof (histentry_T) + sizeof (union histslabalign_T)));
+    struct histslab_T *slab = xmalloc(sizeof *slab);
+    slab->live = 0;
+    slab->size = size;
+    slab->used = 0;
+    slab->data = xmalloc(size);
+
+    if (histslabs.contents == NULL)
+        pl_init(&histslabs);
+    pl_add(&histslabs, slab);
+    loadslab = slab;
+}
+
+/* Stops allocating entries from `loadslab'.
+ * If no entries remain in the slab, it is freed. */
+void end_slab(void)
+{
+    struct histslab_T *slab = loadslab;
+    if (slab == NULL)
+        return;
+    loadslab = NULL;
+
+    if (slab->live == 0) {
+        for (size_t i = histslabs.length; i-- > 0; ) {
+            if (histslabs.contents[i] == slab) {
+                pl_remove(&histslabs, i, 1);
+                break;
+            }
+        }
+        free(slab->data);
+        free(slab);
+    }
 }
 
 /* Searches for the entry that has the specified `number'.
@@ -325,30 +636,25 @@ struct search_result_T search_entry_by_number(unsigned number)
         return result;
     }
 
-    histlink_T *l;
-    if (2 * (nnumber - oldestnum) < nnewestnum - oldestnum) {
-        /* search from the oldest */
-        l = histlist.Oldest;
-        while (number < ashistentry(l)->number)
-            l = l->next;
-        while (number > ashistentry(l)->number)
-            l = l->next;
-        result.next = l;
-        if (number != ashistentry(l)->number)
-            l = l->prev;
-        result.prev = l;
-    } else {
-        /* search from the newest */
-        l = histlist.Newest;
-        while (number > ashistentry(l)->number)
-            l = l->prev;
-        while (number < ashistentry(l)->number)
-            l = l->prev;
-        result.prev = l;
-        if (number != ashistentry(l)->number)
-            l = l->next;
-        result.next = l;
+    /* Now the entry is between the oldest and newest, so it is found in the
+     * ring, or the nearest entries are found around the hole or gap. */
+    size_t i = ring_find(nnumber - oldestnum);
+    assert(i < histring.used);
+    const struct histslot_T *slot = ring_slot(i);
+    if (slot->number == number && slot->entry != NULL) {
+        result.prev = result.next = &slot->entry->link;
+        return result;
     }
+
+    size_t j = i;
+    while (ring_slot(j)->entry == NULL)
+        j++;
+    result.next = &ring_slot(j)->entry->link;
+    j = i;
+    do
+        j--;
+    while (ring_slot(j)->entry == NULL);
+    result.prev = &ring_slot(j)->entry->link;
     return result;
 }
 
@@ -358,11 +664,11 @@ histlink_T *get_nth_newest_entry(unsigned n)
 {
     if (histlist.count <= n)
         return histlist.Oldest;
+    if (n == 0)
+        return Histlist;
 
-    histlink_T *l = Histlist;
-    while (n-- > 0)
-        l = l->prev;
-    return l;
+    ring_compact();
+    return &ring_slot(histring.used - n)->entry->link;
 }
 
 /* Searches for the newest entry whose value begins with the specified `prefix'.
@@ -406,6 +712,371 @@ bool entry_is_newer(const histentry_T *e1, const histentry_T *e2)
 }
 
 
+/* Returns the `index'th used slot in `histring', counting from the oldest. */
+struct histslot_T *ring_slot(size_t index)
+{
+    assert(index < histring.capacity);
+    index += histring.head;
+    if (index >= histring.capacity)
+        index -= histring.capacity;
+    return &histring.slots[index];
+}
+
+/* Adds a slot for the specified entry, which must be the newest, to
+ * `histring'. */
+void ring_append(histentry_T *entry)
+{
+    if (histring.used == histring.capacity) {
+        /* `histring' is full. Remove the holes and/or enlarge it. */
+        size_t capacity = mul(histlist.count, 2);
+        ring_rebuild(capacity > HISTRING_MIN_CAPACITY
+                ? capacity : HISTRING_MIN_CAPACITY);
+    }
+
+    if (nextseq == UINT_MAX)
+        drop_index();  /* The index will be rebuilt with new serial numbers. */
+
+    struct histslot_T *slot = ring_slot(histring.used++);
+    slot->entry = entry;
+    slot->number = entry->number;
+    slot->seq = nextseq++;
+    if (histindex.built)
+        index_entry(slot->seq, entry->value);
+}
+
+/* Removes the slot for the specified entry from `histring'.
+ * If the entry is neither the oldest nor the newest, a hole is left. */
+void ring_remove(const histentry_T *entry)
+{
+    assert(histring.used > 0);
+
+    size_t i = ring_find(ring_key(entry->number));
+    assert(i < histring.used && ring_slot(i)->entry == entry);
+    ring_slot(i)->entry = NULL;
+
+    if (histindex.built && ++histindex.removed > histlist.count)
+        drop_index();  /* The index will be rebuilt when used next time. */
+
+    while (histring.used > 0 && ring_slot(0)->entry == NULL) {
+        if (++histring.head == histring.capacity)
+            histring.head = 0;
+        histring.used--;
+    }
+    while (histring.used > 0 && ring_slot(histring.used - 1)->entry == NULL)
+        histring.used--;
+    if (histring.used == 0)
+        histring.head = 0;
+}
+
+/* Re-allocates the array of `histring' with the specified capacity, removing
+ * all the holes. */
+void ring_rebuild(size_t capacity)
+{
+    assert(capacity > histlist.count);
+
+    struct histslot_T *slots = xmallocn(capacity, sizeof *slots);
+    size_t n = 0;
+    for (size_t i = 0; i < histring.used; i++) {
+        const struct histslot_T *slot = ring_slot(i);
+        if (slot->entry != NULL)
+            slots[n++] = *slot;
+    }
+    assert(n == histlist.count);
+
+    free(histring.slots);
+    histring.slots = slots;
+    histring.capacity = capacity;
+    histring.head = 0;
+    histring.used = n;
+}
+
+/* Removes the holes in `histring' if any, so that the `i'th slot corresponds
+ * to the `i'th oldest entry. */
+void ring_compact(void)
+{
+    if (histring.used > histlist.count)
+        ring_rebuild(histring.capacity);
+}
+
+/* Returns the position of the specified entry number in the range of entry
+ * numbers used in `histring', that is, the number of the entry minus the number
+ * of the oldest entry, modulo `max_number'. */
+unsigned ring_key(unsigned number)
+{
+    assert(histring.used > 0);
+
+    unsigned oldest = ring_slot(0)->number;
+    return (number >= oldest) ? number - oldest : number + max_number - oldest;
+}
+
+/* Returns the index of the first slot in `histring' whose key is not less than
+ * `key', or `histring.used' if there is no such slot. */
+size_t ring_find(unsigned key)
+{
+    if (histring.used == 0)
+        return 0;
+
+    /* If the used slots have consecutive numbers, the key is the index. */
+    if (ring_key(ring_slot(histring.used - 1)->number) == histring.used - 1)
+        return (key < histring.used) ? key : histring.used;
+
+    size_t lo = 0, hi = histring.used;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ring_key(ring_slot(mid)->number) < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/********** Substring search index **********/
+
+/* Returns the entry whose serial number is `seq', or NULL if the entry has been
+ * removed. */
+const histentry_T *ring_find_seq(unsigned seq)
+{
+    size_t lo = 0, hi = histring.used;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ring_slot(mid)->seq < seq)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < histring.used && ring_slot(lo)->seq == seq)
+        return ring_slot(lo)->entry;
+    return NULL;
+}
+
+/* Builds the substring search index from scratch.
+ * The serial numbers of all the entries are renewed. */
+void build_index(void)
+{
+    drop_index();
+    ht_init(&histindex.lists, hashtrigram, trigramcmp);
+    histindex.built = true;
+    histindex.removed = 0;
+
+    nextseq = 0;
+    for (size_t i = 0; i < histring.used; i++) {
+        struct histslot_T *slot = ring_slot(i);
+        slot->seq = nextseq++;
+        if (slot->entry != NULL)
+            index_entry(slot->seq, slot->entry->value);
+    }
+}
+
+void free_postings(kvpair_T kv)
+{
+    struct histpostings_T *p = kv.value;
+    free(p->seqs);
+    free(p);
+}
+
+/* Frees the substring search index if built and resets `histindex.scanned'. */
+void drop_index(void)
+{
+    histindex.scanned = 0;
+    if (!histindex.built)
+        return;
+    ht_clear(&histindex.lists, free_postings);
+    ht_destroy(&histindex.lists);
+    histindex.built = false;
+}
+
+/* Adds the trigrams in the specified entry value to the index. */
+void index_entry(unsigned seq, const char *value)
+{
+    assert(histindex.built);
+
+    size_t length = strlen(value);
+    for (size_t i = 0; i + 3 <= length; i++) {
+        uint_least32_t trigram = trigram_at(&value[i]);
+        struct histpostings_T *p = ht_get(&histindex.lists, &trigram).value;
+        if (p == NULL) {
+            p = xmalloc(sizeof *p);
+            p->trigram = trigram;
+            p->count = p->capacity = 0;
+            p->seqs = NULL;
+            ht_set(&histindex.lists, &p->trigram, p);
+        } else if (p->count > 0 && p->seqs[p->count - 1] == seq) {
+            continue;  /* This trigram appeared earlier in the same value. */
+        }
+        if (p->count == p->capacity) {
+            p->capacity = (p->capacity == 0) ? 4 : mul(p->capacity, 2);
+            p->seqs = xreallocn(p->seqs, p->capacity, sizeof *p->seqs);
+        }
+        p->seqs[p->count++] = seq;
+    }
+}
+
+/* Returns the trigram at the beginning of `s', which must be at least three
+ * bytes long. */
+uint_least32_t trigram_at(const char *s)
+{
+    return (uint_least32_t) (unsigned char) s[0] << 16
+        | (uint_least32_t) (unsigned char) s[1] << 8
+        | (uint_least32_t) (unsigned char) s[2];
+}
+
+/* A hash function for a trigram.
+ * The argument is a pointer to a trigram (const uint_least32_t *). */
+hashval_T hashtrigram(const void *key)
+{
+    return (hashval_T) *(const uint_least32_t *) key * FNVPRIME;
+}
+
+/* A comparison function for trigrams.
+ * The arguments are pointers to trigrams (const uint_least32_t *). */
+int trigramcmp(const void *key1, const void *key2)
+{
+    return *(const uint_least32_t *) key1 != *(const uint_least32_t *) key2;
+}
+
+/* Returns true iff the specified posting list contains `seq'. */
+bool postings_contain(const struct histpostings_T *p, unsigned seq)
+{
+    size_t i = postings_find(p, seq);
+    return i < p->count && p->seqs[i] == seq;
+}
+
+/* Returns the index of the first serial number in the specified posting list
+ * that is not less than `seq', or `p->count' if there is no such number. */
+size_t postings_find(const struct histpostings_T *p, unsigned seq)
+{
+    size_t lo = 0, hi = p->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (p->seqs[mid] < seq)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Checks if the index can be used to search for entries containing `literal'.
+ * It must be three bytes or longer. In a state-dependent encoding, a non-ASCII
+ * character may be encoded differently in the entry value, so the literal must
+ * be ASCII only. */
+bool is_indexable(const char *literal)
+{
+    size_t length = strlen(literal);
+    if (length < 3)
+        return false;
+    if (mblen(NULL, 0) == 0)
+        return true;
+    for (size_t i = 0; i < length; i++)
+        if ((unsigned char) literal[i] >= 0x80)
+            return false;
+    return true;
+}
+
+/********** Duplicate index **********/
+
+/* Builds the duplicate index from scratch. */
+void build_dups_index(void)
+{
+    assert(!histdups.built);
+    ht_initwithcapacity(&histdups.lists, hashstr, htstrcmp, histlist.count);
+    histdups.built = true;
+    histdups.boundary = NULL;
+
+    for (const histlink_T *l = histlist.Oldest; l != Histlist; l = l->next) {
+        histentry_T *e = ashistentry(l);
+        struct histdups_T *d = ht_get(&histdups.lists, e->value).value;
+        size_t count = (d == NULL) ? 0 : d->count;
+        d = xreallocs(d, sizeof *d, count + 1, sizeof *d->entries);
+        d->entries[count] = e;
+        d->count = count + 1;
+        ht_set(&histdups.lists, d->entries[0]->value, d);
+    }
+
+    if (histlist.count > histrmdup) {
+        const histlink_T *l = histlist.Newest;
+        for (unsigned i = 1; i < histrmdup; i++)
+            l = l->prev;
+        histdups.boundary = ashistentry(l);
+    }
+}
+
+/* Frees the duplicate index if built. */
+void drop_dups_index(void)
+{
+    if (!histdups.built)
+        return;
+    ht_clear(&histdups.lists, vfree);
+    ht_destroy(&histdups.lists);
+    histdups.built = false;
+}
+
+/* Adds the specified entry, which must be the newest, to the duplicate index.
+ * This function must be called after the entry is added to `histlist'. */
+void dups_add_entry(histentry_T *entry)
+{
+    struct histdups_T *d = ht_get(&histdups.lists, entry->value).value;
+    size_t count = (d == NULL) ? 0 : d->count;
+    d = xreallocs(d, sizeof *d, count + 1, sizeof *d->entries);
+    d->entries[count] = entry;
+    d->count = count + 1;
+    ht_set(&histdups.lists, d->entries[0]->value, d);
+
+    /* The oldest of the `histrmdup' newest entries moves by one. */
+    if (histlist.count <= histrmdup)
+        histdups.boundary = NULL;
+    else if (histdups.boundary == NULL)
+        histdups.boundary = ashistentry(histlist.Oldest->next);
+    else
+        histdups.boundary = ashistentry(histdups.boundary->Next);
+}
+
+/* Removes the specified entry from the duplicate index.
+ * This function must be called before the entry is removed from `histlist'. */
+void dups_remove_entry(const histentry_T *entry)
+{
+    struct histdups_T *d = ht_get(&histdups.lists, entry->value).value;
+    assert(d != NULL);
+
+    size_t i = 0;
+    while (d->entries[i] != entry)
+        i++, assert(i < d->count);
+    if (d->count == 1) {
+        ht_remove(&histdups.lists, entry->value);
+        free(d);
+    } else {
+        memmove(&d->entries[i], &d->entries[i + 1],
+                sizeof *d->entries * (d->count - i - 1));
+        d->count--;
+        if (i == 0)
+            ht_set(&histdups.lists, d->entries[0]->value, d);
+    }
+
+    /* If the entry is one of the `histrmdup' newest entries, the next older
+     * entry becomes one of them. */
+    if (histdups.boundary != NULL) {
+        unsigned newest = ashistentry(histlist.Newest)->number;
+        if (histlist.count - 1 <= histrmdup)
+            histdups.boundary = NULL;
+        else if (entry == histdups.boundary)
+            histdups.boundary = ashistentry(entry->Prev);
+        else if (entry_age(entry, newest)
+                < entry_age(histdups.boundary, newest))
+            histdups.boundary = ashistentry(histdups.boundary->Prev);
+    }
+}
+
+/* Returns the difference between the number of the specified entry and
+ * `newest', which must be the number of a newer entry. */
+unsigned entry_age(const histentry_T *entry, unsigned newest)
+{
+    if (entry->number <= newest)
+        return newest - entry->number;
+    else
+        return newest + (max_number - entry->number);
+}
+
 /********** Process ID list **********/
 
 struct pidlist_T {
@@ -484,6 +1155,7 @@ void write_histfile_pids(void)
  *    c             history entry cancellation
  *    d             history entry deletion
  *    p             shell process addition/elimination info
+ *    k             compaction marker
  *    others        ignored line
  *
  * A history entry has the following form:
@@ -504,9 +1176,22 @@ void write_histfile_pids(void)
  *    pXXX
  * where `XXX' is the process id (decimal integer). For addition `XXX' is
  * positive and for elimination `XXX' is negative.
+ *
+ * A compaction marker may appear just after the signature in a file that has
+ * replaced an old history file in the log mode. It has the form:
+ *    kRRRRRRRRRRRRRRRR:SSSSSSSSSSSSSSSS:EEEEEEEEEEEEEEEE
+ * where `R' is the revision of the old file, `S' is the size of the old file
+ * that was compacted into the new file, and `E' is the offset in the new file
+ * where the compacted data ends. They are uppercase hexadecimal numbers, each
+ * padded to 16 digits. A shell that has read the old file up to `S' already has
+ * all the entries in the new file up to `E' and can skip them.
  */
 
-/* Opens the history file.
+/* The length of a compaction marker line, including the newline. */
+#define COMPACTION_MARKER_LENGTH 52
+
+/* Opens the history file specified by the $HISTFILE variable.
+ * The pathname is remembered in `histfilepath'.
  * Returns NULL on failure. */
 FILE *open_histfile(void)
 {
@@ -518,8 +1203,23 @@ FILE *open_histfile(void)
     if (mbshistfile == NULL)
         return NULL;
 
-    int fd = open(mbshistfile, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
-    free(mbshistfile);
+    FILE *f = open_histfile_at(mbshistfile);
+    if (f != NULL) {
+        free(histfilepath);
+        histfilepath = mbshistfile;
+    } else {
+        free(mbshistfile);
+    }
+    return f;
+}
+
+/* Opens the history file at the specified pathname.
+ * In the log mode, the file is opened for appending.
+ * Returns NULL on failure. */
+FILE *open_histfile_at(const char *path)
+{
+    int fd = open(path, O_RDWR | O_CREAT | (histlog ? O_APPEND : 0),
+            S_IRUSR | S_IWUSR);
     if (fd < 0)
         return NULL;
 
@@ -542,6 +1242,52 @@ FILE *open_histfile(void)
     return f;
 }
 
+/* Closes the history file and opens the file at `histfilepath' instead.
+ * If the old file was locked, the new file is locked in the same way.
+ * Returns false on failure. `histfile' is unchanged if the new file cannot be
+ * opened. */
+bool reopen_histfile(void)
+{
+    FILE *f = open_histfile_at(histfilepath);
+    if (f == NULL)
+        return false;
+
+    short type = histlocktype;
+    flush_histfile();
+    remove_shellfd(fileno(histfile));
+    fclose(histfile);
+    histfile = f;
+    histlocktype = F_UNLCK;
+    if (type != F_UNLCK && !lock_histfile(type))
+        return false;
+    return true;
+}
+
+/* Checks if the file at `histfilepath' is no longer the open history file,
+ * that is, another shell has replaced the file with a new one. */
+bool histfile_replaced(void)
+{
+    struct stat st1, st2;
+
+    return fstat(fileno(histfile), &st1) >= 0
+        && stat(histfilepath, &st2) >= 0
+        && (st1.st_dev != st2.st_dev || st1.st_ino != st2.st_ino);
+}
+
+/* Flushes the buffer for the history file if anything has been written to it
+ * since the last flush. */
+void flush_histfile(void)
+{
+    if (histneedflush) {
+        histneedflush = false;
+        fflush(histfile);
+        /* We only flush the history file after writing. POSIX doesn't define
+         * the behavior of flush without writing. We don't use fseek instead of
+         * fflush because fseek is less reliable than fflush. In some
+         * implementations (including glibc), fseek doesn't flush the file. */
+    }
+}
+
 /* Locks the history file, which must have been open.
  * `type' must be one of `F_RDLCK', `F_WRLCK' and `F_UNLCK'.
  * If `type' is `F_UNLCK', the buffer for the history file is flushed before
@@ -551,22 +1297,25 @@ FILE *open_histfile(void)
  * Returns true iff successful. */
 bool lock_histfile(short type)
 {
-    if (type == F_UNLCK && histneedflush) {
-        histneedflush = false;
-        fflush(histfile);
-        /* We only flush the history file after writing. POSIX doesn't define
-         * the behavior of flush without writing. We don't use fseek instead of
-         * fflush because fseek is less reliable than fflush. In some
-         * implementations (including glibc), fseek doesn't flush the file. */
-    }
+    if (type == F_UNLCK)
+        flush_histfile();
 
+    if (!lock_file(fileno(histfile), type))
+        return false;
+    histlocktype = type;
+    return true;
+}
+
+/* Locks the whole of the file specified by the file descriptor.
+ * Returns true iff successful. */
+bool lock_file(int fd, short type)
+{
     struct flock flock = {
         .l_type   = type,
         .l_whence = SEEK_SET,
         .l_start  = 0,
         .l_len    = 0, /* to the end of file */
     };
-    int fd = fileno(histfile);
     int result;
 
     while ((result = fcntl(fd, F_SETLKW, &flock)) == -1 && errno == EINTR);
@@ -636,148 +1385,302 @@ bool try_read_line(FILE *restrict f, xwcsbuf_T *restrict buf)
     return false;
 }
 
+/* Loads the contents of the history file from `offset' to the end of the file
+ * into `data'. The file is mapped into memory if it is locked and mapping is
+ * possible; otherwise it is read into a buffer. If `offset' is not less than
+ * the file size, the loaded data is empty. The data must be released by
+ * `unload_histfile' after use.
+ * Returns false on error. */
+/* The file must not be mapped unless locked because it might be truncated while
+ * mapped. An unlocked file is read only in the log mode, in which the file is
+ * never truncated by other shells. */
+bool load_histfile(off_t offset, struct histfiledata_T *data)
+{
+    int fd = fileno(histfile);
+    struct stat st;
+
+    data->contents = NULL;
+    data->size = 0;
+    data->map = NULL;
+    data->mapsize = 0;
+
+    flush_histfile();
+    if (fstat(fd, &st) < 0)
+        return false;
+    if (st.st_size <= offset)
+        return true;
+    if ((uintmax_t) st.st_size >= SIZE_MAX)
+        return false;
+    data->size = (size_t) (st.st_size - offset);
+
+    long pagesize = sysconf(_SC_PAGESIZE);
+    off_t mapoffset = (pagesize > 0) ? offset - offset % pagesize : 0;
+    size_t mapsize = (size_t) (st.st_size - mapoffset);
+    void *map = (histlocktype == F_UNLCK) ? MAP_FAILED :
+            mmap(NULL, mapsize, PROT_READ, MAP_PRIVATE, fd, mapoffset);
+    if (map != MAP_FAILED) {
+        data->contents = (char *) map + (offset - mapoffset);
+        data->map = map;
+        data->mapsize = mapsize;
+        return true;
+    }
+
+    /* fall back on reading into a buffer */
+    data->contents = xmalloc(data->size);
+    size_t done = 0;
+    while (done < data->size) {
+        ssize_t n = pread(fd, &data->contents[done], data->size - done,
+                offset + (off_t) done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            unload_histfile(data);
+            return false;
+        }
+        if (n == 0)
+            break;
+        done += (size_t) n;
+    }
+    data->size = done;
+    return true;
+}
+
+/* Releases the data loaded by `load_histfile'. */
+void unload_histfile(struct histfiledata_T *data)
+{
+    if (data->map != NULL)
+        munmap(data->map, data->mapsize);
+    else
+        free(data->contents);
+    data->contents = NULL;
+    data->size = 0;
+    data->map = NULL;
+    data->mapsize = 0;
+}
+
 /* Reads the signature of the history file (`histfile') and checks if it is a
  * valid signature.
  * If valid:
- *   - the file is positioned just after the signature,
+ *   - the offset of the line next to the signature is assigned to `*offsetp',
  *   - the return value is the revision of the file (non-negative).
  * Otherwise:
- *   - the file position is undefined,
+ *   - `*offsetp' is not modified,
  *   - the return value is negative. */
 /* The history file should be locked. */
-long read_signature(void)
+long read_signature(off_t *offsetp)
 {
-    xwcsbuf_T buf;
-    long rev = -1;
-    const wchar_t *s;
+    static const char prefix[] = "#$# yash history v0 r";
+    char buf[sizeof prefix + 3 * sizeof (long) + 1];
+    ssize_t n;
 
     assert(histfile != NULL);
-    rewind(histfile);
-    if (!read_line(histfile, wb_initwithmax(&buf, HISTORY_DEFAULT_LINE_LENGTH)))
-        goto end;
-    
-    s = matchwcsprefix(buf.contents, L"#$# yash history v0 r");
-    if (s == NULL || !iswdigit(s[0]))
-        goto end;
+    flush_histfile();
+    while ((n = pread(fileno(histfile), buf, sizeof buf - 1, 0)) < 0
+            && errno == EINTR);
+    if (n < 0)
+        return -1;
+
+    char *nl = memchr(buf, '\n', (size_t) n);
+    if (nl == NULL)
+        return -1;
+    *nl = '\0';
+
+    const char *s = matchstrprefix(buf, prefix);
+    if (s == NULL || !('0' <= s[0] && s[0] <= '9'))
+        return -1;
+
+    char *end;
+    long rev;
+    errno = 0;
+    rev = strtol(s, &end, 10);
+    if (errno != 0 || *end != '\0')
+        return -1;
 
-    if (!xwcstol(s, 10, &rev))
-        rev = -1;
-end:
-    wb_destroy(&buf);
+    *offsetp = (off_t) (nl - buf + 1);
     return rev;
 }
 
 /* Reads history entries from the history file, which must have been open.
  * The file format is assumed a simple text, one entry per line.
- * The file is read from the current position.
+ * The whole file is read.
  * The entries that were read from the file are appended to `histlist'. */
 /* The file should be locked. */
-/* This function does not return any error status. The caller should check
- * `ferror' and/or `feof' for the file. */
+/* This function does not return any error status. */
 void read_history_raw(void)
 {
-    xwcsbuf_T buf;
+    struct histfiledata_T data;
 
     assert(histfile != NULL);
-    wb_initwithmax(&buf, HISTORY_DEFAULT_LINE_LENGTH);
-    while (read_line(histfile, &buf)) {
-        char *line = malloc_wcstombs(buf.contents);
-        if (line != NULL) {
-            new_entry(next_history_number(), -1, line);
-            free(line);
-        }
-        wb_clear(&buf);
+    if (!load_histfile(0, &data))
+        return;
+
+    const char *s = data.contents, *end = s + data.size;
+    begin_slab(count_lines(s, end), data.size);
+    const char *nl;
+    while (s < end && (nl = memchr(s, '\n', end - s)) != NULL) {
+        if (is_valid_history_value(s, nl))
+            new_entry(next_history_number(), -1, s, nl - s);
+        s = nl + 1;
     }
-    wb_destroy(&buf);
+    end_slab();
+
+    unload_histfile(&data);
 }
 
-/* Reads history entries from the history file.
- * The file is read from the current position.
+/* Reads history entries from the history file, starting from `offset'.
  * The entries that were read from the file are appended to `histlist'.
+ * An incomplete line at the end of the file is ignored.
+ * After reading, the file is positioned at the end. In the log mode,
+ * `histlogpos' is set to the end of the last complete line instead.
+ * Returns false on error.
  * `update_time' must be called before calling this function. */
-/* The file should be locked. */
-/* This function does not return any error status. The caller should check
- * `ferror' and/or `feof' for the file. */
-void read_history(void)
+/* The file should be locked unless in the log mode. */
+bool read_history(off_t offset)
 {
-    xwcsbuf_T buf;
+    struct histfiledata_T data;
 
     assert(histfile != NULL);
-    wb_initwithmax(&buf, HISTORY_DEFAULT_LINE_LENGTH);
-    while (read_line(histfile, &buf)) {
+    if (!load_histfile(offset, &data))
+        return false;
+
+    const char *s = data.contents, *end = s + data.size;
+    begin_slab(count_lines(s, end), data.size);
+    const char *nl;
+    while (s < end && (nl = memchr(s, '\n', end - s)) != NULL) {
         histfilelines++;
-        switch (buf.contents[0]) {
-            case L'0': case L'1': case L'2': case L'3': case L'4':
-            case L'5': case L'6': case L'7': case L'8': case L'9':
-            case L'A': case L'B': case L'C': case L'D': case L'E': case L'F':
-                parse_history_entry(buf.contents);
+        switch (s[0]) {
+            case '0': case '1': case '2': case '3': case '4':
+            case '5': case '6': case '7': case '8': case '9':
+            case 'A': case 'B': case 'C': case 'D': case 'E': case 'F':
+                parse_history_entry(s, nl);
                 break;
-            case L'c':
+            case 'c':
                 remove_last_entry();
                 break;
-            case L'd':
-                parse_removed_entry(buf.contents + 1);
+            case 'd':
+                parse_removed_entry(s + 1, nl);
                 break;
-            case L'p':
-                parse_process_id(buf.contents + 1);
+            case 'p':
+                parse_process_id(s + 1, nl);
                 break;
         }
-        wb_clear(&buf);
+        s = nl + 1;
     }
-    wb_destroy(&buf);
+    end_slab();
+
+    off_t readend = offset + (off_t) (s - data.contents);
+    unload_histfile(&data);
+    if (histlog) {
+        histlogpos = readend;
+        return true;
+    }
+    return fseeko(histfile, 0, SEEK_END) == 0;
 }
 
-void parse_history_entry(const wchar_t *line)
+/* Checks if there is a compaction marker at `offset' of the history file that
+ * states the file was made by compacting the old file whose revision was
+ * `oldrev' and size was `oldsize'. If so, the end of the compacted data is
+ * assigned to `*endp' and true is returned. */
+bool read_compaction_marker(off_t offset, long oldrev, off_t oldsize,
+        off_t *endp)
 {
-    unsigned long num;
-    time_t time;
-    wchar_t *end;
-    char *value;
+    char buf[COMPACTION_MARKER_LENGTH];
+    ssize_t n;
 
-    assert(iswxdigit(line[0]));
+    while ((n = pread(fileno(histfile), buf, sizeof buf, offset)) < 0
+            && errno == EINTR);
+    if (n != (ssize_t) sizeof buf || buf[0] != 'k'
+            || buf[sizeof buf - 1] != '\n')
+        return false;
 
-    errno = 0;
-    num = wcstoul(line, &end, 0x10);
-    if (errno || end[0] == L'\0' || num > max_number)
-        return;
+    const char *s = &buf[1], *end = &buf[sizeof buf - 1];
+    unsigned long long rev, size, compactend;
+    if (!parse_hex(&s, end, &rev) || *s++ != ':'
+            || !parse_hex(&s, end, &size) || *s++ != ':'
+            || !parse_hex(&s, end, &compactend) || s != end)
+        return false;
+    if (rev != (unsigned long long) oldrev
+            || size != (unsigned long long) oldsize
+            || compactend > (unsigned long long) INTMAX_MAX)
+        return false;
 
-    if (end[0] == L':' && iswxdigit(end[1])) {
-        unsigned long long t;
+    *endp = (off_t) compactend;
+    return true;
+}
 
-        errno = 0;
-        t = wcstoull(&end[1], &end, 0x10);
-        if (errno || end[0] == L'\0')
-            time = -1;
-        else if (t > (unsigned long long) now)
-            time = now;
-        else
-            time = (time_t) t;
-    } else {
-        time = -1;
+/* Counts newlines between `s' and `end'. */
+size_t count_lines(const char *s, const char *end)
+{
+    size_t count = 0;
+    const char *nl;
+    while (s < end && (nl = memchr(s, '\n', end - s)) != NULL) {
+        count++;
+        s = nl + 1;
     }
+    return count;
+}
+
+/* Checks if the bytes between `s' and `end' can be the value of a history
+ * entry: they must be shorter than LINE_MAX, must not contain null bytes, and
+ * must be a valid multibyte string. */
+bool is_valid_history_value(const char *s, const char *end)
+{
+    if (end - s >= LINE_MAX)
+        return false;
+
+    /* Most lines are ASCII only, which needs no conversion check. */
+    while (s < end && (unsigned char) s[0] - 1u < 0x7Fu)
+        s++;
+    if (s == end)
+        return true;
 
-    if (!iswspace(end[0]))
+    mbstate_t state;
+    memset(&state, 0, sizeof state);
+    while (s < end) {
+        size_t n = mbrlen(s, end - s, &state);
+        if (n == 0 || n == (size_t) -1 || n == (size_t) -2)
+            return false;
+        s += n;
+    }
+    return true;
+}
+
+void parse_history_entry(const char *line, const char *end)
+{
+    unsigned long long num, t;
+    time_t time;
+    const char *s = line;
+
+    assert(s < end);
+    if (!parse_hex(&s, end, &num) || num == 0 || num > max_number)
         return;
-    value = malloc_wcstombs(&end[1]);
-    if (value != NULL) {
-        new_entry((unsigned) num, time, value);
-        free(value);
+
+    time = -1;
+    if (s < end && s[0] == ':') {
+        const char *ts = &s[1];
+        if (parse_hex(&ts, end, &t))
+            time = (t > (unsigned long long) now) ? now : (time_t) t;
+        if (ts != &s[1])
+            s = ts;
     }
+
+    if (s >= end || !is_ascii_space(s[0]))
+        return;
+    s++;
+    if (is_valid_history_value(s, end))
+        new_entry((unsigned) num, time, s, end - s);
 }
 
-void parse_removed_entry(const wchar_t *numstr)
+void parse_removed_entry(const char *numstr, const char *end)
 {
-    unsigned long num;
-    wchar_t *end;
+    unsigned long long num;
+    const char *s = numstr;
 
     if (histlist.count == 0)
         return;
-    if (numstr[0] == L'\0')
+    if (!parse_hex(&s, end, &num))
         return;
-
-    errno = 0;
-    num = wcstoul(numstr, &end, 0x10);
-    if (errno || (*end != L'\0' && !iswspace(*end)))
+    if (s < end && !is_ascii_space(s[0]))
         return;
     if (num > max_number)
         return;
@@ -787,23 +1690,77 @@ void parse_removed_entry(const wchar_t *numstr)
         remove_entry(ashistentry(sr.prev));
 }
 
-void parse_process_id(const wchar_t *numstr)
+void parse_process_id(const char *numstr, const char *end)
 {
-    intmax_t num;
-    wchar_t *end;
+    intmax_t num = 0;
+    bool negative = false;
+    const char *s = numstr;
 
-    if (numstr[0] == L'\0')
+    if (s < end && (s[0] == '+' || s[0] == '-')) {
+        negative = (s[0] == '-');
+        s++;
+    }
+    if (s >= end || !('0' <= s[0] && s[0] <= '9'))
+        return;
+    do {
+        int digit = s[0] - '0';
+        if (num > (INTMAX_MAX - digit) / 10)
+            return;
+        num = num * 10 + digit;
+        s++;
+    } while (s < end && '0' <= s[0] && s[0] <= '9');
+    if (s < end && !is_ascii_space(s[0]))
         return;
 
-    errno = 0;
-    num = wcstoimax(numstr, &end, 10);
-    if (errno || (*end != L'\0' && !iswspace(*end)))
+    if (num == 0)
         return;
-    if (num > 0)
+    if (!negative)
         add_histfile_pid((pid_t) num);
-    else if (num < 0)
-        remove_histfile_pid((pid_t) -num);
-    /* XXX: this cast and negation may be unsafe */
+    else
+        remove_histfile_pid((pid_t) num);
+    /* XXX: this cast may be unsafe */
+}
+
+/* Parses the hexadecimal number that starts at `*sp' and ends before `end'.
+ * `*sp' is advanced past all the hexadecimal digits. Both uppercase and
+ * lowercase digits are accepted.
+ * Returns false if there are no digits or the number is too large. */
+bool parse_hex(const char **sp, const char *end, unsigned long long *resultp)
+{
+    const char *s = *sp;
+    unsigned long long result = 0;
+    bool overflow = false;
+
+    for (; s < end; s++) {
+        unsigned digit;
+        if ('0' <= s[0] && s[0] <= '9')
+            digit = s[0] - '0';
+        else if ('A' <= s[0] && s[0] <= 'F')
+            digit = s[0] - 'A' + 0xA;
+        else if ('a' <= s[0] && s[0] <= 'f')
+            digit = s[0] - 'a' + 0xA;
+        else
+            break;
+        if (result > ULLONG_MAX >> 4)
+            overflow = true;
+        result = result << 4 | digit;
+    }
+
+    bool ok = (s != *sp) && !overflow;
+    *sp = s;
+    *resultp = result;
+    return ok;
+}
+
+/* Returns true iff `c' is a space character in the POSIX locale. */
+bool is_ascii_space(char c)
+{
+    switch (c) {
+        case ' ':  case '\t':  case '\n':  case '\v':  case '\f':  case '\r':
+            return true;
+        default:
+            return false;
+    }
 }
 
 /* Re-reads history from the history file.
@@ -813,33 +1770,37 @@ void parse_process_id(const wchar_t *numstr)
  * If `refresh' is true, this function may call `refresh_file'.
  * On failure, `histfile' is closed and set to NULL.
  * `update_time' must be called before calling this function.
- * After calling this function, `histfile' must not be read without
- * repositioning. */
+ * After calling this function, `histfile' is positioned at the end of the file.
+ */
 /* The history file should be locked (F_WRLCK if `refresh' is true or F_RDLCK if
  * `refresh' is false).
  * This function must be called just before writing to the history file. */
 void update_history(bool refresh)
 {
-    bool posfail;
-    fpos_t pos;
+    off_t pos, offset;
     long rev;
 
     if (histfile == NULL)
         return;
     assert(!hist_lock);
 
+    if (histlog) {
+        pos = histlogpos;
+        if (histfile_replaced() && !follow_replaced_histfile(&pos))
+            goto error;
+    } else {
 #if WIO_BROKEN
-    posfail = true;
+        pos = -1;
 #else
-    posfail = fgetpos(histfile, &pos);
+        pos = ftello(histfile);
 #endif
-    rev = read_signature();
+    }
+    rev = read_signature(&offset);
     if (rev < 0)
         goto error;
-    if (!posfail && rev == histfilerev) {
+    if (pos >= 0 && rev == histfilerev) {
         /* The revision has not been changed. Just read new entries. */
-        fsetpos(histfile, &pos);
-        read_history();
+        offset = pos;
     } else {
         /* The revision has been changed. Re-read everything. */
         clear_all_entries();
@@ -847,9 +1808,8 @@ void update_history(bool refresh)
         add_histfile_pid(shell_pid);
         histfilerev = rev;
         histfilelines = 0;
-        read_history();
     }
-    if (ferror(histfile) || !feof(histfile))
+    if (!read_history(offset))
         goto error;
 
     if (refresh)
@@ -860,7 +1820,43 @@ error:
     close_history_file();
 }
 
+/* Switches to the new history file that has replaced the current one in the
+ * log mode. The rest of the current file, which has been read up to `*posp',
+ * is read before switching.
+ * If the new file starts with a compaction marker that matches what we have
+ * read, the compacted part of the new file is skipped by assigning its end to
+ * `*posp'. Otherwise, -1 is assigned so that the new file is read from the
+ * beginning.
+ * Since the file may be replaced again while we are waiting for the lock for
+ * the new file, this is repeated until the file is no longer replaced.
+ * Returns false on error. */
+bool follow_replaced_histfile(off_t *posp)
+{
+    do {
+        off_t offset;
+        bool uptodate = *posp >= 0 && read_signature(&offset) == histfilerev;
+        if (uptodate && !read_history(*posp))
+            return false;
+
+        long oldrev = histfilerev;
+        off_t oldsize = histlogpos;
+        if (!reopen_histfile())
+            return false;
+
+        long rev = read_signature(&offset);
+        if (uptodate && rev >= 0
+                && read_compaction_marker(offset, oldrev, oldsize, posp)) {
+            histfilerev = rev;
+            histfilelines = histlist.count + histfilepids.count;
+        } else {
+            *posp = -1;
+        }
+    } while (histfile_replaced());
+    return true;
+}
+
 /* Refreshes the history file if it is time to do that.
+ * In the log mode, the file is compacted in the background.
  * `histfile' must not be NULL. */
 void maybe_refresh_file(void)
 {
@@ -868,24 +1864,88 @@ void maybe_refresh_file(void)
     if (histfilelines > 20
             && histfilelines / 2 >= histlist.count + histfilepids.count) {
         remove_histfile_pid(0);
-        refresh_file();
+        if (histlog)
+            start_compaction();
+        else
+            refresh_file();
+    }
+}
+
+/* Starts a background process that compacts the history file in the log mode.
+ * The process is a grandchild of the shell so that the shell does not have to
+ * wait for it to finish. It waits for the lock for the file, reads the latest
+ * history from the file, and replaces the file with a compacted one.
+ * The process is started only once for each revision of the file. */
+void start_compaction(void)
+{
+    if (histcompactrev == histfilerev)
+        return;
+    histcompactrev = histfilerev;
+
+    flush_histfile();
+
+    pid_t pid = fork();
+    if (pid < 0)
+        return;
+    if (pid == 0) {
+        if (fork() == 0) {
+            if (lock_histfile(F_WRLCK)) {
+                update_time();
+                update_history(false);
+                /* Another process may have compacted the file already. */
+                if (histfile != NULL && histfilerev == histcompactrev)
+                    replace_histfile(true);
+            }
+        }
+        _exit(Exit_SUCCESS);
     }
+    while (waitpid(pid, NULL, 0) < 0 && errno == EINTR);
 }
 
 /* Like `fwprintf(histfile, format, ...)', but the `histneedflush' flag is set.
- */
+ * In the log mode, the line is written by `vwrite_histlog' instead. */
 int wprintf_histfile(const wchar_t *format, ...)
 {
     va_list ap;
     int result;
 
-    histneedflush = true;
     va_start(ap, format);
-    result = vfwprintf(histfile, format, ap);
+    if (histlog) {
+        result = vwrite_histlog(format, ap);
+    } else {
+        histneedflush = true;
+        result = vfwprintf(histfile, format, ap);
+    }
     va_end(ap);
     return result;
 }
 
+/* Formats a line and appends it to the history file by a single `write' so that
+ * shells reading the file without locking never see a part of a line mixed
+ * with another. `histlogpos' is updated to the new end of the file.
+ * Returns the number of bytes written or a negative value on error. */
+int vwrite_histlog(const wchar_t *format, va_list ap)
+{
+    wchar_t *wline = malloc_vwprintf(format, ap);
+    char *line = malloc_wcstombs(wline);
+    free(wline);
+    if (line == NULL)
+        return -1;
+
+    int fd = fileno(histfile);
+    size_t length = strlen(line);
+    ssize_t n;
+    while ((n = write(fd, line, length)) < 0 && errno == EINTR);
+    free(line);
+    if (n < 0 || (size_t) n < length)
+        return -1;
+
+    off_t end = lseek(fd, 0, SEEK_CUR);
+    if (end >= 0)
+        histlogpos = end;
+    return (int) n;
+}
+
 /* Writes the signature with an incremented revision number, after emptying the
  * file. */
 /* This function does not return any error status. The caller should check
@@ -932,12 +1992,97 @@ void write_history_entry(const histentry_T *entry)
  * `ferror' for the file. */
 void refresh_file(void)
 {
+    if (!hist_lock)
+        compact_duplicates();
+
+    if (histlog && replace_histfile(false))
+        return;
+
     write_signature();
     write_histfile_pids();
     for (const histlink_T *l = histlist.Oldest; l != Histlist; l = l->next)
         write_history_entry(ashistentry(l));
 }
 
+/* Rewrites the history file in the log mode by writing the current history into
+ * a new file and renaming it to the history file, so that shells reading the
+ * file without locking never see the file being rewritten.
+ * If `compaction' is true, the new file starts with a compaction marker so that
+ * shells that have read the whole current file can skip the compacted entries.
+ * On success, `histfile' is replaced with the new file, which is locked with
+ * `F_WRLCK'. Returns false if the new file could not be made, in which case
+ * `histfile' is unchanged. */
+/* The file should be locked with `F_WRLCK'. */
+bool replace_histfile(bool compaction)
+{
+    assert(histlog);
+
+    char *tmppath = malloc_printf("%s.XXXXXX", histfilepath);
+    int fd = move_to_shellfd(mkstemp(tmppath));
+    if (fd < 0)
+        goto fail;
+
+    FILE *f = fdopen(fd, "r+");
+    if (f == NULL) {
+        remove_shellfd(fd);
+        xclose(fd);
+        goto fail_unlink;
+    }
+
+    /* Write into the new file through the stream buffer. */
+    FILE *oldfile = histfile;
+    long oldrev = histfilerev;
+    size_t oldlines = histfilelines;
+    off_t markerpos = -1, endpos;
+    histfile = f;
+    histlog = false;
+
+    write_signature();
+    if (compaction) {
+        flush_histfile();
+        markerpos = ftello(f);
+        wprintf_histfile(L"k%016lX:%016jX:%016jX\n",
+                (unsigned long) oldrev, (uintmax_t) histlogpos, (uintmax_t) 0);
+    }
+    write_histfile_pids();
+    for (const histlink_T *l = histlist.Oldest; l != Histlist; l = l->next)
+        write_history_entry(ashistentry(l));
+    flush_histfile();
+    endpos = ftello(f);
+    if (markerpos >= 0 && endpos >= 0 && fseeko(f, markerpos, SEEK_SET) == 0) {
+        fwprintf(f, L"k%016lX:%016jX:%016jX\n",
+                (unsigned long) oldrev, (uintmax_t) histlogpos,
+                (uintmax_t) endpos);
+        fflush(f);
+    }
+
+    histfile = oldfile;
+    histlog = true;
+    if (ferror(f) || endpos < 0 || fsync(fd) < 0 || !lock_file(fd, F_WRLCK)
+            || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_APPEND) < 0
+            || rename(tmppath, histfilepath) < 0) {
+        histfilerev = oldrev;
+        histfilelines = oldlines;
+        remove_shellfd(fd);
+        fclose(f);
+        goto fail_unlink;
+    }
+    free(tmppath);
+
+    remove_shellfd(fileno(oldfile));
+    fclose(oldfile);
+    histfile = f;
+    histlocktype = F_WRLCK;
+    histlogpos = endpos;
+    return true;
+
+fail_unlink:
+    unlink(tmppath);
+fail:
+    free(tmppath);
+    return false;
+}
+
 
 /********** External functions **********/
 
@@ -970,17 +2115,26 @@ void maybe_init_history(void)
     update_time();
 
     /* open the history file and read it */
+    histlog = shopt_histlog;
     histfile = open_histfile();
     if (histfile != NULL) {
+        off_t offset;
+
         lock_histfile(F_WRLCK);
-        histfilerev = read_signature();
+        /* Another shell may have replaced the file while we were waiting for
+         * the lock. */
+        while (histlog && histfile_replaced()) {
+            if (!reopen_histfile()) {
+                close_history_file();
+                return;
+            }
+        }
+        histfilerev = read_signature(&offset);
         if (histfilerev < 0) {
-            rewind(histfile);
             read_history_raw();
             goto refresh;
         }
-        read_history();
-        if (ferror(histfile) || !feof(histfile)) {
+        if (!read_history(offset)) {
             close_history_file();
             return;
         }
@@ -1033,6 +2187,7 @@ void close_history_file(void)
     remove_shellfd(fileno(histfile));
     fclose(histfile);
     histfile = NULL;
+    histlocktype = F_UNLCK;
 }
 
 /* Calculates the number of the next new entry. */
@@ -1105,7 +2260,8 @@ void add_history_line(const wchar_t *line, size_t maxlen)
         histentry_T *entry;
 
         remove_duplicates(mbsline);
-        entry = new_entry(next_history_number(), now, mbsline);
+        entry = new_entry(
+                next_history_number(), now, mbsline, strlen(mbsline));
         if (histfile != NULL)
             write_history_entry(entry);
         free(mbsline);
@@ -1117,18 +2273,54 @@ void add_history_line(const wchar_t *line, size_t maxlen)
  * `histfile' must be locked and `update_history' must have been called. */
 void remove_duplicates(const char *line)
 {
-    histlink_T *l = histlist.Newest;
-    for (unsigned i = histrmdup; i > 0 && l != Histlist; i--) {
-        histlink_T *prev = l->prev;
-        histentry_T *e = ashistentry(l);
-        if (strcmp(e->value, line) == 0) {
-            if (histfile != NULL) {
-                wprintf_histfile(L"d%X\n", e->number);
-                histfilelines++;
-            }
+    if (histrmdup == 0 || histlist.count == 0)
+        return;
+    if (!histdups.built)
+        build_dups_index();
+
+    /* Entries are removed from the newest. The range of entries to check is
+     * fixed before removing any. */
+    unsigned newest = ashistentry(histlist.Newest)->number;
+    unsigned maxage = (histdups.boundary == NULL)
+        ? UINT_MAX : entry_age(histdups.boundary, newest);
+    const struct histdups_T *d;
+    while ((d = ht_get(&histdups.lists, line).value) != NULL) {
+        histentry_T *e = d->entries[d->count - 1];
+        if (entry_age(e, newest) > maxage)
+            break;
+        if (histfile != NULL) {
+            wprintf_histfile(L"d%X\n", e->number);
+            histfilelines++;
+        }
+        remove_entry(e);
+    }
+}
+
+/* Removes entries that have the same value as a newer entry in the
+ * `histrmdup' newest entries. */
+void compact_duplicates(void)
+{
+    if (histrmdup == 0 || histlist.count == 0)
+        return;
+    if (!histdups.built)
+        build_dups_index();
+
+    unsigned newest = ashistentry(histlist.Newest)->number;
+    unsigned maxage = (histdups.boundary == NULL)
+        ? UINT_MAX : entry_age(histdups.boundary, newest);
+    size_t index = 0;
+    kvpair_T kv;
+    while ((kv = ht_next(&histdups.lists, &index)).key != NULL) {
+        /* Removing an entry other than the newest does not free the list.
+         * The key may change, but the list remains at the same position in
+         * the hashtable. */
+        const struct histdups_T *d = kv.value;
+        while (d->count > 1) {
+            histentry_T *e = d->entries[d->count - 2];
+            if (entry_age(e, newest) > maxage)
+                break;
             remove_entry(e);
         }
-        l = prev;
     }
 }
 
@@ -1140,6 +2332,100 @@ const histlink_T *get_history_entry(unsigned number)
     return (sr.prev == sr.next) ? sr.prev : Histlist;
 }
 
+/* Returns the history entry that is `offset' entries newer than `l' (or older
+ * if `offset' is negative). `l' may be `Histlist', which is regarded as newer
+ * than the newest entry, and so may be the result.
+ * Returns NULL if there is no such entry. */
+const histlink_T *get_history_entry_relative(const histlink_T *l, int offset)
+{
+    size_t index;
+    if (l == Histlist) {
+        index = histlist.count;
+    } else {
+        ring_compact();
+        index = ring_find(ring_key(ashistentry(l)->number));
+        assert(index < histring.used && &ring_slot(index)->entry->link == l);
+    }
+
+    intmax_t target = (intmax_t) index + offset;
+    if (target < 0 || target > (intmax_t) histlist.count)
+        return NULL;
+    if (target == (intmax_t) histlist.count)
+        return Histlist;
+    return &ring_slot((size_t) target)->entry->link;
+}
+
+/* Returns the entry nearest to `l' in the specified direction that may contain
+ * `literal' as a substring, or `Histlist' if there is no such entry. `l' may be
+ * `Histlist', which is regarded as newer than the newest entry.
+ * If `literal' is too short to narrow down the entries using the substring
+ * search index or the index is not worth building yet, this function simply
+ * returns the adjacent entry. Otherwise, the
+ * result contains (at least the first `HISTINDEX_MAX_LISTS') trigrams in
+ * `literal' but may not contain `literal' itself, so the caller should check
+ * the result and call this function again from it as needed. */
+const histlink_T *find_history_candidate(
+        const histlink_T *l, const char *literal, bool newer)
+{
+    if (!is_indexable(literal))
+        return newer ? l->next : l->prev;
+    if (newer && l == Histlist)
+        return Histlist;
+    if (!histindex.built) {
+        if (histindex.scanned < histlist.count) {
+            histindex.scanned++;
+            return newer ? l->next : l->prev;
+        }
+        build_index();
+    }
+
+    /* Find the shortest posting list for the trigrams in `literal'. */
+    size_t length = strlen(literal) - 2, count = 0;
+    const struct histpostings_T *lists[HISTINDEX_MAX_LISTS], *shortest = NULL;
+    for (size_t i = 0; i < length; i++) {
+        uint_least32_t trigram = trigram_at(&literal[i]);
+        const struct histpostings_T *list =
+            ht_get(&histindex.lists, &trigram).value;
+        if (list == NULL)
+            return Histlist;
+        if (shortest == NULL || list->count < shortest->count)
+            shortest = list;
+        if (count < HISTINDEX_MAX_LISTS)
+            lists[count++] = list;
+    }
+
+    /* Walk through the shortest list from the position of `l'. */
+    size_t index;
+    if (l == Histlist) {
+        index = shortest->count;
+    } else {
+        size_t i = ring_find(ring_key(ashistentry(l)->number));
+        assert(i < histring.used && &ring_slot(i)->entry->link == l);
+        index = postings_find(shortest, ring_slot(i)->seq + newer);
+    }
+    for (;;) {
+        unsigned seq;
+        if (newer) {
+            if (index >= shortest->count)
+                return Histlist;
+            seq = shortest->seqs[index++];
+        } else {
+            if (index == 0)
+                return Histlist;
+            seq = shortest->seqs[--index];
+        }
+
+        for (size_t i = 0; i < count; i++)
+            if (lists[i] != shortest && !postings_contain(lists[i], seq))
+                goto next;
+
+        const histentry_T *e = ring_find_seq(seq);
+        if (e != NULL)
+            return &e->link;
+next:;
+    }
+}
+
 #if YASH_ENABLE_LINEEDIT
 
 /* Calls `maybe_init_history' or `update_history' and locks the history. */
@@ -1147,10 +2433,12 @@ void start_using_history(void)
 {
     if (!hist_lock) {
         if (histfile != NULL) {
-            lock_histfile(F_RDLCK);
+            /* In the log mode, the file can be read without locking. */
+            if (!histlog)
+                lock_histfile(F_RDLCK);
             update_time();
             update_history(false);
-            if (histfile != NULL)
+            if (histfile != NULL && !histlog)
                 lock_histfile(F_UNLCK);
         } else {
             maybe_init_history();
@@ -1389,10 +2677,11 @@ struct search_result_T fc_search_entry(const wchar_t *prefix, int number)
 void fc_update_history(void)
 {
     if (histfile != NULL) {
-        lock_histfile(F_RDLCK);
+        if (!histlog)
+            lock_histfile(F_RDLCK);
         update_time();
         update_history(false);
-        if (histfile != NULL)
+        if (histfile != NULL && !histlog)
             lock_histfile(F_UNLCK);
     }
 }
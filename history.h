@@ -78,6 +78,12 @@ extern void add_history(const wchar_t *line)
     __attribute__((nonnull));
 const histlink_T *get_history_entry(unsigned number)
     __attribute__((pure));
+extern const histlink_T *get_history_entry_relative(
+        const histlink_T *l, int offset)
+    __attribute__((nonnull));
+extern const histlink_T *find_history_candidate(
+        const histlink_T *l, const char *literal, _Bool newer)
+    __attribute__((nonnull));
 #if YASH_ENABLE_LINEEDIT
 extern void start_using_history(void);
 extern void end_using_history(void);
@@ -41,6 +41,7 @@
 #include "mail.h"
 #include "option.h"
 #include "parser.h"
+#include "redir.h"
 #include "sig.h"
 #include "strbuf.h"
 #include "util.h"
@@ -64,6 +65,30 @@ static wchar_t *expand_ps1_posix(wchar_t *s)
     __attribute__((nonnull,malloc,warn_unused_result));
 static inline wchar_t get_euid_marker(void)
     __attribute__((pure));
+#if YASH_ENABLE_LINEEDIT
+static bool use_async_prompt(const struct input_interactive_info_T *info)
+    __attribute__((nonnull));
+static bool start_async_prompt(void);
+static void send_prompt(int fd, struct promptset_T prompt);
+static bool parse_async_prompt(struct promptset_T *prompt)
+    __attribute__((nonnull));
+static void close_async_prompt(void);
+static void remember_prompt(struct promptset_T prompt);
+static struct promptset_T copy_prompt(struct promptset_T prompt)
+    __attribute__((warn_unused_result));
+
+/* The prompt set most recently expanded from $PS1 and the related variables.
+ * When the `le-async-prompt' option is enabled, this is displayed while the
+ * new prompt is being expanded in the background.
+ * `lastprompt.main' is NULL if no prompt has been remembered. */
+static struct promptset_T lastprompt;
+/* The reading end of the pipe from which the result of the prompt expansion
+ * in the background is read. Negative if no expansion is in progress. */
+int async_prompt_fd = -1;
+/* The bytes read from `async_prompt_fd' so far. */
+static xstrbuf_T async_prompt_buf;
+#endif
+
 
 /* An input function that inputs from a wide string.
  * `inputinfo' must be a pointer to a `struct input_wcs_info_T'.
@@ -121,6 +146,7 @@ read_input:  /* if there's nothing in the buffer, read the next input */
             switch (wait_for_input(info->fd, trap, -1)) {
                 case W_READY:
                     break;
+                case W_SUBREADY:
                 case W_TIMED_OUT:
                     assert(false);
                 case W_INTERRUPTED:
@@ -239,13 +265,27 @@ inputresult_T input_interactive(struct xwcsbuf_T *buf, void *inputinfo)
 {
     struct input_interactive_info_T *info = inputinfo;
     struct promptset_T prompt;
+    bool async = false;
 
     if (info->prompttype == 1) {
-        if (!posixly_correct)
+#if YASH_ENABLE_LINEEDIT
+        async = use_async_prompt(info) && start_async_prompt();
+#endif
+        if (!posixly_correct && !async)
             exec_variable_as_auxiliary_(VAR_PROMPT_COMMAND);
         check_mail();
     }
+#if YASH_ENABLE_LINEEDIT
+    if (async) {
+        prompt = copy_prompt(lastprompt);
+    } else {
+        prompt = get_prompt(info->prompttype);
+        if (info->prompttype == 1)
+            remember_prompt(prompt);
+    }
+#else
     prompt = get_prompt(info->prompttype);
+#endif
     if (do_job_control)
         print_job_status_all();
     /* Note: no commands must be executed between `print_job_status_all' here
@@ -261,6 +301,17 @@ inputresult_T input_interactive(struct xwcsbuf_T *buf, void *inputinfo)
         inputresult_T result;
 
         result = le_readline(prompt, true, &line);
+        if (async) {
+            /* If the new prompt has not arrived yet, it is no longer needed
+             * unless we have to print it without line-editing. */
+            struct promptset_T newprompt;
+            if (result != INPUT_ERROR)
+                close_async_prompt();
+            else if (receive_async_prompt(true, &newprompt)) {
+                free_prompt(prompt);
+                prompt = copy_prompt(newprompt);
+            }
+        }
         if (result != INPUT_ERROR) {
             free_prompt(prompt);
             if (result == INPUT_OK) {
@@ -332,6 +383,197 @@ struct promptset_T get_prompt(int type)
     return result;
 }
 
+#if YASH_ENABLE_LINEEDIT
+
+/* Returns true iff the prompt for `info' should be expanded in the background
+ * while line-editing starts with `lastprompt'. */
+bool use_async_prompt(const struct input_interactive_info_T *info)
+{
+    return shopt_le_asyncprompt && !posixly_correct
+        && lastprompt.main != NULL
+        && info->fileinfo->fd == STDIN_FILENO
+        && shopt_lineedit != SHOPT_NOLINEEDIT
+        && isatty(STDIN_FILENO) && isatty(STDERR_FILENO);
+}
+
+/* Starts a subshell that executes $PROMPT_COMMAND and expands $PS1 and the
+ * related variables. The result is sent to the pipe `async_prompt_fd'.
+ * Returns true iff successful. */
+bool start_async_prompt(void)
+{
+    int pipefd[2];
+
+    assert(async_prompt_fd < 0);
+    if (pipe(pipefd) < 0)
+        return false;
+
+    /* As in command substitution, the subshell ignores SIGTSTP so that it is
+     * never stopped. */
+    pid_t cpid = fork_and_reset(-1, false, t_tstp);
+    if (cpid < 0) {
+        /* fork failure */
+        xclose(pipefd[PIPE_IN]);
+        xclose(pipefd[PIPE_OUT]);
+        return false;
+    } else if (cpid > 0) {
+        /* parent process */
+        xclose(pipefd[PIPE_OUT]);
+        async_prompt_fd = move_to_shellfd(pipefd[PIPE_IN]);
+        if (async_prompt_fd < 0)
+            return false;
+        sb_init(&async_prompt_buf);
+        return true;
+    } else {
+        /* child process */
+        xclose(pipefd[PIPE_IN]);
+        int fd = move_to_shellfd(pipefd[PIPE_OUT]);
+
+        /* The subshell must not read the user's input. */
+        int nullfd = open("/dev/null", O_RDONLY);
+        if (nullfd > STDIN_FILENO) {
+            xdup2(nullfd, STDIN_FILENO);
+            xclose(nullfd);
+        }
+
+        exec_variable_as_auxiliary_(VAR_PROMPT_COMMAND);
+        if (fd >= 0)
+            send_prompt(fd, get_prompt(1));
+        exit_shell_with_status(Exit_SUCCESS);
+    }
+}
+
+/* Writes the strings of the specified prompt set, each including the
+ * terminating null character, to file descriptor `fd'.
+ * The prompt set is freed in this function. */
+void send_prompt(int fd, struct promptset_T prompt)
+{
+    const wchar_t *strings[] = {
+        prompt.main, prompt.right, prompt.styler, prompt.predict,
+    };
+    for (size_t i = 0; i < sizeof strings / sizeof *strings; i++)
+        if (!write_all(fd, strings[i],
+                    (wcslen(strings[i]) + 1) * sizeof *strings[i]))
+            break;
+    free_prompt(prompt);
+}
+
+/* Reads the result of the prompt expansion in the background.
+ * If `block' is true, this function waits until the whole result is read.
+ * Otherwise, only the bytes that are available without blocking are read.
+ * Returns true iff the whole result has been read successfully, in which case
+ * the new prompt set is assigned to `*prompt'. The strings of the prompt set
+ * are owned by this module and remain valid until the next prompt is expanded.
+ */
+bool receive_async_prompt(bool block, struct promptset_T *prompt)
+{
+#define PROMPT_READ_SIZE 1024
+
+    if (async_prompt_fd < 0)
+        return false;
+
+    for (;;) {
+        if (!block && wait_for_input(async_prompt_fd, false, 0) != W_READY)
+            return false;
+
+        sb_ensuremax(&async_prompt_buf,
+                add(async_prompt_buf.length, PROMPT_READ_SIZE));
+        ssize_t n = read(async_prompt_fd,
+                &async_prompt_buf.contents[async_prompt_buf.length],
+                async_prompt_buf.maxlength - async_prompt_buf.length);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+                continue;
+            break;
+        }
+        if (n == 0)
+            break;
+        async_prompt_buf.length += (size_t) n;
+        async_prompt_buf.contents[async_prompt_buf.length] = '\0';
+    }
+
+    /* The subshell has finished writing the result. */
+    bool ok = parse_async_prompt(prompt);
+    close_async_prompt();
+    return ok;
+
+#undef PROMPT_READ_SIZE
+}
+
+/* Decodes the prompt set in `async_prompt_buf' written by `send_prompt'.
+ * If successful, the result replaces `lastprompt' and is assigned to
+ * `*prompt'. */
+bool parse_async_prompt(struct promptset_T *prompt)
+{
+    if (async_prompt_buf.length % sizeof (wchar_t) != 0)
+        return false;
+
+    size_t count = async_prompt_buf.length / sizeof (wchar_t);
+    wchar_t *s = xmallocn(count + 1, sizeof *s);
+    memcpy(s, async_prompt_buf.contents, async_prompt_buf.length);
+    s[count] = L'\0';
+
+    wchar_t *strings[4];
+    size_t i = 0, index = 0;
+    while (i < sizeof strings / sizeof *strings && index < count) {
+        size_t length = wcslen(&s[index]);
+        strings[i++] = xwcsndup(&s[index], length);
+        index += length + 1;
+    }
+    free(s);
+
+    if (i < sizeof strings / sizeof *strings || index != count) {
+        /* The subshell was terminated before completing the result. */
+        while (i > 0)
+            free(strings[--i]);
+        return false;
+    }
+
+    free_prompt(lastprompt);
+    lastprompt = (struct promptset_T) {
+        .main = strings[0], .right = strings[1],
+        .styler = strings[2], .predict = strings[3],
+    };
+    *prompt = lastprompt;
+    return true;
+}
+
+/* Stops reading the result of the prompt expansion in the background.
+ * If the subshell is still running, it will be killed by SIGPIPE when it
+ * writes the result. */
+void close_async_prompt(void)
+{
+    if (async_prompt_fd >= 0) {
+        remove_shellfd(async_prompt_fd);
+        xclose(async_prompt_fd);
+        async_prompt_fd = -1;
+        sb_destroy(&async_prompt_buf);
+    }
+}
+
+/* Remembers a copy of the specified prompt set in `lastprompt' if the
+ * `le-async-prompt' option is enabled. Otherwise, `lastprompt' is cleared. */
+void remember_prompt(struct promptset_T prompt)
+{
+    free_prompt(lastprompt);
+    if (shopt_le_asyncprompt && !posixly_correct)
+        lastprompt = copy_prompt(prompt);
+    else
+        lastprompt = (struct promptset_T) { .main = NULL };
+}
+
+/* Returns a newly malloced copy of the specified prompt set. */
+struct promptset_T copy_prompt(struct promptset_T prompt)
+{
+    return (struct promptset_T) {
+        .main = xwcsdup(prompt.main),
+        .right = xwcsdup(prompt.right),
+        .styler = xwcsdup(prompt.styler),
+        .predict = xwcsdup(prompt.predict),
+    };
+}
+
+#endif /* YASH_ENABLE_LINEEDIT */
+
 /* Expands the result of `get_prompt_variable' for a prompt.
  * The result is a newly-malloced string. */
 wchar_t *expand_prompt_variable(wchar_t num, wchar_t suffix)
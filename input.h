@@ -35,6 +35,12 @@ extern void print_prompt(const wchar_t *s)
     __attribute__((nonnull));
 extern _Bool unset_nonblocking(int fd);
 
+#if YASH_ENABLE_LINEEDIT
+extern int async_prompt_fd;
+extern _Bool receive_async_prompt(_Bool block, struct promptset_T *prompt)
+    __attribute__((nonnull));
+#endif
+
 
 /* Frees the specified prompt set. */
 void free_prompt(struct promptset_T prompt)
@@ -19,7 +19,7 @@
 #include "../common.h"
 #include "complete.h"
 #include <assert.h>
-#include <dirent.h>
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #if HAVE_GETGRENT
@@ -34,12 +34,14 @@
 #if HAVE_GETPWENT
 # include <pwd.h>
 #endif
+#include <limits.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <wchar.h>
 #include <wctype.h>
 #include <sys/stat.h>
@@ -104,6 +106,15 @@ extern void endhostent(void);
 # endif
 #endif
 
+/* Sort key of a candidate */
+struct candsortkey_T {
+    int score;               // fuzzy matching score (0 if not fuzzy)
+    size_t hyphens;          // number of leading hyphens in the value
+    const wchar_t *folded;   // lowercased value after hyphens, or NULL
+    const wchar_t *key;      // collation key of the value after hyphens
+    le_candidate_T *cand;
+};
+
 
 static void select_candidate(void selector(int offset), int offset)
     __attribute__((nonnull));
@@ -111,14 +122,23 @@ static void select_candidate_by_offset(int offset);
 static void free_candidate(void *c)
     __attribute__((nonnull));
 static void free_context(le_context_T *ctxt);
+static void forget_last_completion(void);
+static bool narrow_last_candidates(void);
+static bool is_narrowable_context(
+        const le_context_T *oldctxt, const le_context_T *newctxt)
+    __attribute__((nonnull,pure));
 static void sort_candidates(void);
-static int sort_candidates_cmp(const void *cp1, const void *cp2)
+static void make_candidate_sortkey(struct candsortkey_T *restrict k,
+        le_candidate_T *restrict cand, bool codepoint)
+    __attribute__((nonnull));
+static int sort_candidates_cmp(const void *kp1, const void *kp2)
     __attribute__((nonnull));
 static void print_context_info(const le_context_T *ctxt)
     __attribute__((nonnull));
 static void print_compopt_info(const le_compopt_T *compopt)
     __attribute__((nonnull));
 
+static bool completion_canceled(void);
 static void execute_completion_function(void);
 static void complete_command_default(void);
 
@@ -129,10 +149,16 @@ static bool le_match_patterns(const le_comppattern_T *ps, const char *s)
     __attribute__((nonnull(2)));
 static bool le_wmatch_patterns(const le_comppattern_T *ps, const wchar_t *s)
     __attribute__((nonnull(2)));
+static bool fuzzy_wmatch(const wchar_t *query, const wchar_t *s)
+    __attribute__((nonnull,pure));
+static bool fuzzy_mbmatch(const wchar_t *query, const char *s)
+    __attribute__((nonnull));
 static void generate_file_candidates(const le_compopt_T *compopt)
     __attribute__((nonnull));
 static void generate_external_command_candidates(const le_compopt_T *compopt)
     __attribute__((nonnull));
+static void generate_indexed_command_candidates(const le_compopt_T *compopt)
+    __attribute__((nonnull));
 static void generate_keyword_candidates(const le_compopt_T *compopt)
     __attribute__((nonnull));
 static void generate_logname_candidates(const le_compopt_T *compopt)
@@ -169,10 +195,27 @@ plist_T le_candidates = { .contents = NULL };
  * When no candidate is selected, the index is `le_candidates.length'. */
 size_t le_selected_candidate_index;
 
+/* True if the current candidates were generated by fuzzy matching.
+ * This is set at the start of completion when the `le-fuzzy' option is
+ * enabled and the source word is not a pattern. */
+static bool fuzzy;
+
 /* The length of the longest common prefix of the current candidates.
  * The value is ((size_t) -1) when not computed. */
 static size_t common_prefix_length;
 
+/* True if the current candidate generation has been canceled because the user
+ * typed another key. */
+static bool canceled;
+/* The number of calls to `completion_canceled' in the current generation */
+static unsigned cancel_check_count;
+
+/* The candidates and context of the last completion, which are kept after the
+ * candidates are cleared so that the next completion can narrow them down
+ * instead of generating candidates again. */
+static plist_T last_candidates = { .contents = NULL };
+static le_context_T *last_ctxt = NULL;
+
 
 /* Performs command line completion.
  * Existing candidates are deleted, if any, and candidates are computed from
@@ -201,16 +244,34 @@ void le_complete(le_compresult_T lecr)
     common_prefix_length = (size_t) -1;
 
     ctxt = le_get_context();
+    fuzzy = shopt_le_fuzzy && !ctxt->substsrc;
     if (le_state_is_compdebug)
         print_context_info(ctxt);
 
+    if (narrow_last_candidates()) {
+        le_compdebug("narrowed down to %zu candidate(s)", le_candidates.length);
+        lecr();
+        goto end;
+    }
+
+    canceled = false;
+    cancel_check_count = 0;
     execute_completion_function();
-    sort_candidates();
-    le_compdebug("total of %zu candidate(s)", le_candidates.length);
+    if (canceled) {
+        /* Discard the candidates. The pending input will be processed as
+         * usual after we return. */
+        clear_interrupted();
+        le_complete_cleanup();
+        forget_last_completion();
+    } else {
+        sort_candidates();
+        le_compdebug("total of %zu candidate(s)", le_candidates.length);
 
-    /* display the results */
-    lecr();
+        /* display the results */
+        lecr();
+    }
 
+end:
     if (le_state_is_compdebug) {
         le_compdebug("completion end");
         le_setupterm(true);
@@ -238,7 +299,12 @@ void lecr_normal(void)
 {
     if (le_candidates.length == 0) {
         le_selected_candidate_index = 0;
-    } else if (ctxt->substsrc || need_subst()) {
+    } else if (fuzzy && le_candidates.length > 1 && need_subst()) {
+        /* The candidates may have nothing in common with the source word, so
+         * just list them and let the user choose one. */
+        le_selected_candidate_index = le_candidates.length;
+        le_display_make_rawvalues();
+    } else if (!fuzzy && (ctxt->substsrc || need_subst())) {
         le_selected_candidate_index = 0;
         substitute_source_word_all();
         le_complete_cleanup();
@@ -379,10 +445,20 @@ bool le_complete_fix_candidate(int index)
     return true;
 }
 
-/* Clears the current candidates. */
+/* Clears the current candidates.
+ * If the candidates were generated for a source word that is not a pattern,
+ * they are kept in `last_candidates' for narrowing. */
 void le_complete_cleanup(void)
 {
     le_display_complete_cleanup();
+    if (le_candidates.contents != NULL && ctxt != NULL && !ctxt->substsrc) {
+        forget_last_completion();
+        last_candidates = le_candidates;
+        last_ctxt = ctxt;
+        le_candidates.contents = NULL;
+        ctxt = NULL;
+        return;
+    }
     if (le_candidates.contents != NULL) {
         plfree(pl_toary(&le_candidates), free_candidate);
         le_candidates.contents = NULL;
@@ -391,6 +467,101 @@ void le_complete_cleanup(void)
     ctxt = NULL;
 }
 
+/* Clears the current candidates and the results of the last completion. */
+void le_complete_forget(void)
+{
+    le_complete_cleanup();
+    forget_last_completion();
+}
+
+/* Frees `last_candidates' and `last_ctxt'. */
+void forget_last_completion(void)
+{
+    if (last_candidates.contents != NULL) {
+        plfree(pl_toary(&last_candidates), free_candidate);
+        last_candidates.contents = NULL;
+    }
+    free_context(last_ctxt);
+    last_ctxt = NULL;
+}
+
+/* If the source word of the current context `ctxt' extends that of the last
+ * completion, moves the candidates of the last completion that still match
+ * the source word into `le_candidates' and returns true. Otherwise, returns
+ * false without changing `le_candidates'.
+ * The candidates in `last_candidates' are already sorted, so the result does
+ * not have to be sorted again.
+ * Fuzzy matching candidates are never narrowed because a candidate that does
+ * not begin with the new source word may still match it. */
+bool narrow_last_candidates(void)
+{
+    if (fuzzy)
+        return false;
+    if (last_ctxt == NULL || !is_narrowable_context(last_ctxt, ctxt))
+        return false;
+
+    /* All the last candidates must begin with the last source word, or the
+     * candidates may not have been generated by simple prefix matching. */
+    size_t oldlen = wcslen(last_ctxt->src), newlen = wcslen(ctxt->src);
+    for (size_t i = 0; i < last_candidates.length; i++) {
+        const le_candidate_T *cand = last_candidates.contents[i];
+        if (wcsncmp(cand->origvalue, last_ctxt->src, oldlen) != 0)
+            return false;
+
+        /* If a non-terminating candidate equals the new source word, new
+         * candidates may be generated by extending it. */
+        if (!cand->terminate && wcscmp(cand->origvalue, ctxt->src) == 0)
+            return false;
+    }
+
+    le_compdebug("narrowing %zu candidate(s) of the last completion",
+            last_candidates.length);
+
+    for (size_t i = 0; i < last_candidates.length; i++) {
+        le_candidate_T *cand = last_candidates.contents[i];
+        if (wcsncmp(cand->origvalue, ctxt->src, newlen) == 0) {
+            free(cand->rawvalue.raw), cand->rawvalue.raw = NULL;
+            free(cand->rawdesc.raw), cand->rawdesc.raw = NULL;
+            pl_add(&le_candidates, cand);
+        } else {
+            free_candidate(cand);
+        }
+    }
+    pl_destroy(&last_candidates);
+    last_candidates.contents = NULL;
+    free_context(last_ctxt);
+    last_ctxt = NULL;
+    return true;
+}
+
+/* Returns true iff the candidates for `oldctxt' can be narrowed down to those
+ * for `newctxt', that is, both contexts are for the same word in the same
+ * command and the source word of `newctxt' is that of `oldctxt' followed by
+ * characters that do not start a new path component or the like. */
+bool is_narrowable_context(
+        const le_context_T *oldctxt, const le_context_T *newctxt)
+{
+    if (oldctxt->substsrc || newctxt->substsrc)
+        return false;
+    if (oldctxt->quote != newctxt->quote || oldctxt->type != newctxt->type)
+        return false;
+    if (oldctxt->srcindex != newctxt->srcindex)
+        return false;
+    if (oldctxt->pwordc != newctxt->pwordc)
+        return false;
+    for (int i = 0; i < oldctxt->pwordc; i++)
+        if (wcscmp(oldctxt->pwords[i], newctxt->pwords[i]) != 0)
+            return false;
+
+    const wchar_t *ext = matchwcsprefix(newctxt->src, oldctxt->src);
+    if (ext == NULL)
+        return false;
+    for (; *ext != L'\0'; ext++)
+        if (!iswalnum(*ext) && wcschr(L"-_.", *ext) == NULL)
+            return false;
+    return true;
+}
+
 /* Frees a completion candidate.
  * The argument must point to a `le_candidate_T' value. */
 void free_candidate(void *c)
@@ -414,12 +585,30 @@ void free_context(le_context_T *ctxt)
     }
 }
 
-/* Sorts the candidates in the candidate list and removes duplicates. */
+/* Sorts the candidates in the candidate list and removes duplicates.
+ * If the candidates were generated by fuzzy matching, they are first sorted by
+ * the matching score in descending order. */
 void sort_candidates(void)
 {
-    qsort(le_candidates.contents,
-            le_candidates.length, sizeof *le_candidates.contents,
-            sort_candidates_cmp);
+    size_t count = le_candidates.length;
+    if (count >= 2) {
+        scratchmark_T mark = scratch_mark();
+        bool codepoint = collation_is_codepoint_order();
+        struct candsortkey_T *keys = scratch_allocn(count, sizeof *keys);
+        for (size_t i = 0; i < count; i++)
+            make_candidate_sortkey(&keys[i], le_candidates.contents[i],
+                    codepoint);
+        if (fuzzy)
+            for (size_t i = 0; i < count; i++)
+                keys[i].score = le_fuzzy_score(ctxt->src,
+                        keys[i].cand->origvalue);
+
+        qsort(keys, count, sizeof *keys, sort_candidates_cmp);
+
+        for (size_t i = 0; i < count; i++)
+            le_candidates.contents[i] = keys[i].cand;
+        scratch_release(mark);
+    }
 
     if (le_candidates.length >= 2) {
         for (size_t i = le_candidates.length - 1; i > 0; i--) {
@@ -434,34 +623,80 @@ void sort_candidates(void)
     }
 }
 
-int sort_candidates_cmp(const void *cp1, const void *cp2)
+/* Computes the sort key for candidate `cand'.
+ * Candidates that start with hyphens are sorted in a special order so that
+ * short options come before long options. That is, candidates are first sorted
+ * by the number of leading hyphens. Candidates with the same number of
+ * hyphens are sorted case-insensitively and then by the collation order of the
+ * rest of the values.
+ * Strings in the key are allocated in the scratch arena. */
+void make_candidate_sortkey(struct candsortkey_T *restrict k,
+        le_candidate_T *restrict cand, bool codepoint)
 {
-    const le_candidate_T *cand1 = *(const le_candidate_T **) cp1;
-    const le_candidate_T *cand2 = *(const le_candidate_T **) cp2;
-    const wchar_t *v1 = cand1->origvalue;
-    const wchar_t *v2 = cand2->origvalue;
+    const wchar_t *v = cand->origvalue;
+    size_t hyphens = wcsspn(v, L"-");
+    v += hyphens;
 
-    /* Candidates that start with hyphens are sorted in a special order so that
-     * short options come before long options. Such candidates are sorted case-
-     * insensitively. */
-    if (v1[0] == L'-' || v2[0] == L'-') {
-        while (*v1 == L'-' && *v2 == L'-')
-            v1++, v2++;
-        if (*v1 == L'-')
-            return 1;
-        if (*v2 == L'-')
-            return -1;
+    k->score = 0;
+    k->hyphens = hyphens;
+    k->folded = NULL;
 #if HAVE_WCSCASECMP
-        int cmp = wcscasecmp(v1, v2);
+    if (hyphens > 0) {
+        size_t length = wcslen(v);
+        wchar_t *folded = scratch_allocn(add(length, 1), sizeof *folded);
+        for (size_t i = 0; i <= length; i++)
+            folded[i] = towlower(v[i]);
+        k->folded = folded;
+    }
+#endif
+    k->key = collation_key(v, codepoint);
+    k->cand = cand;
+}
+
+int sort_candidates_cmp(const void *kp1, const void *kp2)
+{
+    const struct candsortkey_T *k1 = kp1, *k2 = kp2;
+
+    if (k1->score != k2->score)
+        return (k1->score > k2->score) ? -1 : 1;
+    if (k1->hyphens != k2->hyphens)
+        return (k1->hyphens < k2->hyphens) ? -1 : 1;
+    if (k1->folded != NULL) {
+        int cmp = wcscmp(k1->folded, k2->folded);
         if (cmp != 0)
             return cmp;
-#endif
     }
-
-    return wcscoll(v1, v2);
+    return wcscmp(k1->key, k2->key);
     // XXX case-sensitive
 }
 
+/* Checks if the user has typed a key since completion started. If so, cancels
+ * the current candidate generation and returns true.
+ * Candidate generators call this function repeatedly so that slow generation
+ * does not block line-editing. To keep the overhead low, the terminal is
+ * actually polled only once in a number of calls. When canceled, the shell is
+ * marked as interrupted so that wglob and a running completion function stop
+ * as soon as possible. */
+bool completion_canceled(void)
+{
+#ifndef COMPLETION_CANCEL_CHECK_INTERVAL
+#define COMPLETION_CANCEL_CHECK_INTERVAL 64
+#endif
+
+    if (canceled)
+        return true;
+    if (le_state_is_compdebug)
+        return false;
+    if (++cancel_check_count % COMPLETION_CANCEL_CHECK_INTERVAL != 0)
+        return false;
+    if (!le_input_pending())
+        return false;
+
+    canceled = true;
+    set_interrupted();
+    return true;
+}
+
 /* Prints the formatted string to the standard error if the completion debugging
  * option is on.
  * The string is preceded by "[compdebug] " and followed by a newline. */
@@ -677,6 +912,9 @@ void simple_completion(le_candgentype_T type)
  * set to NULL. */
 void generate_candidates(const le_compopt_T *compopt)
 {
+    if (completion_canceled())
+        goto done;
+
     generate_file_candidates(compopt);
     generate_builtin_candidates(compopt);
     generate_external_command_candidates(compopt);
@@ -692,6 +930,7 @@ void generate_candidates(const le_compopt_T *compopt)
     generate_bindkey_candidates(compopt);
     generate_dirstack_candidates(compopt);
 
+done:
     for (const le_comppattern_T *p = compopt->patterns; p != NULL; p = p->next)
         xfnm_free(p->cpattern);
 }
@@ -736,6 +975,13 @@ void le_new_candidate(le_candtype_T type, wchar_t *value, wchar_t *desc,
  * built-in invocation. */
 void le_add_candidate(le_candidate_T *cand, const le_compopt_T *compopt)
 {
+    if (completion_canceled()) {
+        free(cand->value);
+        free(cand->desc);
+        free(cand);
+        return;
+    }
+
     xwcsbuf_T buf;
     wb_initwith(&buf, cand->value);
 
@@ -825,10 +1071,19 @@ bool le_match_patterns(const le_comppattern_T *ps, const char *s)
 
 /* Perform pattern matching for multibyte string `s' using patterns in
  * `compopt->patterns'. The patterns must have been compiled.
+ * In fuzzy matching, the first pattern, which is made from the source word, is
+ * replaced with fuzzy matching against `compopt->src'.
  * Returns true iff successful. */
 bool le_match_comppatterns(const le_compopt_T *compopt, const char *s)
 {
-    return le_match_patterns(compopt->patterns, s);
+    const le_comppattern_T *ps = compopt->patterns;
+    if (fuzzy) {
+        assert(ps->type == CPT_ACCEPT);
+        if (!fuzzy_mbmatch(compopt->src, s))
+            return false;
+        ps = ps->next;
+    }
+    return le_match_patterns(ps, s);
 }
 
 /* Perform pattern matching for wide string `s' using patterns `ps'.
@@ -853,10 +1108,19 @@ bool le_wmatch_patterns(const le_comppattern_T *ps, const wchar_t *s)
 
 /* Perform pattern matching for wide string `s' using patterns in
  * `compopt->patterns'. The patterns must have been compiled.
+ * In fuzzy matching, the first pattern, which is made from the source word, is
+ * replaced with fuzzy matching against `compopt->src'.
  * Returns true iff successful. */
 bool le_wmatch_comppatterns(const le_compopt_T *compopt, const wchar_t *s)
 {
-    return le_wmatch_patterns(compopt->patterns, s);
+    const le_comppattern_T *ps = compopt->patterns;
+    if (fuzzy) {
+        assert(ps->type == CPT_ACCEPT);
+        if (!fuzzy_wmatch(compopt->src, s))
+            return false;
+        ps = ps->next;
+    }
+    return le_wmatch_patterns(ps, s);
 }
 
 /* Generates file name candidates.
@@ -881,17 +1145,43 @@ void generate_file_candidates(const le_compopt_T *compopt)
 
     /* generate candidates by wglob */
     plist_T list;
-    wglob(p->pattern, flags, pl_init(&list));
+    const wchar_t *query = NULL;
+    if (!fuzzy) {
+        wglob(p->pattern, flags, pl_init(&list));
+    } else {
+        /* In fuzzy matching, list all files in the directory and filter them
+         * by the last pathname component of the source word. */
+        const wchar_t *slash = wcsrchr(p->pattern, L'/');
+        size_t dirlen = (slash == NULL) ? 0 : (size_t) (slash - p->pattern) + 1;
+        query = wcsrchr(compopt->src, L'/');
+        query = (query == NULL) ? compopt->src : query + 1;
+
+        xwcsbuf_T pattern;
+        wb_initwithmax(&pattern, dirlen + 2);
+        wb_ncat_force(&pattern, p->pattern, dirlen);
+        wb_cat(&pattern, (query[0] == L'.') ? L".*" : L"*");
+        wglob(pattern.contents, flags, pl_init(&list));
+        wb_destroy(&pattern);
+    }
     p = p->next;
 
     /* check pathnames in `list' and add them to the candidate list */
     for (size_t i = 0; i < list.length; i++) {
         wchar_t *name = list.contents[i];
-        if (p != NULL) {
+        if (completion_canceled()) {
+            free(name);
+            continue;
+        }
+        if (query != NULL || p != NULL) {
             const wchar_t *basename = wcsrchr(name, L'/');
             if (basename == NULL)
                 basename = name;
-            if (!le_wmatch_patterns(p, basename)) {
+            if (query != NULL && !fuzzy_wmatch(query,
+                        basename + (basename[0] == L'/'))) {
+                free(name);
+                continue;
+            }
+            if (p != NULL && !le_wmatch_patterns(p, basename)) {
                 free(name);
                 continue;
             }
@@ -940,6 +1230,11 @@ void generate_external_command_candidates(const le_compopt_T *compopt)
     if (!le_compile_cpatterns(compopt))
         return;
 
+    if (shopt_dircache) {
+        generate_indexed_command_candidates(compopt);
+        return;
+    }
+
     char *const *paths = get_path_array(PA_PATH);
     xstrbuf_T path;
 
@@ -947,8 +1242,8 @@ void generate_external_command_candidates(const le_compopt_T *compopt)
         return;
     sb_init(&path);
     for (const char *dirpath; (dirpath = *paths) != NULL; paths++) {
-        DIR *dir = opendir(dirpath);
-        struct dirent *de;
+        struct cacheddir_T *dir = open_cached_dir(dirpath);
+        const char *name;
         size_t dirpathlen;
 
         if (dir == NULL)
@@ -957,21 +1252,57 @@ void generate_external_command_candidates(const le_compopt_T *compopt)
         if (path.length > 0 && path.contents[path.length - 1] != '/')
             sb_ccat(&path, '/');
         dirpathlen = path.length;
-        while ((de = readdir(dir)) != NULL) {
-            if (!le_match_comppatterns(compopt, de->d_name))
+        while ((name = read_cached_dir(dir)) != NULL) {
+            if (completion_canceled())
+                break;
+            if (!le_match_comppatterns(compopt, name))
                 continue;
-            sb_cat(&path, de->d_name);
+            sb_cat(&path, name);
             if (is_executable_regular(path.contents))
                 le_new_candidate(CT_COMMAND,
-                        malloc_mbstowcs(de->d_name), NULL, compopt);
+                        malloc_mbstowcs(name), NULL, compopt);
             sb_truncate(&path, dirpathlen);
         }
         sb_clear(&path);
-        closedir(dir);
+        close_cached_dir(dir);
+        if (canceled)
+            break;
     }
     sb_destroy(&path);
 }
 
+/* Generates candidates that are the names of external commands using the
+ * command name index. */
+void generate_indexed_command_candidates(const le_compopt_T *compopt)
+{
+    if (!update_command_index(completion_canceled))
+        return;
+
+    /* Unless the source word is a pattern or fuzzy matching is used, the
+     * candidates must start with it, so we only have to look at the names that
+     * have it as a prefix. */
+    char *prefix = (compopt->ctxt->substsrc || fuzzy)
+        ? xstrdup("") : malloc_wcstombs(compopt->src);
+    if (prefix == NULL)
+        return;
+
+    char *const *names;
+    size_t count;
+    for (size_t i = 0;
+            (names = get_command_index_range(i, prefix, &count)) != NULL;
+            i++) {
+        for (size_t j = 0; j < count; j++) {
+            if (completion_canceled())
+                goto end;
+            if (le_match_comppatterns(compopt, names[j]))
+                le_new_candidate(CT_COMMAND,
+                        malloc_mbstowcs(names[j]), NULL, compopt);
+        }
+    }
+end:
+    free(prefix);
+}
+
 /* Generates candidates that are keywords matching the pattern. */
 void generate_keyword_candidates(const le_compopt_T *compopt)
 {
@@ -1060,6 +1391,8 @@ void generate_host_candidates(const le_compopt_T *compopt)
     struct hostent *host;
     sethostent(true);
     while ((host = gethostent()) != NULL) {
+        if (completion_canceled())
+            break;
         if (le_match_comppatterns(compopt, host->h_name))
             le_new_candidate(
                     CT_HOSTNAME, malloc_mbstowcs(host->h_name), NULL, compopt);
@@ -1171,6 +1504,9 @@ size_t get_common_prefix_length(void)
  * If `subst' is true, the whole source word is replaced with the candidate
  * value. Otherwise, the source word is appended (in which case the word must
  * have a valid common prefix).
+ * In fuzzy matching, `subst' is assumed true if any candidate does not begin
+ * with the source word. In that case, the source word is restored when no
+ * candidate is selected.
  * If `finish' is true and if the completed candidate's `terminate' member is
  * true, the word is closed so that the next word can just be entered directly.
  * If either `subst' or `finish' is true, the completion state must be cleaned
@@ -1183,6 +1519,9 @@ void update_main_buffer(bool subst, bool finish)
     size_t substindex;
     le_quote_T quotetype;
 
+    if (!subst && fuzzy)
+        subst = need_subst();
+
     wb_init(&buf);
     if (subst) {
         srclen = 0;
@@ -1193,7 +1532,10 @@ void update_main_buffer(bool subst, bool finish)
         substindex = ctxt->origindex;
         quotetype = ctxt->quote;
     }
-    if (le_selected_candidate_index >= le_candidates.length) {
+    if (le_selected_candidate_index >= le_candidates.length && fuzzy && subst) {
+        cand = NULL;
+        quote(&buf, ctxt->src, quotetype);
+    } else if (le_selected_candidate_index >= le_candidates.length) {
         size_t cpl = get_common_prefix_length();
         assert(srclen <= cpl);
         cand = le_candidates.contents[0];
@@ -1361,6 +1703,391 @@ void quote(xwcsbuf_T *restrict buf,
 }
 
 
+/********** Fuzzy Matching **********/
+
+/* When the `le-fuzzy' option is enabled, a candidate matches the source word
+ * if the candidate contains all the characters of the source word in the same
+ * order. Matching candidates are scored so that the most relevant ones come
+ * first in the candidate list. */
+
+/* Points added for each matched character */
+#define FUZZY_SCORE_MATCH        16
+/* Bonus for a match at the beginning of the string */
+#define FUZZY_BONUS_HEAD         10
+/* Bonus for a match just after a non-alphanumeric character */
+#define FUZZY_BONUS_BOUNDARY      8
+/* Bonus for a match at an uppercase letter after a lowercase letter */
+#define FUZZY_BONUS_CAMEL         7
+/* Minimum bonus for a match just after the previous match */
+#define FUZZY_BONUS_CONSECUTIVE   4
+/* Penalties for characters skipped between two matches */
+#define FUZZY_PENALTY_GAP_START   3
+#define FUZZY_PENALTY_GAP         1
+
+/* Strings longer than this are scored by the greedy algorithm rather than the
+ * dynamic programming algorithm. */
+#ifndef FUZZY_DP_MAX_LENGTH
+#define FUZZY_DP_MAX_LENGTH 256
+#endif
+
+#define FUZZY_NEGATIVE_INFINITY (INT_MIN / 2)
+
+static inline bool fuzzy_casefold(const wchar_t *query)
+    __attribute__((nonnull,pure));
+static inline bool fuzzy_equals(wchar_t qc, wchar_t c, bool casefold)
+    __attribute__((const));
+static bool fuzzy_ascii_prefilter(const wchar_t *query, const char *s)
+    __attribute__((nonnull,pure));
+static int fuzzy_bonus(const wchar_t *s, size_t index)
+    __attribute__((nonnull,pure));
+static int fuzzy_score_greedy(const wchar_t *query, const wchar_t *s,
+        bool casefold)
+    __attribute__((nonnull,pure));
+
+/* Returns true if the query should be matched case-insensitively, that is, if
+ * it contains no uppercase letters. */
+bool fuzzy_casefold(const wchar_t *query)
+{
+    for (; *query != L'\0'; query++)
+        if (iswupper(*query))
+            return false;
+    return true;
+}
+
+bool fuzzy_equals(wchar_t qc, wchar_t c, bool casefold)
+{
+    return qc == c || (casefold && qc == (wchar_t) towlower(c));
+}
+
+/* Returns true iff `s' contains all the characters of `query' in order. */
+bool fuzzy_wmatch(const wchar_t *query, const wchar_t *s)
+{
+    bool casefold = fuzzy_casefold(query);
+    for (; *query != L'\0'; query++) {
+        while (!fuzzy_equals(*query, *s, casefold)) {
+            if (*s == L'\0')
+                return false;
+            s++;
+        }
+        s++;
+    }
+    return true;
+}
+
+/* Like `fuzzy_wmatch', but `s' is a multibyte string. */
+bool fuzzy_mbmatch(const wchar_t *query, const char *s)
+{
+    if (!fuzzy_ascii_prefilter(query, s))
+        return false;
+
+    wchar_t *ws = malloc_mbstowcs(s);
+    if (ws == NULL)
+        return false;
+    bool match = fuzzy_wmatch(query, ws);
+    free(ws);
+    return match;
+}
+
+/* Quickly checks if multibyte string `s' may match `query' without converting
+ * `s' into a wide string. If `query' contains only ASCII characters, the
+ * ASCII characters in `s' are matched against it byte by byte. Returns false
+ * only if `s' cannot match. */
+bool fuzzy_ascii_prefilter(const wchar_t *query, const char *s)
+{
+    for (const wchar_t *q = query; *q != L'\0'; q++)
+        if ((unsigned long) *q >= 0x80)
+            return true;
+
+    bool casefold = fuzzy_casefold(query);
+    for (; *query != L'\0'; query++) {
+        for (;;) {
+            unsigned char c = (unsigned char) *s;
+            if (c == '\0')
+                return false;
+            s++;
+            if (c < 0x80 && fuzzy_equals(*query,
+                        casefold ? (wchar_t) tolower(c) : (wchar_t) c, false))
+                break;
+        }
+    }
+    return true;
+}
+
+/* Returns the bonus for a match at `s[index]'. */
+int fuzzy_bonus(const wchar_t *s, size_t index)
+{
+    if (index == 0)
+        return FUZZY_BONUS_HEAD;
+
+    wchar_t prev = s[index - 1], c = s[index];
+    if (!iswalnum(prev))
+        return iswalnum(c) ? FUZZY_BONUS_BOUNDARY : 0;
+    if (iswlower(prev) && iswupper(c))
+        return FUZZY_BONUS_CAMEL;
+    return 0;
+}
+
+/* Computes the score of `s' with respect to `query'.
+ * Returns a negative value if `s' does not match `query'. Otherwise, returns a
+ * non-negative score, which is larger for a better match.
+ * A match gains points for each matched character, and more for characters
+ * at the beginning of a word or immediately following the previous match.
+ * Characters skipped between matches are penalized.
+ * The best alignment of the query is found by dynamic programming, keeping
+ * only one row of the score matrix per query character. Long strings are
+ * scored by the greedy leftmost alignment instead to bound the cost. */
+int le_fuzzy_score(const wchar_t *query, const wchar_t *s)
+{
+    bool casefold = fuzzy_casefold(query);
+    size_t m = wcslen(query), n = wcslen(s);
+    if (m == 0)
+        return 0;
+    if (m > n || !fuzzy_wmatch(query, s))
+        return -1;
+    if (n > FUZZY_DP_MAX_LENGTH)
+        return fuzzy_score_greedy(query, s, casefold);
+
+    /* `match[j]' is the best score of the alignment of `query[0..i]' where
+     * `query[i]' is matched at `s[j]'.
+     * `best[j]' is the best score of the alignment of `query[0..i]' within
+     * `s[0..j]', including the penalties for the characters after the last
+     * match. */
+    int bonus[n], match[n], best[n], prevmatch[n], prevbest[n];
+    for (size_t j = 0; j < n; j++)
+        bonus[j] = fuzzy_bonus(s, j);
+
+    for (size_t i = 0; i < m; i++) {
+        for (size_t j = 0; j < n; j++) {
+            int score = FUZZY_NEGATIVE_INFINITY;
+            if (j >= i && fuzzy_equals(query[i], s[j], casefold)) {
+                if (i == 0) {
+                    score = FUZZY_SCORE_MATCH + 2 * bonus[j];
+                } else if (j > 0) {
+                    int consecutive = prevmatch[j - 1] + FUZZY_SCORE_MATCH
+                        + (bonus[j] > FUZZY_BONUS_CONSECUTIVE
+                                ? bonus[j] : FUZZY_BONUS_CONSECUTIVE);
+                    int gapped = prevbest[j - 1] + FUZZY_SCORE_MATCH
+                        + bonus[j];
+                    score = consecutive > gapped ? consecutive : gapped;
+                }
+            }
+            match[j] = score;
+
+            int skipped = FUZZY_NEGATIVE_INFINITY;
+            if (j > 0)
+                skipped = best[j - 1] - (best[j - 1] == match[j - 1]
+                        ? FUZZY_PENALTY_GAP_START : FUZZY_PENALTY_GAP);
+            best[j] = score > skipped ? score : skipped;
+        }
+        memcpy(prevmatch, match, sizeof match);
+        memcpy(prevbest, best, sizeof best);
+    }
+
+    int result = 0;
+    for (size_t j = m - 1; j < n; j++)
+        if (match[j] > result)
+            result = match[j];
+    return result;
+}
+
+/* Scores `s' by matching each character of `query' at its leftmost possible
+ * position. `s' must match `query'. */
+int fuzzy_score_greedy(const wchar_t *query, const wchar_t *s, bool casefold)
+{
+    int score = 0;
+    size_t last = (size_t) -1;
+    for (size_t j = 0; *query != L'\0'; j++) {
+        assert(s[j] != L'\0');
+        if (!fuzzy_equals(*query, s[j], casefold))
+            continue;
+
+        int bonus = fuzzy_bonus(s, j);
+        if (last == (size_t) -1) {
+            bonus *= 2;
+        } else if (last + 1 == j) {
+            if (bonus < FUZZY_BONUS_CONSECUTIVE)
+                bonus = FUZZY_BONUS_CONSECUTIVE;
+        } else {
+            score -= FUZZY_PENALTY_GAP_START
+                + (int) (j - last - 2) * FUZZY_PENALTY_GAP;
+        }
+        score += FUZZY_SCORE_MATCH + bonus;
+        last = j;
+        query++;
+    }
+    return score > 0 ? score : 0;
+}
+
+/* Like `le_fuzzy_score', but `s' is a multibyte string. */
+int le_fuzzy_mbscore(const wchar_t *query, const char *s)
+{
+    if (!fuzzy_ascii_prefilter(query, s))
+        return -1;
+
+    wchar_t *ws = malloc_mbstowcs(s);
+    if (ws == NULL)
+        return -1;
+    int score = le_fuzzy_score(query, ws);
+    free(ws);
+    return score;
+}
+
+
+/********** Candidate Word Cache **********/
+
+/* The complete built-in can cache the words given as operands so that a
+ * completion function does not have to run an expensive command to produce
+ * the same words every time. */
+
+/* A cached list of words */
+struct compcache_T {
+    wchar_t *key;
+    void **words;
+    time_t stored, expire;
+    size_t depcount;
+    struct compcachedep_T *deps;
+};
+/* `key' is the name of the cache entry and `words' is a NULL-terminated array
+ * of pointers to the cached wide strings.
+ * `stored' is the time when the words were stored. The entry is valid until
+ * `expire' unless it is (time_t) -1.
+ * `deps' is an array of `depcount' files the entry depends on. The entry is
+ * invalidated when any of the files is modified. */
+
+/* A file a cache entry depends on */
+struct compcachedep_T {
+    char *path;
+    bool exists;
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+};
+
+static void **get_cached_words(const wchar_t *key)
+    __attribute__((nonnull));
+static void store_cached_words(const wchar_t *key, void *const *words,
+        unsigned long ttl, void *const *deppaths)
+    __attribute__((nonnull));
+static bool stat_compcachedep(struct compcachedep_T *dep)
+    __attribute__((nonnull));
+static void free_compcache(struct compcache_T *cache);
+
+#ifndef COMPCACHE_MAX_ENTRIES
+#define COMPCACHE_MAX_ENTRIES 64
+#endif
+
+/* A hashtable from keys (wchar_t *) to cache entries (struct compcache_T *).
+ * The keys are the `key' members of the values. */
+static hashtable_T compcachehash;
+
+/* Returns the cached words for the specified key, or NULL if there is no valid
+ * cache entry for the key. */
+void **get_cached_words(const wchar_t *key)
+{
+    if (compcachehash.capacity == 0)
+        return NULL;
+
+    struct compcache_T *cache = ht_get(&compcachehash, key).value;
+    if (cache == NULL)
+        return NULL;
+
+    bool valid = true;
+    if (cache->expire != (time_t) -1 && time(NULL) >= cache->expire)
+        valid = false;
+    for (size_t i = 0; valid && i < cache->depcount; i++) {
+        struct compcachedep_T dep = { .path = cache->deps[i].path, };
+        stat_compcachedep(&dep);
+        if (dep.exists != cache->deps[i].exists || (dep.exists &&
+                    (dep.dev != cache->deps[i].dev ||
+                     dep.ino != cache->deps[i].ino ||
+                     dep.mtime != cache->deps[i].mtime)))
+            valid = false;
+    }
+    if (!valid) {
+        le_compdebug("cache \"%ls\" has expired", key);
+        ht_remove(&compcachehash, key);
+        free_compcache(cache);
+        return NULL;
+    }
+    return cache->words;
+}
+
+/* Stores a copy of `words' in the cache entry for `key'.
+ * If `ttl' is non-zero, the entry expires after `ttl' seconds.
+ * `deppaths' is a NULL-terminated array of pathnames (wchar_t *) of the files
+ * the entry depends on. */
+void store_cached_words(const wchar_t *key, void *const *words,
+        unsigned long ttl, void *const *deppaths)
+{
+    if (compcachehash.capacity == 0)
+        ht_init(&compcachehash, hashwcs, htwcscmp);
+
+    /* remove the old entry for the key, or the oldest entry if full */
+    struct compcache_T *old = ht_get(&compcachehash, key).value;
+    if (old == NULL && compcachehash.count >= COMPCACHE_MAX_ENTRIES) {
+        size_t index = 0;
+        kvpair_T kv;
+        while ((kv = ht_next(&compcachehash, &index)).key != NULL) {
+            struct compcache_T *c = kv.value;
+            if (old == NULL || c->stored < old->stored)
+                old = c;
+        }
+    }
+    if (old != NULL) {
+        ht_remove(&compcachehash, old->key);
+        free_compcache(old);
+    }
+
+    struct compcache_T *cache = xmalloc(sizeof *cache);
+    cache->key = xwcsdup(key);
+    cache->words = pldup(words, copyaswcs);
+    cache->stored = time(NULL);
+    if (ttl == 0 || cache->stored == (time_t) -1)
+        cache->expire = (time_t) -1;
+    else
+        cache->expire = cache->stored + (time_t) ttl;
+    cache->depcount = plcount(deppaths);
+    cache->deps = xmallocn(cache->depcount, sizeof *cache->deps);
+    for (size_t i = 0; i < cache->depcount; i++) {
+        cache->deps[i].path = malloc_wcstombs(deppaths[i]);
+        if (cache->deps[i].path == NULL)
+            cache->deps[i].path = xstrdup("");
+        stat_compcachedep(&cache->deps[i]);
+    }
+    ht_set(&compcachehash, cache->key, cache);
+
+    le_compdebug("stored %zu word(s) in cache \"%ls\"",
+            plcount(cache->words), key);
+}
+
+/* Fills the `exists', `dev', `ino' and `mtime' members of `dep' by `stat'ing
+ * `dep->path'. Returns `dep->exists'. */
+bool stat_compcachedep(struct compcachedep_T *dep)
+{
+    struct stat st;
+    dep->exists = stat(dep->path, &st) >= 0;
+    if (dep->exists) {
+        dep->dev = st.st_dev;
+        dep->ino = st.st_ino;
+        dep->mtime = st.st_mtime;
+    }
+    return dep->exists;
+}
+
+/* Frees the specified cache entry. */
+void free_compcache(struct compcache_T *cache)
+{
+    if (cache != NULL) {
+        free(cache->key);
+        plfree(cache->words, free);
+        for (size_t i = 0; i < cache->depcount; i++)
+            free(cache->deps[i].path);
+        free(cache->deps);
+        free(cache);
+    }
+}
+
+
 /********** Built-ins **********/
 
 /* Options for the "complete" built-in. */
@@ -1370,6 +2097,10 @@ const struct xgetopt_T complete_options[] = {
     { L'-', L"array-variable",       OPTARG_NONE,     true,  NULL, },
     { L'-', L"bindkey",              OPTARG_NONE,     true,  NULL, },
     { L'b', L"builtin-command",      OPTARG_NONE,     true,  NULL, },
+    { L'-', L"cache-depend",         OPTARG_REQUIRED, true,  NULL, },
+    { L'-', L"cache-load",           OPTARG_REQUIRED, true,  NULL, },
+    { L'-', L"cache-store",          OPTARG_REQUIRED, true,  NULL, },
+    { L'-', L"cache-ttl",            OPTARG_REQUIRED, true,  NULL, },
     { L'c', L"command",              OPTARG_NONE,     true,  NULL, },
     { L'D', L"description",          OPTARG_REQUIRED, true,  NULL, },
     { L'd', L"directory",            OPTARG_NONE,     true,  NULL, },
@@ -1418,6 +2149,11 @@ int complete_builtin(int argc __attribute__((unused)), void **argv)
     le_candtype_T candtype = CT_WORD;
     le_comppattern_T *patterns = NULL;
     bool terminate = true;
+    const wchar_t *cachekey = NULL;
+    bool cachestore = false;
+    unsigned long cachettl = 0;
+    plist_T cachedeps;
+    pl_init(&cachedeps);
 
 #define NEWPATTERN(typ) \
     do {                                                            \
@@ -1468,6 +2204,34 @@ int complete_builtin(int argc __attribute__((unused)), void **argv)
                 switch (opt->longopt[0]) {
                     case L'a':  cgtype |= CGT_ARRAY;  break;
                     case L'b':  cgtype |= CGT_BINDKEY;  break;
+                    case L'c':
+                        switch (opt->longopt[6]) {
+                            case L'd':
+                                pl_add(&cachedeps, xoptarg);
+                                break;
+                            case L'l':
+                            case L's':
+                                if (cachekey != NULL) {
+                                    xerror(0, Ngt("more than one of the "
+                                                "--cache-load and --cache-store"
+                                                " options is specified"));
+                                    exitstatus = Exit_ERROR;
+                                    goto finish;
+                                }
+                                cachekey = xoptarg;
+                                cachestore = (opt->longopt[6] == L's');
+                                break;
+                            case L't':
+                                if (!xwcstoul(xoptarg, 10, &cachettl)) {
+                                    xerror(0, Ngt("`%ls' is not a valid "
+                                                "integer"), xoptarg);
+                                    exitstatus = Exit_ERROR;
+                                    goto finish;
+                                }
+                                break;
+                            default:    assert(false);
+                        }
+                        break;
                     case L'd':  cgtype |= CGT_DIRSTACK;  break;
                     case L'e':
                         switch (opt->longopt[1]) {
@@ -1587,12 +2351,34 @@ dupopterror:
 
     print_compopt_info(&compopt);
 
+    /* treat the cache */
+    void **cachedwords = NULL;
+    if (cachekey != NULL) {
+        if (cachestore) {
+            store_cached_words(cachekey, words, cachettl, cachedeps.contents);
+        } else {
+            cachedwords = get_cached_words(cachekey);
+            if (cachedwords == NULL) {
+                le_compdebug("cache \"%ls\" is not available", cachekey);
+                exitstatus = Exit_FAILURE;
+                goto finish;
+            }
+            le_compdebug("using cache \"%ls\"", cachekey);
+        }
+    }
+
     size_t oldcount = le_candidates.length;
+    if (cachedwords != NULL)
+        generate_candidates_from_words(
+                candtype, cachedwords, description, &compopt);
     generate_candidates_from_words(candtype, words, description, &compopt);
     generate_candidates(&compopt);
     size_t newcount = le_candidates.length;
 
-    exitstatus = (oldcount != newcount) ? Exit_SUCCESS : Exit_FAILURE;
+    if (cachedwords != NULL)
+        exitstatus = Exit_SUCCESS;
+    else
+        exitstatus = (oldcount != newcount) ? Exit_SUCCESS : Exit_FAILURE;
 
 finish:
     while (patterns != NULL) {
@@ -1600,6 +2386,7 @@ finish:
         free(patterns);
         patterns = next;
     }
+    pl_destroy(&cachedeps);
     return exitstatus;
 }
 
@@ -1610,6 +2397,9 @@ const char complete_help[] = Ngt(
 const char complete_syntax[] = Ngt(
 "\tcomplete [-A pattern] [-R pattern] [-T] [-P prefix] [-S suffix] \\\n"
 "\t         [-abcdfghjkuv] [[-O] [-D description] words...]\n"
+"\tcomplete --cache-store=key [--cache-ttl=seconds] \\\n"
+"\t         [--cache-depend=file]... [options...] [words...]\n"
+"\tcomplete --cache-load=key [options...] [words...]\n"
 );
 #endif
 
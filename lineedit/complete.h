@@ -193,6 +193,7 @@ extern void le_complete_select_column(int offset);
 extern void le_complete_select_page(int offset);
 extern _Bool le_complete_fix_candidate(int index);
 extern void le_complete_cleanup(void);
+extern void le_complete_forget(void);
 extern void le_compdebug(const char *format, ...)
     __attribute__((nonnull,format(printf,1,2)));
 
@@ -213,6 +214,10 @@ extern _Bool le_match_comppatterns(const le_compopt_T *compopt, const char *s)
 extern _Bool le_wmatch_comppatterns(
         const le_compopt_T *compopt, const wchar_t *s)
     __attribute__((nonnull));
+extern int le_fuzzy_score(const wchar_t *query, const wchar_t *s)
+    __attribute__((nonnull,pure));
+extern int le_fuzzy_mbscore(const wchar_t *query, const char *s)
+    __attribute__((nonnull));
 
 extern int complete_builtin(int argc, void **argv)
     __attribute__((nonnull));
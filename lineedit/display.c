@@ -28,6 +28,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <wchar.h>
 #include <wctype.h>
@@ -36,10 +37,12 @@
 #include "../job.h"
 #include "../option.h"
 #include "../plist.h"
+#include "../redir.h"
 #include "../strbuf.h"
 #include "../util.h"
 #include "complete.h"
 #include "editing.h"
+#include "highlight.h"
 #include "terminfo.h"
 
 
@@ -64,7 +67,15 @@
  * when the cursor is sticking, or we cannot track the cursor position
  * correctly. To deal with this problem, if we finish printing a text at the end
  * of a line, we print a dummy space character and erase it to ensure the cursor
- * is no longer sticking. */
+ * is no longer sticking.
+ *
+ * To keep the output small, the edit line is not reprinted as a whole when it
+ * is modified. We remember the character, style and width of each cell of the
+ * edit line on the screen (`current_cells') and reprint only the cells that
+ * differ from the new contents. If the terminal can insert or delete
+ * characters, the unchanged text is shifted rather than reprinted. Likewise, we
+ * remember the pieces of text printed in the candidate area (`candimages') and
+ * reprint only the pieces that have changed. */
 
 
 #if HAVE_WCWIDTH
@@ -331,8 +342,10 @@ bool lebuf_putchar1_trunc(int c)
 
 /********** Displaying **********/
 
+typedef struct lecell_T lecell_T;
 typedef struct candpage_T candpage_T;
 typedef struct candcol_T candcol_T;
+typedef struct candimage_T candimage_T;
 
 static void finish(void);
 static void clear_to_end_of_screen(void);
@@ -341,9 +354,39 @@ static void maybe_print_promptsp(void);
 static void update_editline(void);
 static bool current_display_is_uptodate(size_t index)
     __attribute__((pure));
+static void make_cursor_positions(int *positions, size_t index)
+    __attribute__((nonnull));
+static void init_cells(lecell_T *cells, int count, lecell_T cell)
+    __attribute__((nonnull));
+static void set_editline_cells(
+        lecell_T *cells, const int *positions, size_t index, int startline)
+    __attribute__((nonnull));
+static void update_editline_line(
+        const lecell_T *newcells, int cellcount, int line, int shift)
+    __attribute__((nonnull));
+static void shift_cells(
+        const lecell_T *newcells, int line, int column, int end, int shift)
+    __attribute__((nonnull));
+static int update_cost(const lecell_T *oldcells, const lecell_T *newcells,
+        int from, int to)
+    __attribute__((nonnull,pure));
+static void update_cells(
+        const lecell_T *newcells, int cellcount, int from, int to)
+    __attribute__((nonnull));
+static void set_cell_style(int style);
+static void reset_cell_style(void);
+static int content_end(const lecell_T *cells, int limit)
+    __attribute__((nonnull,pure));
+static inline bool cell_equals(const lecell_T *c1, const lecell_T *c2)
+    __attribute__((nonnull,pure));
+static void free_editline(void);
 static void check_cand_overwritten(void);
 static void update_styler(void);
 static void reset_style_before_moving(void);
+static int right_prompt_line(int endposition)
+    __attribute__((pure));
+static int right_prompt_column(void)
+    __attribute__((pure));
 static void update_right_prompt(void);
 static void print_search(void);
 static void go_to(le_pos_T p);
@@ -363,11 +406,26 @@ static void free_candcol(void *candcol)
     __attribute__((nonnull));
 static void print_candidates_all(void);
 static void update_highlighted_candidate(void);
+static void print_candidates(int baseline);
 static void print_candidate(const le_candidate_T *cand, const candcol_T *col,
-        bool highlight, bool printdesc)
+        bool highlight)
+    __attribute__((nonnull));
+static void print_candidate_desc(const le_candidate_T *cand)
     __attribute__((nonnull));
 static void print_candidate_count(size_t pageindex);
 static void print_candidate_count_0(void);
+static struct lebuf_T begin_candimage(int line, int column);
+static void end_candimage(plist_T *images, int line, int column,
+        struct lebuf_T save)
+    __attribute__((nonnull));
+static void show_candimages(plist_T *images, int baseline)
+    __attribute__((nonnull));
+static void update_candimage_line(void *const *oldimages, size_t oldcount,
+        void *const *newimages, size_t newcount)
+    __attribute__((nonnull));
+static void free_candimages(void);
+static void free_candimage(void *candimage)
+    __attribute__((nonnull));
 static size_t col_of_cand(size_t candindex);
 static int col_of_cand_cmp(const void *candindexp, const void *colp)
     __attribute__((nonnull));
@@ -408,6 +466,47 @@ static int last_edit_line;
 /* True when the terminal's current font setting is the one set by the styler
  * prompt. */
 static bool styler_active;
+/* The style of cells for which the terminal's current font setting has been
+ * set, in addition to the styler prompt. CELL_NORMAL if none. */
+static int active_cell_style;
+
+/* The type of cells of the edit line on the screen. */
+struct lecell_T {
+    wchar_t c;            /* character displayed in the cell */
+    unsigned char part;   /* index of the cell among the cells of `c' */
+    unsigned char style;  /* one of the `CELL_*' values below */
+};
+#define CELL_NORMAL  0  /* main part of the edit line, or an empty cell */
+#define CELL_PREDICT 1  /* predicted part of the edit line */
+#define CELL_PROMPT  2  /* part of the prompt */
+#define CELL_UNKNOWN 3  /* unknown contents that may need erasing */
+#define CELL_HIGHLIGHT 4  /* plus a non-zero le_hlstyle_T: highlighted main
+                             part of the edit line */
+#define BLANK_CELL ((lecell_T) { .c = L'\0', .part = 0, .style = CELL_NORMAL })
+
+/* The font settings for the styles of syntax highlighting, in the same notation
+ * as the prompt. They are applied after the styler prompt. */
+static const wchar_t *const highlight_styles[HL_STYLE_COUNT] = {
+    [HL_NONE]      = L"",
+    [HL_COMMAND]   = L"\\fg.",
+    [HL_KEYWORD]   = L"\\fyo.",
+    [HL_OPERATOR]  = L"\\fo.",
+    [HL_QUOTE]     = L"\\fy.",
+    [HL_EXPANSION] = L"\\fc.",
+    [HL_COMMENT]   = L"\\fi.",
+};
+
+/* The approximate number of bytes needed to move the cursor within a line.
+ * A run of unchanged cells shorter than this is reprinted rather than skipped.
+ */
+#define MOVE_COST 4
+
+/* The cells of the edit line that are currently displayed on the screen.
+ * The cells of line `l', column `c' (counted from the line of `editbasepos') is
+ * current_cells[l * le_columns + c]. */
+static lecell_T *current_cells = NULL;
+/* The number of lines in `current_cells'. */
+static int current_cell_lines;
 
 /* The line on which the right prompt is displayed.
  * The value is -1 when the right prompt is not displayed. */
@@ -439,6 +538,15 @@ struct candcol_T {
     int width;         /* total width of the whole column. */
 };
 
+/* The type of pieces of text printed in the candidate area. */
+struct candimage_T {
+    int line;       /* line number of the piece on the screen */
+    int column;     /* column where the piece starts */
+    int endcolumn;  /* column where the piece ends */
+    char *value;    /* printed bytes, possibly containing escape sequences */
+    size_t length;  /* number of bytes in `value' */
+};
+
 /* A list of completion candidate pages.
  * The elements pointed to by `candpages.contents[*]' are of type `candpage_T'.
  */
@@ -459,6 +567,14 @@ static int candbaseline;
 /* When the candidate area is overwritten by the edit line or the right prompt,
  * this flag is set. */
 static bool candoverwritten;
+/* A list of the pieces of text currently displayed in the candidate area.
+ * The elements pointed to by `candimages.contents[*]' are of type
+ * `candimage_T', sorted by position.
+ * The list is inactive when the contents of the candidate area are unknown. */
+static plist_T candimages = { .contents = NULL };
+/* The number of the first line of the candidate area when `candimages' was
+ * printed. */
+static int candimagebase;
 
 
 /* Initializes the display module. */
@@ -506,9 +622,10 @@ void finish(void)
 
     clear_to_end_of_screen(), candbaseline = -1;
     le_display_complete_cleanup();
+    free_candimages();
 
-    free(current_editline), current_editline = NULL;
-    free(cursor_positions), cursor_positions = NULL;
+    free_editline();
+    le_highlight_clear();
     free(rprompt.value);
     free(sprompt.value);
 
@@ -517,12 +634,15 @@ void finish(void)
 }
 
 /* Flushes the contents of the print buffer to the standard error and destroys
- * the buffer. */
+ * the buffer.
+ * The contents are written by a single system call if possible so that the
+ * terminal receives the whole update at once. */
 void le_display_flush(void)
 {
     current_position = lebuf.pos;
-    fwrite(lebuf.buf.contents, 1, lebuf.buf.length, stderr);
     fflush(stderr);
+    if (lebuf.buf.length > 0)
+        write_all(STDERR_FILENO, lebuf.buf.contents, lebuf.buf.length);
     sb_destroy(&lebuf.buf);
 }
 
@@ -661,16 +781,28 @@ void maybe_print_promptsp(void)
 }
 
 /* Prints the content of the edit line.
+ * Only the cells that differ from those currently displayed are reprinted.
  * The cursor may be anywhere when this function is called.
  * The cursor is left at an unspecified position when this function returns. */
 void update_editline(void)
 {
+    int columns = lebuf.maxcolumn;
     size_t index = 0;
+    int startline = 0;
+
+    /* The styles of characters may have changed before the first changed
+     * character. */
+    size_t hlindex = SIZE_MAX;
+    if (shopt_le_highlight)
+        hlindex = le_highlight_update(le_main_buffer.contents,
+                (le_main_length < le_main_buffer.length)
+                ? le_main_length : le_main_buffer.length);
 
     if (current_editline != NULL) {
         /* We only reprint what have been changed from the last update:
          * skip the unchanged part at the beginning of the line. */
         assert(cursor_positions != NULL);
+        assert(current_cells != NULL);
 
         while (current_editline[index] != L'\0' &&
                 current_display_is_uptodate(index))
@@ -680,59 +812,97 @@ void update_editline(void)
         if (current_editline[index] == L'\0'
                 && le_main_buffer.contents[index] == L'\0')
             return;
+        if (hlindex < index)
+            index = hlindex;
 
-        go_to_index(index);
-        if (current_editline[index] != L'\0')
-            clear_editline();
+        startline = cursor_positions[index] / columns - editbasepos.line;
     } else {
-        /* print the whole edit line */
-        go_to(editbasepos);
-        clear_editline();
+        /* We don't know what is displayed after the prompt. */
+        assert(current_cells == NULL);
+        current_cell_lines = (last_edit_line > editbasepos.line)
+            ? last_edit_line - editbasepos.line + 1 : 1;
+        current_cells = xmallocn(
+                (size_t) current_cell_lines * columns, sizeof *current_cells);
+        init_cells(current_cells, current_cell_lines * columns,
+                (lecell_T) { .c = L'\0', .style = CELL_UNKNOWN });
+        init_cells(current_cells, editbasepos.column,
+                (lecell_T) { .c = L'\0', .style = CELL_PROMPT });
     }
 
-    update_styler();
-
     // No need to check for overflow in `le_main_buffer.length + 1' here. Should
     // overflow occur, the buffer would not have been allocated successfully.
-    current_editline = xreallocn(current_editline,
-            le_main_buffer.length + 1, sizeof *current_editline);
-    cursor_positions = xreallocn(cursor_positions,
-            le_main_buffer.length + 1, sizeof *cursor_positions);
-    for (;;) {
-        wchar_t c = le_main_buffer.contents[index];
-        current_editline[index] = c;
-        cursor_positions[index]
-            = lebuf.pos.line * lebuf.maxcolumn + lebuf.pos.column;
-        if (index == le_main_buffer.length)
-            break;
-        if (styler_active && index >= le_main_length) {
-            lebuf_print_sgr0(), styler_active = false;
-            lebuf_print_prompt(prompt.predict);
-        }
-        lebuf_putwchar(c, true);
-        index++;
+    int *positions = xmallocn(le_main_buffer.length + 1, sizeof *positions);
+    make_cursor_positions(positions, index);
+
+    /* Guess how far the unchanged characters at the end of the edit line have
+     * moved so that we can shift them on the screen. */
+    int shift = 0;
+    if (current_editline != NULL) {
+        size_t oldi = wcslen(current_editline), newi = le_main_buffer.length;
+        while (oldi > index && newi > index && current_editline[oldi - 1]
+                == le_main_buffer.contents[newi - 1])
+            oldi--, newi--;
+        if (current_editline[oldi] != L'\0')
+            shift = positions[newi] - cursor_positions[oldi];
+    }
+
+    /* Make the cells to be displayed. The lines before `startline' are not
+     * changed. */
+    int newlines =
+        positions[le_main_buffer.length] / columns - editbasepos.line + 1;
+    int lines = (newlines > current_cell_lines) ? newlines : current_cell_lines;
+    int cellcount = lines * columns;
+    if (current_cell_lines < lines) {
+        current_cells = xreallocn(
+                current_cells, (size_t) cellcount, sizeof *current_cells);
+        init_cells(&current_cells[current_cell_lines * columns],
+                (lines - current_cell_lines) * columns,
+                (lecell_T) { .c = L'\0', .style = CELL_UNKNOWN });
     }
+    lecell_T *newcells = xmallocn((size_t) cellcount, sizeof *newcells);
+    memcpy(newcells, current_cells, startline * columns * sizeof *newcells);
+    init_cells(&newcells[startline * columns], (lines - startline) * columns,
+            BLANK_CELL);
+    if (startline == 0)
+        init_cells(newcells, editbasepos.column,
+                (lecell_T) { .c = L'\0', .style = CELL_PROMPT });
+    set_editline_cells(newcells, positions, index, startline);
+
+    /* erase the right prompt if it is to be moved */
+    if (rprompt_line >= 0 && rprompt_line !=
+            right_prompt_line(positions[le_main_buffer.length])) {
+        go_to((le_pos_T) { rprompt_line, right_prompt_column() });
+        reset_style_before_moving();
+        lebuf_print_el();
+        rprompt_line = -1;
+    }
+
+    for (int line = startline; line < lines; line++)
+        update_editline_line(newcells, cellcount, line, shift);
     lebuf_print_sgr0(), styler_active = false;
+    active_cell_style = CELL_NORMAL;
+    free(newcells);
 
+    current_cell_lines = newlines;
+    current_cells = xreallocn(current_cells,
+            (size_t) newlines * columns, sizeof *current_cells);
+    current_editline = xreallocn(current_editline,
+            le_main_buffer.length + 1, sizeof *current_editline);
+    wmemcpy(current_editline, le_main_buffer.contents,
+            le_main_buffer.length + 1);
+    free(cursor_positions);
+    cursor_positions = positions;
     current_length = le_main_length;
 
-    fillip_cursor();
-
-    last_edit_line =
-        (lebuf.pos.line >= rprompt_line) ? lebuf.pos.line : rprompt_line;
+    int lastline = editbasepos.line + newlines - 1;
+    last_edit_line = (lastline >= rprompt_line) ? lastline : rprompt_line;
 
-    /* clear the right prompt if the edit line reaches it. */
-    if (rprompt_line == lebuf.pos.line
-            && lebuf.pos.column > lebuf.maxcolumn - rprompt.width - 2) {
-        lebuf_print_el();
-        rprompt_line = -1;
-    } else if (rprompt_line < lebuf.pos.line) {
-        rprompt_line = -1;
+    /* Lines of the candidate area have been erased if the edit line has
+     * reached them. */
+    if (0 <= candbaseline && candbaseline <= lastline) {
+        candbaseline = lastline + 1;
+        candoverwritten = true;
     }
-
-    /* clear the remaining of the current line if we're overwriting the
-     * candidate area. */
-    check_cand_overwritten();
 }
 
 bool current_display_is_uptodate(size_t index)
@@ -745,6 +915,330 @@ bool current_display_is_uptodate(size_t index)
     return true;
 }
 
+/* Computes the positions of the characters in the main buffer on the screen.
+ * If the nth character is positioned at line `l', column `c', then
+ * positions[n] is set to l * le_columns + c.
+ * `positions' must have room for `le_main_buffer.length + 1' elements.
+ * The first `index' characters must be the same as those displayed, for which
+ * the positions are copied from `cursor_positions'. */
+void make_cursor_positions(int *positions, size_t index)
+{
+    struct lebuf_T save = lebuf;
+
+    if (cursor_positions != NULL) {
+        memcpy(positions, cursor_positions, index * sizeof *positions);
+        lebuf_init((le_pos_T) {
+                .line   = cursor_positions[index] / lebuf.maxcolumn,
+                .column = cursor_positions[index] % lebuf.maxcolumn });
+    } else {
+        assert(index == 0);
+        lebuf_init(editbasepos);
+    }
+
+    for (;;) {
+        positions[index] = lebuf.pos.line * lebuf.maxcolumn + lebuf.pos.column;
+        if (index == le_main_buffer.length)
+            break;
+        lebuf_putwchar(le_main_buffer.contents[index], true);
+        sb_clear(&lebuf.buf);
+        index++;
+    }
+
+    sb_destroy(&lebuf.buf);
+    lebuf = save;
+}
+
+/* Sets the first `count' elements of `cells' to `cell'. */
+void init_cells(lecell_T *cells, int count, lecell_T cell)
+{
+    for (int i = 0; i < count; i++)
+        cells[i] = cell;
+}
+
+/* Sets the cells of the characters of the main buffer that are displayed on
+ * or after line `startline' (counted from the line of `editbasepos').
+ * `positions' must be the result of `make_cursor_positions'.
+ * The characters before `index' are not displayed after line `startline'
+ * except the ones that are on the same line as the character of `index'. */
+void set_editline_cells(
+        lecell_T *cells, const int *positions, size_t index, int startline)
+{
+    int base = editbasepos.line * lebuf.maxcolumn;
+    int from = (editbasepos.line + startline) * lebuf.maxcolumn;
+
+    while (index > 0 && positions[index] > from)
+        index--;
+
+    size_t token = shopt_le_highlight ? le_highlight_find(index) : 0;
+    for (; index < le_main_buffer.length; index++) {
+        wchar_t c = le_main_buffer.contents[index];
+        int end = positions[index + 1];
+        int width = wcwidth(c);
+        if (width <= 0)
+            width = end - positions[index];
+        int style = CELL_PREDICT;
+        if (index < le_main_length) {
+            le_hlstyle_T hl = shopt_le_highlight
+                ? le_highlight_style(&token, index) : HL_NONE;
+            style = (hl == HL_NONE) ? CELL_NORMAL : CELL_HIGHLIGHT + (int) hl;
+        }
+        /* A wide character that does not fit in the end of a line is moved to
+         * the next line, so we count the cells backward from the end. */
+        for (int i = 0; i < width; i++) {
+            int p = end - width + i;
+            if (p >= from)
+                cells[p - base] = (lecell_T) {
+                    .c = c,
+                    .part = i,
+                    .style = style,
+                };
+        }
+    }
+}
+
+/* Updates a line of the edit line on the screen so that the cells in
+ * `current_cells' become the same as those in `newcells'.
+ * `cellcount' is the number of cells in `newcells' and `current_cells'.
+ * `line' is counted from the line of `editbasepos'.
+ * `shift' is the number of cells by which the unchanged characters at the end
+ * of the edit line have moved. */
+void update_editline_line(
+        const lecell_T *newcells, int cellcount, int line, int shift)
+{
+    int columns = lebuf.maxcolumn;
+    lecell_T *oldline = &current_cells[line * columns];
+    const lecell_T *newline = &newcells[line * columns];
+
+    int column = 0;
+    while (column < columns && cell_equals(&oldline[column], &newline[column]))
+        column++;
+    if (column == columns)
+        return;
+    while (column > 0 &&
+            (oldline[column].part > 0 || newline[column].part > 0))
+        column--;
+
+    /* The cells occupied by the right prompt are not in `current_cells'. We
+     * must not erase the right prompt if it remains on this line. */
+    int limit = (editbasepos.line + line == rprompt_line)
+        ? right_prompt_column() : columns;
+
+    int newend = content_end(newline, columns);
+    if (shift != 0 && limit == columns)
+        shift_cells(newcells, line, column, newend, shift);
+    update_cells(newcells, cellcount, line * columns + column,
+            line * columns + newend);
+
+    int oldend = content_end(oldline, limit);
+    if (oldend > newend) {
+        go_to((le_pos_T) { editbasepos.line + line, newend });
+        if (limit == columns) {
+            if (active_cell_style != CELL_NORMAL)
+                reset_cell_style();
+            reset_style_before_moving();
+            lebuf_print_el();
+            init_cells(&oldline[newend], columns - newend, BLANK_CELL);
+        } else {
+            reset_cell_style();
+            for (int i = newend; i < oldend; i++)
+                lebuf_putwchar(L' ', false);
+            init_cells(&oldline[newend], oldend - newend, BLANK_CELL);
+        }
+    }
+}
+
+/* Inserts or deletes characters at `column' on `line' of the edit line to
+ * shift the cells of the line by `shift' if the terminal supports it and it is
+ * expected to reduce the output.
+ * The cells up to `end' are to be updated to `newcells' after shifting. */
+void shift_cells(
+        const lecell_T *newcells, int line, int column, int end, int shift)
+{
+    int columns = lebuf.maxcolumn;
+    lecell_T *oldline = &current_cells[line * columns];
+    const lecell_T *newline = &newcells[line * columns];
+    int count = (shift > 0) ? shift : -shift;
+
+    /* Don't split a wide character. */
+    if (count >= columns - column || oldline[column].part > 0)
+        return;
+    if (oldline[shift > 0 ? columns - count : column + count].part > 0)
+        return;
+
+    lecell_T *shifted = xmallocn(columns, sizeof *shifted);
+    if (shift > 0) {
+        init_cells(&shifted[column], count, BLANK_CELL);
+        memcpy(&shifted[column + count], &oldline[column],
+                (columns - column - count) * sizeof *shifted);
+    } else {
+        memcpy(&shifted[column], &oldline[column + count],
+                (columns - column - count) * sizeof *shifted);
+        init_cells(&shifted[columns - count], count, BLANK_CELL);
+    }
+
+    if (update_cost(shifted, newline, column, end) + MOVE_COST
+            < update_cost(oldline, newline, column, end)) {
+        go_to((le_pos_T) { editbasepos.line + line, column });
+        if (active_cell_style != CELL_NORMAL)
+            reset_cell_style();
+        if (shift > 0 ? lebuf_print_ich(count) : lebuf_print_dch(count))
+            memcpy(&oldline[column], &shifted[column],
+                    (columns - column) * sizeof *oldline);
+    }
+
+    free(shifted);
+}
+
+/* Estimates the number of bytes needed to update the cells from
+ * `oldcells[from]' to `oldcells[to-1]' to those in `newcells'. */
+int update_cost(const lecell_T *oldcells, const lecell_T *newcells,
+        int from, int to)
+{
+    int cost = 0;
+
+    for (int i = from; i < to; ) {
+        if (cell_equals(&oldcells[i], &newcells[i])) {
+            i++;
+            continue;
+        }
+
+        int end = i + 1;
+        for (int j = end; j < to && j - end < MOVE_COST; j++)
+            if (!cell_equals(&oldcells[j], &newcells[j]))
+                end = j + 1;
+        cost += MOVE_COST + (end - i);
+        i = end;
+    }
+    return cost;
+}
+
+/* Reprints the cells from `current_cells[from]' to `current_cells[to-1]' that
+ * differ from those in `newcells'.
+ * `cellcount' is the number of cells in `newcells' and `current_cells'.
+ * Runs of unchanged cells shorter than `MOVE_COST' are reprinted together with
+ * the changed cells around them. */
+void update_cells(const lecell_T *newcells, int cellcount, int from, int to)
+{
+    int columns = lebuf.maxcolumn;
+
+    for (int i = from; i < to; ) {
+        if (cell_equals(&current_cells[i], &newcells[i])) {
+            i++;
+            continue;
+        }
+
+        int end = i + 1;
+        for (int j = end; j < to && j - end < MOVE_COST; j++)
+            if (!cell_equals(&current_cells[j], &newcells[j]))
+                end = j + 1;
+
+        /* print whole characters */
+        while (i > 0 && newcells[i].part > 0)
+            i--;
+        go_to((le_pos_T) { editbasepos.line + i / columns, i % columns });
+        while (i < end) {
+            const lecell_T *cell = &newcells[i];
+            int width = 1;
+            while (i + width < cellcount && newcells[i + width].part > 0)
+                width++;
+
+            if (cell->c != L'\0') {
+                set_cell_style(cell->style);
+                lebuf_putwchar(cell->c, true);
+            } else {
+                reset_cell_style();
+                lebuf_putwchar(L' ', false);
+            }
+            memcpy(&current_cells[i], cell, width * sizeof *cell);
+            i += width;
+
+            /* If we have reached the end of the line, we don't know whether
+             * the cursor is sticking to the end of the line or not. To make it
+             * sure, print the next character or erase the next line. */
+            if (i >= end && i % columns == 0 && i < cellcount) {
+                if (newcells[i].c != L'\0') {
+                    end = i + 1;
+                } else {
+                    reset_cell_style();
+                    lebuf_putwchar(L' ',  false);
+                    lebuf_putwchar(L'\r', false);
+                    lebuf_print_el();
+                    init_cells(&current_cells[i], columns, BLANK_CELL);
+                    if (rprompt_line == editbasepos.line + i / columns)
+                        rprompt_line = -1;
+                }
+            }
+        }
+    }
+}
+
+/* Changes the font setting of the terminal for printing cells of the specified
+ * style. */
+void set_cell_style(int style)
+{
+    switch (style) {
+        case CELL_NORMAL:
+            if (active_cell_style != CELL_NORMAL)
+                reset_cell_style();
+            update_styler();
+            break;
+        case CELL_PREDICT:
+            if (active_cell_style != CELL_PREDICT) {
+                reset_cell_style();
+                lebuf_print_prompt(prompt.predict);
+                active_cell_style = CELL_PREDICT;
+            }
+            break;
+        default:
+            assert(CELL_HIGHLIGHT < style
+                    && style < CELL_HIGHLIGHT + HL_STYLE_COUNT);
+            if (active_cell_style != style) {
+                /* The highlight style is applied on top of the styler. */
+                if (active_cell_style != CELL_NORMAL)
+                    reset_cell_style();
+                update_styler();
+                lebuf_print_prompt(highlight_styles[style - CELL_HIGHLIGHT]);
+                active_cell_style = style;
+            }
+            break;
+    }
+}
+
+/* Resets the font setting of the terminal if it has been changed by the styler
+ * prompt or for the style of cells. */
+void reset_cell_style(void)
+{
+    if (styler_active || active_cell_style != CELL_NORMAL) {
+        lebuf_print_sgr0(), styler_active = false;
+        active_cell_style = CELL_NORMAL;
+    }
+}
+
+/* Returns the index of the cell just after the last non-empty cell in the
+ * first `limit' cells of `cells'. */
+int content_end(const lecell_T *cells, int limit)
+{
+    while (limit > 0 && cell_equals(&cells[limit - 1], &BLANK_CELL))
+        limit--;
+    return limit;
+}
+
+/* Returns true iff the two cells have the same contents.
+ * A cell with unknown contents is not equal to any cell. */
+bool cell_equals(const lecell_T *c1, const lecell_T *c2)
+{
+    return c1->c == c2->c && c1->part == c2->part && c1->style == c2->style
+        && c1->style != CELL_UNKNOWN;
+}
+
+/* Frees the data that describe the edit line currently displayed. */
+void free_editline(void)
+{
+    free(current_editline), current_editline = NULL;
+    free(cursor_positions), cursor_positions = NULL;
+    free(current_cells), current_cells = NULL;
+}
+
 /* Sets the `candoverwritten' flag and clears to the end of line if the current
  * position is in the candidate area. */
 void check_cand_overwritten(void)
@@ -774,6 +1268,7 @@ void reset_style_before_moving(void)
     if (!le_ti_msgr) {
         lebuf_print_sgr0();
         styler_active = false;
+        active_cell_style = CELL_NORMAL;
     }
 }
 
@@ -785,27 +1280,50 @@ void update_right_prompt(void)
     int trim = (int)shopt_le_trimright;
     if (rprompt_line >= 0)
         return;
-    if (rprompt.width == 0)
-        return;
-    if (lebuf.maxcolumn - rprompt.width - 2 + trim < 0)
-        return;
-    int c = cursor_positions[le_main_buffer.length] % lebuf.maxcolumn;
-    bool has_enough_room = (c <= lebuf.maxcolumn - rprompt.width - 2 + trim);
-    if (!has_enough_room && !shopt_le_alwaysrp)
+    int line = right_prompt_line(cursor_positions[le_main_buffer.length]);
+    if (line < 0)
         return;
 
     go_to_index(le_main_buffer.length);
-    if (!has_enough_room) {
+    if (lebuf.pos.line < line) {
         lebuf_print_nel();
         check_cand_overwritten();
     }
-    lebuf_print_cuf(lebuf.maxcolumn - rprompt.width - lebuf.pos.column - 1 + trim);
+    lebuf_print_cuf(right_prompt_column() - lebuf.pos.column);
     sb_ncat_force(&lebuf.buf, rprompt.value, rprompt.length);
     lebuf.pos.column += rprompt.width - trim;
     last_edit_line = rprompt_line = lebuf.pos.line;
     styler_active = false;
 }
 
+/* Returns the number of the line on which the right prompt is to be displayed
+ * if the edit line ends at the specified position. (The position is given in
+ * the same form as the elements of `cursor_positions'.)
+ * Returns -1 if the right prompt is not to be displayed. */
+int right_prompt_line(int endposition)
+{
+    int trim = (int)shopt_le_trimright;
+    if (rprompt.width == 0)
+        return -1;
+    if (lebuf.maxcolumn - rprompt.width - 2 + trim < 0)
+        return -1;
+
+    int line = endposition / lebuf.maxcolumn;
+    int column = endposition % lebuf.maxcolumn;
+    if (column <= lebuf.maxcolumn - rprompt.width - 2 + trim)
+        return line;
+    else if (shopt_le_alwaysrp)
+        return line + 1;
+    else
+        return -1;
+}
+
+/* Returns the column where the right prompt starts. */
+int right_prompt_column(void)
+{
+    return lebuf.maxcolumn - rprompt.width - 1 + (int)shopt_le_trimright;
+}
+
 /* Prints the current search result and the search line.
  * The cursor may be anywhere when this function is called.
  * Characters after the prompt are cleared in this function.
@@ -814,8 +1332,7 @@ void print_search(void)
 {
     assert(le_search_buffer.contents != NULL);
 
-    free(current_editline), current_editline = NULL;
-    free(cursor_positions), cursor_positions = NULL;
+    free_editline();
 
     go_to(editbasepos);
     clear_editline();
@@ -827,6 +1344,7 @@ void print_search(void)
     reset_style_before_moving();
     lebuf_print_nel();
     clear_to_end_of_screen(), candbaseline = -1;
+    free_candimages();
 
     update_styler();
 
@@ -857,15 +1375,36 @@ void print_search(void)
 }
 
 /* Moves the cursor to the specified position.
- * The target column must be less than `lebuf.maxcolumn'. */
+ * The target column must be less than `lebuf.maxcolumn'.
+ * If the target line is below any line that has been displayed, newlines are
+ * printed to scroll the screen as needed. */
 void go_to(le_pos_T p)
 {
     if (line_max < lebuf.pos.line)
         line_max = lebuf.pos.line;
 
-    assert(p.line <= line_max);
     assert(p.column < lebuf.maxcolumn);
 
+    if (lebuf.pos.column >= lebuf.maxcolumn) {
+        /* The cursor is sticking to the end of the line. We must not use the
+         * "cub" capability in this state. */
+        reset_style_before_moving();
+        lebuf_print_cr();
+    }
+
+    if (p.line > line_max) {
+        if (lebuf.pos.line < line_max)
+            go_to((le_pos_T) { line_max, 0 });
+        else
+            reset_style_before_moving();
+        while (lebuf.pos.line < p.line)
+            lebuf_print_nel();
+        line_max = p.line;
+        if (p.column > 0)
+            lebuf_print_cuf(p.column);
+        return;
+    }
+
     if (p.line == lebuf.pos.line) {
         if (lebuf.pos.column == p.column)
             return;
@@ -1173,187 +1712,153 @@ void print_candidates_all(void)
 {
     lebuf_print_sgr0(), styler_active = false;
     go_to_after_editline();
-    clear_to_end_of_screen();
     assert(lebuf.pos.column == 0);
+    if (candoverwritten)
+        free_candimages();
     candoverwritten = false;
 
-    if (le_candidates.contents == NULL)
+    print_candidates(lebuf.pos.line);
+}
+
+/* Reprints the candidate area at the current position if the highlighted
+ * candidate has been changed.
+ * Before calling this function, the candidate area must have been printed by
+ * `print_candidates_all'.
+ * The cursor may be anywhere when this function is called and is left at an
+ * unspecified position when this function returns. */
+void update_highlighted_candidate(void)
+{
+    assert(candbaseline >= 0);
+    if (le_candidates.length == 0)
         return;
+    if (candhighlight == le_selected_candidate_index)
+        return;
+
+    lebuf_print_sgr0(), styler_active = false;
+    go_to((le_pos_T) { candbaseline, 0 });
+    print_candidates(candbaseline);
+}
+
+/* Prints the candidate area starting at line `baseline'.
+ * The cursor must be at the beginning of line `baseline' when this function is
+ * called. The cursor is left at an unspecified position when this function
+ * returns.
+ * The parts of the candidate area that are already displayed are not
+ * reprinted. */
+void print_candidates(int baseline)
+{
+    plist_T images;
+    struct lebuf_T save;
+    pl_init(&images);
+
+    if (le_candidates.contents == NULL)
+        goto done;
     if (le_candidates.length == 0) {
-        candbaseline = lebuf.pos.line;
+        candbaseline = baseline;
+        save = begin_candimage(baseline, 0);
         print_candidate_count_0();
-        return;
+        end_candimage(&images, baseline, 0, save);
+        goto done;
     }
     if (candpages.contents == NULL)
-        return;
+        goto done;
 
-    candbaseline = lebuf.pos.line;
+    candbaseline = baseline;
 
     size_t pageindex = le_selected_candidate_index < le_candidates.length
         ? page_of_col(col_of_cand(le_selected_candidate_index))
         : 0;
     const candpage_T *page = candpages.contents[pageindex];
     const candcol_T *firstcol = candcols.contents[page->colindex];
+    int line = baseline;
 
-    for (size_t rowi = 0, rowcount = firstcol->candcount; ; ) {
+    for (size_t rowi = 0; rowi < firstcol->candcount; rowi++, line++) {
         int scrcol = 0;
 
         for (size_t coli = 0; coli < page->colcount; coli++) {
             const candcol_T *col = candcols.contents[page->colindex + coli];
-            if (rowi >= col->candcount)
+            if (rowi >= col->candcount || scrcol >= lebuf.maxcolumn)
                 break;
 
-            while (lebuf.pos.column < scrcol)
-                lebuf_putchar1_trunc(' ');
-
+            /* The value and the description are printed separately so that
+             * changing the highlight reprints only the value. */
             size_t candindex = col->candindex + rowi;
-            print_candidate(le_candidates.contents[candindex], col,
-                    le_selected_candidate_index == candindex, true);
+            const le_candidate_T *cand = le_candidates.contents[candindex];
+            save = begin_candimage(line, scrcol);
+            print_candidate(cand, col,
+                    le_selected_candidate_index == candindex);
+            int desccol = lebuf.pos.column;
+            end_candimage(&images, line, scrcol, save);
+            if (cand->desc != NULL) {
+                save = begin_candimage(line, desccol);
+                print_candidate_desc(cand);
+                end_candimage(&images, line, desccol, save);
+            }
 
             scrcol += col->width;
         }
-
-        rowi++;
-        if (rowi >= rowcount)
-            break;
-        lebuf_print_nel();
     }
 
     if (candpages.length > 1) {  /* print status line */
-        lebuf_print_nel();
+        save = begin_candimage(line, 0);
         print_candidate_count(pageindex);
+        end_candimage(&images, line, 0, save);
     }
 
     candhighlight = le_selected_candidate_index;
+
+done:
+    show_candimages(&images, baseline);
 }
 
-/* Reprints the highlighted candidate.
- * The previously highlighted candidate is reprinted in the normal style and
- * the currently selected candidate is highlighted.
- * Before calling this function, the candidate area must have been printed by
- * `print_candidates_all'.
- * The cursor may be anywhere when this function is called and is left at an
- * unspecified position when this function returns. */
-void update_highlighted_candidate(void)
+/* Prints the specified candidate at the current cursor position.
+ * The candidate is highlighted iff `highlight' is true.
+ * The cursor is left just after the printed candidate. */
+void print_candidate(
+        const le_candidate_T *cand, const candcol_T *col, bool highlight)
 {
-    assert(candbaseline >= 0);
-    if (le_candidates.length == 0)
-        return;
-    if (candhighlight == le_selected_candidate_index)
-        return;
-
-    size_t oldpageindex, oldcolindex, newpageindex, newcolindex;
-
-    if (candhighlight < le_candidates.length) {
-        oldcolindex = col_of_cand(candhighlight);
-        oldpageindex = page_of_col(oldcolindex);
-    } else {
-        oldcolindex = 0;
-        oldpageindex = 0;
-    }
-    if (le_selected_candidate_index < le_candidates.length) {
-        newcolindex = col_of_cand(le_selected_candidate_index);
-        newpageindex = page_of_col(newcolindex);
+    int line = lebuf.pos.line;
+    int base = lebuf.pos.column;
+
+    if (highlight)
+        lebuf_print_bold();
+    lebuf_putchar1_trunc(highlight ? '[' : ' ');
+    if (lebuf.pos.column + cand->rawvalue.width < lebuf.maxcolumn) {
+        lebuf.pos.column += cand->rawvalue.width;
+        sb_cat(&lebuf.buf, cand->rawvalue.raw);
     } else {
-        newcolindex = 0;
-        newpageindex = 0;
-    }
-    if (oldpageindex != newpageindex) {
-        print_candidates_all();
-        return;
-    }
-
-    lebuf_print_sgr0(), styler_active = false;
-
-    const candpage_T *page = candpages.contents[newpageindex];
-    const candcol_T *col;
-    int column;
-    size_t rowindex;
-
-    /* de-highlight the previous selected candidate */
-    if (candhighlight < le_candidates.length) {
-        column = 0;
-        for (size_t i = page->colindex; i < oldcolindex; i++) {
-            col = candcols.contents[i];
-            column += col->width;
-        }
-        col = candcols.contents[oldcolindex];
-        rowindex = candhighlight - col->candindex;
-        go_to((le_pos_T) { .line = candbaseline + (int) rowindex,
-                           .column = column });
-        print_candidate(
-                le_candidates.contents[candhighlight], col, false, false);
-    }
-
-    /* highlight the current selected candidate */
-    candhighlight = le_selected_candidate_index;
-    if (candhighlight < le_candidates.length) {
-        column = 0;
-        for (size_t i = page->colindex; i < newcolindex; i++) {
-            col = candcols.contents[i];
-            column += col->width;
-        }
-        col = candcols.contents[newcolindex];
-        rowindex = candhighlight - col->candindex;
-        go_to((le_pos_T) { .line = candbaseline + (int) rowindex,
-                           .column = column });
-        print_candidate(
-                le_candidates.contents[candhighlight], col, true, false);
+        print_candidate_rawvalue(cand);
     }
+    while (lebuf.pos.column + 2 < lebuf.maxcolumn
+            && lebuf.pos.column - base < col->valuewidth - 1)
+        lebuf_putchar1_trunc(' ');
+    if (highlight)
+        lebuf_print_sgr0(), lebuf_print_bold();
+    lebuf_putchar1_trunc(highlight ? ']' : ' ');
+    if (highlight)
+        lebuf_print_sgr0();
 
-    /* print status line */
-    if (candpages.length > 1) {
-        col = candcols.contents[page->colindex];
-        go_to((le_pos_T) { .line = candbaseline + col->candcount,
-                           .column = 0 });
-        lebuf_print_el();
-        print_candidate_count(newpageindex);
-    }
+    assert(lebuf.pos.line == line);
 }
 
-/* Prints the specified candidate at the current cursor position.
- * The candidate is highlighted iff `highlight' is true.
- * Iff `printdesc' is true, the candidate's description is printed.
- * The cursor is left just after the printed candidate. */
-void print_candidate(const le_candidate_T *cand, const candcol_T *col,
-        bool highlight, bool printdesc)
+/* Prints the description of the specified candidate at the current cursor
+ * position.
+ * The cursor is left just after the printed description. */
+void print_candidate_desc(const le_candidate_T *cand)
 {
+#ifndef NDEBUG
     int line = lebuf.pos.line;
+#endif
 
-    /* print value */
-    if (true /* cand->value != NULL */) {
-        int base = lebuf.pos.column;
-        if (highlight)
-            lebuf_print_bold();
-        lebuf_putchar1_trunc(highlight ? '[' : ' ');
-        if (lebuf.pos.column + cand->rawvalue.width < lebuf.maxcolumn) {
-            lebuf.pos.column += cand->rawvalue.width;
-            sb_cat(&lebuf.buf, cand->rawvalue.raw);
-        } else {
-            print_candidate_rawvalue(cand);
-        }
-        while (lebuf.pos.column + 2 < lebuf.maxcolumn
-                && lebuf.pos.column - base < col->valuewidth - 1)
-            lebuf_putchar1_trunc(' ');
-        if (highlight)
-            lebuf_print_sgr0(), lebuf_print_bold();
-        lebuf_putchar1_trunc(highlight ? ']' : ' ');
-        if (highlight)
-            lebuf_print_sgr0();
-    }
-
-    /* print description */
-    if (printdesc && cand->desc != NULL) {
-        lebuf_putchar1_trunc(' ');
-        lebuf_putchar1_trunc('(');
-        if (lebuf.pos.column + cand->rawdesc.width < lebuf.maxcolumn) {
-            lebuf.pos.column += cand->rawdesc.width;
-            sb_cat(&lebuf.buf, cand->rawdesc.raw);
-        } else {
-            lebuf_putws_trunc(cand->desc);
-        }
-        lebuf_putchar1_trunc(')');
+    lebuf_putchar1_trunc(' ');
+    lebuf_putchar1_trunc('(');
+    if (lebuf.pos.column + cand->rawdesc.width < lebuf.maxcolumn) {
+        lebuf.pos.column += cand->rawdesc.width;
+        sb_cat(&lebuf.buf, cand->rawdesc.raw);
+    } else {
+        lebuf_putws_trunc(cand->desc);
     }
+    lebuf_putchar1_trunc(')');
 
     assert(lebuf.pos.line == line);
 }
@@ -1392,6 +1897,152 @@ void print_candidate_count_0(void)
     }
 }
 
+/* Saves the print buffer and initializes it to render a piece of text to be
+ * printed at the specified position of the candidate area.
+ * Returns the saved print buffer, which must be passed to `end_candimage'. */
+struct lebuf_T begin_candimage(int line, int column)
+{
+    struct lebuf_T save = lebuf;
+    lebuf_init((le_pos_T) { line, column });
+    return save;
+}
+
+/* Adds the text rendered in the print buffer to `images' and restores the
+ * print buffer to `save'.
+ * `line' and `column' must be the arguments given to `begin_candimage'.
+ * Nothing is added if the text is invisible. */
+void end_candimage(plist_T *images, int line, int column, struct lebuf_T save)
+{
+    assert(lebuf.pos.line == line);
+    if (lebuf.pos.column > column) {
+        candimage_T *image = xmalloc(sizeof *image);
+        image->line = line;
+        image->column = column;
+        image->endcolumn = lebuf.pos.column;
+        image->length = lebuf.buf.length;
+        image->value = sb_tostr(&lebuf.buf);
+        pl_add(images, image);
+    } else {
+        sb_destroy(&lebuf.buf);
+    }
+    lebuf = save;
+}
+
+/* Prints the pieces of text in `images' to the candidate area starting at line
+ * `baseline' and replaces `candimages' with them.
+ * If the candidate area currently displayed starts at the same line, only the
+ * pieces that differ from those displayed are printed. Otherwise, the whole
+ * candidate area is cleared and reprinted.
+ * The cursor must be at the beginning of line `baseline' when this function is
+ * called. The cursor is left at an unspecified position when this function
+ * returns. `images' is destroyed in this function. */
+void show_candimages(plist_T *images, int baseline)
+{
+    assert(lebuf.pos.line == baseline && lebuf.pos.column == 0);
+
+    if (candimages.contents == NULL || candimagebase != baseline) {
+        clear_to_end_of_screen();
+        free_candimages();
+        pl_init(&candimages);
+    }
+
+    void *const *oldimages = candimages.contents;
+    void *const *newimages = images->contents;
+    size_t oldcount = candimages.length, newcount = images->length;
+    size_t oi = 0, ni = 0;
+
+    while (ni < newcount) {
+        const candimage_T *newimage = newimages[ni];
+        int line = newimage->line;
+
+        /* erase the lines that no longer have text */
+        while (oi < oldcount) {
+            const candimage_T *oldimage = oldimages[oi];
+            if (oldimage->line >= line)
+                break;
+            go_to((le_pos_T) { oldimage->line, 0 });
+            lebuf_print_el();
+            while (++oi < oldcount
+                    && ((candimage_T *) oldimages[oi])->line == oldimage->line);
+        }
+
+        size_t oj = oi, nj = ni;
+        while (oj < oldcount && ((candimage_T *) oldimages[oj])->line == line)
+            oj++;
+        while (nj < newcount && ((candimage_T *) newimages[nj])->line == line)
+            nj++;
+        update_candimage_line(&oldimages[oi], oj - oi, &newimages[ni], nj - ni);
+        oi = oj, ni = nj;
+    }
+    if (oi < oldcount) {
+        /* erase the rest of the old candidate area */
+        go_to((le_pos_T) { ((candimage_T *) oldimages[oi])->line, 0 });
+        clear_to_end_of_screen();
+    }
+
+    free_candimages();
+    candimages = *images;
+    candimagebase = baseline;
+}
+
+/* Updates a line of the candidate area displaying the pieces of text in
+ * `oldimages' to display those in `newimages'. */
+void update_candimage_line(void *const *oldimages, size_t oldcount,
+        void *const *newimages, size_t newcount)
+{
+    bool samelayout = (oldcount == newcount);
+    for (size_t i = 0; samelayout && i < newcount; i++) {
+        const candimage_T *oldimage = oldimages[i], *newimage = newimages[i];
+        samelayout = (oldimage->column == newimage->column);
+    }
+
+    if (!samelayout && oldcount > 0) {
+        const candimage_T *oldimage = oldimages[0];
+        go_to((le_pos_T) { oldimage->line, 0 });
+        lebuf_print_el();
+    }
+
+    for (size_t i = 0; i < newcount; i++) {
+        const candimage_T *newimage = newimages[i];
+        const candimage_T *oldimage = samelayout ? oldimages[i] : NULL;
+        if (oldimage != NULL && oldimage->endcolumn == newimage->endcolumn
+                && oldimage->length == newimage->length
+                && memcmp(oldimage->value, newimage->value,
+                    newimage->length) == 0)
+            continue;
+
+        go_to((le_pos_T) { newimage->line, newimage->column });
+        sb_ncat_force(&lebuf.buf, newimage->value, newimage->length);
+        lebuf.pos.column = newimage->endcolumn;
+
+        if (oldimage != NULL && oldimage->endcolumn > newimage->endcolumn) {
+            if (i + 1 == newcount)
+                lebuf_print_el();
+            else
+                while (lebuf.pos.column < oldimage->endcolumn)
+                    lebuf_putchar1_trunc(' ');
+        }
+    }
+}
+
+/* Frees `candimages' and makes it inactive. */
+void free_candimages(void)
+{
+    if (candimages.contents != NULL) {
+        plfree(pl_toary(&candimages), free_candimage);
+        candimages.contents = NULL;
+    }
+}
+
+/* Frees a piece of text in the candidate area.
+ * The argument must point to a `candimage_T' value. */
+void free_candimage(void *candimage)
+{
+    candimage_T *i = candimage;
+    free(i->value);
+    free(i);
+}
+
 /* Returns the index of the column to which the candidate of index `candindex'
  * belongs. Column list `candcols' must not be empty. */
 size_t col_of_cand(size_t candindex)
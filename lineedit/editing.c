@@ -196,14 +196,44 @@ static size_t last_put_elem = 0;  /* < KILL_RING_SIZE */
 /* The position and length of the last put string. */
 static size_t last_put_range_start, last_put_range_length;
 
+/* The text being inserted by `insert_pasted_text'. */
+static struct {
+    const wchar_t *text;
+    size_t length;
+} pasted = { NULL, 0, };
+
 /* Set to true if the next completion command should restart completion from
  * scratch. */
 static bool reset_completion;
 /* The next value of `reset_completion'. */
 static bool next_reset_completion;
 
-/* Probability distribution tree for command prediction. */
-static trie_T *prediction_tree = NULL;
+/* The model for command prediction, that is, probability distributions of
+ * commands based on the recent history entries. The model is built when first
+ * used and then kept up to date as history entries are added and removed so
+ * that it need not be rebuilt for each prompt.
+ * The model contains a contiguous run of the newest history entries, which are
+ * called samples. Each sample has a weight that is larger than that of the
+ * previous sample by the factor of 1 / PREDICTION_DECAY, so older entries are
+ * considered less probable. `tree' is the distribution of commands and
+ * `contexttree' is that of pairs of successive commands, where the key is the
+ * previous command and the command joined by a newline. The oldest sample is
+ * not included in `contexttree' since its previous command is not a sample.
+ * When an entry other than the oldest or newest sample is removed from the
+ * history, its slot in `samples' is left with a null `entry' pointer, which we
+ * call a tombstone, and the samples around it are regarded as successive. The
+ * first and last slots are never tombstones. */
+struct predsample_T {
+    const histentry_T *entry;
+    double weight;
+};
+static struct {
+    bool active;
+    trie_T *tree, *contexttree;
+    double nextweight;               /* the weight of the next new sample */
+    struct predsample_T *samples;    /* ring buffer of MAX_PREDICTION_SAMPLE */
+    size_t head, count;
+} prediction = { .active = false, };
 
 
 static void reset_state(void);
@@ -292,13 +322,32 @@ static size_t find_nth_occurence(wchar_t c, int n);
 static void put_killed_string(bool after_cursor, bool cursor_on_last_char);
 static void insert_killed_string(
         bool after_cursor, bool cursor_on_last_char, size_t index);
+static void insert_pasted_text(wchar_t c);
 static void cancel_undo(int offset);
 
 static void check_reset_completion(void);
 
-static void create_prediction_tree(void);
-static size_t count_matching_previous_commands(const histentry_T *e1)
+static void activate_prediction(void);
+static void deactivate_prediction(void);
+static struct predsample_T *prediction_sample(size_t index)
+    __attribute__((pure));
+static void push_prediction_sample(const histentry_T *e)
+    __attribute__((nonnull));
+static void pop_oldest_prediction_sample(void);
+static void pop_newest_prediction_sample(void);
+static void remove_prediction_sample(size_t index);
+static size_t prev_prediction_sample(size_t index)
+    __attribute__((pure));
+static size_t next_prediction_sample(size_t index)
+    __attribute__((pure));
+static bool is_prediction_sample(const histentry_T *e)
     __attribute__((nonnull,pure));
+static void update_prediction_tree(trie_T **treep,
+        const histentry_T *prev, const histentry_T *e, double weight)
+    __attribute__((nonnull(1,3)));
+static void rescale_prediction(void);
+static wchar_t *predict(const wchar_t *typed)
+    __attribute__((nonnull,malloc,warn_unused_result));
 static void clear_prediction(void);
 static void update_buffer_with_prediction(void);
 
@@ -327,6 +376,9 @@ static void update_search(void);
 static void perform_search(const wchar_t *pattern,
         enum le_search_direction_T dir, enum le_search_type_T type)
     __attribute__((nonnull));
+static const histlink_T *perform_fuzzy_search(
+        const wchar_t *query, enum le_search_direction_T dir)
+    __attribute__((nonnull));
 static void search_again(enum le_search_direction_T dir);
 static void beginning_search(enum le_search_direction_T dir);
 static inline bool beginning_search_check_go_to_history(const wchar_t *prefix)
@@ -368,8 +420,10 @@ void le_editing_init(void)
     set_overwriting(false);
 
     if (shopt_le_predict) {
-        create_prediction_tree();
+        activate_prediction();
         update_buffer_with_prediction();
+    } else {
+        deactivate_prediction();
     }
 }
 
@@ -381,13 +435,12 @@ wchar_t *le_editing_finalize(void)
 
     plfree(pl_toary(&undo_history), free);
 
-    le_complete_cleanup();
+    le_complete_forget();
 
     end_using_history();
     free(main_history_value);
 
     clear_prediction();
-    trie_destroy(prediction_tree), prediction_tree = NULL;
     wb_wccat(&le_main_buffer, L'\n');
     return wb_towcs(&le_main_buffer);
 }
@@ -426,6 +479,33 @@ void le_invoke_command(le_command_func_T *cmd, wchar_t arg)
             le_main_index--;
 }
 
+/* Inserts the specified text pasted from the terminal.
+ * In the vi and emacs editing modes, the whole text is inserted into the main
+ * buffer at once so that characters in the text never invoke commands bound to
+ * them. In the other modes, each character is passed to the default command of
+ * the mode. */
+void le_insert_pasted_text(const wchar_t *s, size_t n)
+{
+    switch (LE_CURRENT_MODE) {
+        case LE_MODE_VI_INSERT:
+        case LE_MODE_VI_COMMAND:
+        case LE_MODE_EMACS:
+            pasted.text = s;
+            pasted.length = n;
+            le_invoke_command(insert_pasted_text, L'\0');
+            pasted.text = NULL;
+            pasted.length = 0;
+            break;
+        default:
+            for (size_t i = 0; i < n; i++) {
+                le_invoke_command(le_current_mode->default_command, s[i]);
+                if (le_editstate != LE_EDITSTATE_EDITING)
+                    break;
+            }
+            break;
+    }
+}
+
 /* Resets `state'. */
 void reset_state(void)
 {
@@ -2181,6 +2261,21 @@ void insert_killed_string(
     reset_state();
 }
 
+/* Inserts the text pasted from the terminal (`pasted') at the current cursor
+ * position. The cursor is left after the inserted text. */
+void insert_pasted_text(wchar_t c __attribute__((unused)))
+{
+    ALERT_AND_RETURN_IF_PENDING;
+    if (pasted.length == 0)
+        return;
+    maybe_save_undo_history();
+    clear_prediction();
+
+    wb_ninsert_force(&le_main_buffer, le_main_index, pasted.text, pasted.length);
+    le_main_index += pasted.length;
+    reset_state();
+}
+
 /* Replaces the string just inserted by `cmd_put_left' with the previously
  * killed string. */
 void cmd_put_pop(wchar_t c __attribute__((unused)))
@@ -2509,51 +2604,279 @@ void check_reset_completion(void)
 #define MAX_PREDICTION_SAMPLE 10000
 #endif /* ifndef MAX_PREDICTION_SAMPLE */
 
-/* Create a probability distribution tree for command prediction based on the
- * current history. The result is set to `prediction_tree'. */
-void create_prediction_tree(void)
-{
-    trie_T *t = trie_create();
-#define N 4
-    size_t hits[N] = {0};
-    for (const histlink_T *l = Histlist; (l = l->prev) != Histlist; ) {
-        const histentry_T *e = (const histentry_T *) l;
-        size_t k = count_matching_previous_commands(e);
-        assert(k < N);
-        for (size_t i = 0; i <= k; i++)
-            hits[i]++;
-        if (hits[0] >= MAX_PREDICTION_SAMPLE)
-            break;
+/* The weight of a sample in the prediction model relative to that of the next
+ * newer sample. */
+#define PREDICTION_DECAY 0.99
+/* When the weight of new samples reaches this value, all the weights are scaled
+ * down so that they do not overflow. */
+#define PREDICTION_WEIGHT_LIMIT 1e100
+/* Nodes of the prediction trees are removed when their probability falls below
+ * the weight of new samples multiplied by this value. */
+#define PREDICTION_MIN_RATIO 1e-12
 
-        wchar_t *cmd = malloc_mbstowcs(e->value);
-        if (cmd == NULL)
-            continue;
-        t = trie_add_probability(t, cmd, 1.0 / (hits[k] + 1));
-        free(cmd);
+/* Builds the prediction model from the current history if not yet built. */
+void activate_prediction(void)
+{
+    if (prediction.active)
+        return;
+
+    prediction.active = true;
+    prediction.tree = trie_create();
+    prediction.contexttree = trie_create();
+    prediction.nextweight = 1.0;
+    prediction.samples =
+        xmallocn(MAX_PREDICTION_SAMPLE, sizeof *prediction.samples);
+    prediction.head = prediction.count = 0;
+
+    const histlink_T *l = histlist.Newest;
+    if (l == Histlist)
+        return;
+    for (size_t n = 1; n < MAX_PREDICTION_SAMPLE && l->prev != Histlist; n++)
+        l = l->prev;
+    for (; l != Histlist; l = l->next)
+        push_prediction_sample(ashistentry(l));
+}
+
+/* Frees the prediction model if built. */
+void deactivate_prediction(void)
+{
+    if (!prediction.active)
+        return;
+
+    prediction.active = false;
+    trie_destroy(prediction.tree);
+    trie_destroy(prediction.contexttree);
+    free(prediction.samples);
+}
+
+/* Returns the `index'th oldest sample in the prediction model. */
+struct predsample_T *prediction_sample(size_t index)
+{
+    assert(index < MAX_PREDICTION_SAMPLE);
+    index += prediction.head;
+    if (index >= MAX_PREDICTION_SAMPLE)
+        index -= MAX_PREDICTION_SAMPLE;
+    return &prediction.samples[index];
+}
+
+/* Adds the specified entry, which must be the entry next to the newest sample,
+ * to the prediction model. If the model is full, the oldest sample is removed
+ * from the model. */
+void push_prediction_sample(const histentry_T *e)
+{
+    if (prediction.count == MAX_PREDICTION_SAMPLE)
+        pop_oldest_prediction_sample();
+    if (prediction.nextweight >= PREDICTION_WEIGHT_LIMIT)
+        rescale_prediction();
+
+    struct predsample_T *s = prediction_sample(prediction.count++);
+    s->entry = e;
+    s->weight = prediction.nextweight;
+    prediction.nextweight /= PREDICTION_DECAY;
+
+    update_prediction_tree(&prediction.tree, NULL, e, s->weight);
+    if (prediction.count > 1)
+        update_prediction_tree(&prediction.contexttree,
+                prediction_sample(prediction.count - 2)->entry, e, s->weight);
+}
+
+/* Removes the oldest sample from the prediction model. */
+void pop_oldest_prediction_sample(void)
+{
+    assert(prediction.count > 0);
+
+    const struct predsample_T *s = prediction_sample(0);
+    update_prediction_tree(&prediction.tree, NULL, s->entry, -s->weight);
+    if (prediction.count > 1) {
+        /* The next sample is no longer preceded by a sample. */
+        const struct predsample_T *next =
+            prediction_sample(next_prediction_sample(0));
+        update_prediction_tree(&prediction.contexttree,
+                s->entry, next->entry, -next->weight);
     }
 
-    prediction_tree = t;
+    do {
+        if (++prediction.head == MAX_PREDICTION_SAMPLE)
+            prediction.head = 0;
+        prediction.count--;
+    } while (prediction.count > 0 && prediction_sample(0)->entry == NULL);
 }
 
-// Counts N-1 at most
-size_t count_matching_previous_commands(const histentry_T *e)
+/* Removes the newest sample from the prediction model. */
+void pop_newest_prediction_sample(void)
 {
-    size_t count = 0;
-    const histlink_T *l1 = &e->link, *l2 = Histlist;
-    while ((l1 = l1->prev) != Histlist) {
-        l2 = l2->prev;
+    assert(prediction.count > 0);
 
-        const histentry_T *e1 = (const histentry_T *) l1;
-        const histentry_T *e2 = (const histentry_T *) l2;
-        if (strcmp(e1->value, e2->value) != 0)
-            break;
-        count++;
-        if (count >= N - 1)
-            break;
+    const struct predsample_T *s = prediction_sample(prediction.count - 1);
+    update_prediction_tree(&prediction.tree, NULL, s->entry, -s->weight);
+    if (prediction.count > 1)
+        update_prediction_tree(&prediction.contexttree,
+                prediction_sample(prev_prediction_sample(prediction.count - 1))
+                    ->entry,
+                s->entry, -s->weight);
+
+    do
+        prediction.count--;
+    while (prediction.count > 0
+            && prediction_sample(prediction.count - 1)->entry == NULL);
+}
+
+/* Removes the `index'th oldest sample, which must be neither the oldest nor the
+ * newest, from the prediction model, leaving a tombstone. The pair of the
+ * samples around it is added to `contexttree' instead of the pairs including
+ * the removed sample. */
+void remove_prediction_sample(size_t index)
+{
+    assert(0 < index && index < prediction.count - 1);
+
+    struct predsample_T *s = prediction_sample(index);
+    const histentry_T *prev = prediction_sample(prev_prediction_sample(index))
+        ->entry;
+    const struct predsample_T *next =
+        prediction_sample(next_prediction_sample(index));
+    update_prediction_tree(&prediction.tree, NULL, s->entry, -s->weight);
+    update_prediction_tree(&prediction.contexttree,
+            prev, s->entry, -s->weight);
+    update_prediction_tree(&prediction.contexttree,
+            s->entry, next->entry, -next->weight);
+    update_prediction_tree(&prediction.contexttree,
+            prev, next->entry, next->weight);
+
+    s->entry = NULL;
+}
+
+/* Returns the index of the nearest sample that is older than the `index'th
+ * oldest sample and is not a tombstone. */
+size_t prev_prediction_sample(size_t index)
+{
+    do
+        assert(index > 0);
+    while (prediction_sample(--index)->entry == NULL);
+    return index;
+}
+
+/* Returns the index of the nearest sample that is newer than the `index'th
+ * oldest sample and is not a tombstone. */
+size_t next_prediction_sample(size_t index)
+{
+    do
+        assert(index + 1 < prediction.count);
+    while (prediction_sample(++index)->entry == NULL);
+    return index;
+}
+
+/* Returns true iff the specified history entry is not older than the oldest
+ * sample. Since the newest history entry is always the newest sample, such an
+ * entry is a sample (unless it has been removed). */
+bool is_prediction_sample(const histentry_T *e)
+{
+    unsigned oldest = prediction_sample(0)->entry->number;
+    unsigned newest = prediction_sample(prediction.count - 1)->entry->number;
+    if (oldest <= newest)
+        return oldest <= e->number && e->number <= newest;
+    else
+        return oldest <= e->number || e->number <= newest;
+}
+
+/* Adds `weight' to the probability of the command of `e' in the prediction
+ * tree `*treep'. If `prev' is non-NULL, the key is the command of `prev' and
+ * that of `e' joined by a newline. A negative weight decreases the
+ * probability. */
+void update_prediction_tree(trie_T **treep,
+        const histentry_T *prev, const histentry_T *e, double weight)
+{
+    xwcsbuf_T key;
+    wb_init(&key);
+    if (prev != NULL) {
+        if (wb_mbscat(&key, prev->value) != NULL)
+            goto done;
+        wb_wccat(&key, L'\n');
+    }
+    if (wb_mbscat(&key, e->value) != NULL)
+        goto done;
+
+    if (weight >= 0)
+        *treep = trie_add_probability(*treep, key.contents, weight);
+    else
+        *treep = trie_subtract_probability(*treep, key.contents, -weight,
+                prediction.nextweight * PREDICTION_MIN_RATIO);
+done:
+    wb_destroy(&key);
+}
+
+/* Scales down the weights in the prediction model by PREDICTION_WEIGHT_LIMIT.
+ */
+void rescale_prediction(void)
+{
+    double factor = 1.0 / PREDICTION_WEIGHT_LIMIT;
+    trie_scale_probability(prediction.tree, factor);
+    trie_scale_probability(prediction.contexttree, factor);
+    for (size_t i = 0; i < prediction.count; i++)
+        prediction_sample(i)->weight *= factor;
+    prediction.nextweight *= factor;
+}
+
+/* Returns the most probable command fragment that follows `typed' as a
+ * newly-malloced wide string. The fragment that follows the newest command in
+ * the history is preferred if any. */
+wchar_t *predict(const wchar_t *typed)
+{
+    if (prediction.count > 1) {
+        xwcsbuf_T key;
+        wb_init(&key);
+        if (wb_mbscat(&key, prediction_sample(prediction.count - 1)
+                    ->entry->value) == NULL) {
+            wb_wccat(&key, L'\n');
+            wb_cat(&key, typed);
+            wchar_t *suffix = trie_probable_key(
+                    prediction.contexttree, key.contents);
+            if (suffix[0] != L'\0') {
+                wb_destroy(&key);
+                return suffix;
+            }
+            free(suffix);
+        }
+        wb_destroy(&key);
     }
-    return count;
+    return trie_probable_key(prediction.tree, typed);
+}
+
+/* Updates the prediction model for the specified history entry, which has just
+ * been added as the newest entry. */
+void le_prediction_add_entry(const histentry_T *e)
+{
+    if (prediction.active)
+        push_prediction_sample(e);
+}
+
+/* Updates the prediction model for the specified history entry, which is about
+ * to be removed from the history. Entries older than any samples are ignored. */
+void le_prediction_remove_entry(const histentry_T *e)
+{
+    if (!prediction.active || prediction.count == 0 || !is_prediction_sample(e))
+        return;
+
+    if (e == prediction_sample(0)->entry) {
+        pop_oldest_prediction_sample();
+    } else if (e == prediction_sample(prediction.count - 1)->entry) {
+        pop_newest_prediction_sample();
+    } else {
+        /* Removed entries are usually near the newest, so search backward. */
+        size_t index = prediction.count - 2;
+        while (prediction_sample(index)->entry != e) {
+            assert(index > 1);
+            index--;
+        }
+        remove_prediction_sample(index);
+    }
+}
+
+/* Drops the prediction model. This function must be called when all the history
+ * entries are removed. */
+void le_prediction_reset(void)
+{
+    deactivate_prediction();
 }
-#undef N
 
 /* Clears the second part of `le_main_buffer'.
  * Commands that modify the buffer usually need to call this function. However,
@@ -2581,8 +2904,7 @@ void update_buffer_with_prediction(void)
 
     le_main_length = le_main_buffer.length;
 
-    wchar_t *suffix = trie_probable_key(
-            prediction_tree, le_main_buffer.contents);
+    wchar_t *suffix = predict(le_main_buffer.contents);
     wb_catfree(&le_main_buffer, suffix);
 }
 
@@ -3490,20 +3812,10 @@ void cmd_prev_history_eol(wchar_t c __attribute__((unused)))
  * See `go_to_history' for the meaning of `curpos'. */
 void go_to_history_relative(int offset, enum le_search_type_T curpos)
 {
-    const histlink_T *l = main_history_entry;
-    if (offset > 0) {
-        do {
-            if (l == Histlist)
-                goto alert;
-            l = l->next;
-        } while (--offset > 0);
-    } else if (offset < 0) {
-        do {
-            l = l->prev;
-            if (l == Histlist)
-                goto alert;
-        } while (++offset < 0);
-    }
+    const histlink_T *l =
+        get_history_entry_relative(main_history_entry, offset);
+    if (l == NULL)
+        goto alert;
     go_to_history(l, curpos);
     reset_state();
     return;
@@ -3727,6 +4039,7 @@ void perform_search(const wchar_t *pattern,
 {
     const histlink_T *l = main_history_entry;
     xfnmatch_T *xfnm;
+    const wchar_t *literal = L"";
 
     if (dir == FORWARD && l == Histlist)
         goto done;
@@ -3736,6 +4049,7 @@ void perform_search(const wchar_t *pattern,
             wchar_t *p = escape(pattern, NULL);
             xfnm = xfnm_compile(p, XFNM_HEADONLY);
             free(p);
+            literal = pattern;
             break;
         }
         case SEARCH_VI: {
@@ -3749,12 +4063,19 @@ void perform_search(const wchar_t *pattern,
                 }
             }
             xfnm = xfnm_compile(pattern, flags);
+            if (!is_matching_pattern(pattern) && wcschr(pattern, L'\\') == NULL)
+                literal = pattern;
             break;
         }
         case SEARCH_EMACS: {
+            if (shopt_le_fuzzy) {
+                l = perform_fuzzy_search(pattern, dir);
+                goto done;
+            }
             wchar_t *p = escape(pattern, NULL);
             xfnm = xfnm_compile(p, 0);
             free(p);
+            literal = pattern;
             break;
         }
         default:
@@ -3765,21 +4086,68 @@ void perform_search(const wchar_t *pattern,
         goto done;
     }
 
+    /* The history's substring search index narrows down the entries that
+     * possibly match when the pattern is a literal string. */
+    char *mbsliteral = malloc_wcstombs(literal);
     for (;;) {
-        switch (dir) {
-            case FORWARD:   l = l->next;  break;
-            case BACKWARD:  l = l->prev;  break;
-        }
+        l = find_history_candidate(
+                l, mbsliteral != NULL ? mbsliteral : "", dir == FORWARD);
         if (l == Histlist)
             break;
         if (xfnm_match(xfnm, ashistentry(l)->value) == 0)
             break;
     }
+    free(mbsliteral);
     xfnm_free(xfnm);
 done:
     le_search_result = l;
 }
 
+/* Performs history search by fuzzy matching and returns the result.
+ * The history entries that match `query' are ranked by the matching score,
+ * entries with the same score ranked by recency. The result is the entry
+ * ranked next to the current entry (`main_history_entry') in the specified
+ * direction, where BACKWARD means lower rank. If the current entry does not
+ * match `query', a BACKWARD search returns the best match. */
+const histlink_T *perform_fuzzy_search(
+        const wchar_t *query, enum le_search_direction_T dir)
+{
+    const histlink_T *cur = main_history_entry;
+    int curscore = -1;
+    if (cur != Histlist)
+        curscore = le_fuzzy_mbscore(query, ashistentry(cur)->value);
+    if (curscore < 0)
+        curscore = INT_MAX;
+
+    /* Scan the entries from the newest to the oldest. */
+    const histlink_T *result = Histlist;
+    int resultscore = -1;
+    bool older = false;
+    for (const histlink_T *l = Histlist->prev; l != Histlist; l = l->prev) {
+        if (l == cur) {
+            older = true;
+            continue;
+        }
+
+        int score = le_fuzzy_mbscore(query, ashistentry(l)->value);
+        if (score < 0)
+            continue;
+        switch (dir) {
+            case BACKWARD:
+                if (score < curscore || (score == curscore && older))
+                    if (score > resultscore)
+                        result = l, resultscore = score;
+                break;
+            case FORWARD:
+                if (score > curscore || (score == curscore && !older))
+                    if (resultscore < 0 || score <= resultscore)
+                        result = l, resultscore = score;
+                break;
+        }
+    }
+    return result;
+}
+
 /* Redoes the last search. */
 void cmd_search_again(wchar_t c __attribute__((unused)))
 {
@@ -42,6 +42,15 @@ extern wchar_t *le_editing_finalize(void)
     __attribute__((malloc,warn_unused_result));
 extern void le_invoke_command(le_command_func_T *cmd, wchar_t arg)
     __attribute__((nonnull));
+extern void le_insert_pasted_text(const wchar_t *s, size_t n)
+    __attribute__((nonnull));
+
+struct histentry_T;
+extern void le_prediction_add_entry(const struct histentry_T *e)
+    __attribute__((nonnull));
+extern void le_prediction_remove_entry(const struct histentry_T *e)
+    __attribute__((nonnull));
+extern void le_prediction_reset(void);
 
 
 /********** Commands **********/
@@ -0,0 +1,805 @@
+/* Yash: yet another shell */
+/* highlight.c: syntax highlighting for line-editing */
+/* (C) 2026 magicant */
+
+/* This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#include "../common.h"
+#include "highlight.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+#include "../strbuf.h"
+#include "../util.h"
+
+
+/* This module splits the edit line into tokens and determines the style of
+ * each token for syntax highlighting. The lexer is not a full parser: it only
+ * recognizes quotations, expansions, operators, comments, command names and
+ * reserved words, which is enough for highlighting.
+ *
+ * The tokens are lexed incrementally so that highlighting a long edit line
+ * does not slow down editing. Each token remembers the state of the lexer at
+ * its start. When the edit line is modified, lexing resumes from the token
+ * that contains the first modified character. Once the lexer has passed the
+ * modified part and reaches the start of an old token in the same state as
+ * before, the rest of the old tokens are reused. */
+
+
+/* The maximum depth of nested contexts the lexer keeps track of. Contexts
+ * nested deeper than this are not tracked and may be highlighted wrongly. */
+#define HL_MAXDEPTH 14
+
+/* contexts in which the lexer works */
+enum hlcontext_T {
+    CTX_COMMAND,     /* commands at the top level */
+    CTX_PAREN,       /* commands in a subshell or process redirection */
+    CTX_CMDSUB,      /* commands in a command substitution "$(...)" */
+    CTX_BACKQUOTE,   /* commands in a command substitution "`...`" */
+    CTX_DQUOTE,      /* double-quoted text */
+    CTX_PARAM,       /* parameter expansion "${...}" */
+    CTX_ARITH,       /* arithmetic expansion "$((...))" */
+    CTX_ARITHPAREN,  /* parentheses in an arithmetic expansion */
+};
+
+/* flags of the lexer state, which are meaningful in command contexts */
+#define HLF_CMDPOS  (1 << 0)  /* the next word is a command name */
+#define HLF_REDIR   (1 << 1)  /* the next word is the operand of redirection */
+#define HLF_NAME    (1 << 2)  /* the next word is a name after a keyword */
+#define HLF_WANTIN  (1 << 3)  /* "in" or "do" may follow the name */
+#define HLF_INWORD  (1 << 4)  /* the lexer is in the middle of a word */
+#define HLF_CMDWORD (1 << 5)  /* the current word is a command name */
+#define HLF_CASE    (1 << 6)  /* the name is the subject of a case command */
+#define HLF_PATTERN (1 << 7)  /* the next word is a pattern of a case command */
+
+/* The state of the lexer.
+ * Unused elements of `nest' are always zero so that states can be compared by
+ * `memcmp'. */
+typedef struct hlstate_T {
+    unsigned char depth;  /* number of elements used in `nest' */
+    unsigned char flags;  /* flags for the current context */
+    struct {
+        unsigned char context;     /* nested context */
+        unsigned char outerflags;  /* flags for the context outside */
+    } nest[HL_MAXDEPTH];
+} hlstate_T;
+
+/* A token of the edit line. */
+typedef struct hltoken_T {
+    size_t start;          /* index of the first character */
+    hlstate_T state;       /* state of the lexer at `start' */
+    unsigned char style;   /* style of the token (le_hlstyle_T) */
+} hltoken_T;
+
+
+static inline enum hlcontext_T current_context(const hlstate_T *st)
+    __attribute__((nonnull,pure));
+static void push_context(hlstate_T *st, enum hlcontext_T context)
+    __attribute__((nonnull));
+static void pop_context(hlstate_T *st)
+    __attribute__((nonnull));
+static size_t lex(const wchar_t *s, size_t len, size_t i, hlstate_T *st,
+        le_hlstyle_T *style)
+    __attribute__((nonnull));
+static size_t lex_command(const wchar_t *s, size_t len, size_t i,
+        hlstate_T *st, le_hlstyle_T *style)
+    __attribute__((nonnull));
+static size_t lex_operator(const wchar_t *s, size_t i, hlstate_T *st)
+    __attribute__((nonnull));
+static size_t lex_word(const wchar_t *s, size_t len, size_t i,
+        hlstate_T *st, le_hlstyle_T *style)
+    __attribute__((nonnull));
+static size_t lex_dquote(const wchar_t *s, size_t len, size_t i,
+        hlstate_T *st, le_hlstyle_T *style)
+    __attribute__((nonnull));
+static size_t lex_param(const wchar_t *s, size_t len, size_t i,
+        hlstate_T *st, le_hlstyle_T *style)
+    __attribute__((nonnull));
+static size_t lex_arith(const wchar_t *s, size_t len, size_t i,
+        hlstate_T *st, le_hlstyle_T *style)
+    __attribute__((nonnull));
+static size_t lex_dollar(const wchar_t *s, size_t i, hlstate_T *st,
+        le_hlstyle_T *style, le_hlstyle_T plainstyle)
+    __attribute__((nonnull));
+static size_t skip_single_quote(const wchar_t *s, size_t len, size_t i)
+    __attribute__((nonnull,pure));
+static size_t skip_dquote_text(const wchar_t *s, size_t len, size_t i)
+    __attribute__((nonnull,pure));
+static void begin_word(hlstate_T *st)
+    __attribute__((nonnull));
+static void end_word(hlstate_T *st)
+    __attribute__((nonnull));
+static bool apply_keyword(hlstate_T *st, const wchar_t *word, size_t len)
+    __attribute__((nonnull));
+static bool is_assignment(const wchar_t *word, size_t len)
+    __attribute__((nonnull,pure));
+static inline bool is_blank(wchar_t c)
+    __attribute__((const));
+static inline bool is_delimiter(wchar_t c)
+    __attribute__((const));
+
+
+/* The text that has been lexed. */
+static xwcsbuf_T hltext = { .contents = NULL };
+/* The tokens of `hltext', sorted by `start'. */
+static hltoken_T *hltokens = NULL;
+/* The number of tokens in `hltokens'. */
+static size_t hltokencount = 0;
+
+
+/* Updates the tokens for the new text `s' of length `len' and returns the index
+ * of the first character whose style may have changed. Returns SIZE_MAX if the
+ * text has not changed since the last update. */
+size_t le_highlight_update(const wchar_t *s, size_t len)
+{
+    if (hltext.contents == NULL)
+        wb_init(&hltext);
+
+    /* find the modified part: [prefix, oldend) is replaced with
+     * [prefix, newend) */
+    size_t oldlen = hltext.length;
+    size_t minlen = (oldlen < len) ? oldlen : len;
+    size_t prefix = 0;
+    while (prefix < minlen && hltext.contents[prefix] == s[prefix])
+        prefix++;
+    if (prefix == oldlen && prefix == len)
+        return SIZE_MAX;
+    size_t suffix = 0;
+    while (suffix < minlen - prefix
+            && hltext.contents[oldlen - suffix - 1] == s[len - suffix - 1])
+        suffix++;
+    size_t oldend = oldlen - suffix, newend = len - suffix;
+
+    /* The lexer may look at the null character after the text but never
+     * beyond it. */
+    wb_clear(&hltext);
+    wb_ncat_force(&hltext, s, len);
+
+    /* Resume lexing from the token containing the character just before the
+     * modified part, which may have been affected by the modification. */
+    size_t first = (prefix > 0) ? le_highlight_find(prefix - 1) : 0;
+    hlstate_T st;
+    size_t i;
+    if (first < hltokencount) {
+        st = hltokens[first].state;
+        i = hltokens[first].start;
+    } else {
+        memset(&st, 0, sizeof st);
+        st.flags = HLF_CMDPOS;
+        i = 0;
+    }
+    size_t resume = i;
+
+    hltoken_T *newtokens = NULL;
+    size_t newcount = 0, newcap = 0;
+    size_t old = first;
+    while (i < len) {
+        if (i >= newend) {
+            /* If we are at the start of an old token in the same state as
+             * before, the remaining old tokens are still valid. */
+            size_t oldi = i - newend + oldend;
+            while (old < hltokencount && hltokens[old].start < oldi)
+                old++;
+            if (old < hltokencount && hltokens[old].start == oldi
+                    && memcmp(&hltokens[old].state, &st, sizeof st) == 0)
+                goto sync;
+        }
+
+        if (newcount == newcap) {
+            newcap = (newcap == 0) ? 16 : add(newcap, newcap);
+            newtokens = xreallocn(newtokens, newcap, sizeof *newtokens);
+        }
+        hltoken_T *t = &newtokens[newcount++];
+        le_hlstyle_T style = HL_NONE;
+        t->start = i;
+        t->state = st;
+        i = lex(hltext.contents, len, i, &st, &style);
+        t->style = style;
+    }
+    old = hltokencount;
+sync:;
+
+    /* replace the old tokens in [first, old) with the new tokens */
+    size_t tailcount = hltokencount - old;
+    size_t count = first + newcount + tailcount;
+    if (count > hltokencount)
+        hltokens = xreallocn(hltokens, count, sizeof *hltokens);
+    memmove(&hltokens[first + newcount], &hltokens[old],
+            tailcount * sizeof *hltokens);
+    if (newcount > 0)
+        memcpy(&hltokens[first], newtokens, newcount * sizeof *hltokens);
+    for (size_t k = first + newcount; k < count; k++)
+        hltokens[k].start = hltokens[k].start - oldend + newend;
+    hltokencount = count;
+    free(newtokens);
+
+    return resume;
+}
+
+/* Frees the tokens and the text. */
+void le_highlight_clear(void)
+{
+    if (hltext.contents != NULL) {
+        wb_destroy(&hltext);
+        hltext.contents = NULL;
+    }
+    free(hltokens);
+    hltokens = NULL;
+    hltokencount = 0;
+}
+
+/* Returns the index of the token that contains the character at `index' of the
+ * text. */
+size_t le_highlight_find(size_t index)
+{
+    size_t lo = 0, hi = hltokencount;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (hltokens[mid].start <= index)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Returns the style of the character at `index' of the text.
+ * `*tokenp' must be the index of a token that starts at or before `index'. It
+ * is advanced to the token that contains the character. */
+le_hlstyle_T le_highlight_style(size_t *tokenp, size_t index)
+{
+    size_t k = *tokenp;
+    while (k + 1 < hltokencount && hltokens[k + 1].start <= index)
+        k++;
+    *tokenp = k;
+    return (k < hltokencount) ? hltokens[k].style : HL_NONE;
+}
+
+
+/********** Lexer **********/
+
+/* Returns the context the lexer is working in. */
+enum hlcontext_T current_context(const hlstate_T *st)
+{
+    return (st->depth == 0) ? CTX_COMMAND : st->nest[st->depth - 1].context;
+}
+
+/* Enters a nested context. The current flags are saved to be restored when the
+ * context is left. */
+void push_context(hlstate_T *st, enum hlcontext_T context)
+{
+    if (st->depth < HL_MAXDEPTH) {
+        st->nest[st->depth].context = context;
+        st->nest[st->depth].outerflags = st->flags;
+        st->depth++;
+    }
+}
+
+/* Leaves the current nested context. */
+void pop_context(hlstate_T *st)
+{
+    if (st->depth > 0) {
+        st->depth--;
+        st->flags = st->nest[st->depth].outerflags;
+        st->nest[st->depth].context = st->nest[st->depth].outerflags = 0;
+    }
+}
+
+/* Lexes the token that starts at `s[i]'. `len' is the length of `s', which must
+ * be followed by a null character.
+ * The state of the lexer `*st' is updated to that at the end of the token and
+ * the style of the token is assigned to `*style'.
+ * Returns the index of the end of the token, which is always greater than
+ * `i'. */
+size_t lex(const wchar_t *s, size_t len, size_t i, hlstate_T *st,
+        le_hlstyle_T *style)
+{
+    size_t end = i + 1;
+
+    assert(i < len);
+    switch (current_context(st)) {
+        case CTX_COMMAND:
+        case CTX_PAREN:
+        case CTX_CMDSUB:
+        case CTX_BACKQUOTE:
+            end = lex_command(s, len, i, st, style);
+            break;
+        case CTX_DQUOTE:
+            end = lex_dquote(s, len, i, st, style);
+            break;
+        case CTX_PARAM:
+            end = lex_param(s, len, i, st, style);
+            break;
+        case CTX_ARITH:
+        case CTX_ARITHPAREN:
+            end = lex_arith(s, len, i, st, style);
+            break;
+        default:
+            assert(false);
+            *style = HL_NONE;
+            break;
+    }
+    assert(i < end && end <= len);
+    return end;
+}
+
+/* Lexes a token in a command context. */
+size_t lex_command(const wchar_t *s, size_t len, size_t i,
+        hlstate_T *st, le_hlstyle_T *style)
+{
+    enum hlcontext_T context = current_context(st);
+    size_t end = i + 1;
+
+    if (is_blank(s[i])) {
+        end_word(st);
+        while (end < len && is_blank(s[end]))
+            end++;
+        *style = HL_NONE;
+        return end;
+    }
+
+    switch (s[i]) {
+        case L'\n':
+            end_word(st);
+            if (!(st->flags & HLF_PATTERN))
+                st->flags = HLF_CMDPOS;
+            *style = HL_NONE;
+            return i + 1;
+        case L'#':
+            if (st->flags & HLF_INWORD)
+                break;
+            end = i + 1;
+            while (end < len && s[end] != L'\n')
+                end++;
+            *style = HL_COMMENT;
+            return end;
+        case L'`':
+            if (context != CTX_BACKQUOTE)
+                break;
+            end_word(st);
+            pop_context(st);
+            *style = HL_EXPANSION;
+            return i + 1;
+        case L')':
+            end_word(st);
+            if (st->flags & HLF_PATTERN) {
+                st->flags = HLF_CMDPOS;
+                *style = HL_OPERATOR;
+            } else if (context == CTX_CMDSUB) {
+                pop_context(st);
+                *style = HL_EXPANSION;
+            } else {
+                /* the end of a subshell or a pattern of a case command
+                 * whose start was not recognized */
+                if (context == CTX_PAREN)
+                    pop_context(st);
+                else
+                    st->flags = HLF_CMDPOS;
+                *style = HL_OPERATOR;
+            }
+            return i + 1;
+    }
+
+    end = lex_operator(s, i, st);
+    if (end > i) {
+        *style = HL_OPERATOR;
+        return end;
+    }
+
+    return lex_word(s, len, i, st, style);
+}
+
+/* Lexes an operator at `s[i]' in a command context. Returns the index of the
+ * end of the operator, or `i' if there is no operator. */
+size_t lex_operator(const wchar_t *s, size_t i, hlstate_T *st)
+{
+    size_t j = i;
+
+    /* A redirection operator may be preceded by a file descriptor. */
+    if (!(st->flags & HLF_INWORD)) {
+        while (iswdigit(s[j]))
+            j++;
+        if (j > i && s[j] != L'<' && s[j] != L'>')
+            return i;
+    }
+
+    switch (s[j]) {
+        case L';':
+            end_word(st);
+            if (s[j + 1] == L';') {
+                st->flags = HLF_PATTERN;
+                return j + 2;
+            }
+            st->flags = HLF_CMDPOS;
+            return j + 1;
+        case L'&':
+        case L'|':
+            end_word(st);
+            if (st->flags & HLF_PATTERN)
+                return j + 1;
+            st->flags = HLF_CMDPOS;
+            return (s[j + 1] == s[j]) ? j + 2 : j + 1;
+        case L'(':
+            end_word(st);
+            if (st->flags & HLF_PATTERN)
+                return j + 1;
+            if (s[j + 1] == L')') {
+                /* function definition */
+                st->flags = HLF_CMDPOS;
+                return j + 2;
+            }
+            push_context(st, CTX_PAREN);
+            st->flags = HLF_CMDPOS;
+            return j + 1;
+        case L'<':
+        case L'>':
+            end_word(st);
+            if (s[j + 1] == L'(') {
+                /* process redirection */
+                push_context(st, CTX_PAREN);
+                st->flags = HLF_CMDPOS;
+                return j + 2;
+            }
+            if (s[j] == L'<') {
+                j++;
+                if (s[j] == L'<') {
+                    j++;
+                    if (s[j] == L'-' || s[j] == L'<')
+                        j++;
+                } else if (s[j] == L'>' || s[j] == L'&') {
+                    j++;
+                }
+            } else {
+                j++;
+                if (s[j] == L'>' || s[j] == L'|' || s[j] == L'&')
+                    j++;
+            }
+            st->flags |= HLF_REDIR;
+            return j;
+        default:
+            return i;
+    }
+}
+
+/* Lexes (part of) a word in a command context. */
+size_t lex_word(const wchar_t *s, size_t len, size_t i,
+        hlstate_T *st, le_hlstyle_T *style)
+{
+    bool wordstart = !(st->flags & HLF_INWORD);
+    size_t end = i + 1;
+
+    switch (s[i]) {
+        case L'\'':
+            begin_word(st);
+            *style = HL_QUOTE;
+            return skip_single_quote(s, len, i);
+        case L'"':
+            begin_word(st);
+            push_context(st, CTX_DQUOTE);
+            st->flags = 0;
+            *style = HL_QUOTE;
+            return skip_dquote_text(s, len, i + 1);
+        case L'\\':
+            begin_word(st);
+            *style = HL_QUOTE;
+            return (i + 1 < len) ? i + 2 : i + 1;
+        case L'$':
+            begin_word(st);
+            return lex_dollar(s, i, st, style,
+                    (st->flags & HLF_CMDWORD) ? HL_COMMAND : HL_NONE);
+        case L'`':
+            begin_word(st);
+            push_context(st, CTX_BACKQUOTE);
+            st->flags = HLF_CMDPOS;
+            *style = HL_EXPANSION;
+            return i + 1;
+    }
+
+    /* unquoted characters */
+    while (end < len && !is_delimiter(s[end]) && !wcschr(L"'\"\\$`", s[end]))
+        end++;
+
+    if (wordstart && is_delimiter(s[end])
+            && apply_keyword(st, &s[i], end - i)) {
+        *style = HL_KEYWORD;
+        return end;
+    }
+
+    begin_word(st);
+    if (wordstart && is_assignment(&s[i], end - i))
+        st->flags &= ~HLF_CMDWORD;
+    *style = (st->flags & HLF_CMDWORD) ? HL_COMMAND : HL_NONE;
+    return end;
+}
+
+/* Lexes a token in double quotes. */
+size_t lex_dquote(const wchar_t *s, size_t len, size_t i,
+        hlstate_T *st, le_hlstyle_T *style)
+{
+    switch (s[i]) {
+        case L'"':
+            pop_context(st);
+            *style = HL_QUOTE;
+            return i + 1;
+        case L'$':
+            return lex_dollar(s, i, st, style, HL_QUOTE);
+        case L'`':
+            push_context(st, CTX_BACKQUOTE);
+            st->flags = HLF_CMDPOS;
+            *style = HL_EXPANSION;
+            return i + 1;
+        default:
+            *style = HL_QUOTE;
+            return skip_dquote_text(s, len, i);
+    }
+}
+
+/* Lexes a token in a parameter expansion. */
+size_t lex_param(const wchar_t *s, size_t len, size_t i,
+        hlstate_T *st, le_hlstyle_T *style)
+{
+    size_t end = i + 1;
+
+    switch (s[i]) {
+        case L'}':
+            pop_context(st);
+            *style = HL_EXPANSION;
+            return i + 1;
+        case L'\'':
+            *style = HL_QUOTE;
+            return skip_single_quote(s, len, i);
+        case L'"':
+            push_context(st, CTX_DQUOTE);
+            st->flags = 0;
+            *style = HL_QUOTE;
+            return skip_dquote_text(s, len, i + 1);
+        case L'\\':
+            *style = HL_QUOTE;
+            return (i + 1 < len) ? i + 2 : i + 1;
+        case L'$':
+            return lex_dollar(s, i, st, style, HL_EXPANSION);
+        case L'`':
+            push_context(st, CTX_BACKQUOTE);
+            st->flags = HLF_CMDPOS;
+            *style = HL_EXPANSION;
+            return i + 1;
+    }
+
+    while (end < len && !wcschr(L"}'\"\\$`", s[end]))
+        end++;
+    *style = HL_EXPANSION;
+    return end;
+}
+
+/* Lexes a token in an arithmetic expansion. */
+size_t lex_arith(const wchar_t *s, size_t len, size_t i,
+        hlstate_T *st, le_hlstyle_T *style)
+{
+    size_t end = i + 1;
+
+    *style = HL_EXPANSION;
+    switch (s[i]) {
+        case L'(':
+            push_context(st, CTX_ARITHPAREN);
+            return i + 1;
+        case L')':
+            end = (current_context(st) == CTX_ARITH && s[i + 1] == L')')
+                ? i + 2 : i + 1;
+            pop_context(st);
+            return end;
+        case L'$':
+            return lex_dollar(s, i, st, style, HL_EXPANSION);
+        case L'`':
+            push_context(st, CTX_BACKQUOTE);
+            st->flags = HLF_CMDPOS;
+            return i + 1;
+    }
+
+    while (end < len && !wcschr(L"()$`", s[end]))
+        end++;
+    return end;
+}
+
+/* Lexes a token that starts with a dollar sign at `s[i]'.
+ * If the dollar sign does not start an expansion, the style of the token is
+ * `plainstyle'. */
+size_t lex_dollar(const wchar_t *s, size_t i, hlstate_T *st,
+        le_hlstyle_T *style, le_hlstyle_T plainstyle)
+{
+    wchar_t c = s[i + 1];
+
+    assert(s[i] == L'$');
+    *style = HL_EXPANSION;
+    if (c == L'{') {
+        push_context(st, CTX_PARAM);
+        st->flags = 0;
+        return i + 2;
+    }
+    if (c == L'(') {
+        if (s[i + 2] == L'(') {
+            push_context(st, CTX_ARITH);
+            st->flags = 0;
+            return i + 3;
+        }
+        push_context(st, CTX_CMDSUB);
+        st->flags = HLF_CMDPOS;
+        return i + 2;
+    }
+    if (c == L'_' || iswalpha(c)) {
+        size_t end = i + 2;
+        while (s[end] == L'_' || iswalnum(s[end]))
+            end++;
+        return end;
+    }
+    if (c != L'\0' && (iswdigit(c) || wcschr(L"@*#?-$!", c)))
+        return i + 2;
+
+    *style = plainstyle;
+    return i + 1;
+}
+
+/* Returns the index just after the single-quoted string that starts at `s[i]'.
+ * If the closing quote is missing, returns `len'. */
+size_t skip_single_quote(const wchar_t *s, size_t len, size_t i)
+{
+    assert(s[i] == L'\'');
+    i++;
+    while (i < len && s[i] != L'\'')
+        i++;
+    return (i < len) ? i + 1 : len;
+}
+
+/* Returns the index of the first double quote, dollar sign or backquote at or
+ * after `s[i]' that is not escaped by a backslash, or `len' if none. */
+size_t skip_dquote_text(const wchar_t *s, size_t len, size_t i)
+{
+    while (i < len && s[i] != L'"' && s[i] != L'$' && s[i] != L'`') {
+        if (s[i] == L'\\' && i + 1 < len)
+            i++;
+        i++;
+    }
+    return i;
+}
+
+/* Marks the start of a word if the lexer is not in a word. */
+void begin_word(hlstate_T *st)
+{
+    if (!(st->flags & HLF_INWORD)) {
+        st->flags |= HLF_INWORD;
+        if ((st->flags & (HLF_CMDPOS | HLF_REDIR)) == HLF_CMDPOS)
+            st->flags |= HLF_CMDWORD;
+    }
+}
+
+/* Marks the end of a word if the lexer is in a word, updating the flags
+ * depending on what the word was. */
+void end_word(hlstate_T *st)
+{
+    unsigned flags = st->flags;
+
+    if (!(flags & HLF_INWORD))
+        return;
+
+    if (flags & HLF_REDIR) {
+        flags &= ~HLF_REDIR;
+    } else if (flags & HLF_NAME) {
+        flags &= ~HLF_NAME;
+        if (!(flags & HLF_WANTIN))
+            flags |= HLF_CMDPOS;  /* a function body follows */
+    } else {
+        flags &= ~(HLF_WANTIN | HLF_CASE);
+        if (flags & HLF_CMDWORD)
+            flags &= ~HLF_CMDPOS;
+    }
+    st->flags = flags & ~(HLF_INWORD | HLF_CMDWORD);
+}
+
+/* If `word' is a reserved word in the current state, updates the flags as
+ * the reserved word affects the following words and returns true. */
+bool apply_keyword(hlstate_T *st, const wchar_t *word, size_t len)
+{
+    static const struct {
+        const wchar_t *word;
+        unsigned char flags;  /* flags after the keyword */
+    } keywords[] = {
+        { L"!",        HLF_CMDPOS, },
+        { L"case",     HLF_NAME | HLF_WANTIN | HLF_CASE, },
+        { L"do",       HLF_CMDPOS, },
+        { L"done",     0, },
+        { L"elif",     HLF_CMDPOS, },
+        { L"else",     HLF_CMDPOS, },
+        { L"esac",     0, },
+        { L"fi",       0, },
+        { L"for",      HLF_NAME | HLF_WANTIN, },
+        { L"function", HLF_NAME, },
+        { L"if",       HLF_CMDPOS, },
+        { L"in",       0, },
+        { L"then",     HLF_CMDPOS, },
+        { L"until",    HLF_CMDPOS, },
+        { L"while",    HLF_CMDPOS, },
+        { L"{",        HLF_CMDPOS, },
+        { L"}",        0, },
+    };
+
+    bool cmdpos = (st->flags & (HLF_CMDPOS | HLF_REDIR)) == HLF_CMDPOS;
+    bool wantin = (st->flags & (HLF_WANTIN | HLF_NAME)) == HLF_WANTIN;
+    bool pattern = (st->flags & HLF_PATTERN) != 0;
+    if (!cmdpos && !wantin && !pattern)
+        return false;
+
+    if (pattern) {
+        if (len != 4 || wcsncmp(word, L"esac", 4) != 0)
+            return false;
+        st->flags = 0;
+        return true;
+    }
+
+    for (size_t k = 0; k < sizeof keywords / sizeof *keywords; k++) {
+        if (wcsncmp(word, keywords[k].word, len) != 0
+                || keywords[k].word[len] != L'\0')
+            continue;
+        if (!cmdpos && wcscmp(keywords[k].word, L"in") != 0
+                && wcscmp(keywords[k].word, L"do") != 0)
+            return false;
+        if (wantin && (st->flags & HLF_CASE) && keywords[k].word[0] == L'i')
+            st->flags = HLF_PATTERN;  /* "in" of a case command */
+        else
+            st->flags = keywords[k].flags;
+        return true;
+    }
+    return false;
+}
+
+/* Returns true iff `word' starts with a variable name followed by an equal
+ * sign. */
+bool is_assignment(const wchar_t *word, size_t len)
+{
+    if (len == 0 || !(word[0] == L'_' || iswalpha(word[0])))
+        return false;
+    for (size_t i = 1; i < len; i++) {
+        if (word[i] == L'=')
+            return true;
+        if (!(word[i] == L'_' || iswalnum(word[i])))
+            return false;
+    }
+    return false;
+}
+
+/* Returns true iff `c' is a space or tab. */
+bool is_blank(wchar_t c)
+{
+    return c == L' ' || c == L'\t';
+}
+
+/* Returns true iff `c' ends a word. */
+bool is_delimiter(wchar_t c)
+{
+    switch (c) {
+        case L'\0':  case L' ':  case L'\t':  case L'\n':
+        case L';':   case L'&':  case L'|':
+        case L'(':   case L')':  case L'<':   case L'>':
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+/* vim: set ts=8 sts=4 sw=4 et tw=80: */
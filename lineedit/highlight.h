@@ -0,0 +1,49 @@
+/* Yash: yet another shell */
+/* highlight.h: syntax highlighting for line-editing */
+/* (C) 2026 magicant */
+
+/* This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef YASH_HIGHLIGHT_H
+#define YASH_HIGHLIGHT_H
+
+#include <stddef.h>
+
+
+/* Styles of characters determined by syntax highlighting. */
+typedef enum le_hlstyle_T {
+    HL_NONE,       /* ordinary text */
+    HL_COMMAND,    /* command name */
+    HL_KEYWORD,    /* reserved word */
+    HL_OPERATOR,   /* control or redirection operator */
+    HL_QUOTE,      /* quoted text */
+    HL_EXPANSION,  /* parameter expansion, command substitution, etc. */
+    HL_COMMENT,    /* comment */
+} le_hlstyle_T;
+#define HL_STYLE_COUNT (HL_COMMENT + 1)
+
+extern size_t le_highlight_update(const wchar_t *s, size_t length)
+    __attribute__((nonnull));
+extern void le_highlight_clear(void);
+extern size_t le_highlight_find(size_t index)
+    __attribute__((pure));
+extern le_hlstyle_T le_highlight_style(size_t *tokenp, size_t index)
+    __attribute__((nonnull));
+
+
+#endif /* YASH_HIGHLIGHT_H */
+
+
+/* vim: set ts=8 sts=4 sw=4 et tw=80: */
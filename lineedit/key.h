@@ -215,6 +215,7 @@
 #define Key_cr        Key_c_m
 #define Key_escape    Key_c_lb
 #define Key_backslash L"\\\\"   // must end with '\\'
+#define Key_paste     L"\\pst"  // start of bracketed paste (never bound)
 
 #define META_BIT    0x80
 #define ESCAPE_CHAR '\33'
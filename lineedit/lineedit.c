@@ -27,6 +27,7 @@
 #include <unistd.h>
 #include <wchar.h>
 #include "../option.h"
+#include "../path.h"
 #include "../sig.h"
 #include "../strbuf.h"
 #include "../util.h"
@@ -42,6 +43,8 @@
 static void reader_init(bool trap);
 static void reader_finalize(void);
 static void read_next(void);
+static void do_idle_work(void);
+static void receive_prompt(void);
 static int get_read_timeout(void)
     __attribute__((pure));
 static char pop_prebuffer(void);
@@ -50,6 +53,9 @@ static inline bool has_meta_bit(char c)
 static inline trieget_T make_trieget(const wchar_t *keyseq)
     __attribute__((nonnull,const));
 static void append_to_second_buffer(wchar_t wc);
+static void read_bracketed_paste(void);
+static void insert_pasted_bytes(const char *s, size_t length)
+    __attribute__((nonnull));
 
 
 /* The state of line-editing. */
@@ -159,6 +165,8 @@ static mbstate_t reader_state;
 static xwcsbuf_T reader_second_buffer;
 /* If true, next input will be inserted directly to the main buffer. */
 bool le_next_verbatim;
+/* True if the idle work for the current line has been done. */
+static bool idle_work_done;
 
 /* Initializes the state of the reader. */
 void reader_init(bool trap)
@@ -168,6 +176,7 @@ void reader_init(bool trap)
     memset(&reader_state, 0, sizeof reader_state);
     wb_init(&reader_second_buffer);
     le_next_verbatim = false;
+    idle_work_done = false;
 }
 
 /* Frees memory used by the reader. */
@@ -198,8 +207,11 @@ void read_next(void)
     le_display_update(true);
     le_display_flush();
 
+    if (!keycode_ambiguous)
+        do_idle_work();
+
     /* wait for and read the next byte */
-    switch (wait_for_input(STDIN_FILENO, reader_trap,
+    switch (wait_for_inputs(STDIN_FILENO, async_prompt_fd, reader_trap,
             keycode_ambiguous ? get_read_timeout() : -1)) {
         case W_READY:
             switch (read(STDIN_FILENO, &c, 1)) {
@@ -234,6 +246,9 @@ direct_first_buffer:
                 sb_ccat(&reader_first_buffer, c);
             }
             break;
+        case W_SUBREADY:
+            receive_prompt();
+            return;
         case W_TIMED_OUT:
             timeout = true;
             break;
@@ -272,7 +287,10 @@ direct_first_buffer:
                 if (timeout) {
             case TG_EXACTMATCH:
                     sb_remove(&reader_first_buffer, 0, tg.matchlength);
-                    wb_cat(&reader_second_buffer, tg.value.keyseq);
+                    if (wcscmp(tg.value.keyseq, Key_paste) == 0)
+                        read_bracketed_paste();
+                    else
+                        wb_cat(&reader_second_buffer, tg.value.keyseq);
                     continue;
                 } else {
                     keycode_ambiguous = true;
@@ -351,6 +369,33 @@ process_keymap:
     }
 }
 
+/* Does some work that can be done while waiting for the user to type the next
+ * key. The work is abandoned as soon as input is available.
+ * Currently, the command name index is updated once for each line so that
+ * command name completion can use it without delay. */
+void do_idle_work(void)
+{
+    if (idle_work_done)
+        return;
+    if (!shopt_dircache) {
+        idle_work_done = true;
+        return;
+    }
+    idle_work_done = update_command_index(le_input_pending);
+}
+
+/* Reads the prompt being expanded in the background. When the whole prompt has
+ * been read, the display is cleared so that it is reprinted with the new
+ * prompt. */
+void receive_prompt(void)
+{
+    struct promptset_T prompt;
+    if (receive_async_prompt(false, &prompt)) {
+        le_display_clear(false);
+        le_display_init(prompt);
+    }
+}
+
 /* Returns a timeout value to be passed to the `wait_for_input' function.
  * The value is taken from the $YASH_LE_TIMEOUT variable. */
 int get_read_timeout(void)
@@ -368,6 +413,13 @@ int get_read_timeout(void)
     return LE_TIMEOUT_DEFAULT;
 }
 
+/* Returns true iff there is input that has not yet been read from the
+ * terminal. This function does not block. */
+bool le_input_pending(void)
+{
+    return wait_for_input(STDIN_FILENO, false, 0) == W_READY;
+}
+
 /* Appends `s' to the prebuffer. String `s' is freed in this function. */
 void le_append_to_prebuffer(char *s)
 {
@@ -441,5 +493,137 @@ void append_to_second_buffer(wchar_t wc)
     }
 }
 
+/* Reads text pasted in the bracketed paste mode and inserts it into the main
+ * buffer. This function is called when the sequence that starts pasted text
+ * has been removed from the first buffer. The text is read in bulk until the
+ * end sequence (`le_paste_end') and inserted at once without being processed
+ * as key input. Bytes following the end sequence are left in the prebuffer so
+ * that they are not lost when editing ends before they are processed, except
+ * for null bytes.
+ * If the end sequence does not arrive in time, the text read so far is
+ * inserted. */
+void read_bracketed_paste(void)
+{
+#ifndef LE_PASTE_TIMEOUT
+#define LE_PASTE_TIMEOUT 1000
+#endif
+#define PASTE_READ_SIZE 4096
+
+    xstrbuf_T buf;
+    size_t endlength = strlen(le_paste_end);
+    size_t searched = 0;
+    const char *end;
+
+    /* The first buffer and the prebuffer may already contain some of the
+     * pasted bytes. */
+    sb_init(&buf);
+    sb_ncat_force(&buf, reader_first_buffer.contents,
+            reader_first_buffer.length);
+    sb_clear(&reader_first_buffer);
+    if (reader_prebuffer.contents != NULL) {
+        sb_ncat_force(&buf, reader_prebuffer.contents,
+                reader_prebuffer.length);
+        sb_destroy(&reader_prebuffer);
+        reader_prebuffer.contents = NULL;
+    }
+
+    for (;;) {
+        /* search the newly read bytes for the end sequence */
+        end = NULL;
+        for (const char *s = &buf.contents[searched];
+                (s = memchr(s, le_paste_end[0],
+                    buf.length - (size_t) (s - buf.contents))) != NULL;
+                s++) {
+            if (buf.length - (size_t) (s - buf.contents) < endlength)
+                break;
+            if (memcmp(s, le_paste_end, endlength) == 0) {
+                end = s;
+                break;
+            }
+        }
+        if (end != NULL)
+            break;
+        if (buf.length >= endlength)
+            searched = buf.length - endlength + 1;
+
+        if (wait_for_input(STDIN_FILENO, reader_trap, LE_PASTE_TIMEOUT)
+                != W_READY)
+            break;
+        sb_ensuremax(&buf, add(buf.length, PASTE_READ_SIZE));
+        ssize_t n = read(STDIN_FILENO, &buf.contents[buf.length],
+                buf.maxlength - buf.length);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+                continue;
+            break;
+        }
+        if (n == 0)
+            break;
+        buf.length += (size_t) n;
+        buf.contents[buf.length] = '\0';
+    }
+
+    if (end != NULL) {
+        size_t length = (size_t) (end - buf.contents);
+        const char *rest = &end[endlength];
+        size_t restlength = buf.length - (size_t) (rest - buf.contents);
+        xstrbuf_T tail;
+
+        /* The prebuffer is a null-terminated string, so null bytes are
+         * dropped rather than cutting off the bytes after them. */
+        sb_initwithmax(&tail, restlength);
+        for (size_t i = 0; i < restlength; i++)
+            if (rest[i] != '\0')
+                sb_ccat(&tail, rest[i]);
+        if (tail.length > 0)
+            le_append_to_prebuffer(sb_tostr(&tail));
+        else
+            sb_destroy(&tail);
+        sb_truncate(&buf, length);
+    }
+    insert_pasted_bytes(buf.contents, buf.length);
+    sb_destroy(&buf);
+
+#undef PASTE_READ_SIZE
+}
+
+/* Converts the specified pasted bytes into wide characters and inserts them
+ * into the main buffer. Null bytes and bytes that cannot be converted are
+ * skipped. Carriage returns, which terminals send for line breaks in pasted
+ * text, are converted to newlines. */
+void insert_pasted_bytes(const char *s, size_t length)
+{
+    xwcsbuf_T text;
+    mbstate_t state;
+    bool after_cr = false;
+
+    wb_initwithmax(&text, length);
+    memset(&state, 0, sizeof state);
+    while (length > 0) {
+        wchar_t wc;
+        size_t n = mbrtowc(&wc, s, length, &state);
+        switch (n) {
+            case 0:            // null byte
+                n = 1;
+                break;
+            case (size_t) -1:  // conversion error
+            case (size_t) -2:  // incomplete character at the end
+                memset(&state, 0, sizeof state);
+                n = 1;
+                break;
+            default:
+                if (wc == L'\r')
+                    wb_wccat(&text, L'\n');
+                else if (wc != L'\n' || !after_cr)
+                    wb_wccat(&text, wc);
+                after_cr = (wc == L'\r');
+                break;
+        }
+        s += n, length -= n;
+    }
+
+    le_insert_pasted_text(text.contents, text.length);
+    wb_destroy(&text);
+}
 
 /* vim: set ts=8 sts=4 sw=4 et tw=80: */
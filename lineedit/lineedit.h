@@ -55,6 +55,7 @@ extern _Bool le_next_verbatim;
 
 extern void le_append_to_prebuffer(char *s)
     __attribute__((nonnull));
+extern _Bool le_input_pending(void);
 
 
 #endif /* YASH_LINEEDIT_H */
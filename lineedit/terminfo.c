@@ -58,6 +58,10 @@
 
 
 /* terminfo capabilities */
+#define TI_BD      "BD"
+#define TI_BE      "BE"
+#define TI_PE      "PE"
+#define TI_PS      "PS"
 #define TI_am      "am"
 #define TI_bel     "bel"
 #define TI_blink   "blink"
@@ -74,10 +78,14 @@
 #define TI_cuf1    "cuf1"
 #define TI_cuu     "cuu"
 #define TI_cuu1    "cuu1"
+#define TI_dch     "dch"
+#define TI_dch1    "dch1"
 #define TI_dim     "dim"
 #define TI_ed      "ed"
 #define TI_el      "el"
 #define TI_flash   "flash"
+#define TI_ich     "ich"
+#define TI_ich1    "ich1"
 #define TI_invis   "invis"
 #define TI_kBEG    "kBEG"
 #define TI_kCAN    "kCAN"
@@ -270,8 +278,19 @@ _Bool le_meta_bit8;
  * The values of entries are `keyseq'. */
 trie_T *le_keycodes = NULL;
 
+/* The sequence the terminal sends at the end of pasted text in the bracketed
+ * paste mode. Initialized in `set_up_keycodes'. */
+const char *le_paste_end;
+
 /* True if the terminal is set to the keyboard-transmit mode. */
 static _Bool transmit_mode = 0;
+/* True if the terminal is set to the bracketed paste mode. */
+static _Bool paste_mode = 0;
+
+/* The sequences sent by xterm-compatible terminals at the start and end of
+ * pasted text, used if the terminfo does not define them. */
+#define DEFAULT_PASTE_START "\33[200~"
+#define DEFAULT_PASTE_END   "\33[201~"
 
 
 static inline int is_strcap_valid(const char *s)
@@ -289,6 +308,8 @@ static void print_color_code(long color, char *seta, char *set)
     __attribute__((nonnull));
 static void print_smkx(void);
 static void print_rmkx(void);
+static void print_be(void);
+static void print_bd(void);
 static int putchar_stderr(int c);
 
 
@@ -549,6 +570,14 @@ void set_up_keycodes(void)
             t = trie_set(t, seq, (trievalue_T) { .keyseq = keymap[i].keyseq });
     }
 
+    const char *seq = tigetstr(TI_PS);
+    if (!is_strcap_valid(seq) || seq[0] == '\0')
+        seq = DEFAULT_PASTE_START;
+    t = trie_set(t, seq, (trievalue_T) { .keyseq = Key_paste });
+    le_paste_end = tigetstr(TI_PE);
+    if (!is_strcap_valid(le_paste_end) || le_paste_end[0] == '\0')
+        le_paste_end = DEFAULT_PASTE_END;
+
     le_keycodes = t;
 }
 
@@ -675,6 +704,26 @@ void lebuf_print_cuu(long count)
     lebuf.pos.line -= count;
 }
 
+/* Prints the "ich"/"ich1" code to the print buffer.
+ * (insert `count' blank characters, shifting the rest of the line right)
+ * The cursor position is not changed.
+ * Returns true iff successful. */
+_Bool lebuf_print_ich(long count)
+{
+    assert(count > 0);
+    return move_cursor_mul(TI_ich, count, 1) || move_cursor_1(TI_ich1, count);
+}
+
+/* Prints the "dch"/"dch1" code to the print buffer.
+ * (delete `count' characters, shifting the rest of the line left)
+ * The cursor position is not changed.
+ * Returns true iff successful. */
+_Bool lebuf_print_dch(long count)
+{
+    assert(count > 0);
+    return move_cursor_mul(TI_dch, count, 1) || move_cursor_1(TI_dch1, count);
+}
+
 /* Prints the "el" code to the print buffer. (clear to end of line)
  * Returns true iff successful. */
 _Bool lebuf_print_el(void)
@@ -847,6 +896,29 @@ void print_rmkx(void)
     }
 }
 
+/* Prints the "BE" code to the standard error and sets the `paste_mode' flag.
+ * The terminal then brackets pasted text with the "PS" and "PE" sequences. */
+void print_be(void)
+{
+    char *v = tigetstr(TI_BE);
+    if (is_strcap_valid(v) && v[0] != '\0') {
+        tputs(v, 1, putchar_stderr);
+        paste_mode = 1;
+    }
+}
+
+/* Prints the "BD" code to the standard error if the `paste_mode' flag is set.
+ * The flag is cleared in this function. */
+void print_bd(void)
+{
+    if (paste_mode) {
+        char *v = tigetstr(TI_BD);
+        if (is_strcap_valid(v))
+            tputs(v, 1, putchar_stderr);
+        paste_mode = 0;
+    }
+}
+
 /* Like `putchar', but prints to `stderr'. */
 int putchar_stderr(int c)
 {
@@ -908,6 +980,7 @@ _Bool le_set_terminal(void)
 
     // XXX it should be configurable whether we print smkx or not.
     print_smkx();
+    print_be();
 
     return 1;
 
@@ -941,6 +1014,7 @@ _Bool le_save_terminal(void)
  * successfully restored. */
 _Bool le_restore_terminal(void)
 {
+    print_bd();
     print_rmkx();
     fflush(stderr);
     return xtcsetattr(STDIN_FILENO, TCSADRAIN, &original_terminal_state) >= 0;
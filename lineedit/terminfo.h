@@ -27,6 +27,7 @@ extern int le_ti_xmc;
 extern _Bool le_ti_am, le_ti_xenl, le_ti_msgr;
 extern _Bool le_meta_bit8;
 extern struct trienode_T /* trie_T */ *le_keycodes;
+extern const char *le_paste_end;
 
 extern _Bool le_setupterm(_Bool bypass);
 
@@ -47,6 +48,8 @@ extern void lebuf_print_cub(long count);
 extern void lebuf_print_cuf(long count);
 extern void lebuf_print_cud(long count);
 extern void lebuf_print_cuu(long count);
+extern _Bool lebuf_print_ich(long count);
+extern _Bool lebuf_print_dch(long count);
 extern _Bool lebuf_print_el(void);
 extern _Bool lebuf_print_ed(void);
 extern _Bool lebuf_print_clear(void);
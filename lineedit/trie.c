@@ -436,6 +436,44 @@ trienode_T *trie_add_probability(
     return node;
 }
 
+/* Subtracts the given probability value `p' from each node on the given key
+ * string `keywcs'. Nodes whose probability becomes `min' or less are removed
+ * with their descendants, but the root node `node' itself is never removed. */
+trienode_T *trie_subtract_probability(
+        trienode_T *node, const wchar_t *keywcs, double p, double min)
+{
+    if (node->valuevalid)
+        node->value.probability -= p;
+
+    if (keywcs[0] == L'\0')
+        return node;
+
+    ssize_t index = searchw(node, keywcs[0]);
+    if (index < 0)
+        return node;
+
+    trienode_T *child = node->entries[index].child;
+    if (child->valuevalid && child->value.probability - p <= min) {
+        trie_destroy(child);
+        memmove(&node->entries[index], &node->entries[index + 1],
+                sizeof *node->entries * (node->count - index - 1));
+        node = shrink(node);
+    } else {
+        node->entries[index].child =
+            trie_subtract_probability(child, &keywcs[1], p, min);
+    }
+    return node;
+}
+
+/* Multiplies the probability values of all the nodes by `factor'. */
+void trie_scale_probability(trienode_T *node, double factor)
+{
+    if (node->valuevalid)
+        node->value.probability *= factor;
+    for (size_t i = 0; i < node->count; i++)
+        trie_scale_probability(node->entries[i].child, factor);
+}
+
 /* Returns the most probable key as a newly-malloced wide string.
  * Only keys that start with `skipkey' are considered. The `skipkey' prefix is
  * not included in the result.
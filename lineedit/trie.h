@@ -65,6 +65,11 @@ extern void trie_destroy(trie_T *t);
 
 extern trie_T *trie_add_probability(trie_T *t, const wchar_t *keywcs, double p)
     __attribute__((nonnull,malloc,warn_unused_result));
+extern trie_T *trie_subtract_probability(
+        trie_T *t, const wchar_t *keywcs, double p, double min)
+    __attribute__((nonnull,malloc,warn_unused_result));
+extern void trie_scale_probability(trie_T *t, double factor)
+    __attribute__((nonnull));
 extern wchar_t *trie_probable_key(const trie_T *t, const wchar_t *skipkey)
     __attribute__((nonnull,malloc,warn_unused_result));
 
@@ -30,6 +30,7 @@
 #include "builtin.h"
 #include "exec.h"
 #include "job.h"
+#include "path.h"
 #include "plist.h"
 #include "redir.h"
 #include "sig.h"
@@ -124,6 +125,9 @@ bool shopt_xtrace = false;
 bool shopt_traceall = true;
 
 #if YASH_ENABLE_HISTORY
+/* If set, the history file is written as an append-only log that can be read
+ * without locking. Corresponds to the --histlog option. */
+bool shopt_histlog = false;
 /* If set, lines that start with a space are not saved in the history.
  * Corresponds to the --histspace option. */
 bool shopt_histspace = false;
@@ -156,6 +160,11 @@ bool shopt_extendedglob = false;
  * Corresponds to the --nullglob option. */
 bool shopt_nullglob = false;
 
+/* If set, directory listings are cached for filename expansion and
+ * completion.
+ * Corresponds to the --dircache option. */
+bool shopt_dircache = true;
+
 /* If set, brace expansion is enabled.
  * Corresponds to the --braceexpand option. */
 bool shopt_braceexpand = false;
@@ -196,9 +205,17 @@ bool shopt_le_predict = false;
 bool shopt_le_predictempty = false;
 /* If set, debugging information is printed during command completion. */
 bool shopt_le_compdebug = false;
+/* If set, completion candidates and history search results are matched by
+ * fuzzy matching. */
+bool shopt_le_fuzzy = false;
 /* If set, the right prompt will trim the extra space left at end for cursor
  * to sit if prompt is too large */
 bool shopt_le_trimright = false;
+/* If set, $PROMPT_COMMAND and $PS1 are processed in the background while the
+ * previous prompt is displayed. */
+bool shopt_le_asyncprompt = false;
+/* If set, the edit line is highlighted according to the shell syntax. */
+bool shopt_le_highlight = false;
 #endif
 
 
@@ -219,6 +236,7 @@ static const struct option_T shell_options[] = {
     { 0,    0,    L"curasync",       &shopt_curasync,       true, },
     { 0,    0,    L"curbg",          &shopt_curbg,          true, },
     { 0,    0,    L"curstop",        &shopt_curstop,        true, },
+    { 0,    0,    L"dircache",       &shopt_dircache,       true, },
     { 0,    0,    L"dotglob",        &shopt_dotglob,        true, },
 #if YASH_ENABLE_LINEEDIT
     { 0,    0,    L"emacs",          &shopt_emacs,          true, },
@@ -232,14 +250,18 @@ static const struct option_T shell_options[] = {
     { 0,    L'f', L"glob",           &shopt_glob,           true, },
     { L'h', 0,    L"hashondef",      &shopt_hashondef,      true, },
 #if YASH_ENABLE_HISTORY
+    { 0,    0,    L"histlog",        &shopt_histlog,        true, },
     { 0,    0,    L"histspace",      &shopt_histspace,      true, },
 #endif
     { 0,    0,    L"ignoreeof",      &shopt_ignoreeof,      true, },
     { L'i', 0,    L"interactive",    &is_interactive,       false, },
 #if YASH_ENABLE_LINEEDIT
     { 0,    0,    L"lealwaysrp",     &shopt_le_alwaysrp,    true, },
+    { 0,    0,    L"leasyncprompt",  &shopt_le_asyncprompt, true, },
     { 0,    0,    L"lecompdebug",    &shopt_le_compdebug,   true, },
     { 0,    0,    L"leconvmeta",     &shopt_le_yesconvmeta, true, },
+    { 0,    0,    L"lefuzzy",        &shopt_le_fuzzy,       true, },
+    { 0,    0,    L"lehighlight",    &shopt_le_highlight,   true, },
     { 0,    0,    L"lenoconvmeta",   &shopt_le_noconvmeta,  true, },
     { 0,    0,    L"lepredict",      &shopt_le_predict,     true, },
     { 0,    0,    L"lepredictempty", &shopt_le_predictempty,true, },
@@ -680,6 +702,8 @@ int set_shell_option(const struct option_T *option, bool enable,
             ensure_foreground();
         reset_job_signals();
     }
+    if (option->optp == &shopt_dircache && !enable)
+        clear_dirlist_cache();
 #if YASH_ENABLE_LINEEDIT
     if (option->optp == &shopt_vi) {
         if (enable)
@@ -17,6 +17,11 @@
 
 
 #include "common.h"
+#if D_TYPE_NEEDS_DEFAULT_SOURCE
+/* make the DT_* constants visible on glibc */
+# define _DEFAULT_SOURCE 1
+# define _BSD_SOURCE 1
+#endif
 #include "path.h"
 #include <assert.h>
 #include <ctype.h>
@@ -31,11 +36,18 @@
 #if HAVE_PATHS_H
 # include <paths.h>
 #endif
+#if HAVE_PTHREAD
+# include <pthread.h>
+#endif
 #include <pwd.h>
+#if HAVE_PTHREAD
+# include <signal.h>
+#endif
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
@@ -549,6 +561,755 @@ void forget_home_directory(const wchar_t *username)
 }
 
 
+/********** Directory Listing Cache **********/
+
+/* Type of a directory entry, as far as known without calling `stat' */
+enum filetype_T {
+    FILETYPE_UNKNOWN, FILETYPE_DIR, FILETYPE_LINK, FILETYPE_OTHER,
+};
+
+/* Listing of the entries in a directory */
+struct dirlist_T {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    unsigned long lastuse;
+    size_t refcount;
+    size_t count;
+    char **names;
+    unsigned char *types;
+};
+/* `path' is the pathname of the directory, which is the key in the cache.
+ * `dev', `ino' and `mtime' are the results of `stat'ing the directory when the
+ * listing was made. The listing is valid as long as they don't change.
+ * `lastuse' is the value of `dirlist_clock' when the listing was last used.
+ * `refcount' is the number of users of the listing plus one if the listing is
+ * in the cache.
+ * `names' is an array of `count' pointers to the entry names, and `types' is an
+ * array of `count' values of `enum filetype_T'. */
+
+/* Object to read entries of a directory via the cache */
+struct cacheddir_T {
+    struct dirlist_T *list;
+    size_t index;
+};
+
+static struct dirlist_T *get_dirlist(
+        const char *restrict path, DIR *restrict dir,
+        const struct stat *restrict st)
+    __attribute__((nonnull(1,2),warn_unused_result));
+static struct dirlist_T *read_dirlist(
+        const char *restrict path, DIR *restrict dir,
+        const struct stat *restrict st)
+    __attribute__((nonnull(1,2),malloc,warn_unused_result));
+static bool is_cacheable_dirlist(const struct stat *st)
+    __attribute__((nonnull));
+static void add_dirlist_to_cache(struct dirlist_T *list)
+    __attribute__((nonnull));
+static void release_dirlist(struct dirlist_T *list)
+    __attribute__((nonnull));
+static inline enum filetype_T dirent_type(const struct dirent *de)
+    __attribute__((nonnull,pure));
+
+#ifndef DIRLIST_CACHE_SIZE
+#define DIRLIST_CACHE_SIZE 32
+#endif
+#ifndef DIRLIST_CACHE_MAX_ENTRIES
+#define DIRLIST_CACHE_MAX_ENTRIES 500000
+#endif
+
+/* A hashtable from directory pathnames to `struct dirlist_T's.
+ * The keys are the `path' members of the values.
+ * The cache keeps at most DIRLIST_CACHE_SIZE directories and
+ * DIRLIST_CACHE_MAX_ENTRIES entries in total. */
+static hashtable_T dirlisthash;
+/* The total number of entries in the cached listings */
+static size_t dirlist_total;
+/* A counter incremented each time a listing is used */
+static unsigned long dirlist_clock;
+
+/* Opens the specified directory for reading its entries with
+ * `read_cached_dir'. If the `dircache' option is set, the listing may be
+ * taken from or entered into the cache.
+ * On error, returns NULL with `errno' set. */
+struct cacheddir_T *open_cached_dir(const char *path)
+{
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+        return NULL;
+
+    struct stat st;
+    bool usecache = shopt_dircache && stat(path, &st) >= 0;
+    struct dirlist_T *list = get_dirlist(path, dir, usecache ? &st : NULL);
+    closedir(dir);
+
+    struct cacheddir_T *cdir = xmalloc(sizeof *cdir);
+    cdir->list = list;
+    cdir->index = 0;
+    return cdir;
+}
+
+/* Returns the name of the next entry in the directory, or NULL if no more
+ * entries are left. */
+const char *read_cached_dir(struct cacheddir_T *cdir)
+{
+    if (cdir->index >= cdir->list->count)
+        return NULL;
+    return cdir->list->names[cdir->index++];
+}
+
+/* Closes the directory opened by `open_cached_dir'. */
+void close_cached_dir(struct cacheddir_T *cdir)
+{
+    release_dirlist(cdir->list);
+    free(cdir);
+}
+
+/* Returns the listing of the directory `path'.
+ * `dir' must be the opened directory and `st' the result of `stat'ing it, or
+ * NULL if the cache should not be used. If a valid listing is found in the
+ * cache, it is returned. Otherwise, the entries are read from `dir' into a new
+ * listing, which is entered into the cache if possible. The returned listing
+ * must be released by `release_dirlist'. */
+struct dirlist_T *get_dirlist(
+        const char *restrict path, DIR *restrict dir,
+        const struct stat *restrict st)
+{
+    bool usecache = st != NULL;
+
+    if (usecache && dirlisthash.capacity > 0) {
+        struct dirlist_T *list = ht_get(&dirlisthash, path).value;
+        if (list != NULL) {
+            if (list->dev == st->st_dev && list->ino == st->st_ino
+                    && list->mtime == st->st_mtime) {
+                list->lastuse = ++dirlist_clock;
+                list->refcount++;
+                return list;
+            }
+            ht_remove(&dirlisthash, path);
+            dirlist_total -= list->count;
+            release_dirlist(list);
+        }
+    }
+
+    struct dirlist_T *list = read_dirlist(path, dir, st);
+    if (usecache && is_cacheable_dirlist(st))
+        add_dirlist_to_cache(list);
+    return list;
+}
+
+/* Reads all the entries of `dir' into a new listing.
+ * `st' is the result of `stat'ing the directory, which may be NULL if the
+ * listing is not to be cached. */
+struct dirlist_T *read_dirlist(
+        const char *restrict path, DIR *restrict dir,
+        const struct stat *restrict st)
+{
+    plist_T names;
+    xstrbuf_T types;
+    pl_init(&names);
+    sb_init(&types);
+
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        pl_add(&names, xstrdup(de->d_name));
+        sb_ccat(&types, (char) dirent_type(de));
+    }
+
+    struct dirlist_T *list = xmalloc(sizeof *list);
+    list->path = xstrdup(path);
+    if (st != NULL) {
+        list->dev = st->st_dev;
+        list->ino = st->st_ino;
+        list->mtime = st->st_mtime;
+    }
+    list->lastuse = ++dirlist_clock;
+    list->refcount = 1;
+    list->count = names.length;
+    list->names = (char **) pl_toary(&names);
+    list->types = (unsigned char *) sb_tostr(&types);
+    return list;
+}
+
+/* Decides if a listing of a directory with the given `stat' result can be
+ * cached.
+ * A directory modified in the last two seconds is not cached because another
+ * modification within the same second would not change its modification time.
+ */
+bool is_cacheable_dirlist(const struct stat *st)
+{
+    time_t now = time(NULL);
+    return now != (time_t) -1 && difftime(now, st->st_mtime) >= 2.0;
+}
+
+/* Enters the listing into the cache, evicting least recently used ones if the
+ * cache is full. */
+void add_dirlist_to_cache(struct dirlist_T *list)
+{
+    if (list->count > DIRLIST_CACHE_MAX_ENTRIES)
+        return;
+
+    if (dirlisthash.capacity == 0)
+        ht_initwithcapacity(&dirlisthash, hashstr, htstrcmp,
+                DIRLIST_CACHE_SIZE);
+
+    while (dirlisthash.count >= DIRLIST_CACHE_SIZE ||
+            dirlist_total + list->count > DIRLIST_CACHE_MAX_ENTRIES) {
+        struct dirlist_T *oldest = NULL;
+        size_t index = 0;
+        kvpair_T kv;
+        while ((kv = ht_next(&dirlisthash, &index)).key != NULL) {
+            struct dirlist_T *l = kv.value;
+            if (oldest == NULL || l->lastuse < oldest->lastuse)
+                oldest = l;
+        }
+        assert(oldest != NULL);
+        ht_remove(&dirlisthash, oldest->path);
+        dirlist_total -= oldest->count;
+        release_dirlist(oldest);
+    }
+
+    list->refcount++;
+    ht_set(&dirlisthash, list->path, list);
+    dirlist_total += list->count;
+}
+
+/* Decrements the reference count of the listing and frees it if it reaches
+ * zero. */
+void release_dirlist(struct dirlist_T *list)
+{
+    assert(list->refcount > 0);
+    if (--list->refcount > 0)
+        return;
+
+    plfree((void **) list->names, free);
+    free(list->types);
+    free(list->path);
+    free(list);
+}
+
+/* Empties the directory listing cache. */
+void clear_dirlist_cache(void)
+{
+    if (dirlisthash.capacity == 0)
+        return;
+
+    size_t index = 0;
+    kvpair_T kv;
+    while ((kv = ht_next(&dirlisthash, &index)).key != NULL)
+        release_dirlist(kv.value);
+    ht_clear(&dirlisthash, NULL);
+    dirlist_total = 0;
+}
+
+/* Returns the type of the directory entry, or FILETYPE_UNKNOWN if the system
+ * does not tell. */
+enum filetype_T dirent_type(const struct dirent *de)
+{
+#if HAVE_D_TYPE
+    switch (de->d_type) {
+        case DT_UNKNOWN:  return FILETYPE_UNKNOWN;
+        case DT_DIR:      return FILETYPE_DIR;
+        case DT_LNK:      return FILETYPE_LINK;
+        default:          return FILETYPE_OTHER;
+    }
+#else
+    (void) de;
+    return FILETYPE_UNKNOWN;
+#endif
+}
+
+
+/********** Command Name Index **********/
+
+/* Sorted list of the names of the executable regular files in a directory */
+struct cmdindex_T {
+    char *path;
+    bool built, stale;
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    size_t count;
+    char **names;
+};
+/* `path' is the pathname of the directory as it appears in $PATH.
+ * `built' is true iff `names' has been built. When `built' is true, `dev',
+ * `ino' and `mtime' are the results of `stat'ing the directory when the index
+ * was built, and the index is valid as long as they don't change unless
+ * `stale' is true. `stale' is set if the directory was modified so recently
+ * that a further modification might not change `mtime'.
+ * `names' is an array of `count' entry names sorted by `strcmp'. */
+
+static void sync_command_index(char *const *paths)
+    __attribute__((nonnull));
+static bool update_cmdindex(struct cmdindex_T *index, bool interrupted(void))
+    __attribute__((nonnull(1)));
+static void free_cmdindex(void *index);
+static int cmdindex_namecmp(const void *p1, const void *p2)
+    __attribute__((nonnull,pure));
+
+#ifndef CMDINDEX_INTERRUPT_CHECK_INTERVAL
+#define CMDINDEX_INTERRUPT_CHECK_INTERVAL 64
+#endif
+
+/* An array of pointers to `struct cmdindex_T's, one for each directory in
+ * $PATH, in the same order as in $PATH. */
+static plist_T cmdindexes;
+
+/* Brings the command name index up to date with $PATH and the contents of the
+ * directories.
+ * If `interrupted' is non-NULL, it is called every now and then and the update
+ * is abandoned as soon as it returns true.
+ * Returns true iff the whole index has been updated. */
+bool update_command_index(bool interrupted(void))
+{
+    char *const *paths = get_path_array(PA_PATH);
+    if (paths == NULL) {
+        clear_command_index();
+        return true;
+    }
+
+    sync_command_index(paths);
+    for (size_t i = 0; i < cmdindexes.length; i++) {
+        if (interrupted != NULL && interrupted())
+            return false;
+        if (!update_cmdindex(cmdindexes.contents[i], interrupted))
+            return false;
+    }
+    return true;
+}
+
+/* Rearranges `cmdindexes' so that it corresponds to `paths', reusing the
+ * existing indexes for the directories that remain in `paths'. */
+void sync_command_index(char *const *paths)
+{
+    if (cmdindexes.contents == NULL)
+        pl_init(&cmdindexes);
+
+    size_t i = 0;
+    for (; paths[i] != NULL; i++) {
+        if (i < cmdindexes.length) {
+            struct cmdindex_T *index = cmdindexes.contents[i];
+            if (strcmp(index->path, paths[i]) == 0)
+                continue;
+        }
+
+        /* find the index for `paths[i]' among the rest, or create a new one */
+        struct cmdindex_T *index = NULL;
+        for (size_t j = i + 1; j < cmdindexes.length; j++) {
+            struct cmdindex_T *idx = cmdindexes.contents[j];
+            if (strcmp(idx->path, paths[i]) == 0) {
+                index = idx;
+                pl_remove(&cmdindexes, j, 1);
+                break;
+            }
+        }
+        if (index == NULL) {
+            index = xmalloc(sizeof *index);
+            index->path = xstrdup(paths[i]);
+            index->built = false;
+            index->count = 0;
+            index->names = NULL;
+        }
+        void *elem = index;
+        pl_ninsert(&cmdindexes, i, &elem, 1);
+    }
+
+    /* remove the indexes for the directories no longer in $PATH */
+    while (cmdindexes.length > i) {
+        free_cmdindex(cmdindexes.contents[cmdindexes.length - 1]);
+        pl_remove(&cmdindexes, cmdindexes.length - 1, 1);
+    }
+}
+
+/* Rebuilds the index if the directory has been modified since the index was
+ * built.
+ * Returns false iff `interrupted' returned true, in which case the index is
+ * left unchanged. */
+bool update_cmdindex(struct cmdindex_T *index, bool interrupted(void))
+{
+    struct stat st;
+    if (stat(index->path, &st) < 0) {
+        plfree((void **) index->names, free);
+        index->built = false;
+        index->count = 0;
+        index->names = NULL;
+        return true;
+    }
+
+    if (index->built && !index->stale && index->dev == st.st_dev
+            && index->ino == st.st_ino && index->mtime == st.st_mtime)
+        return true;
+
+    DIR *dir = opendir(index->path);
+    if (dir == NULL)
+        return true;
+
+    plist_T names;
+    xstrbuf_T path;
+    pl_init(&names);
+    sb_init(&path);
+    sb_cat(&path, index->path);
+    if (path.length > 0 && path.contents[path.length - 1] != '/')
+        sb_ccat(&path, '/');
+    size_t dirpathlen = path.length;
+
+    struct dirent *de;
+    unsigned count = 0;
+    while ((de = readdir(dir)) != NULL) {
+        if (interrupted != NULL
+                && ++count % CMDINDEX_INTERRUPT_CHECK_INTERVAL == 0
+                && interrupted()) {
+            closedir(dir);
+            sb_destroy(&path);
+            plfree(pl_toary(&names), free);
+            return false;
+        }
+        if (dirent_type(de) == FILETYPE_DIR)
+            continue;
+        sb_cat(&path, de->d_name);
+        if (is_executable_regular(path.contents))
+            pl_add(&names, xstrdup(de->d_name));
+        sb_truncate(&path, dirpathlen);
+    }
+    closedir(dir);
+    sb_destroy(&path);
+
+    qsort(names.contents, names.length, sizeof *names.contents,
+            cmdindex_namecmp);
+
+    plfree((void **) index->names, free);
+    index->built = true;
+    index->stale = !is_cacheable_dirlist(&st);
+    index->dev = st.st_dev;
+    index->ino = st.st_ino;
+    index->mtime = st.st_mtime;
+    index->count = names.length;
+    index->names = (char **) pl_toary(&names);
+    return true;
+}
+
+/* Frees the specified `struct cmdindex_T'. */
+void free_cmdindex(void *index)
+{
+    struct cmdindex_T *idx = index;
+    plfree((void **) idx->names, free);
+    free(idx->path);
+    free(idx);
+}
+
+/* Compares two strings pointed to by `p1' and `p2' by `strcmp'. */
+int cmdindex_namecmp(const void *p1, const void *p2)
+{
+    return strcmp(*(char *const *) p1, *(char *const *) p2);
+}
+
+/* Returns the names in the command name index for the `dirindex'th directory
+ * in $PATH that start with `prefix'.
+ * The names are returned as a pointer to the first of them in the sorted
+ * array. The number of the names is assigned to `*countp'.
+ * Returns NULL if `dirindex' is not less than the number of the directories in
+ * the index. `update_command_index' should be called before this function. */
+char *const *get_command_index_range(
+        size_t dirindex, const char *restrict prefix, size_t *restrict countp)
+{
+    if (cmdindexes.contents == NULL || dirindex >= cmdindexes.length)
+        return NULL;
+
+    const struct cmdindex_T *index = cmdindexes.contents[dirindex];
+    size_t prefixlen = strlen(prefix);
+
+    /* find the first name not less than `prefix' */
+    size_t lo = 0, hi = index->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(index->names[mid], prefix) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    size_t end = lo;
+    while (end < index->count
+            && strncmp(index->names[end], prefix, prefixlen) == 0)
+        end++;
+
+    *countp = end - lo;
+    return &index->names[lo];
+}
+
+/* Empties the command name index. */
+void clear_command_index(void)
+{
+    if (cmdindexes.contents == NULL)
+        return;
+
+    plfree(pl_toary(&cmdindexes), free_cmdindex);
+    cmdindexes.contents = NULL;
+}
+
+
+/********** Autoload Bundle **********/
+
+/* A bundle is a single file that contains the contents of all the files in the
+ * "completion" directory. Having a bundle named "completion.bundle" in a
+ * directory of $YASH_LOADPATH, the shell can look up completion files without
+ * searching the directory for each file.
+ * A bundle starts with the line "#yash-bundle", followed by lines each of
+ * which contains the name, offset and length of a file separated by a space.
+ * The name is relative to the directory in $YASH_LOADPATH, like
+ * "completion/INIT". The list of files ends with a line "%%", which is
+ * followed by the contents of the files. The offsets are counted from the
+ * beginning of the contents.
+ * A bundle is not used if the "completion" directory is newer than the
+ * bundle, that is, files may have been added or removed since the bundle was
+ * made. A file in a bundle is not used if the actual file is newer than the
+ * bundle or differs in size, that is, the file may have been edited. Files
+ * missing in the bundle are looked up in the directory as usual. */
+
+#define BUNDLE_NAME "completion.bundle"
+#define BUNDLE_DIR "completion"
+#define BUNDLE_MAGIC "#yash-bundle\n"
+#define BUNDLE_HEADER_END "%%\n"
+
+/* A bundle read into memory */
+struct loadbundle_T {
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    char *contents;
+    size_t size;
+    hashtable_T index;
+};
+/* `dev', `ino' and `mtime' are the results of `stat'ing the bundle file when
+ * it was mapped.
+ * `contents' is the private memory mapping of the bundle file of `size' bytes,
+ * in which the newlines and spaces in the header are replaced with null
+ * characters.
+ * `index' is a hashtable from the file names to `struct bundleentry_T's. The
+ * keys point into `contents'. */
+
+/* A file in a bundle */
+struct bundleentry_T {
+    size_t offset, length;
+};
+
+static struct loadbundle_T *get_load_bundle(const char *dir)
+    __attribute__((nonnull));
+static struct loadbundle_T *read_load_bundle(
+        const char *restrict path, const struct stat *restrict st)
+    __attribute__((nonnull,malloc,warn_unused_result));
+static bool parse_load_bundle(struct loadbundle_T *bundle)
+    __attribute__((nonnull));
+static bool is_bundle_entry_current(const struct loadbundle_T *bundle,
+        const struct bundleentry_T *entry, const char *path)
+    __attribute__((nonnull));
+static void free_load_bundle(struct loadbundle_T *bundle);
+
+/* A hashtable from directory pathnames (char *) to the bundles in them
+ * (struct loadbundle_T *). */
+static hashtable_T loadbundlehash;
+
+/* Searches $YASH_LOADPATH for the file `name' to be autoloaded, just like
+ * `which(name, get_path_array(PA_LOADPATH), is_readable_regular)'.
+ * If the file is found in a bundle, a copy of its contents is assigned to
+ * `*codep'. Otherwise, NULL is assigned to `*codep'.
+ * Returns the pathname of the file, or NULL if not found. The pathname and the
+ * contents must be freed by the caller. */
+char *which_autoload(const char *restrict name, char **restrict codep)
+{
+    *codep = NULL;
+
+    char *const *dirs = get_path_array(PA_LOADPATH);
+    if (name[0] == '\0' || name[0] == '/' || dirs == NULL
+            || strncmp(name, BUNDLE_DIR "/", strlen(BUNDLE_DIR "/")) != 0)
+        return which(name, dirs, is_readable_regular);
+
+    for (const char *dir; (dir = *dirs) != NULL; dirs++) {
+        struct loadbundle_T *bundle = get_load_bundle(dir);
+        const struct bundleentry_T *entry =
+            (bundle != NULL) ? ht_get(&bundle->index, name).value : NULL;
+        if (entry != NULL) {
+            xstrbuf_T path;
+            sb_init(&path);
+            sb_cat(&path, dir);
+            if (path.length > 0 && path.contents[path.length - 1] != '/')
+                sb_ccat(&path, '/');
+            sb_cat(&path, name);
+            if (is_bundle_entry_current(bundle, entry, path.contents)) {
+                char *code = xmalloc(entry->length + 1);
+                memcpy(code, &bundle->contents[entry->offset], entry->length);
+                code[entry->length] = '\0';
+                *codep = code;
+                return sb_tostr(&path);
+            }
+            sb_destroy(&path);
+        }
+
+        char *const onedir[] = { (char *) dir, NULL };
+        char *path = which(name, onedir, is_readable_regular);
+        if (path != NULL)
+            return path;
+    }
+    return NULL;
+}
+
+/* Returns the valid bundle in the specified directory, or NULL if there is
+ * none. The bundle is read from the file or taken from `loadbundlehash'. */
+struct loadbundle_T *get_load_bundle(const char *dir)
+{
+    xstrbuf_T path;
+    sb_init(&path);
+    sb_cat(&path, dir);
+    if (path.length > 0 && path.contents[path.length - 1] != '/')
+        sb_ccat(&path, '/');
+    size_t dirlen = path.length;
+
+    struct loadbundle_T *bundle = NULL;
+    struct stat st, dirst;
+    sb_cat(&path, BUNDLE_NAME);
+    if (stat(path.contents, &st) < 0 || !S_ISREG(st.st_mode))
+        goto end;
+    sb_truncate(&path, dirlen);
+    sb_cat(&path, BUNDLE_DIR);
+    if (stat(path.contents, &dirst) >= 0 && dirst.st_mtime > st.st_mtime)
+        goto end;
+
+    if (loadbundlehash.capacity == 0)
+        ht_init(&loadbundlehash, hashstr, htstrcmp);
+
+    bundle = ht_get(&loadbundlehash, dir).value;
+    if (bundle != NULL) {
+        if (bundle->dev == st.st_dev && bundle->ino == st.st_ino
+                && bundle->mtime == st.st_mtime)
+            goto end;
+        kvpair_T kv = ht_remove(&loadbundlehash, dir);
+        free(kv.key);
+        free_load_bundle(kv.value);
+    }
+
+    sb_truncate(&path, dirlen);
+    sb_cat(&path, BUNDLE_NAME);
+    bundle = read_load_bundle(path.contents, &st);
+    if (bundle != NULL)
+        ht_set(&loadbundlehash, xstrdup(dir), bundle);
+
+end:
+    sb_destroy(&path);
+    return bundle;
+}
+
+/* Maps the bundle file `path' whose `stat' result is `st' into memory.
+ * Returns NULL if the file cannot be mapped or is not a valid bundle. */
+struct loadbundle_T *read_load_bundle(
+        const char *restrict path, const struct stat *restrict st)
+{
+    if (st->st_size <= 0 || (uintmax_t) st->st_size > SIZE_MAX)
+        return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    size_t size = (size_t) st->st_size;
+    void *contents = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+            fd, 0);
+    xclose(fd);
+    if (contents == MAP_FAILED)
+        return NULL;
+
+    struct loadbundle_T *bundle = xmalloc(sizeof *bundle);
+    bundle->dev = st->st_dev;
+    bundle->ino = st->st_ino;
+    bundle->mtime = st->st_mtime;
+    bundle->contents = contents;
+    bundle->size = size;
+    ht_init(&bundle->index, hashstr, htstrcmp);
+    if (!parse_load_bundle(bundle)) {
+        free_load_bundle(bundle);
+        return NULL;
+    }
+    return bundle;
+}
+
+/* Parses the header of the bundle and fills `bundle->index'.
+ * Returns false if the bundle is malformed. */
+bool parse_load_bundle(struct loadbundle_T *bundle)
+{
+    char *s = bundle->contents, *end = s + bundle->size;
+    if (bundle->size < strlen(BUNDLE_MAGIC)
+            || memcmp(s, BUNDLE_MAGIC, strlen(BUNDLE_MAGIC)) != 0)
+        return false;
+    s += strlen(BUNDLE_MAGIC);
+
+    /* first, find the end of the header */
+    char *body = s;
+    for (;;) {
+        char *nl = memchr(body, '\n', end - body);
+        if (nl == NULL)
+            return false;
+        bool last = (size_t) (nl - body) == strlen(BUNDLE_HEADER_END) - 1
+            && memcmp(body, BUNDLE_HEADER_END, nl - body) == 0;
+        body = nl + 1;
+        if (last)
+            break;
+    }
+    size_t bodysize = end - body;
+
+    /* then, parse the lines in the header */
+    for (char *nl; (nl = memchr(s, '\n', end - s)) < body - 1; s = nl + 1) {
+        *nl = '\0';
+
+        char *sp = strchr(s, ' ');
+        if (sp == NULL)
+            return false;
+        *sp = '\0';
+
+        unsigned long offset, length;
+        char *e;
+        errno = 0;
+        offset = strtoul(sp + 1, &e, 10);
+        if (*e != ' ')
+            return false;
+        length = strtoul(e + 1, &e, 10);
+        if (*e != '\0' || errno != 0)
+            return false;
+        if (offset > bodysize || length > bodysize - offset)
+            return false;
+
+        struct bundleentry_T *entry = xmalloc(sizeof *entry);
+        entry->offset = (size_t) (body - bundle->contents) + offset;
+        entry->length = length;
+        free(ht_set(&bundle->index, s, entry).value);
+    }
+    return true;
+}
+
+/* Returns false if the actual file `path' of the specified entry seems to have
+ * been modified since the bundle was made. A file that only exists in the
+ * bundle is current. */
+bool is_bundle_entry_current(const struct loadbundle_T *bundle,
+        const struct bundleentry_T *entry, const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) < 0)
+        return true;
+    return (uintmax_t) st.st_size == entry->length
+        && st.st_mtime <= bundle->mtime;
+}
+
+/* Frees the specified bundle. */
+void free_load_bundle(struct loadbundle_T *bundle)
+{
+    if (bundle != NULL) {
+        ht_clear(&bundle->index, vfree);
+        ht_destroy(&bundle->index);
+        munmap(bundle->contents, bundle->size);
+        free(bundle);
+    }
+}
+
 /********** wglob **********/
 
 /* Parsed glob pattern component */
@@ -577,6 +1338,13 @@ struct wglob_search {
     xstrbuf_T path;
     xwcsbuf_T wpath;
     plist_T *results;
+#if HAVE_OPENAT
+    int dirfd;
+    size_t dirfdpathlen;
+#endif
+#if HAVE_PTHREAD
+    struct wglob_pool *pool;
+#endif
 };
 /* `pattern' is an array of pointers to struct wglob_pattern objects. Each
  * wglob_pattern object is called a "component", which corresponds to one
@@ -584,7 +1352,13 @@ struct wglob_search {
  * `path' and `wpath' are intermediate pathnames, denoting the currently
  * searched directory. They are the multi-byte and wide string versions of the
  * same pathname. The multi-byte version is mainly used for calling OS APIs and
- * the wide version for producing the final results. */
+ * the wide version for producing the final results.
+ * `dirfd' is a file descriptor for the directory named by the first
+ * `dirfdpathlen' bytes of `path', which is a prefix of `path' that is empty or
+ * ends with a slash. File system calls are made relative to `dirfd' so that
+ * the kernel need not resolve the whole `path' again for each entry. `dirfd'
+ * is AT_FDCWD while `dirfdpathlen' is zero.
+ * `pool' is non-null iff the search is performed by more than one thread. */
 
 /* Data used in search for one level of directory */
 struct wglob_stack {
@@ -599,6 +1373,41 @@ struct wglob_stack {
  * not active. When non-zero, it is active. For a recursive search component,
  * the value is the depth of the current recursion. */
 
+#if HAVE_PTHREAD
+
+/* Data shared among threads performing a parallel search */
+struct wglob_pool {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    plist_T tasks;
+    size_t threads, idle;
+};
+/* `tasks' is a stack of pointers to `struct wglob_task's that are waiting to be
+ * picked up by an idle thread. A thread that is about to recurse into a
+ * subdirectory hands it over as a new task if there are idle threads.
+ * `threads' is the number of threads participating in the search and `idle'
+ * the number of them waiting for a task. The search is finished when all the
+ * threads are idle and no task is left. The members are protected by `mutex'.
+ */
+
+/* Subdirectory to be searched by another thread */
+struct wglob_task {
+    char *path;
+    wchar_t *wpath;
+    struct wglob_stack *t;
+};
+/* `t' is a private copy of the whole stack for the subdirectory, including all
+ * its ancestors. */
+
+/* Thread performing a parallel search */
+struct wglob_worker {
+    pthread_t thread;
+    struct wglob_search s;
+    plist_T results;
+};
+
+#endif /* HAVE_PTHREAD */
+
 /* The wglob search algorithm used to perform naive search, but it was slow when
  * the pattern contained more than one recursive search component */
 // (e.g. foo/**/bar/**/baz)
@@ -632,8 +1441,8 @@ static void wglob_search(
 static void wglob_search_literal_each(
         struct wglob_search *restrict s, const struct wglob_stack *restrict t)
     __attribute__((nonnull));
-static void wglob_add_result(
-        struct wglob_search *s, bool only_if_existing, bool markdir)
+static void wglob_add_result(struct wglob_search *s,
+        enum filetype_T type, bool only_if_existing, bool markdir)
     __attribute__((nonnull));
 static void wglob_search_literal_uniq(
         struct wglob_search *restrict s, struct wglob_stack *restrict t)
@@ -642,20 +1451,50 @@ static bool wglob_scandir(
         struct wglob_search *restrict s, const struct wglob_stack *restrict t)
     __attribute__((nonnull));
 static void wglob_scandir_entry(
-        const char *name, struct wglob_search *restrict s,
+        const char *name, enum filetype_T type,
+        struct wglob_search *restrict s,
         const struct wglob_stack *restrict t, struct wglob_stack *restrict t2,
         bool only_if_existing)
     __attribute__((nonnull));
 static bool wglob_should_recurse(
-        const char *restrict name, const char *restrict path,
+        const char *restrict name, enum filetype_T type,
+        const struct wglob_search *restrict s,
         const struct wglob_pattern *restrict c, struct wglob_stack *restrict t,
         size_t count)
     __attribute__((nonnull));
+#if HAVE_OPENAT
+static const char *wglob_relpath(const struct wglob_search *s)
+    __attribute__((nonnull,pure));
+#endif
+static DIR *wglob_opendir(const struct wglob_search *s)
+    __attribute__((nonnull));
+static int wglob_stat(const struct wglob_search *restrict s,
+        struct stat *restrict st, bool followlink)
+    __attribute__((nonnull));
 static bool wglob_is_reentry(const struct wglob_stack *const t, size_t count)
     __attribute__((nonnull,pure));
 
-static int wglob_sortcmp(const void *v1, const void *v2)
-    __attribute__((pure,nonnull));
+#if HAVE_PTHREAD
+static size_t wglob_thread_count(const struct wglob_search *s)
+    __attribute__((nonnull));
+static void wglob_search_parallel(struct wglob_search *restrict s,
+        struct wglob_stack *restrict t, size_t threads)
+    __attribute__((nonnull));
+static void *wglob_worker_main(void *w)
+    __attribute__((nonnull));
+static void wglob_work(struct wglob_search *s)
+    __attribute__((nonnull));
+static bool wglob_hand_over(
+        struct wglob_search *restrict s, const struct wglob_stack *restrict t)
+    __attribute__((nonnull));
+static struct wglob_stack *wglob_stack_copy(
+        const struct wglob_search *s, const struct wglob_stack *t)
+    __attribute__((nonnull(1),malloc,warn_unused_result));
+static void wglob_stack_free_all(struct wglob_stack *t);
+#endif
+
+static const wchar_t *wglob_sortstr(const void *p)
+    __attribute__((const,nonnull));
 
 /* A wide string version of `glob'.
  * Adds all pathnames that matches the specified pattern to the specified list.
@@ -673,7 +1512,9 @@ static int wglob_sortcmp(const void *v1, const void *v2)
  * If the pattern is invalid, immediately returns false.
  * If the shell is interactive and SIGINT is not blocked, this function can be
  * interrupted, in which case false is returned.
- * Minor errors such as permission errors are ignored. */
+ * Minor errors such as permission errors are ignored.
+ * A recursive search is performed by as many threads as specified by the
+ * $YASH_GLOB_THREADS variable. */
 bool wglob(const wchar_t *restrict pattern, enum wglobflags_T flags,
         plist_T *restrict list)
 {
@@ -690,11 +1531,24 @@ bool wglob(const wchar_t *restrict pattern, enum wglobflags_T flags,
     sb_init(&s.path);
     wb_init(&s.wpath);
     s.results = list;
+#if HAVE_OPENAT
+    s.dirfd = AT_FDCWD;
+    s.dirfdpathlen = 0;
+#endif
+#if HAVE_PTHREAD
+    s.pool = NULL;
+#endif
 
     struct wglob_stack *t = wglob_stack_new(&s, NULL);
     t->active_components[0] = 1;
 
-    wglob_search(&s, t);
+#if HAVE_PTHREAD
+    size_t threads = wglob_thread_count(&s);
+    if (threads > 1)
+        wglob_search_parallel(&s, t, threads);
+    else
+#endif
+        wglob_search(&s, t);
 
     free(t);
 
@@ -704,7 +1558,7 @@ bool wglob(const wchar_t *restrict pattern, enum wglobflags_T flags,
 
     if (!(flags & WGLB_NOSORT)) {
         size_t count = list->length - listbase;  /* # of resulting items */
-        qsort(list->contents + listbase, count, sizeof (void *), wglob_sortcmp);
+        sort_by_collation(list->contents + listbase, count, wglob_sortstr);
     }
     return !is_interrupted();
 }
@@ -920,7 +1774,7 @@ void wglob_search_literal_each(
             free(t2);
         } else {
             /* This is the last component. */
-            wglob_add_result(s, true, false);
+            wglob_add_result(s, FILETYPE_UNKNOWN, true, false);
         }
 
         sb_truncate(&s->path, savepathlen);
@@ -928,20 +1782,28 @@ void wglob_search_literal_each(
     }
 }
 
-/* Adds `s->path' to `s->results'. */
-void wglob_add_result(
-        struct wglob_search *s, bool only_if_existing, bool markdir)
+/* Adds `s->path' to `s->results'.
+ * `type' is the type of the file if known from the directory entry, in which
+ * case `stat' is not called to decide whether to append a slash. */
+void wglob_add_result(struct wglob_search *s,
+        enum filetype_T type, bool only_if_existing, bool markdir)
 {
-    if (!only_if_existing && !markdir) {
+    if (!only_if_existing && (!markdir || type == FILETYPE_OTHER)) {
         pl_add(s->results, xwcsdup(s->wpath.contents));
         return;
     }
 
-    struct stat st;
-    bool existing = stat(s->path.contents, &st) >= 0;
+    bool existing, isdir;
+    if (!only_if_existing && type == FILETYPE_DIR) {
+        existing = isdir = true;
+    } else {
+        struct stat st;
+        existing = wglob_stat(s, &st, true) >= 0;
+        isdir = existing && S_ISDIR(st.st_mode);
+    }
     if (only_if_existing && !existing)
         return;
-    if (!markdir || !existing || !S_ISDIR(st.st_mode)) {
+    if (!markdir || !isdir) {
         pl_add(s->results, xwcsdup(s->wpath.contents));
         return;
     }
@@ -982,7 +1844,8 @@ void wglob_search_literal_uniq(
     for (const kvpair_T *n = names; n->key != NULL; n++) {
         const struct wglob_pattern *c = n->value;
         memset(t2->active_components, 0, s->pattern.length);
-        wglob_scandir_entry(c->value.literal.name, s, t, t2, true);
+        wglob_scandir_entry(
+                c->value.literal.name, FILETYPE_UNKNOWN, s, t, t2, true);
     }
 
     free(t2);
@@ -995,22 +1858,54 @@ void wglob_search_literal_uniq(
 bool wglob_scandir(
         struct wglob_search *restrict s, const struct wglob_stack *restrict t)
 {
-    DIR* dir = opendir((s->path.length == 0) ? "." : s->path.contents);
+    DIR *dir = wglob_opendir(s);
     if (dir == NULL)
         return false;
 
+#if HAVE_OPENAT
+    int savedirfd = s->dirfd;
+    size_t savedirfdpathlen = s->dirfdpathlen;
+    s->dirfd = dirfd(dir);
+    s->dirfdpathlen = s->path.length;
+#endif
+
+    /* The cache is not shared among threads. */
+    bool usecache = shopt_dircache;
+#if HAVE_PTHREAD
+    usecache &= (s->pool == NULL);
+#endif
+    struct stat st;
+    struct dirlist_T *list = NULL;
+    if (usecache && wglob_stat(s, &st, true) >= 0)
+        list = get_dirlist(
+                (s->path.length == 0) ? "." : s->path.contents, dir, &st);
+
     struct wglob_stack *t2 = wglob_stack_new(s, t);
 
     /* An empty name, which is needed for empty literal components, must be
      * explicitly produced as it would never be returned from readdir. */
-    wglob_scandir_entry("", s, t, t2, true);
+    wglob_scandir_entry("", FILETYPE_UNKNOWN, s, t, t2, true);
 
     /* now try each directory entry */
-    struct dirent *de;
-    while ((de = readdir(dir)) != NULL) {
-        memset(t2->active_components, 0, s->pattern.length);
-        wglob_scandir_entry(de->d_name, s, t, t2, false);
+    if (list != NULL) {
+        for (size_t i = 0; i < list->count; i++) {
+            memset(t2->active_components, 0, s->pattern.length);
+            wglob_scandir_entry(
+                    list->names[i], list->types[i], s, t, t2, false);
+        }
+        release_dirlist(list);
+    } else {
+        struct dirent *de;
+        while ((de = readdir(dir)) != NULL) {
+            memset(t2->active_components, 0, s->pattern.length);
+            wglob_scandir_entry(de->d_name, dirent_type(de), s, t, t2, false);
+        }
     }
+
+#if HAVE_OPENAT
+    s->dirfd = savedirfd;
+    s->dirfdpathlen = savedirfdpathlen;
+#endif
     closedir(dir);
 
     free(t2);
@@ -1022,14 +1917,17 @@ bool wglob_scandir(
  * `t' is the stack frame for the current directory path and `t2' for the next
  * frame. `t2->prev' must be `t' and `t2->active_components' must have been
  * zeroed.
+ * `type' is the type of the file if known from the directory entry.
  * `only_if_existing' is passed to `wglob_add_result' and should be false iff
  * the `name' is known to be an existing file. */
 void wglob_scandir_entry(
-        const char *name, struct wglob_search *restrict s,
+        const char *name, enum filetype_T type,
+        struct wglob_search *restrict s,
         const struct wglob_stack *restrict t, struct wglob_stack *restrict t2,
         bool only_if_existing)
 {
     size_t savepathlen = s->path.length, savewpathlen = s->wpath.length;
+    bool recursing = false;
 
     sb_cat(&s->path, name);
     if (wb_mbscat(&s->wpath, name) != NULL)
@@ -1048,7 +1946,7 @@ void wglob_scandir_entry(
                 if (i + 1 < s->pattern.length) // has a next component?
                     t2->active_components[i + 1] = 1;
                 else
-                    wglob_add_result(s, only_if_existing, false);
+                    wglob_add_result(s, type, only_if_existing, false);
                 break;
             case WGLOB_MATCH:
                 if (name[0] == '\0')
@@ -1058,17 +1956,19 @@ void wglob_scandir_entry(
                 if (i + 1 < s->pattern.length) // has a next component?
                     t2->active_components[i + 1] = 1;
                 else
-                    wglob_add_result(s, only_if_existing, s->flags & WGLB_MARK);
+                    wglob_add_result(s, type, only_if_existing,
+                            s->flags & WGLB_MARK);
                 break;
             case WGLOB_RECSEARCH:
                 assert(i + 1 < s->pattern.length);
                 if (name[0] == '\0')
                     continue;
                 if (t2->active_components[i] == 0) {
-                    const char *path = s->path.contents;
                     size_t count = t->active_components[i] - 1;
-                    if (wglob_should_recurse(name, path, c, t2, count))
+                    if (wglob_should_recurse(name, type, s, c, t2, count)) {
                         t2->active_components[i] = t->active_components[i] + 1;
+                        recursing = true;
+                    }
                 }
                 break;
         }
@@ -1077,6 +1977,14 @@ void wglob_scandir_entry(
     sb_ccat(&s->path, '/');
     wb_wccat(&s->wpath, L'/');
 
+#if HAVE_PTHREAD
+    /* let an idle thread search the subdirectory if any */
+    if (recursing && s->pool != NULL && wglob_hand_over(s, t2))
+        goto done;
+#else
+    (void) recursing;
+#endif
+
     /* descend down to the next subdirectory */
     wglob_search(s, t2);
 
@@ -1086,10 +1994,11 @@ done:
 }
 
 /* Decides if we should continue recursion on this component.
- * In this function, `t->st' is updated to the result of `stat'ing the `path'.
- */
+ * In this function, `t->st' is updated to the result of `stat'ing `s->path'
+ * unless `type' tells that it is not a directory. */
 bool wglob_should_recurse(
-        const char *restrict name, const char *restrict path,
+        const char *restrict name, enum filetype_T type,
+        const struct wglob_search *restrict s,
         const struct wglob_pattern *restrict c, struct wglob_stack *restrict t,
         size_t count)
 {
@@ -1101,9 +2010,10 @@ bool wglob_should_recurse(
             return false;
     }
 
-    int (*statfunc)(const char *path, struct stat *st) =
-        c->value.recsearch.followlink ? stat : lstat;
-    if (statfunc(path, &t->st) < 0)
+    bool followlink = c->value.recsearch.followlink;
+    if (type == FILETYPE_OTHER || (type == FILETYPE_LINK && !followlink))
+        return false;
+    if (wglob_stat(s, &t->st, followlink) < 0)
         return false;
     if (!S_ISDIR(t->st.st_mode))
         return false;
@@ -1124,9 +2034,253 @@ bool wglob_is_reentry(const struct wglob_stack *const t, size_t count)
     return false;
 }
 
-int wglob_sortcmp(const void *v1, const void *v2)
+#if HAVE_OPENAT
+
+/* Returns `s->path' relative to `s->dirfd'. */
+const char *wglob_relpath(const struct wglob_search *s)
+{
+    const char *rel = &s->path.contents[s->dirfdpathlen];
+    if (s->dirfdpathlen > 0)
+        while (rel[0] == '/')  /* `s->path' may contain successive slashes */
+            rel++;
+    return (rel[0] == '\0') ? "." : rel;
+}
+
+#endif /* HAVE_OPENAT */
+
+/* Opens the directory `s->path'. */
+DIR *wglob_opendir(const struct wglob_search *s)
+{
+#if HAVE_OPENAT
+    int fd = openat(s->dirfd, wglob_relpath(s), O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return NULL;
+
+    DIR *dir = fdopendir(fd);
+    if (dir == NULL)
+        xclose(fd);
+    return dir;
+#else
+    return opendir((s->path.length == 0) ? "." : s->path.contents);
+#endif
+}
+
+/* Calls `stat' (or `lstat' if `followlink' is false) for `s->path'. */
+int wglob_stat(const struct wglob_search *restrict s,
+        struct stat *restrict st, bool followlink)
+{
+#if HAVE_OPENAT
+    return fstatat(s->dirfd, wglob_relpath(s), st,
+            followlink ? 0 : AT_SYMLINK_NOFOLLOW);
+#else
+    const char *path = (s->path.length == 0) ? "." : s->path.contents;
+    return followlink ? stat(path, st) : lstat(path, st);
+#endif
+}
+
+#if HAVE_PTHREAD
+
+/* Returns the number of threads that should perform the search.
+ * The value of $YASH_GLOB_THREADS is used if the pattern contains a recursive
+ * search component and the results are to be sorted. Otherwise, returns 1. */
+size_t wglob_thread_count(const struct wglob_search *s)
+{
+#ifndef WGLOB_MAX_THREADS
+#define WGLOB_MAX_THREADS 64
+#endif
+
+    if (s->flags & WGLB_NOSORT)
+        return 1;  // The order of results would be non-deterministic.
+
+    bool recursive = false;
+    for (size_t i = 0; i < s->pattern.length; i++) {
+        const struct wglob_pattern *c = s->pattern.contents[i];
+        if (c->type == WGLOB_RECSEARCH) {
+            recursive = true;
+            break;
+        }
+    }
+    if (!recursive)
+        return 1;
+
+    const wchar_t *v = getvar(L VAR_YASH_GLOB_THREADS);
+    int count;
+    if (v == NULL || !xwcstoi(v, 10, &count) || count < 1)
+        return 1;
+    return (count < WGLOB_MAX_THREADS) ? (size_t) count : WGLOB_MAX_THREADS;
+}
+
+/* Performs `wglob_search(s, t)' using at most `threads' threads including the
+ * calling thread.
+ * The other threads block all signals so that signals are handled by the
+ * calling thread as usual. The results of all the threads are added to
+ * `s->results' when all the threads have finished. */
+void wglob_search_parallel(struct wglob_search *restrict s,
+        struct wglob_stack *restrict t, size_t threads)
+{
+    struct wglob_pool pool;
+    pthread_mutex_init(&pool.mutex, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+    pl_init(&pool.tasks);
+    pool.threads = 1;
+    pool.idle = 0;
+    s->pool = &pool;
+
+    struct wglob_worker *workers = xmallocn(threads - 1, sizeof *workers);
+    size_t count;
+    sigset_t all, saveset;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saveset);
+    for (count = 0; count < threads - 1; count++) {
+        struct wglob_worker *w = &workers[count];
+        w->s.pattern = s->pattern;
+        w->s.flags = s->flags;
+        sb_init(&w->s.path);
+        wb_init(&w->s.wpath);
+        w->s.results = pl_init(&w->results);
+#if HAVE_OPENAT
+        w->s.dirfd = AT_FDCWD;
+        w->s.dirfdpathlen = 0;
+#endif
+        w->s.pool = &pool;
+
+        pthread_mutex_lock(&pool.mutex);
+        pool.threads++;
+        pthread_mutex_unlock(&pool.mutex);
+        if (pthread_create(&w->thread, NULL, wglob_worker_main, w) != 0) {
+            pthread_mutex_lock(&pool.mutex);
+            pool.threads--;
+            pthread_mutex_unlock(&pool.mutex);
+            sb_destroy(&w->s.path);
+            wb_destroy(&w->s.wpath);
+            pl_destroy(&w->results);
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &saveset, NULL);
+
+    wglob_search(s, t);
+    wglob_work(s);
+
+    for (size_t i = 0; i < count; i++) {
+        struct wglob_worker *w = &workers[i];
+        pthread_join(w->thread, NULL);
+        pl_ncat(s->results, w->results.contents, w->results.length);
+        sb_destroy(&w->s.path);
+        wb_destroy(&w->s.wpath);
+        pl_destroy(&w->results);
+    }
+    free(workers);
+
+    assert(pool.tasks.length == 0);
+    pl_destroy(&pool.tasks);
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.mutex);
+    s->pool = NULL;
+}
+
+void *wglob_worker_main(void *w)
+{
+    wglob_work(&((struct wglob_worker *) w)->s);
+    return NULL;
+}
+
+/* Performs tasks in `s->pool' until the search is finished. */
+void wglob_work(struct wglob_search *s)
+{
+    struct wglob_pool *pool = s->pool;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        if (pool->tasks.length > 0) {
+            size_t last = pool->tasks.length - 1;
+            struct wglob_task *task = pool->tasks.contents[last];
+            pl_truncate(&pool->tasks, last);
+            pthread_mutex_unlock(&pool->mutex);
+
+            sb_cat(&s->path, task->path);
+            wb_cat(&s->wpath, task->wpath);
+            wglob_search(s, task->t);
+            sb_truncate(&s->path, 0);
+            wb_truncate(&s->wpath, 0);
+
+            free(task->path);
+            free(task->wpath);
+            wglob_stack_free_all(task->t);
+            free(task);
+
+            pthread_mutex_lock(&pool->mutex);
+            continue;
+        }
+
+        if (++pool->idle == pool->threads) {
+            /* No thread is left that may produce a new task. */
+            pthread_cond_broadcast(&pool->cond);
+            break;
+        }
+        do
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        while (pool->tasks.length == 0 && pool->idle < pool->threads);
+        if (pool->tasks.length == 0)
+            break;
+        pool->idle--;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/* Passes the subdirectory `s->path' to another thread if there is an idle one.
+ * `t' is the stack frame for the subdirectory.
+ * Returns true iff passed, in which case the caller must not search the
+ * subdirectory. */
+bool wglob_hand_over(
+        struct wglob_search *restrict s, const struct wglob_stack *restrict t)
+{
+    struct wglob_pool *pool = s->pool;
+    bool handed = false;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->tasks.length < pool->idle) {
+        struct wglob_task *task = xmalloc(sizeof *task);
+        task->path = xstrdup(s->path.contents);
+        task->wpath = xwcsdup(s->wpath.contents);
+        task->t = wglob_stack_copy(s, t);
+        pl_add(&pool->tasks, task);
+        pthread_cond_signal(&pool->cond);
+        handed = true;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return handed;
+}
+
+/* Returns a newly malloced copy of stack frame `t' and all its ancestors. */
+struct wglob_stack *wglob_stack_copy(
+        const struct wglob_search *s, const struct wglob_stack *t)
+{
+    if (t == NULL)
+        return NULL;
+
+    struct wglob_stack *copy = wglob_stack_new(s, NULL);
+    copy->st = t->st;
+    memcpy(copy->active_components, t->active_components, s->pattern.length);
+    copy->prev = wglob_stack_copy(s, t->prev);
+    return copy;
+}
+
+/* Frees stack frame `t' and all its ancestors. */
+void wglob_stack_free_all(struct wglob_stack *t)
+{
+    while (t != NULL) {
+        struct wglob_stack *prev = (struct wglob_stack *) t->prev;
+        free(t);
+        t = prev;
+    }
+}
+
+#endif /* HAVE_PTHREAD */
+
+const wchar_t *wglob_sortstr(const void *p)
 {
-    return wcscoll(*(const wchar_t *const *) v1, *(const wchar_t *const *) v2);
+    return p;
 }
 
 
@@ -1616,6 +2770,8 @@ int hash_builtin(int argc, void **argv)
         if (remove) {
             if (xoptind == argc) {  // forget all
                 clear_cmdhash();
+                clear_command_index();
+                clear_dirlist_cache();
             } else {                // forget the specified
                 for (int i = xoptind; i < argc; i++) {
                     char *cmd = malloc_wcstombs(ARGV(i));
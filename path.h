@@ -87,6 +87,34 @@ extern const wchar_t *get_home_directory(
     __attribute__((nonnull));
 
 
+/********** Directory Listing Cache **********/
+
+struct cacheddir_T;
+
+extern struct cacheddir_T *open_cached_dir(const char *path)
+    __attribute__((nonnull,warn_unused_result));
+extern const char *read_cached_dir(struct cacheddir_T *cdir)
+    __attribute__((nonnull));
+extern void close_cached_dir(struct cacheddir_T *cdir)
+    __attribute__((nonnull));
+extern void clear_dirlist_cache(void);
+
+
+/********** Command Name Index **********/
+
+extern _Bool update_command_index(_Bool interrupted(void));
+extern char *const *get_command_index_range(
+        size_t dirindex, const char *restrict prefix, size_t *restrict countp)
+    __attribute__((nonnull));
+extern void clear_command_index(void);
+
+
+/********** Autoload Bundle **********/
+
+extern char *which_autoload(const char *restrict name, char **restrict codep)
+    __attribute__((nonnull,malloc,warn_unused_result));
+
+
 /********** wglob **********/
 
 enum wglobflags_T {
@@ -627,13 +627,21 @@ int wait_for_sigchld(bool interruptible, bool return_on_trap)
  * specified timeout, which means that this function may wait for a time length
  * longer than the specified timeout. */
 enum wait_for_input_T wait_for_input(int fd, bool trap, int timeout)
+{
+    return wait_for_inputs(fd, -1, trap, timeout);
+}
+
+/* Like `wait_for_input', but also waits for file descriptor `subfd' if it is
+ * non-negative. Returns W_READY if `fd' is available for reading, or
+ * W_SUBREADY if `subfd' is available but `fd' is not. */
+enum wait_for_input_T wait_for_inputs(int fd, int subfd, bool trap, int timeout)
 {
     sigset_t ss;
     struct timespec to;
     struct timespec *top;
 
     assert(fd >= 0);
-    if (fd >= FD_SETSIZE) {
+    if (fd >= FD_SETSIZE || subfd >= FD_SETSIZE) {
         xerror(0, Ngt("too many files are opened for yash to handle"));
         return W_ERROR;
     }
@@ -673,16 +681,24 @@ enum wait_for_input_T wait_for_input(int fd, bool trap, int timeout)
         fd_set fdset;
         FD_ZERO(&fdset);
         FD_SET(fd, &fdset);
+        if (subfd >= 0)
+            FD_SET(subfd, &fdset);
 
-        int count = pselect(fd + 1, &fdset, NULL, NULL, top, &ss);
+        int count = pselect((fd > subfd ? fd : subfd) + 1,
+                &fdset, NULL, NULL, top, &ss);
 
         if (trap && sigint_received) {
             sigint_received = false;
             return W_INTERRUPTED;
         }
 
-        if (count >= 0)
-            return FD_ISSET(fd, &fdset) ? W_READY : W_TIMED_OUT;
+        if (count >= 0) {
+            if (FD_ISSET(fd, &fdset))
+                return W_READY;
+            if (subfd >= 0 && FD_ISSET(subfd, &fdset))
+                return W_SUBREADY;
+            return W_TIMED_OUT;
+        }
 
         if (errno != EINTR) {
             xerror(errno, "pselect");
@@ -1063,6 +1079,12 @@ void set_interrupted(void)
     sigint_received = true;
 }
 
+/* Clears the `sigint_received' flag. */
+void clear_interrupted(void)
+{
+    sigint_received = false;
+}
+
 #if YASH_ENABLE_LINEEDIT
 
 #ifdef SIGWINCH
@@ -47,10 +47,12 @@ extern void handle_signals(void);
 extern int wait_for_sigchld(_Bool interruptible, _Bool return_on_trap);
 
 enum wait_for_input_T {
-    W_READY, W_TIMED_OUT, W_INTERRUPTED, W_ERROR,
+    W_READY, W_SUBREADY, W_TIMED_OUT, W_INTERRUPTED, W_ERROR,
 };
 
 extern enum wait_for_input_T wait_for_input(int fd, _Bool trap, int timeout);
+extern enum wait_for_input_T wait_for_inputs(
+        int fd, int subfd, _Bool trap, int timeout);
 
 extern int handle_traps(void);
 extern void execute_exit_trap(void);
@@ -59,6 +61,7 @@ extern void phantomize_traps(void);
 extern _Bool is_interrupted(void);
 extern void set_laststatus_if_interrupted(void);
 extern void set_interrupted(void);
+extern void clear_interrupted(void);
 #if YASH_ENABLE_LINEEDIT
 extern void reset_sigwinch(void);
 #endif
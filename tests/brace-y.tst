@@ -152,6 +152,28 @@ __IN__
 [{1..3}][{1..3}][{1..3}]
 __OUT__
 
+test_oE 'sequences as words of for loop'
+for i in {1..3} {08..12..2} {-1..+1}; do printf '[%s]' "$i"; done
+echo
+for i in {1..3} x {5..4}; do printf '[%s]' "$i"; done
+echo
+__IN__
+[1][2][3][08][10][12][-1][+0][+1]
+[1][2][3][x][5][4]
+__OUT__
+
+test_oE 'breaking loop over sequence'
+for i in {1..100000000} {1..100000000}; do
+    if [ "$i" -ge 3 ]; then break; fi
+    echo $i
+done
+echo $i
+__IN__
+1
+2
+3
+__OUT__
+
 )
 
 test_oE 'disabled brace expansion'
@@ -17,6 +17,19 @@ complete: `--no-such-option' is not a valid option
 __ERR__
 #`
 
+test_Oe -e 2 'invalid cache TTL'
+complete --cache-store=key --cache-ttl=foo
+__IN__
+complete: `foo' is not a valid integer
+__ERR__
+#`
+
+test_Oe -e 2 'both --cache-load and --cache-store'
+complete --cache-load=key --cache-store=key
+__IN__
+complete: more than one of the --cache-load and --cache-store options is specified
+__ERR__
+
 test_Oe -e 2 'not during completion'
 complete
 __IN__
@@ -112,6 +112,65 @@ __IN__
 bar
 __OUT__
 
+mkdir bundlepath bundlepath/completion
+printf '%s\n' '#yash-bundle' 'completion/a 0 7' 'completion/b 7 9' '%%' \
+    'echo A' 'echo B 1' >bundlepath/completion.bundle
+touch -t 200001010000 bundlepath/completion
+
+test_oE 'dot script in bundle in $LOADPATH'
+YASH_LOADPATH="$PWD/bundlepath"
+. -L completion/a
+. -L completion/b
+__IN__
+A
+B 1
+__OUT__
+
+mkdir stalebundlepath stalebundlepath/completion
+cp bundlepath/completion.bundle stalebundlepath/
+echo 'echo file' >stalebundlepath/completion/a
+touch -t 200001010000 stalebundlepath/completion.bundle
+
+test_oE 'bundle older than directory is ignored'
+YASH_LOADPATH="$PWD/stalebundlepath"
+. -L completion/a
+__IN__
+file
+__OUT__
+
+mkdir partbundlepath partbundlepath/completion
+cp bundlepath/completion.bundle partbundlepath/
+echo 'echo file c' >partbundlepath/completion/c
+touch -t 200001010000 partbundlepath/completion
+touch -t 200101010000 partbundlepath/completion.bundle
+
+test_oE 'file missing in bundle is found in same directory'
+YASH_LOADPATH="$PWD/partbundlepath:$PWD/bundlepath"
+. -L completion/c
+. -L completion/a
+__IN__
+file c
+A
+__OUT__
+
+mkdir editedbundlepath editedbundlepath/completion
+cp bundlepath/completion.bundle editedbundlepath/
+echo 'echo a' >editedbundlepath/completion/a
+echo 'echo B 22' >editedbundlepath/completion/b
+touch -t 200201010000 editedbundlepath/completion/a
+touch -t 200001010000 editedbundlepath/completion/b
+touch -t 200001010000 editedbundlepath/completion
+touch -t 200101010000 editedbundlepath/completion.bundle
+
+test_oE 'file edited after bundle was made is read from file'
+YASH_LOADPATH="$PWD/editedbundlepath"
+. -L completion/a
+. -L completion/b
+__IN__
+a
+B 22
+__OUT__
+
 (
 chmod a+x print_args
 if command -v print_args >/dev/null 2>&1; then
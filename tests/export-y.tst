@@ -78,6 +78,22 @@ __ERR__
 
 )
 
+test_Oe -e 2 'invalid option -i'
+export -i a
+__IN__
+export: `-i' is not a valid option
+__ERR__
+#'
+#`
+
+test_Oe -e 2 'invalid option --integer'
+export --integer a
+__IN__
+export: `--integer' is not a valid option
+__ERR__
+#'
+#`
+
 test_Oe -e 2 'invalid option -z'
 export -z
 __IN__
@@ -10,6 +10,14 @@ __IN__
 [1][2][3][X][1  2  3]
 __OUT__
 
+test_oE 'IFS with whitespace and non-whitespace characters'
+IFS=' 	:,;x'
+a=' 1:2,,3 ;4	'
+bracket $a 5x$a"x6"
+__IN__
+[1][2][][3][4][5x][1][2][][3][4][x6]
+__OUT__
+
 test_oE 'empty last field is not ignored (non-backslash IFS)' --empty-last-field
 IFS=' ='
 a='='; bracket $a
@@ -197,6 +197,9 @@ complete: generate completion candidates
 Syntax:
 	complete [-A pattern] [-R pattern] [-T] [-P prefix] [-S suffix] \
 	         [-abcdfghjkuv] [[-O] [-D description] words...]
+	complete --cache-store=key [--cache-ttl=seconds] \
+	         [--cache-depend=file]... [options...] [words...]
+	complete --cache-load=key [options...] [words...]
 
 Options:
 	-A ...   --accept=...
@@ -204,6 +207,10 @@ Options:
 	         --array-variable
 	         --bindkey
 	-b       --builtin-command
+	         --cache-depend=...
+	         --cache-load=...
+	         --cache-store=...
+	         --cache-ttl=...
 	-c       --command
 	-D ...   --description=...
 	-d       --directory
@@ -588,9 +595,10 @@ __IN__
 local: set or print local variables
 
 Syntax:
-	local [-prxX] [name[=value]...]
+	local [-iprxX] [name[=value]...]
 
 Options:
+	-i       --integer
 	-p       --print
 	-r       --readonly
 	-x       --export
@@ -768,6 +776,7 @@ Options:
 	         -o curasync
 	         -o curbg
 	         -o curstop
+	         -o dircache
 	         -o dotglob
 	         -o emacs
 	         -o emptylastfield
@@ -778,12 +787,16 @@ Options:
 	         -o forlocal
 	+f       -o glob
 	-h       -o hashondef
+	         -o histlog
 	         -o histspace
 	         -o ignoreeof
 	-i       -o interactive
 	         -o lealwaysrp
+	         -o leasyncprompt
 	         -o lecompdebug
 	         -o leconvmeta
+	         -o lefuzzy
+	         -o lehighlight
 	         -o lenoconvmeta
 	         -o lepredict
 	         -o lepredictempty
@@ -951,11 +964,12 @@ __IN__
 typeset: set or print variables
 
 Syntax:
-	typeset [-fgprxX] [name[=value]...]
+	typeset [-fgiprxX] [name[=value]...]
 
 Options:
 	-f       --functions
 	-g       --global
+	-i       --integer
 	-p       --print
 	-r       --readonly
 	-x       --export
@@ -0,0 +1,45 @@
+# histbench.sh: measures the time to load a large history file
+# (C) 2026 magicant
+#
+# Usage: sh histbench.sh [yash [line_count [repeat_count]]]
+# The yash executable defaults to ../yash; 1000000 history entries are loaded
+# 3 times by default.
+
+set -o errexit -o nounset
+
+yash="${1:-../yash}" lines="${2:-1000000}" repeat="${3:-3}"
+case $yash in (*/*) yash="$(cd -- "$(dirname -- "$yash")" && pwd)/${yash##*/}"
+esac
+
+tmpdir="${TMPDIR:-/tmp}/histbench.$$"
+trap 'rm -fr -- "$tmpdir"' EXIT
+umask 077  # yash ignores a history file that other users can access
+mkdir -- "$tmpdir"
+histfile="$tmpdir/history"
+
+# The history file contains the process ID of this script so that the shell
+# considers the file shared and does not rewrite it on startup. Each run then
+# only loads the file and appends two lines to it.
+awk -v n="$lines" -v pid="$$" 'BEGIN {
+    printf "#$# yash history v0 r0\np%d\n", pid
+    for (i = 1; i <= n; i++)
+        printf "%X:%X echo history entry %d | grep -e entry\n", \
+            i, 1600000000 + i, i
+}' >"$histfile"
+printf '%s: %s entries, %s bytes\n' \
+    "$yash" "$lines" "$(wc -c <"$histfile" | tr -d ' ')"
+
+# The "times" built-in reports the CPU time consumed by the child process.
+i=0
+while [ "$i" -lt "$repeat" ]; do
+    i=$((i + 1))
+    (
+        HISTFILE="$histfile" HISTSIZE="$lines" \
+            "$yash" -i +m --norcfile -c 'fc -l -1' </dev/null >/dev/null
+        times >"$tmpdir/times"
+        { read -r _ && read -r user sys; } <"$tmpdir/times"
+        printf 'run %d: user %s, sys %s\n' "$i" "$user" "$sys"
+    )
+done
+
+# vim: set ts=8 sts=4 sw=4 et:
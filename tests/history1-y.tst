@@ -335,4 +335,357 @@ __OUT__
 
 )
 
+(
+export histfile=histfile$LINENO histsize=50
+umask 077
+{
+    echo '#$# yash history v0 r3'
+    echo 'p99999999'
+    echo '1:5F000000 echo one'
+    echo '2 echo two'
+    echo '3 echo three'
+    echo 'c'
+    echo '0 echo zero'
+    echo '4 echo four'
+    echo 'd2'
+    echo '5:ZZ echo bad time'
+    echo '5 echo five'
+    printf '6 echo incomplete'
+} >"$histfile"
+
+test_oE -e 0 'reading history file' -i +m --rcfile="rcfile1"
+fc -l
+__IN__
+1	echo one
+2	echo four
+3	echo five
+4	fc -l
+__OUT__
+
+)
+
+(
+export histfile=histfile$LINENO histsize=50
+umask 077
+{
+    echo echo one
+    echo
+    echo echo three
+} >"$histfile"
+
+test_oE -e 0 'reading plain text history file' -i +m --rcfile="rcfile1"
+fc -l
+__IN__
+1	echo one
+2	
+3	echo three
+4	fc -l
+__OUT__
+
+)
+
+(
+export histfile=histfile$LINENO histsize=100
+umask 077
+{
+    echo '#$# yash history v0 r0'
+    i=1
+    while [ $i -le 1000 ]; do
+        printf '%X : %d\n' $i $i
+        i=$((i+1))
+    done
+} >"$histfile"
+
+test_oE -e 0 'reading history file larger than HISTSIZE' -i +m \
+    --rcfile="rcfile1"
+fc -l -3
+fc -l 4 4
+__IN__
+99	: 999
+100	: 1000
+101	fc -l -3
+4	: 904
+__OUT__
+
+)
+
+(
+export histfile=histfile$LINENO histsize=50
+umask 077
+{
+    echo '#$# yash history v0 r0'
+    echo "p$$"
+    for i in 1869D 1869E 1869F 186A0 1 2 3; do
+        echo "$i : $i"
+    done
+    echo 'd1869F'
+    echo 'd2'
+} >"$histfile"
+
+test_oE -e 0 'finding entries with wrapped numbers' -i +m --rcfile="rcfile1"
+fc -l 99998 1
+history -d 100000
+fc -l 99997 3
+history 2
+__IN__
+99998	: 1869E
+100000	: 186A0
+1	: 1
+99997	: 1869D
+99998	: 1869E
+1	: 1
+3	: 3
+6	fc -l 99997 3
+7	history 2
+__OUT__
+
+)
+
+(
+export histfile=histfile$LINENO histsize=50
+umask 077
+
+testee -is +m --rcfile="rcfile1" -o histlog >/dev/null <<\__END__
+echo foo 1
+echo foo 2
+__END__
+
+test_oE -e 0 'history file shared as append-only log' \
+    -i +m --rcfile="rcfile1" -o histlog
+fc -l
+history -F
+echo foo 3
+fc -l
+set -o nullglob
+echo temporary files: "$HISTFILE".*
+__IN__
+1	echo foo 1
+2	echo foo 2
+3	fc -l
+foo 3
+1	echo foo 1
+2	echo foo 2
+3	fc -l
+4	history -F
+5	echo foo 3
+6	fc -l
+temporary files:
+__OUT__
+
+)
+
+(
+export histfile=histfile$LINENO histsize=5
+umask 077
+
+# The file is compacted when it has more than 20 lines and the lines are twice
+# as many as the entries. The compaction runs in the background, so we wait
+# for the new file that starts with the compaction marker.
+testee -is +m --rcfile="rcfile1" -o histlog >/dev/null <<\__END__
+: 1
+: 2
+: 3
+: 4
+: 5
+: 6
+: 7
+: 8
+: 9
+: 10
+: 11
+: 12
+: 13
+: 14
+: 15
+: 16
+: 17
+: 18
+: 19
+: 20
+: 21
+: 22
+: 23
+: 24
+: 25
+__END__
+i=0
+until grep -q '^k' "$histfile" || [ "$i" -ge 10 ]; do
+    sleep 1
+    i=$((i+1))
+done
+
+# The compacted file keeps the last $HISTSIZE entries at the time of the
+# compaction and the entries appended after that.
+test_oE -e 0 'shared history file is compacted in background'
+sed -n '2s/^\(k\).*/\1/p' "$histfile"
+grep -c -e ' : [1-9]$' -e ' : 1[0-6]$' "$histfile"
+grep -c ' : 25$' "$histfile"
+__IN__
+k
+0
+1
+__OUT__
+
+test_oE -e 0 'compacted history file is read' \
+    -i +m --rcfile="rcfile1" -o histlog
+fc -l
+__IN__
+2	: 22
+3	: 23
+4	: 24
+5	: 25
+6	fc -l
+__OUT__
+
+)
+
+# The "replace" script replaces the history file with a new file that starts
+# with a compaction marker followed by an entry "compacted" that stands for the
+# compacted entries and an entry "appended" after the compacted part. The first
+# operand is added to the size of the old file recorded in the marker and the
+# second is the number of the "appended" entry.
+cat >replace <<\__END__
+rev=$(head -n 1 "$HISTFILE") rev=${rev##*r} size=$(wc -c <"$HISTFILE")
+sig="#\$# yash history v0 r$((rev+1))" body="1 : compacted"
+{
+    printf '%s\n' "$sig"
+    printf 'k%016X:%016X:%016X\n' "$rev" "$((size+$1))" \
+        "$((${#sig}+1+52+${#body}+1))"
+    printf '%s\n' "$body" "$2 : appended"
+} >"$HISTFILE.new"
+mv -f "$HISTFILE.new" "$HISTFILE"
+__END__
+
+(
+export histfile=histfile$LINENO histsize=50
+umask 077
+
+# The shell has read the whole old file, so it skips the compacted part.
+test_oE -e 0 'compaction marker matching old file is honored' \
+    -i +m --rcfile="rcfile1" -o histlog
+: a 1
+: a 2
+. ./replace 0 4
+fc -l
+__IN__
+1	: a 1
+2	: a 2
+3	. ./replace 0 4
+4	: appended
+5	fc -l
+__OUT__
+
+)
+
+(
+export histfile=histfile$LINENO histsize=50
+umask 077
+
+# The marker does not match the old file, so the new file is read from the
+# beginning.
+test_oE -e 0 'compaction marker not matching old file is ignored' \
+    -i +m --rcfile="rcfile1" -o histlog
+: a 1
+: a 2
+. ./replace 1 4
+fc -l
+__IN__
+1	: compacted
+4	: appended
+5	fc -l
+__OUT__
+
+)
+
+(
+export histfile=histfile$LINENO histsize=50
+umask 077
+
+cat >input <<\__END__
+: b 1
+history -F
+: b 2
+__END__
+
+# The other shell replaces the history file by "history -F". This shell reads
+# the entries added to the new file and appends its own entries to it.
+test_oE -e 0 'shell follows history file replaced by another shell' \
+    -i +m --rcfile="rcfile1" -o histlog
+: a 1
+"$TESTEE" -is +m --rcfile="rcfile1" -o histlog <input
+fc -l
+head -n 1 "$HISTFILE"
+grep -c ' fc -l$' "$HISTFILE"
+__IN__
+1	: a 1
+2	"$TESTEE" -is +m --rcfile="rcfile1" -o histlog <input
+3	: b 1
+4	history -F
+5	: b 2
+6	fc -l
+#$# yash history v0 r1
+1
+__OUT__
+
+)
+
+(
+export histfile=histfile$LINENO histsize=1000
+umask 077
+
+for s in a b c; do
+    i=1
+    while [ "$i" -le 100 ]; do
+        echo ": $s $i"
+        i=$((i+1))
+    done >"input$s"
+    testee -is +m --rcfile="rcfile1" -o histlog <"input$s" >/dev/null &
+done
+wait
+
+test_oE -e 0 'shells append to shared history file concurrently' \
+    -i +m --rcfile="rcfile1" -o histlog
+fc -l 1 | grep -c ': a [0-9]'
+fc -l 1 | grep -c ': b [0-9]'
+fc -l 1 | grep -c ': c [0-9]'
+fc -l 1 | cut -f 1 | sort | uniq -d
+__IN__
+100
+100
+100
+__OUT__
+
+)
+
+(
+export histfile=histfile$LINENO histsize=50 histrmdup=4
+umask 077
+for value in a b a b c b a; do
+    echo ": $value"
+done >"$histfile"
+
+test_oE -e 0 'HISTRMDUP applied to history file on refresh' \
+    -i +m --rcfile="rcfile2"
+fc -l
+: b
+fc -l
+__IN__
+1	: a
+2	: b
+3	: a
+5	: c
+6	: b
+7	: a
+8	fc -l
+1	: a
+2	: b
+3	: a
+5	: c
+7	: a
+9	: b
+10	fc -l
+__OUT__
+
+)
+
 # vim: set ft=sh ts=8 sts=4 sw=4 et:
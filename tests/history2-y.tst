@@ -56,4 +56,87 @@ __OUT__
 
 )
 
+(
+if ! testee -c 'command -bv bindkey' >/dev/null; then
+    skip="true"
+fi
+
+cat >rcfile2 <<\__END__
+PS1= PS2= HISTSIZE=100
+unset HISTFILE HISTRMDUP
+set -o emacs
+__END__
+
+# The keys are typed into a pseudo-terminal. The search for "qqq" fails after
+# examining all the entries, so the later searches use the substring search
+# index, except the one for "yz", which is too short to be indexed. The last
+# search string has more trigrams than are intersected in the index.
+test_oE 'incremental search with and without substring search index'
+{
+    printf 'echo abcdef >>out\r'
+    printf 'echo abcxyz >>out\r'
+    printf 'echo 0123456789012345678901234567890123456789 >>out\r'
+    printf ': filler\r'
+    printf '\022qqq\007'
+    printf '\022cdef\r\r'
+    printf '\022yz\r\r'
+    printf '\022bcx\r\r'
+    printf '\0220123456789012345678901234567890123456789\r\r'
+    printf 'exit\r'
+} |
+TERM=vt100 ../ptwrap -i "$TESTEE" -i +m --rcfile="rcfile2" >/dev/null
+cat out
+__IN__
+abcdef
+abcxyz
+0123456789012345678901234567890123456789
+abcdef
+abcxyz
+abcxyz
+0123456789012345678901234567890123456789
+__OUT__
+
+cat >rcfile3 <<\__END__
+PS1= PS2= HISTSIZE=100 HISTRMDUP=2
+unset HISTFILE
+set -o emacs -o le-predict
+bindkey -e '\^T' accept-prediction
+__END__
+
+# The second "echo y" removes the first from the middle of the prediction
+# samples, after which "echo z" follows the first "echo x". Ctrl-T accepts the
+# command predicted from the previous one.
+test_oE 'prediction after entry is removed by HISTRMDUP'
+{
+    printf 'echo x >>out2\r'
+    printf 'echo y >>out2\r'
+    printf 'echo z >>out2\r'
+    printf 'echo y >>out2\r'
+    printf 'echo w >>out2\r'
+    printf 'echo x >>out2\r'
+    printf 'echo \024'
+    printf 'history >>out2\r'
+    printf 'exit\r'
+} |
+TERM=vt100 ../ptwrap -i "$TESTEE" -i +m --rcfile="rcfile3" >/dev/null
+cat out2
+__IN__
+x
+y
+z
+y
+w
+x
+z
+1	echo x >>out2
+3	echo z >>out2
+4	echo y >>out2
+5	echo w >>out2
+6	echo x >>out2
+7	echo z >>out2
+8	history >>out2
+__OUT__
+
+)
+
 # vim: set ft=sh ts=8 sts=4 sw=4 et:
@@ -0,0 +1,325 @@
+# lineedit-y.tst: yash-specific test of line-editing
+
+if ! testee -c 'command -bv bindkey' >/dev/null; then
+    skip="true"
+fi
+
+# In the tests below, keys are typed into a pseudo-terminal and the commands
+# entered write their results to files, which are examined afterward.
+
+cat >rcfile <<\__END__
+PS1= PS2= HISTSIZE=100
+unset HISTFILE
+set -o emacs
+__END__
+
+# The pasted text between "ESC [ 200 ~" and "ESC [ 201 ~" contains Ctrl-B and
+# a tab, which would move the cursor and complete a word if typed.
+test_oE 'pasted control characters are inserted literally'
+{
+    printf "echo '\033[200~a\002b\tc\033[201~' >paste1\r"
+    printf 'exit\r'
+} |
+TERM=xterm ../ptwrap -i "$TESTEE" -i +m --rcfile="rcfile" >/dev/null
+tr '\002\t' 'BT' <paste1
+__IN__
+aBbTc
+__OUT__
+
+# The pasted line breaks are inserted into the buffer rather than accepting
+# the line. The second pasted command is discarded by Ctrl-C.
+test_oE 'pasted line breaks do not accept line'
+{
+    printf '\033[200~echo 1 >>paste2\recho 2 >>paste2\r\033[201~\r'
+    printf '\033[200~echo 3 >>paste2\r\033[201~\003'
+    printf 'echo 4 >>paste2\r'
+    printf 'exit\r'
+} |
+TERM=xterm ../ptwrap -i "$TESTEE" -i +m --rcfile="rcfile" >/dev/null
+cat paste2
+__IN__
+1
+2
+4
+__OUT__
+
+# The text is too long to be read from the terminal at once.
+test_oE 'long pasted text is read across multiple reads'
+{
+    printf 'echo \033[200~'
+    i=0
+    while [ "$i" -lt 500 ]; do
+        printf '%s' 0123456789012345678901234567890123456789
+        i=$((i+1))
+    done
+    printf '\033[201~ | wc -c >paste3\r'
+    printf 'exit\r'
+} |
+TERM=xterm ../ptwrap -i "$TESTEE" -i +m --rcfile="rcfile" >/dev/null
+tr -d ' ' <paste3
+__IN__
+20001
+__OUT__
+
+test_oE 'null bytes in and after pasted text are skipped'
+{
+    printf 'echo \033[200~a\000b\033[201~c\000d >paste4\r'
+    printf 'exit\r'
+} |
+TERM=xterm ../ptwrap -i "$TESTEE" -i +m --rcfile="rcfile" >/dev/null
+cat paste4
+__IN__
+abcd
+__OUT__
+
+cat >rcfile2 <<\__END__
+PS1='$ ' PS2='> ' HISTSIZE=100
+unset HISTFILE
+set -o emacs -o le-no-conv-meta
+bindkey -e '\^G' alert
+__END__
+
+# In the tests below, the output of the shell is interpreted by vtscreen,
+# which prints the screen of a 20x6 terminal with the cursor position each
+# time Ctrl-G rings the bell.
+
+test_oE 'insertion and deletion in middle of line'
+{
+    printf 'echo abcdef\002\002\002XY\007'
+    printf '\004\004\010\007'
+    printf '0123456789\007'
+    printf '\001\006\006\006\006\006ZZZ\007'
+    printf '\013\007'
+    printf '\003exit\r'
+} |
+COLUMNS=20 LINES=6 TERM=xterm ../ptwrap -i "$TESTEE" -i +m --rcfile="rcfile2" |
+../vtscreen -c 20 6
+__IN__
+$ echo abcXYdef
+---- 1,13
+$ echo abcXf
+---- 1,12
+$ echo abcX012345678
+9f
+---- 2,2
+$ echo ZZZabcX012345
+6789f
+---- 1,11
+$ echo ZZZ
+---- 1,11
+__OUT__
+
+mkdir candidates
+touch candidates/cand1 candidates/cand2 candidates/cand3 candidates/other
+
+# Each line is aborted by Ctrl-C after the snapshot, which clears the
+# candidate list.
+test_oE 'candidate list is redrawn when selection changes'
+{
+    printf 'cd candidates\r'
+    printf 'echo c\t\007'
+    printf '\003echo c\t\t\t\007'
+    printf '\003echo c\t\t\t\t\t\007'
+    printf '\003echo c\t\t\t\033[Z\007'
+    printf '\003exit\r'
+} |
+COLUMNS=20 LINES=6 TERM=xterm ../ptwrap -i "$TESTEE" -i +m --rcfile="rcfile2" |
+../vtscreen -a -c 20 6
+__IN__
+$ cd candidates
+$ echo cand
+ cand1  cand3
+ cand2
+---- 2,12
+$ cd candidates
+$ echo cand
+$ echo cand2
+ cand1  cand3
+[cand2]
+ooooooo
+---- 3,13
+$ cd candidates
+$ echo cand
+$ echo cand2
+$ echo cand
+ cand1  cand3
+ cand2
+---- 4,12
+$ echo cand
+$ echo cand2
+$ echo cand
+$ echo cand1
+[cand1] cand3
+ooooooo
+ cand2
+---- 4,13
+__OUT__
+
+cat >rcfile3 <<\__END__
+PS1='$ ' PS1R='<R' PS2='> ' HISTSIZE=100
+unset HISTFILE
+set -o emacs
+bindkey -e '\^G' alert
+__END__
+
+# The right prompt is hidden while the line is too long to leave a space
+# between the line and the right prompt.
+test_oE 'right prompt'
+{
+    printf 'echo abc\007'
+    printf 'defghijk\007'
+    printf 'l\007'
+    printf '\010\010\010\007'
+    printf '\r\007'
+    printf 'exit\r'
+} |
+COLUMNS=20 LINES=6 TERM=xterm ../ptwrap -i "$TESTEE" -i +m --rcfile="rcfile3" |
+../vtscreen -c 20 6
+__IN__
+$ echo abc       <R
+---- 1,11
+$ echo abcdefghijk
+---- 1,19
+$ echo abcdefghijkl
+---- 1,20
+$ echo abcdefghi <R
+---- 1,17
+$ echo abcdefghi <R
+abcdefghi
+$                <R
+---- 3,3
+__OUT__
+
+cat >rcfile4 <<\__END__
+PS1='$ ' PS2='> ' HISTSIZE=100
+unset HISTFILE
+set -o emacs -o le-highlight
+bindkey -e '\^G' alert
+__END__
+
+# The attribute lines printed by vtscreen show the colors of the highlighted
+# characters: Y for keywords, g for command names, o for operators, y for
+# quotations, c for expansions, and i for comments.
+test_oE 'highlighting of keywords, operators, quotes, expansions and comments'
+{
+    printf 'if true; then echo "a$x" '\''q'\'' $(ls) ${y} >f; fi # c\007'
+    printf '\003exit\r'
+} |
+COLUMNS=60 LINES=6 TERM=xterm ../ptwrap -i "$TESTEE" -i +m --rcfile="rcfile4" |
+../vtscreen -a 60 6
+__IN__
+$ if true; then echo "a$x" 'q' $(ls) ${y} >f; fi # c
+  YY ggggo YYYY gggg yyccy yyy ccggc cccc o o YY iii
+----
+__OUT__
+
+# Inserting a quotation mark in the middle of a word makes the rest of the
+# line an unterminated quotation until it is closed. Removing a closing
+# parenthesis leaves the rest of the line in the unterminated command
+# substitution.
+test_oE 'highlighting after editing in middle of token (quotes and expansions)'
+{
+    printf 'echo ab cd\007'
+    printf '\002\002\002\002'\''\007'
+    printf '\005'\''\007'
+    printf '\003echo $(echo $(ls) x) y\007'
+    printf '\002\002\002\004\007'
+    printf '\003exit\r'
+} |
+COLUMNS=40 LINES=6 TERM=xterm ../ptwrap -i "$TESTEE" -i +m --rcfile="rcfile4" |
+../vtscreen -a 40 6
+__IN__
+$ echo ab cd
+  gggg
+----
+$ echo a'b cd
+  gggg  yyyyy
+----
+$ echo a'b cd'
+  gggg  yyyyyy
+----
+$ echo a'b cd'
+  gggg  yyyyyy
+$ echo $(echo $(ls) x) y
+  gggg ccgggg ccggc  c
+----
+$ echo a'b cd'
+  gggg  yyyyyy
+$ echo $(echo $(ls) x y
+  gggg ccgggg ccggc
+----
+__OUT__
+
+# Editing a word changes it into a keyword, and inserting a blank before "#"
+# starts a comment.
+test_oE 'highlighting after editing in middle of token (keywords and comments)'
+{
+    printf 'ix true\007'
+    printf '\001\006\004f\007'
+    printf '\003echo a#b\007'
+    printf '\002\002 \007'
+    printf '\003exit\r'
+} |
+COLUMNS=40 LINES=6 TERM=xterm ../ptwrap -i "$TESTEE" -i +m --rcfile="rcfile4" |
+../vtscreen -a 40 6
+__IN__
+$ ix true
+  gg
+----
+$ if true
+  YY gggg
+----
+$ if true
+  YY gggg
+$ echo a#b
+  gggg
+----
+$ if true
+  YY gggg
+$ echo a #b
+  gggg   ii
+----
+__OUT__
+
+(
+if [ "$(testee -c 'a=$(printf "\343\201\202"); echo "${#a}"')" -ne 1 ]; then
+    skip="true"
+fi
+
+# The test file contains no multibyte characters so that it can be read in any
+# locale. The characters are Hiragana letters, which occupy two columns each.
+# A wide character that does not fit in the last column is moved to the next
+# line, leaving the last column blank.
+test_oE 'wide characters at right margin'
+{
+    printf 'echo \343\201\202\343\201\204\343\201\206'
+    printf '\343\201\210\343\201\212\343\201\213\007'
+    printf '\343\201\215\007'
+    printf '\002\002\002\002x\007'
+    printf '\010\010\007'
+    printf '\003exit\r'
+} |
+COLUMNS=20 LINES=6 TERM=xterm ../ptwrap -i "$TESTEE" -i +m --rcfile="rcfile2" |
+../vtscreen -c 20 6 >wide.out
+a=$(printf '\343\201\202') i=$(printf '\343\201\204')
+u=$(printf '\343\201\206') e=$(printf '\343\201\210')
+o=$(printf '\343\201\212') ka=$(printf '\343\201\213')
+ki=$(printf '\343\201\215')
+diff - wide.out <<__END__
+\$ echo $a$i$u$e$o$ka
+---- 1,20
+\$ echo $a$i$u$e$o$ka
+$ki
+---- 2,3
+\$ echo $a$i${u}x$e$o$ka
+$ki
+---- 1,15
+\$ echo $a$i$e$o$ka$ki
+---- 1,12
+__END__
+__IN__
+__OUT__
+
+)
+
+# vim: set ft=sh ts=8 sts=4 sw=4 et:
@@ -567,6 +567,15 @@ b/b/a/b/a/b/b/a
 b/b/b/a/b/a/b/a
 __OUT__
 
+test_oE 'recursive search with multiple threads' --extendedglob
+serial="$(printf '%s\n' ***/a/**/b)"
+YASH_GLOB_THREADS=4
+parallel="$(printf '%s\n' ***/a/**/b)"
+if [ "$serial" ] && [ "$serial" = "$parallel" ]; then echo ok; fi
+__IN__
+ok
+__OUT__
+
 )
 
 mkdir nullglob
@@ -590,4 +599,57 @@ __OUT__
 
 )
 
+mkdir dircache
+>dircache/a
+touch -t 200001010000 dircache
+
+test_oE 'dircache on: adding file'
+echo dircache/*
+>dircache/b
+echo dircache/*
+rm dircache/b
+echo dircache/*
+__IN__
+dircache/a
+dircache/a dircache/b
+dircache/a
+__OUT__
+
+test_oE 'dircache off: adding file' --nodircache
+echo dircache/*
+>dircache/c
+echo dircache/*
+__IN__
+dircache/a
+dircache/a dircache/c
+__OUT__
+
+test_oE 'dircache: hash -r discards cached listings'
+touch -t 200001010000 dircache
+echo dircache/*
+>dircache/d
+touch -t 200001010000 dircache
+echo dircache/*
+hash -r
+echo dircache/*
+__IN__
+dircache/a dircache/c
+dircache/a dircache/c
+dircache/a dircache/c dircache/d
+__OUT__
+
+test_oE 'dircache: disabling the option discards cached listings'
+touch -t 200001010000 dircache
+echo dircache/*
+>dircache/e
+touch -t 200001010000 dircache
+echo dircache/*
+set +o dircache -o dircache
+echo dircache/*
+__IN__
+dircache/a dircache/c dircache/d
+dircache/a dircache/c dircache/d
+dircache/a dircache/c dircache/d dircache/e
+__OUT__
+
 # vim: set ft=sh ts=8 sts=4 sw=4 et:
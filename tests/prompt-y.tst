@@ -261,4 +261,125 @@ __OUT__
 
 )
 
+(
+if ! testee -c 'command -bv bindkey' >/dev/null; then
+    skip="true"
+fi
+
+# In the tests below, keys are typed into a pseudo-terminal and vtscreen prints
+# the screen each time Ctrl-G rings the bell. The first prompt is expanded
+# synchronously and remembered as the previous prompt for the next line.
+
+cat >rcfile_async <<\__END__
+PS1='A> ' PS2='> ' HISTSIZE=100
+unset HISTFILE
+set -o emacs -o le-async-prompt
+bindkey -e '\^G' alert
+__END__
+
+# The prompt is not complete while the file "hold" exists.
+echo B >prompt_b
+>hold1
+
+test_oE 'line can be edited while prompt is expanded in background'
+{
+    printf '%s\r' \
+        "PS1='\$(cat prompt_b; while [ -e hold1 ]; do sleep 1; done)> '"
+    printf 'echo typed\007'
+    sleep 1
+    rm hold1
+    sleep 3
+    printf '\007'
+    printf '\r\007'
+    printf 'exit\r'
+} |
+COLUMNS=80 LINES=8 TERM=xterm ../ptwrap -i "$TESTEE" -i +m \
+    --rcfile="rcfile_async" |
+../vtscreen 80 8
+__IN__
+A> PS1='$(cat prompt_b; while [ -e hold1 ]; do sleep 1; done)> '
+A> echo typed
+----
+A> PS1='$(cat prompt_b; while [ -e hold1 ]; do sleep 1; done)> '
+B> echo typed
+----
+A> PS1='$(cat prompt_b; while [ -e hold1 ]; do sleep 1; done)> '
+B> echo typed
+typed
+B>
+----
+__OUT__
+
+>hold2
+
+test_oE 'previous prompt is kept for line accepted before new prompt'
+{
+    printf '%s\r' \
+        "PS1='\$(cat prompt_b; while [ -e hold2 ]; do sleep 1; done)> '"
+    printf 'echo 1\r'
+    printf 'echo 2\007'
+    sleep 1
+    rm hold2
+    sleep 3
+    printf '\007'
+    printf '\r'
+    printf 'exit\r'
+} |
+COLUMNS=80 LINES=8 TERM=xterm ../ptwrap -i "$TESTEE" -i +m \
+    --rcfile="rcfile_async" |
+../vtscreen 80 8
+__IN__
+A> PS1='$(cat prompt_b; while [ -e hold2 ]; do sleep 1; done)> '
+A> echo 1
+1
+A> echo 2
+----
+A> PS1='$(cat prompt_b; while [ -e hold2 ]; do sleep 1; done)> '
+A> echo 1
+1
+B> echo 2
+----
+__OUT__
+
+# If the subshell that expands the prompt exits or is killed before sending
+# the result, the previous prompt remains.
+test_oE 'previous prompt is kept if prompt expansion fails'
+{
+    printf '%s\r' "PS1='B> ' PROMPT_COMMAND='exit 3'"
+    sleep 1
+    printf 'echo 1\007\r'
+    printf '%s\r' "PROMPT_COMMAND='exec sh -c \"kill -s KILL \\\$\\\$\"'"
+    sleep 1
+    printf 'echo 2\007\r'
+    printf 'unset PROMPT_COMMAND\r'
+    sleep 1
+    printf '\007'
+    printf 'exit\r'
+} |
+COLUMNS=80 LINES=10 TERM=xterm ../ptwrap -i "$TESTEE" -i +m \
+    --rcfile="rcfile_async" |
+../vtscreen 80 10
+__IN__
+A> PS1='B> ' PROMPT_COMMAND='exit 3'
+A> echo 1
+----
+A> PS1='B> ' PROMPT_COMMAND='exit 3'
+A> echo 1
+1
+A> PROMPT_COMMAND='exec sh -c "kill -s KILL \$\$"'
+A> echo 2
+----
+A> PS1='B> ' PROMPT_COMMAND='exit 3'
+A> echo 1
+1
+A> PROMPT_COMMAND='exec sh -c "kill -s KILL \$\$"'
+A> echo 2
+2
+A> unset PROMPT_COMMAND
+B>
+----
+__OUT__
+
+)
+
 # vim: set ft=sh ts=8 sts=4 sw=4 et:
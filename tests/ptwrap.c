@@ -81,6 +81,21 @@ static int open_noctty(const char *pathname) {
     return fd;
 }
 
+static void set_raw_mode(int fd) {
+    /* Input is forwarded as soon as it is available, possibly before the
+     * child process changes the terminal settings, so the input must not be
+     * subject to any processing that the child cannot undo. */
+    struct termios t;
+    if (tcgetattr(fd, &t) < 0)
+        errno_exit("cannot get terminal attributes");
+    t.c_iflag &= ~(BRKINT | ICRNL | IGNCR | INLCR | ISTRIP | IXON);
+    t.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    t.c_cc[VMIN] = 1;
+    t.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &t) < 0)
+        errno_exit("cannot set terminal attributes");
+}
+
 enum state_T { INACTIVE, READING, WRITING, };
 struct channel_T {
     int from_fd, to_fd;
@@ -132,8 +147,11 @@ static void process_buffer(
     }
 }
 
-static void forward_all_io(int master_fd) {
-    struct channel_T outgoing;
+static void forward_all_io(int master_fd, bool forward_input) {
+    struct channel_T incoming, outgoing;
+    incoming.from_fd = STDIN_FILENO;
+    incoming.to_fd = master_fd;
+    incoming.state = forward_input ? READING : INACTIVE;
     outgoing.from_fd = master_fd;
     outgoing.to_fd = STDOUT_FILENO;
     outgoing.state = READING;
@@ -145,11 +163,13 @@ static void forward_all_io(int master_fd) {
         fd_set read_fds, write_fds;
         FD_ZERO(&read_fds);
         FD_ZERO(&write_fds);
+        set_fd_set(&incoming, &read_fds, &write_fds);
         set_fd_set(&outgoing, &read_fds, &write_fds);
         if (select(master_fd + 1, &read_fds, &write_fds, NULL, NULL) < 0)
             errno_exit("cannot find file descriptor to forward");
 
         /* read to or write from buffer */
+        process_buffer(&incoming, &read_fds, &write_fds);
         process_buffer(&outgoing, &read_fds, &write_fds);
     }
 }
@@ -220,6 +240,12 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     */
     optind = 1;
+    bool forward_input = false;
+    if (optind < argc && strcmp(argv[optind], "-i") == 0) {
+        /* forward the standard input to the slave as if typed in raw mode */
+        forward_input = true;
+        optind++;
+    }
     if (optind < argc && strcmp(argv[optind], "--") == 0)
         optind++;
 
@@ -229,6 +255,8 @@ int main(int argc, char *argv[]) {
     int master_fd = prepare_master_pseudo_terminal();
     const char *slave_name = slave_pseudo_terminal_name(master_fd);
     int slave_fd = open_noctty(slave_name);
+    if (forward_input)
+        set_raw_mode(slave_fd);
 
     pid_t child_pid = fork();
     if (child_pid < 0)
@@ -236,7 +264,7 @@ int main(int argc, char *argv[]) {
     if (child_pid > 0) {
         /* parent process */
         close(slave_fd);
-        forward_all_io(master_fd);
+        forward_all_io(master_fd, forward_input);
         return await_child(child_pid);
     } else {
         /* child process */
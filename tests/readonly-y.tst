@@ -176,6 +176,22 @@ __ERR__
 
 )
 
+test_Oe -e 2 'invalid option -i'
+readonly -i a
+__IN__
+readonly: `-i' is not a valid option
+__ERR__
+#'
+#`
+
+test_Oe -e 2 'invalid option --integer'
+readonly --integer a
+__IN__
+readonly: `--integer' is not a valid option
+__ERR__
+#'
+#`
+
 test_Oe -e 2 'invalid option -z'
 readonly -z
 __IN__
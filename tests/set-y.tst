@@ -192,6 +192,7 @@ test_long_option_default_on  "$LINENO" clobber
 test_long_option_default_on  "$LINENO" curasync
 test_long_option_default_on  "$LINENO" curbg
 test_long_option_default_on  "$LINENO" curstop
+test_long_option_default_on  "$LINENO" dircache
 test_long_option_default_off "$LINENO" dotglob
 test_long_option_default_off "$LINENO" emptylastfield
 test_long_option_default_off "$LINENO" errexit
@@ -217,6 +218,7 @@ test_long_option_default_off "$LINENO" xtrace
 if ! testee --version --verbose | grep -Fqx ' * history'; then
     skip="true"
 fi
+test_long_option_default_off "$LINENO" histlog
 test_long_option_default_off "$LINENO" histspace
 )
 (
@@ -225,8 +227,11 @@ if ! testee --version --verbose | grep -Fqx ' * lineedit'; then
 fi
 test_long_option_default_off "$LINENO" emacs
 test_long_option_default_off "$LINENO" lealwaysrp
+test_long_option_default_off "$LINENO" leasyncprompt
 test_long_option_default_off "$LINENO" lecompdebug
 test_long_option_default_off "$LINENO" leconvmeta
+test_long_option_default_off "$LINENO" lefuzzy
+test_long_option_default_off "$LINENO" lehighlight
 test_long_option_default_off "$LINENO" lenoconvmeta
 test_long_option_default_on  "$LINENO" lepromptsp
 test_long_option_default_off "$LINENO" levisiblebell
@@ -391,11 +396,11 @@ set -o
 __IN__
 
 test_oE 'set -o: output'
-set -o | grep -v '^histspace ' |
+set -o | grep -v '^histlog ' | grep -v '^histspace ' |
 grep -v '^le' | grep -v '^emacs ' | grep -v '^notifyle ' | grep -v '^vi '
 echo ---
 set -a +o caseglob -o dotglob
-set -o | head -n 9
+set -o | head -n 10
 __IN__
 allexport       off
 braceexpand     off
@@ -405,6 +410,7 @@ cmdline         off
 curasync        on
 curbg           on
 curstop         on
+dircache        on
 dotglob         off
 emptylastfield  off
 errexit         off
@@ -438,6 +444,7 @@ cmdline         off
 curasync        on
 curbg           on
 curstop         on
+dircache        on
 dotglob         on
 __OUT__
 
@@ -453,6 +460,7 @@ test_oE 'set +o: output'
 set +o |
 grep -v '^set [+-]o le' |
 grep -Fvx 'set +o emacs' |
+grep -Fvx 'set +o histlog' |
 grep -Fvx 'set +o histspace' |
 grep -Fvx 'set +o notifyle' |
 grep -Fvx 'set +o vi'
@@ -464,6 +472,7 @@ set -o clobber
 set -o curasync
 set -o curbg
 set -o curstop
+set -o dircache
 set +o dotglob
 set +o emptylastfield
 set +o errexit
@@ -414,6 +414,7 @@ Options:
 	         -o curasync
 	         -o curbg
 	         -o curstop
+	         -o dircache
 	         -o dotglob
 	         -o emacs
 	         -o emptylastfield
@@ -424,12 +425,16 @@ Options:
 	         -o forlocal
 	+f       -o glob
 	-h       -o hashondef
+	         -o histlog
 	         -o histspace
 	         -o ignoreeof
 	-i       -o interactive
 	         -o lealwaysrp
+	         -o leasyncprompt
 	         -o lecompdebug
 	         -o leconvmeta
+	         -o lefuzzy
+	         -o lehighlight
 	         -o lenoconvmeta
 	         -o lepredict
 	         -o lepredictempty
@@ -473,6 +478,7 @@ Options:
 	         -o curasync
 	         -o curbg
 	         -o curstop
+	         -o dircache
 	         -o dotglob
 	         -o emacs
 	         -o emptylastfield
@@ -483,12 +489,16 @@ Options:
 	         -o forlocal
 	+f       -o glob
 	-h       -o hashondef
+	         -o histlog
 	         -o histspace
 	         -o ignoreeof
 	-i       -o interactive
 	         -o lealwaysrp
+	         -o leasyncprompt
 	         -o lecompdebug
 	         -o leconvmeta
+	         -o lefuzzy
+	         -o lehighlight
 	         -o lenoconvmeta
 	         -o lepredict
 	         -o lepredictempty
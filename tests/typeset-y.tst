@@ -145,6 +145,48 @@ __OUT__
 
 )
 
+test_oE 'defining integer variables (-i)' -e
+a=010
+typeset -i a b=2+3 c
+echo $a $b ${c-unset}
+__IN__
+8 5 unset
+__OUT__
+
+test_oE 'assigning to integer variables (-i)' -e
+typeset -i a=1 b
+a=a+2 b=0x10
+echo $a $b
+a= b=1.9
+echo $a $b
+__IN__
+3 16
+0 1
+__OUT__
+
+test_oE 'arithmetic expansion with integer variables (-i)' -e
+typeset -i a=1
+echo $((a += 2)) $((a++)) $a $((a * 10))
+__IN__
+3 3 4 40
+__OUT__
+
+test_oE 'exporting integer variables (-ix)' -e
+typeset -ix a=3
+: $((a *= 5))
+sh -c 'echo $a'
+__IN__
+15
+__OUT__
+
+test_oE -e 0 'printing integer variables (-p)' -e
+typeset -i a b=7
+typeset -p a b
+__IN__
+typeset -i a
+typeset -i b=7
+__OUT__
+
 test_oE -e 0 'printing all variables (-p)' -e
 typeset -p >/dev/null
 typeset -p | grep -q '^typeset -x PATH='
@@ -465,6 +507,12 @@ __IN__
 typeset: the -f option cannot be used with the -X option
 __ERR__
 
+test_Oe -e 2 'specifying -f and -i at once'
+typeset -fi
+__IN__
+typeset: the -f option cannot be used with the -i option
+__ERR__
+
 test_O -d -e 1 'printing to closed output stream (all variables w/o -p)'
 typeset >&-
 __IN__
@@ -501,6 +549,13 @@ __IN__
 typeset: $a is read-only
 __ERR__
 
+test_Oe -e 1 'giving integer attribute to array'
+a=(1 2)
+typeset -i a
+__IN__
+typeset: $a is an array
+__ERR__
+
 test_Oe -e 1 'printing non-existing variable'
 typeset -p a
 __IN__
@@ -0,0 +1,528 @@
+/* vtscreen.c: emulates a terminal screen and prints its snapshots */
+/* (C) 2026 magicant */
+
+/* This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* This program reads the output of a program running in a pseudo-terminal
+ * (typically forwarded by ptwrap) from the standard input and interprets the
+ * escape sequences of the subset of xterm that is used by the line-editing.
+ * Every time the bell character is received, the content of the emulated
+ * screen is printed to the standard output.
+ *
+ * Usage: vtscreen [-a] [-c] columns lines
+ *
+ * Each snapshot consists of the lines of the screen without trailing blanks,
+ * up to the last non-blank line, followed by a "----" separator line. With
+ * the -c option, the separator line is followed by the 1-origin line and
+ * column of the cursor, as in "---- 2,5". With the -a option, each line that
+ * has attributes is followed by a line that contains one character per
+ * column:
+ *   k r g y b m c w   foreground color (upper case if also bold)
+ *   o                 bold
+ *   i                 dim
+ *   v                 reverse
+ *   u                 underline
+ *   (space)           no attribute
+ * The attribute line is not aligned with the preceding line if it contains
+ * wide characters, because the text line has one character per wide
+ * character. */
+
+#define _XOPEN_SOURCE 700
+#include <locale.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wchar.h>
+
+#define MAXPARAMS 16
+
+struct attr_T {
+    signed char fg;  /* -1 for default */
+    bool bold, dim, reverse, underline;
+};
+
+struct cell_T {
+    wchar_t c;         /* L'\0' for blank */
+    bool continuation; /* true for the second column of a wide character */
+    struct attr_T attr;
+};
+
+static int columns, lines;
+static struct cell_T *screen;
+static int row, col;
+static bool wrap_pending, insert_mode;
+static int scroll_top, scroll_bottom;
+static struct attr_T attr = { -1, false, false, false, false, };
+static int saved_row, saved_col;
+static struct attr_T saved_attr;
+static bool print_attributes, print_cursor;
+
+static struct cell_T *cell(int r, int c)
+{
+    return &screen[r * columns + c];
+}
+
+static bool is_blank(int r, int c)
+{
+    wchar_t wc = cell(r, c)->c;
+    return wc == L'\0' || wc == L' ';
+}
+
+static void clear_cells(int r, int from, int to)
+{
+    for (int c = from; c < to; c++)
+        *cell(r, c) = (struct cell_T) {
+            .c = L'\0', .continuation = false, .attr = attr,
+        };
+}
+
+static void clear_rows(int from, int to)
+{
+    for (int r = from; r < to; r++)
+        clear_cells(r, 0, columns);
+}
+
+/* Moves the lines in the range [top, bottom] up by `count' lines within the
+ * range. Negative `count' moves the lines down. */
+static void scroll_lines(int top, int bottom, int count)
+{
+    int height = bottom - top + 1;
+    if (count > height)
+        count = height;
+    else if (count < -height)
+        count = -height;
+    size_t rowsize = columns * sizeof *screen;
+    if (count > 0) {
+        memmove(cell(top, 0), cell(top + count, 0),
+                (height - count) * rowsize);
+        clear_rows(bottom - count + 1, bottom + 1);
+    } else if (count < 0) {
+        count = -count;
+        memmove(cell(top + count, 0), cell(top, 0),
+                (height - count) * rowsize);
+        clear_rows(top, top + count);
+    }
+}
+
+static void line_feed(void)
+{
+    wrap_pending = false;
+    if (row == scroll_bottom)
+        scroll_lines(scroll_top, scroll_bottom, 1);
+    else if (row < lines - 1)
+        row++;
+}
+
+static void reverse_line_feed(void)
+{
+    wrap_pending = false;
+    if (row == scroll_top)
+        scroll_lines(scroll_top, scroll_bottom, -1);
+    else if (row > 0)
+        row--;
+}
+
+static int clamp(int value, int min, int max)
+{
+    return value < min ? min : value > max ? max : value;
+}
+
+static void move_cursor(int r, int c)
+{
+    row = clamp(r, 0, lines - 1);
+    col = clamp(c, 0, columns - 1);
+    wrap_pending = false;
+}
+
+/* Shifts the characters at and after the cursor to the right by `count'
+ * columns. */
+static void insert_blanks(int count)
+{
+    count = clamp(count, 0, columns - col);
+    memmove(cell(row, col + count), cell(row, col),
+            (columns - col - count) * sizeof *screen);
+    clear_cells(row, col, col + count);
+}
+
+static void delete_chars(int count)
+{
+    count = clamp(count, 0, columns - col);
+    memmove(cell(row, col), cell(row, col + count),
+            (columns - col - count) * sizeof *screen);
+    clear_cells(row, columns - count, columns);
+}
+
+static void put_char(wchar_t c)
+{
+    int width = wcwidth(c);
+    if (width == 0)
+        return;  /* combining characters are not supported */
+    if (width < 0 || width > 2)
+        width = 1;
+
+    if (wrap_pending || col + width > columns) {
+        col = 0;
+        line_feed();
+    }
+    if (insert_mode)
+        insert_blanks(width);
+    *cell(row, col) = (struct cell_T) {
+        .c = c, .continuation = false, .attr = attr,
+    };
+    if (width == 2)
+        *cell(row, col + 1) = (struct cell_T) {
+            .c = L'\0', .continuation = true, .attr = attr,
+        };
+    col += width;
+    if (col >= columns) {
+        col = columns - 1;
+        wrap_pending = true;
+    }
+}
+
+static void print_snapshot(void)
+{
+    int last = lines - 1;
+    for (; last >= 0; last--) {
+        int c;
+        for (c = 0; c < columns; c++)
+            if (!is_blank(last, c))
+                break;
+        if (c < columns)
+            break;
+    }
+
+    for (int r = 0; r <= last; r++) {
+        int end = columns;
+        while (end > 0 && is_blank(r, end - 1))
+            end--;
+        for (int c = 0; c < end; c++) {
+            const struct cell_T *p = cell(r, c);
+            if (!p->continuation)
+                printf("%lc", p->c == L'\0' ? L' ' : (wint_t) p->c);
+        }
+        putchar('\n');
+
+        if (!print_attributes)
+            continue;
+        char attrs[columns + 1];
+        int attrend = 0;
+        for (int c = 0; c < columns; c++) {
+            const struct attr_T *a = &cell(r, c)->attr;
+            char ch;
+            if (a->fg >= 0)
+                ch = "krgybmcw"[a->fg] - (a->bold ? 'a' - 'A' : 0);
+            else if (a->bold)
+                ch = 'o';
+            else if (a->dim)
+                ch = 'i';
+            else if (a->reverse)
+                ch = 'v';
+            else if (a->underline)
+                ch = 'u';
+            else
+                ch = ' ';
+            attrs[c] = ch;
+            if (ch != ' ')
+                attrend = c + 1;
+        }
+        if (attrend > 0) {
+            attrs[attrend] = '\0';
+            puts(attrs);
+        }
+    }
+
+    if (print_cursor)
+        printf("---- %d,%d\n", row + 1, col + 1);
+    else
+        puts("----");
+    fflush(stdout);
+}
+
+static void select_graphic_rendition(const int params[], int count)
+{
+    if (count == 0)
+        count = 1;  /* params[0] is zero */
+    for (int i = 0; i < count; i++) {
+        int p = params[i];
+        switch (p) {
+            case 0:
+                attr = (struct attr_T) { -1, false, false, false, false, };
+                break;
+            case 1:   attr.bold = true;                    break;
+            case 2:   attr.dim = true;                     break;
+            case 4:   attr.underline = true;               break;
+            case 7:   attr.reverse = true;                 break;
+            case 22:  attr.bold = attr.dim = false;        break;
+            case 24:  attr.underline = false;              break;
+            case 27:  attr.reverse = false;                break;
+            case 39:  attr.fg = -1;                        break;
+            case 38:
+            case 48:
+                /* skip extended color specification */
+                if (i + 1 < count && params[i + 1] == 5)
+                    i += 2;
+                else if (i + 1 < count && params[i + 1] == 2)
+                    i += 4;
+                break;
+            default:
+                if (30 <= p && p <= 37)
+                    attr.fg = p - 30;
+                else if (90 <= p && p <= 97)
+                    attr.fg = p - 90;
+                break;
+        }
+    }
+}
+
+static void control_sequence(
+        char final, bool private, const int params[], int count)
+{
+    int n = (params[0] > 0) ? params[0] : 1;
+    switch (final) {
+        case 'A':  move_cursor(row - n, col);  break;
+        case 'B':  move_cursor(row + n, col);  break;
+        case 'C':  move_cursor(row, col + n);  break;
+        case 'D':  move_cursor(row, col - n);  break;
+        case 'E':  move_cursor(row + n, 0);    break;
+        case 'F':  move_cursor(row - n, 0);    break;
+        case 'G':  move_cursor(row, n - 1);    break;
+        case 'd':  move_cursor(n - 1, col);    break;
+        case 'H':
+        case 'f':
+            move_cursor(n - 1, (params[1] > 0 ? params[1] : 1) - 1);
+            break;
+        case 'J':
+            switch (params[0]) {
+                case 0:
+                    clear_cells(row, col, columns);
+                    clear_rows(row + 1, lines);
+                    break;
+                case 1:
+                    clear_rows(0, row);
+                    clear_cells(row, 0, col + 1);
+                    break;
+                default:
+                    clear_rows(0, lines);
+                    break;
+            }
+            break;
+        case 'K':
+            switch (params[0]) {
+                case 0:   clear_cells(row, col, columns);  break;
+                case 1:   clear_cells(row, 0, col + 1);    break;
+                default:  clear_cells(row, 0, columns);    break;
+            }
+            break;
+        case '@':  insert_blanks(n);  break;
+        case 'P':  delete_chars(n);   break;
+        case 'X':  clear_cells(row, col, clamp(col + n, 0, columns));  break;
+        case 'L':
+            if (scroll_top <= row && row <= scroll_bottom)
+                scroll_lines(row, scroll_bottom, -n);
+            break;
+        case 'M':
+            if (scroll_top <= row && row <= scroll_bottom)
+                scroll_lines(row, scroll_bottom, n);
+            break;
+        case 'S':  scroll_lines(scroll_top, scroll_bottom, n);   break;
+        case 'T':  scroll_lines(scroll_top, scroll_bottom, -n);  break;
+        case 'm':
+            if (!private)
+                select_graphic_rendition(params, count);
+            break;
+        case 'h':
+        case 'l':
+            if (!private)
+                for (int i = 0; i < count; i++)
+                    if (params[i] == 4)
+                        insert_mode = (final == 'h');
+            break;
+        case 'r':
+            if (!private) {
+                int top = (params[0] > 0 ? params[0] : 1) - 1;
+                int bottom = (params[1] > 0 ? params[1] : lines) - 1;
+                if (top < bottom && bottom < lines) {
+                    scroll_top = top, scroll_bottom = bottom;
+                    move_cursor(0, 0);
+                }
+            }
+            break;
+        case 's':
+            saved_row = row, saved_col = col, saved_attr = attr;
+            break;
+        case 'u':
+            move_cursor(saved_row, saved_col), attr = saved_attr;
+            break;
+    }
+}
+
+enum state_T { GROUND, ESCAPE, CHARSET, CSI, OSC, OSC_ESCAPE, };
+
+int main(int argc, char *argv[])
+{
+    setlocale(LC_CTYPE, "");
+
+    int opt;
+    while ((opt = getopt(argc, argv, "ac")) != -1) {
+        switch (opt) {
+            case 'a':  print_attributes = true;  break;
+            case 'c':  print_cursor = true;      break;
+            default:   return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "usage: %s [-a] [-c] columns lines\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    columns = atoi(argv[optind]);
+    lines = atoi(argv[optind + 1]);
+    if (columns <= 0 || lines <= 0) {
+        fprintf(stderr, "%s: invalid screen size\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    screen = malloc((size_t) columns * lines * sizeof *screen);
+    if (screen == NULL) {
+        perror(argv[0]);
+        return EXIT_FAILURE;
+    }
+    clear_rows(0, lines);
+    scroll_top = 0, scroll_bottom = lines - 1;
+
+    enum state_T state = GROUND;
+    mbstate_t mbstate;
+    memset(&mbstate, 0, sizeof mbstate);
+    int params[MAXPARAMS], paramcount = 0;
+    bool private = false;
+    int c;
+    while ((c = getchar()) != EOF) {
+        switch (state) {
+        case GROUND:
+            if (mbsinit(&mbstate)) {
+                switch (c) {
+                    case '\a':  print_snapshot();      continue;
+                    case '\b':
+                        wrap_pending = false;
+                        if (col > 0)
+                            col--;
+                        continue;
+                    case '\t':
+                        move_cursor(row, (col / 8 + 1) * 8);
+                        continue;
+                    case '\n':  case '\v':  case '\f':
+                        line_feed();
+                        continue;
+                    case '\r':
+                        col = 0, wrap_pending = false;
+                        continue;
+                    case '\033':
+                        state = ESCAPE;
+                        continue;
+                }
+                if (0 <= c && c < 0x20)
+                    continue;
+            }
+
+            char byte = c;
+            wchar_t wc;
+            switch (mbrtowc(&wc, &byte, 1, &mbstate)) {
+                case (size_t) -2:
+                    break;
+                case (size_t) -1:
+                    memset(&mbstate, 0, sizeof mbstate);
+                    put_char(L'?');
+                    break;
+                default:
+                    put_char(wc);
+                    break;
+            }
+            break;
+        case ESCAPE:
+            state = GROUND;
+            switch (c) {
+                case '[':
+                    state = CSI;
+                    memset(params, 0, sizeof params);
+                    paramcount = 0;
+                    private = false;
+                    break;
+                case ']':
+                    state = OSC;
+                    break;
+                case '(':  case ')':  case '*':  case '+':
+                    state = CHARSET;
+                    break;
+                case '7':
+                    saved_row = row, saved_col = col, saved_attr = attr;
+                    break;
+                case '8':
+                    move_cursor(saved_row, saved_col), attr = saved_attr;
+                    break;
+                case 'D':
+                    line_feed();
+                    break;
+                case 'E':
+                    col = 0;
+                    line_feed();
+                    break;
+                case 'M':
+                    reverse_line_feed();
+                    break;
+            }
+            break;
+        case CHARSET:
+            state = GROUND;
+            break;
+        case CSI:
+            if ('0' <= c && c <= '9') {
+                if (paramcount == 0)
+                    paramcount = 1;
+                if (paramcount <= MAXPARAMS) {
+                    int *p = &params[paramcount - 1];
+                    if (*p < 10000)
+                        *p = *p * 10 + (c - '0');
+                }
+            } else if (c == ';') {
+                if (paramcount == 0)
+                    paramcount = 1;
+                paramcount++;
+            } else if (c == '?' || c == '>' || c == '<' || c == '=') {
+                private = true;
+            } else if (0x40 <= c && c <= 0x7E) {
+                state = GROUND;
+                if (paramcount > MAXPARAMS)
+                    paramcount = MAXPARAMS;
+                control_sequence(c, private, params, paramcount);
+            }
+            /* intermediate bytes are ignored */
+            break;
+        case OSC:
+            if (c == '\a')
+                state = GROUND;
+            else if (c == '\033')
+                state = OSC_ESCAPE;
+            break;
+        case OSC_ESCAPE:
+            state = (c == '\\') ? GROUND : OSC;
+            break;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* vim: set ts=8 sts=4 sw=4 et tw=80: */
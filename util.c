@@ -25,6 +25,7 @@
 # include <libintl.h>
 #endif
 #include <limits.h>
+#include <locale.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -47,6 +48,86 @@ void alloc_failed(void)
 }
 
 
+/********** Scratch Arena **********/
+
+#ifndef SCRATCH_CHUNKSIZE
+#define SCRATCH_CHUNKSIZE 8192
+#endif
+
+/* memory block that makes up the scratch arena */
+struct scratchchunk_T {
+    struct scratchchunk_T *prev;  /* older chunk */
+    size_t size;                  /* size of `data' */
+    union {
+        long l;
+        double d;
+        long double ld;
+        void *p;
+    } data[];
+};
+
+/* the newest chunk in the arena */
+static struct scratchchunk_T *scratch_chunk = NULL;
+/* number of bytes used in `scratch_chunk' */
+static size_t scratch_used = 0;
+/* a chunk kept after release for reuse */
+static struct scratchchunk_T *scratch_spare = NULL;
+
+/* Returns the current position of the scratch arena. */
+scratchmark_T scratch_mark(void)
+{
+    return (scratchmark_T) { scratch_chunk, scratch_used };
+}
+
+/* Frees all the memory allocated in the scratch arena after `mark' was made.
+ * One chunk of the default size is kept for later use. */
+void scratch_release(scratchmark_T mark)
+{
+    while (scratch_chunk != mark.chunk) {
+        struct scratchchunk_T *chunk = scratch_chunk;
+        assert(chunk != NULL);
+        scratch_chunk = chunk->prev;
+        if (scratch_spare == NULL && chunk->size == SCRATCH_CHUNKSIZE)
+            scratch_spare = chunk;
+        else
+            free(chunk);
+    }
+    assert(mark.used <= (scratch_chunk != NULL ? scratch_chunk->size : 0));
+    scratch_used = mark.used;
+}
+
+/* Allocates memory of the specified size in the scratch arena.
+ * The memory is suitably aligned for any type and is valid until released by
+ * `scratch_release'. */
+void *scratch_alloc(size_t size)
+{
+    const size_t align = sizeof *scratch_chunk->data;
+    size = add(size, align - 1) / align * align;
+    if (size == 0)
+        size = align;
+
+    if (scratch_chunk == NULL || scratch_chunk->size - scratch_used < size) {
+        struct scratchchunk_T *chunk;
+        if (size <= SCRATCH_CHUNKSIZE / 4 && scratch_spare != NULL) {
+            chunk = scratch_spare;
+            scratch_spare = NULL;
+        } else {
+            size_t chunksize = size <= SCRATCH_CHUNKSIZE / 4
+                    ? SCRATCH_CHUNKSIZE : size;
+            chunk = xmallocs(sizeof *chunk, chunksize, 1);
+            chunk->size = chunksize;
+        }
+        chunk->prev = scratch_chunk;
+        scratch_chunk = chunk;
+        scratch_used = 0;
+    }
+
+    void *result = (char *) scratch_chunk->data + scratch_used;
+    scratch_used += size;
+    return result;
+}
+
+
 /********** String Utilities **********/
 
 #if !HAVE_STRNLEN
@@ -221,6 +302,78 @@ void *copyaswcs(const void *p)
     return xwcsdup(p);
 }
 
+/* Returns true iff `wcscoll' is known to be equivalent to `wcscmp' in the
+ * current locale. */
+bool collation_is_codepoint_order(void)
+{
+    const char *name = setlocale(LC_COLLATE, NULL);
+    return name != NULL &&
+        (strcmp(name, "C") == 0 || strcmp(name, "POSIX") == 0);
+}
+
+/* Returns a collation key for `s', that is, a wide string such that comparing
+ * two keys by `wcscmp' gives the same result as comparing the original strings
+ * by `wcscoll'. If `codepoint' is true, which should be the result of
+ * `collation_is_codepoint_order', `s' itself is returned. Otherwise, the key
+ * is allocated in the scratch arena. */
+const wchar_t *collation_key(const wchar_t *s, bool codepoint)
+{
+    if (codepoint)
+        return s;
+
+    /* Most locales produce a key a few times as long as the string, so we first
+     * try a buffer of a guessed size to avoid calling `wcsxfrm' twice. */
+    size_t size = add(mul(wcslen(s), 4), 1);
+    wchar_t *key = scratch_allocn(size, sizeof *key);
+    size_t length = wcsxfrm(key, s, size);
+    if (length >= size) {
+        size = add(length, 1);
+        key = scratch_allocn(size, sizeof *key);
+        wcsxfrm(key, s, size);
+    }
+    return key;
+}
+
+/* Element of the array sorted by `sort_by_collation' */
+struct collsortelem_T {
+    const wchar_t *key;
+    void *elem;
+};
+
+static int collsortcmp(const void *e1, const void *e2)
+    __attribute__((pure,nonnull));
+
+/* Sorts the `count' elements of `array' in the collation order of the current
+ * locale, where `elemstr' returns the string each element is compared by.
+ * A collation key is computed only once for each element instead of calling
+ * `wcscoll' for every comparison. */
+void sort_by_collation(void **array, size_t count,
+        const wchar_t *elemstr(const void *elem))
+{
+    if (count < 2)
+        return;
+
+    scratchmark_T mark = scratch_mark();
+    bool codepoint = collation_is_codepoint_order();
+    struct collsortelem_T *elems = scratch_allocn(count, sizeof *elems);
+    for (size_t i = 0; i < count; i++) {
+        elems[i].key = collation_key(elemstr(array[i]), codepoint);
+        elems[i].elem = array[i];
+    }
+
+    qsort(elems, count, sizeof *elems, collsortcmp);
+
+    for (size_t i = 0; i < count; i++)
+        array[i] = elems[i].elem;
+    scratch_release(mark);
+}
+
+int collsortcmp(const void *e1, const void *e2)
+{
+    return wcscmp(((const struct collsortelem_T *) e1)->key,
+            ((const struct collsortelem_T *) e2)->key);
+}
+
 
 /********** Error Utilities **********/
 
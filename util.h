@@ -175,6 +175,36 @@ void *xreallocs(void *ptr, size_t mainsize, size_t count, size_t elemsize)
 }
 
 
+/********** Scratch Arena **********/
+
+/* The scratch arena is a stack-like memory pool for short-lived objects.
+ * Memory allocated by `scratch_alloc' is never freed individually. Instead,
+ * `scratch_release' frees all the memory allocated after the corresponding
+ * call to `scratch_mark'. Marks must be released in the reverse order of
+ * creation, so expansions nested in other expansions can each have their own
+ * mark. */
+
+/* position in the scratch arena */
+typedef struct scratchmark_T {
+    struct scratchchunk_T *chunk;
+    size_t used;
+} scratchmark_T;
+
+extern scratchmark_T scratch_mark(void);
+extern void scratch_release(scratchmark_T mark);
+extern void *scratch_alloc(size_t size)
+    __attribute__((malloc,warn_unused_result));
+static inline void *scratch_allocn(size_t count, size_t elemsize)
+    __attribute__((malloc,warn_unused_result));
+
+/* Like `scratch_alloc(count * elemsize)', but aborts the program if the size
+ * is too large. */
+void *scratch_allocn(size_t count, size_t elemsize)
+{
+    return scratch_alloc(mul(count, elemsize));
+}
+
+
 /********** String Utilities **********/
 
 #if !HAVE_STRNLEN
@@ -209,6 +239,12 @@ extern wchar_t *matchwcsprefix(const wchar_t *s, const wchar_t *prefix)
     __attribute__((pure,nonnull));
 extern void *copyaswcs(const void *p)
     __attribute__((malloc,warn_unused_result,nonnull));
+extern _Bool collation_is_codepoint_order(void);
+extern const wchar_t *collation_key(const wchar_t *s, _Bool codepoint)
+    __attribute__((nonnull,warn_unused_result));
+extern void sort_by_collation(void **array, size_t count,
+        const wchar_t *elemstr(const void *elem))
+    __attribute__((nonnull(3)));
 
 #if HAVE_STRNLEN
 # ifndef strnlen
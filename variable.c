@@ -36,6 +36,7 @@
 #include <unistd.h>
 #include <wchar.h>
 #include <wctype.h>
+#include "arith.h"
 #include "builtin.h"
 #include "configm.h"
 #include "exec.h"
@@ -93,10 +94,11 @@ typedef enum vartype_T {
     VF_EXPORT   = 1 << 2,
     VF_READONLY = 1 << 3,
     VF_NODELETE = 1 << 4,
+    VF_INTEGER  = 1 << 5,
 } vartype_T;
 #define VF_MASK ((1 << 2) - 1)
 /* For any variable, the variable type is either VF_SCALAR or VF_ARRAY,
- * possibly OR'ed with other flags. */
+ * possibly OR'ed with other flags. VF_INTEGER is only used with VF_SCALAR. */
 
 /* type of variables */
 typedef struct variable_T {
@@ -108,6 +110,7 @@ typedef struct variable_T {
             size_t valc;
         } array;
     } v_contents;
+    long v_integer;
     void (*v_getter)(struct variable_T *var);
 } variable_T;
 #define v_value v_contents.value
@@ -118,7 +121,11 @@ typedef struct variable_T {
  * `v_value', `v_vals' and the elements of `v_vals' are `free'able.
  * `v_value' is NULL if the variable is declared but not yet assigned.
  * `v_vals' is always non-NULL, but it may contain no elements.
- * `v_getter' is the setter function, which is reset to NULL on reassignment.*/
+ * `v_getter' is the setter function, which is reset to NULL on reassignment.
+ * If a scalar variable has the VF_INTEGER flag and a value, `v_integer' is the
+ * value. `v_value' is then the string representation of `v_integer', which is
+ * not made until needed: `v_value' is NULL and `v_getter' is `integer_getter'
+ * until the value is used as a string. */
 
 /* type of shell functions (defined later) */
 typedef struct function_T function_T;
@@ -148,6 +155,8 @@ static variable_T *new_local(const wchar_t *name)
     __attribute__((nonnull));
 static variable_T *new_temporary(const wchar_t *name)
     __attribute__((nonnull));
+static variable_T *prepare_variable(const wchar_t *name, scope_T scope)
+    __attribute__((nonnull));
 static variable_T *new_variable(const wchar_t *name, scope_T scope)
     __attribute__((nonnull));
 static void xtrace_variable(const wchar_t *name, const wchar_t *value)
@@ -160,6 +169,21 @@ static void get_all_variables_rec(
         hashtable_T *table, environ_T *env, bool global)
     __attribute__((nonnull));
 
+static const wchar_t *scalar_value(variable_T *var)
+    __attribute__((nonnull));
+static inline bool has_integer_value(const variable_T *var)
+    __attribute__((nonnull,pure));
+static bool to_integer(wchar_t *value, long *resultp)
+    __attribute__((nonnull));
+static void set_integer_value(variable_T *var, long value)
+    __attribute__((nonnull));
+static bool make_integer(const wchar_t *name, variable_T *var)
+    __attribute__((nonnull));
+
+static void integer_getter(variable_T *var)
+    __attribute__((nonnull));
+static inline void make_string_value(variable_T *var)
+    __attribute__((nonnull));
 static void lineno_getter(variable_T *var)
     __attribute__((nonnull));
 static void random_getter(variable_T *var)
@@ -436,10 +460,11 @@ void update_environment(const wchar_t *name)
 char *get_exported_value(const wchar_t *name)
 {
     for (environ_T *env = current_env; env != NULL; env = env->parent) {
-        const variable_T *var = ht_get(&env->contents, name).value;
+        variable_T *var = ht_get(&env->contents, name).value;
         if (var != NULL && (var->v_type & VF_EXPORT)) {
             switch (var->v_type & VF_MASK) {
                 case VF_SCALAR:
+                    make_string_value(var);
                     if (var->v_value == NULL)
                         continue;
                     return malloc_wcstombs(var->v_value);
@@ -585,15 +610,10 @@ variable_T *new_temporary(const wchar_t *name)
 }
 
 /* Creates a new variable with the specified name if there is none.
- * If the variable already exists, it is cleared and returned.
- *
- * On error, an error message is printed to the standard error and NULL is
- * returned. Otherwise, the (new) variable is returned.
- * `v_type' is the only valid member of the returned variable and all the
- * members of the variable (including `v_type') must be initialized by the
- * caller. If `v_type' of the return value includes the VF_EXPORT flag, the
- * caller must call `update_environment'. */
-variable_T *new_variable(const wchar_t *name, scope_T scope)
+ * If the variable already exists, it is returned without change.
+ * On error (the variable is read-only), an error message is printed to the
+ * standard error and NULL is returned. */
+variable_T *prepare_variable(const wchar_t *name, scope_T scope)
 {
     variable_T *var;
 
@@ -606,10 +626,25 @@ variable_T *new_variable(const wchar_t *name, scope_T scope)
     if (var->v_type & VF_READONLY) {
         xerror(0, Ngt("$%ls is read-only"), name);
         return NULL;
-    } else {
-        varvaluefree(var);
-        return var;
     }
+    return var;
+}
+
+/* Creates a new variable with the specified name if there is none.
+ * If the variable already exists, it is cleared and returned.
+ *
+ * On error, an error message is printed to the standard error and NULL is
+ * returned. Otherwise, the (new) variable is returned.
+ * `v_type' is the only valid member of the returned variable and all the
+ * members of the variable (including `v_type') must be initialized by the
+ * caller. If `v_type' of the return value includes the VF_EXPORT flag, the
+ * caller must call `update_environment'. */
+variable_T *new_variable(const wchar_t *name, scope_T scope)
+{
+    variable_T *var = prepare_variable(name, scope);
+    if (var != NULL)
+        varvaluefree(var);
+    return var;
 }
 
 /* Creates a scalar variable with the specified name and value.
@@ -619,6 +654,8 @@ variable_T *new_variable(const wchar_t *name, scope_T scope)
  * set to the variable), but this function does not reset an existing VF_EXPORT
  * flag if `export' is false. The `shopt_allexport' option, if true, supersedes
  * `export' unless `name' begins with an '='.
+ * If the variable has the integer attribute, `value' is evaluated as an
+ * arithmetic expression and the result is assigned.
  * Returns true iff successful. On error, an error message is printed to the
  * standard error. */
 bool set_variable(
@@ -627,17 +664,57 @@ bool set_variable(
     if (shopt_allexport && name[0] != '=')
         export = true;
 
-    variable_T *var = new_variable(name, scope);
+    variable_T *var = prepare_variable(name, scope);
     if (var == NULL) {
         free(value);
         return false;
     }
 
-    var->v_type = VF_SCALAR
-        | (var->v_type & (VF_EXPORT | VF_NODELETE))
-        | (export ? VF_EXPORT : 0);
-    var->v_value = value;
-    var->v_getter = NULL;
+    if ((var->v_type & VF_INTEGER) && value != NULL) {
+        long integer;
+        if (!to_integer(value, &integer))
+            return false;
+        set_integer_value(var, integer);
+    } else {
+        varvaluefree(var);
+        var->v_type = VF_SCALAR
+            | (var->v_type & (VF_EXPORT | VF_NODELETE | VF_INTEGER));
+        var->v_value = value;
+        var->v_getter = NULL;
+    }
+    if (export)
+        var->v_type |= VF_EXPORT;
+
+    variable_set(name, var);
+    if (var->v_type & VF_EXPORT)
+        update_environment(name);
+    return true;
+}
+
+/* Assigns an integer to the specified scalar variable.
+ * If the variable has the integer attribute, the value is stored without
+ * being converted to a string. Otherwise, this function is equivalent to
+ * `set_variable' with the decimal representation of `value'. */
+bool set_variable_long(
+        const wchar_t *name, long value, scope_T scope, bool export)
+{
+    if (shopt_allexport && name[0] != '=')
+        export = true;
+
+    variable_T *var = prepare_variable(name, scope);
+    if (var == NULL)
+        return false;
+
+    if (var->v_type & VF_INTEGER) {
+        set_integer_value(var, value);
+    } else {
+        varvaluefree(var);
+        var->v_type = VF_SCALAR | (var->v_type & (VF_EXPORT | VF_NODELETE));
+        var->v_value = malloc_wprintf(L"%ld", value);
+        var->v_getter = NULL;
+    }
+    if (export)
+        var->v_type |= VF_EXPORT;
 
     variable_set(name, var);
     if (var->v_type & VF_EXPORT)
@@ -809,17 +886,115 @@ void xtrace_array(const wchar_t *name, void *const *values)
 const wchar_t *getvar(const wchar_t *name)
 {
     variable_T *var = search_variable(name);
-    if (var != NULL && (var->v_type & VF_MASK) == VF_SCALAR) {
-        if (var->v_getter) {
-            var->v_getter(var);
-            if ((var->v_type & VF_MASK) != VF_SCALAR)
-                return NULL;
-        }
-        return var->v_value;
-    }
+    if (var != NULL)
+        return scalar_value(var);
     return NULL;
 }
 
+/* Gets the value of the specified scalar variable for arithmetic evaluation.
+ * If the variable has the integer attribute and a value, the value is assigned
+ * to `*valuep' without being converted to a string and true is returned.
+ * Otherwise, the value of the variable is assigned to `*stringp' as `getvar'
+ * would return and false is returned. */
+bool getvar_long(const wchar_t *name, long *valuep, const wchar_t **stringp)
+{
+    variable_T *var = search_variable(name);
+    if (var == NULL) {
+        *stringp = NULL;
+        return false;
+    }
+    if (has_integer_value(var)) {
+        *valuep = var->v_integer;
+        return true;
+    }
+    *stringp = scalar_value(var);
+    return false;
+}
+
+/* Returns the value of the specified variable if it is a scalar. The getter of
+ * the variable is called if any. Returns NULL if the variable is not a scalar
+ * or has no value. */
+const wchar_t *scalar_value(variable_T *var)
+{
+    if ((var->v_type & VF_MASK) != VF_SCALAR)
+        return NULL;
+    if (var->v_getter) {
+        var->v_getter(var);
+        if ((var->v_type & VF_MASK) != VF_SCALAR)
+            return NULL;
+    }
+    return var->v_value;
+}
+
+/* Returns true iff `v_integer' of the specified variable is its current value.
+ */
+bool has_integer_value(const variable_T *var)
+{
+    if ((var->v_type & (VF_MASK | VF_INTEGER)) != (VF_SCALAR | VF_INTEGER))
+        return false;
+    if (var->v_getter == integer_getter)
+        return true;
+    return var->v_getter == NULL && var->v_value != NULL;
+}
+
+/* Converts the specified string to an integer to be assigned to a variable
+ * that has the integer attribute. The string is evaluated as an arithmetic
+ * expression, where an empty string is regarded as zero.
+ * `value' is freed in this function.
+ * Returns true iff successful. On error, an error message is printed. */
+bool to_integer(wchar_t *value, long *resultp)
+{
+    if (value[0] == L'\0') {
+        free(value);
+        *resultp = 0;
+        return true;
+    }
+    return evaluate_integer(value, resultp);
+}
+
+/* Replaces the value of the specified variable with the specified integer.
+ * The variable must have the integer attribute. */
+void set_integer_value(variable_T *var, long value)
+{
+    assert(var->v_type & VF_INTEGER);
+    varvaluefree(var);
+    var->v_type = VF_SCALAR | (var->v_type & ~VF_MASK);
+    var->v_value = NULL;
+    var->v_integer = value;
+    var->v_getter = integer_getter;
+}
+
+/* Gives the integer attribute to the specified variable.
+ * If the variable already has a value, the value is converted by `to_integer'.
+ * The caller must call `update_environment' if the variable is exported.
+ * Returns true iff successful. On error, an error message is printed. */
+bool make_integer(const wchar_t *name, variable_T *var)
+{
+    if (var->v_type & VF_INTEGER)
+        return true;
+    if ((var->v_type & VF_MASK) == VF_ARRAY) {
+        xerror(0, Ngt("$%ls is an array"), name);
+        return false;
+    }
+
+    const wchar_t *value = scalar_value(var);
+    if (value == NULL) {
+        var->v_type |= VF_INTEGER;
+        return true;
+    }
+    if (var->v_type & VF_READONLY) {
+        xerror(0, Ngt("$%ls is read-only"), name);
+        return false;
+    }
+
+    long integer;
+    if (!to_integer(xwcsdup(value), &integer))
+        return false;
+    var->v_type |= VF_INTEGER;
+    set_integer_value(var, integer);
+    return true;
+}
+
 /* Returns the value(s) of the specified variable/array as an array.
  * The return value's type is `struct get_variable_T'. It has three members:
  * `type', `count' and `values'.
@@ -1018,6 +1193,16 @@ void close_current_environment(void)
 
 /********** Getters **********/
 
+/* getter for variables that have the integer attribute */
+void integer_getter(variable_T *var)
+{
+    assert((var->v_type & VF_MASK) == VF_SCALAR);
+    assert(var->v_type & VF_INTEGER);
+    assert(var->v_value == NULL);
+    var->v_value = malloc_wprintf(L"%ld", var->v_integer);
+    var->v_getter = NULL;
+}
+
 /* line number of the currently executing command */
 static unsigned long current_lineno;
 
@@ -1035,6 +1220,14 @@ void update_lineno(unsigned long lineno)
     }
 }
 
+/* Makes the string value of the specified scalar variable if it has the
+ * integer attribute and the string has not yet been made. */
+void make_string_value(variable_T *var)
+{
+    if (var->v_getter == integer_getter)
+        integer_getter(var);
+}
+
 /* getter for $LINENO */
 void lineno_getter(variable_T *var)
 {
@@ -1105,6 +1298,8 @@ void variable_set(const wchar_t *name, variable_T *var)
     case L'R':
         if (random_active && wcscmp(name, L VAR_RANDOM) == 0) {
             random_active = false;
+            if (var != NULL)
+                make_string_value(var);
             if (var != NULL
                     && (var->v_type & VF_MASK) == VF_SCALAR
                     && var->v_value != NULL) {
@@ -1200,6 +1395,7 @@ void reset_path(path_T name, variable_T *var)
         if (v != NULL) {
             switch (v->v_type & VF_MASK) {
                 case VF_SCALAR:
+                    make_string_value(v);
                     env->paths[name] = decompose_paths(v->v_value);
                     break;
                 case VF_ARRAY:
@@ -1566,11 +1762,11 @@ void generate_dirstack_candidates(const le_compopt_T *compopt)
 struct reading_option_T;
 
 static void print_variable(
-        const wchar_t *name, const variable_T *var,
+        const wchar_t *name, variable_T *var,
         const wchar_t *argv0, bool readonly, bool export)
     __attribute__((nonnull));
 static void print_scalar(const wchar_t *name, bool namequote,
-        const variable_T *var, const wchar_t *argv0)
+        variable_T *var, const wchar_t *argv0)
     __attribute__((nonnull));
 static void print_array(
         const wchar_t *name, const variable_T *var, const wchar_t *argv0)
@@ -1625,6 +1821,7 @@ static void assign_array(const wchar_t *name, const plist_T *ranges, size_t i)
 const struct xgetopt_T typeset_options[] = {
     { L'f', L"functions", OPTARG_NONE, false, NULL, },
     { L'g', L"global",    OPTARG_NONE, false, NULL, },
+    { L'i', L"integer",   OPTARG_NONE, false, NULL, },
     { L'p', L"print",     OPTARG_NONE, true,  NULL, },
     { L'r', L"readonly",  OPTARG_NONE, false, NULL, },
     { L'x', L"export",    OPTARG_NONE, false, NULL, },
@@ -1636,31 +1833,54 @@ const struct xgetopt_T typeset_options[] = {
 };
 /* Note: `local_options' is defined as part of `typeset_options'. */
 
+/* Options for the "export" and "readonly" built-ins. They are the same as those
+ * for the "typeset" built-in except that the integer attribute is not
+ * supported. */
+const struct xgetopt_T export_options[] = {
+    { L'f', L"functions", OPTARG_NONE, false, NULL, },
+    { L'g', L"global",    OPTARG_NONE, false, NULL, },
+    { L'p', L"print",     OPTARG_NONE, true,  NULL, },
+    { L'r', L"readonly",  OPTARG_NONE, false, NULL, },
+    { L'x', L"export",    OPTARG_NONE, false, NULL, },
+    { L'X', L"unexport",  OPTARG_NONE, false, NULL, },
+#if YASH_ENABLE_HELP
+    { L'-', L"help",      OPTARG_NONE, false, NULL, },
+#endif
+    { L'\0', NULL, 0, false, NULL, },
+};
+
 /* The "typeset" built-in, which accepts the following options:
  *  -f: affect functions rather than variables
  *  -g: global
+ *  -i: give the integer attribute to variables
  *  -p: print variables
  *  -r: make variables readonly
  *  -x: export variables
  *  -X: cancel exportation of variables
  * Equivalent built-ins:
- *  export:   typeset -gx
+ *  export:   typeset -gx (without -i)
  *  local:    typeset
- *  readonly: typeset -gr
+ *  readonly: typeset -gr (without -i)
  * The "set" built-in without any arguments is redirected to this built-in. */
 int typeset_builtin(int argc, void **argv)
 {
-    bool function = false, global = false, print = false;
+    bool function = false, global = false, integer = false, print = false;
     bool readonly = false, export = false, unexport = false;
 
-    const struct xgetopt_T *options =
-        (ARGV(0)[0] == L'l' /*local*/) ? local_options : typeset_options;
+    const struct xgetopt_T *options;
+    switch (ARGV(0)[0]) {
+        case L'e' /*export*/:
+        case L'r' /*readonly*/:  options = export_options;   break;
+        case L'l' /*local*/:     options = local_options;    break;
+        default:                 options = typeset_options;  break;
+    }
     const struct xgetopt_T *opt;
     xoptind = 0;
     while ((opt = xgetopt(argv, options, 0)) != NULL) {
         switch (opt->shortopt) {
             case L'f':  function = true;  break;
             case L'g':  global   = true;  break;
+            case L'i':  integer  = true;  break;
             case L'p':  print    = true;  break;
             case L'r':  readonly = true;  break;
             case L'x':  export   = true;  break;
@@ -1708,6 +1928,9 @@ int typeset_builtin(int argc, void **argv)
     if (function && unexport)
         return special_builtin_error(
                 mutually_exclusive_option_error(L'f', L'X'));
+    if (function && integer)
+        return special_builtin_error(
+                mutually_exclusive_option_error(L'f', L'i'));
     if (export && unexport)
         return special_builtin_error(
                 mutually_exclusive_option_error(L'x', L'X'));
@@ -1743,9 +1966,19 @@ int typeset_builtin(int argc, void **argv)
                     /* create/assign variable */
                     variable_T *var = global ? new_global(arg) : new_local(arg);
                     vartype_T saveexport = var->v_type & VF_EXPORT;
+                    bool converted = false;
+                    if (integer && !(var->v_type & VF_INTEGER)) {
+                        if (!make_integer(arg, var))
+                            continue;
+                        converted = true;
+                    }
                     if (wequal != NULL) {
+                        long value;
                         if (var->v_type & VF_READONLY) {
                             xerror(0, Ngt("$%ls is read-only"), arg);
+                        } else if (var->v_type & VF_INTEGER) {
+                            if (to_integer(xwcsdup(&wequal[1]), &value))
+                                set_integer_value(var, value);
                         } else {
                             varvaluefree(var);
                             var->v_type = VF_SCALAR | (var->v_type & ~VF_MASK);
@@ -1761,7 +1994,8 @@ int typeset_builtin(int argc, void **argv)
                         var->v_type &= ~VF_EXPORT;
                     variable_set(arg, var);
                     if (saveexport != (var->v_type & VF_EXPORT)
-                            || (wequal != NULL && (var->v_type & VF_EXPORT)))
+                            || ((wequal != NULL || converted)
+                                && (var->v_type & VF_EXPORT)))
                         update_environment(arg);
                 } else {
                     /* print the variable */
@@ -1801,7 +2035,7 @@ int typeset_builtin(int argc, void **argv)
  * is not true.
  * An error message is printed to the standard error on error. */
 void print_variable(
-        const wchar_t *name, const variable_T *var,
+        const wchar_t *name, variable_T *var,
         const wchar_t *argv0, bool readonly, bool export)
 {
     wchar_t *qname = NULL;
@@ -1834,12 +2068,13 @@ void print_variable(
  * normal assignment syntax.
  * An error message is printed to the standard error on error. */
 void print_scalar(const wchar_t *name, bool namequote,
-        const variable_T *var, const wchar_t *argv0)
+        variable_T *var, const wchar_t *argv0)
 {
     wchar_t *quotedvalue;
     const char *format;
     char *opts;
 
+    make_string_value(var);
     if (var->v_value != NULL)
         quotedvalue = quote_as_word(var->v_value);
     else
@@ -1971,7 +2206,9 @@ end:
 char *vartype_option_string(vartype_T type)
 {
     xstrbuf_T opts;
-    sb_initwithmax(&opts, 4);
+    sb_initwithmax(&opts, 5);
+    if (type & VF_INTEGER)
+        sb_ccat(&opts, 'i');
     if (type & VF_EXPORT)
         sb_ccat(&opts, 'x');
     if (type & VF_READONLY)
@@ -1986,7 +2223,7 @@ const char typeset_help[] = Ngt(
 "set or print variables"
 );
 const char typeset_syntax[] = Ngt(
-"\ttypeset [-fgprxX] [name[=value]...]\n"
+"\ttypeset [-fgiprxX] [name[=value]...]\n"
 );
 const char export_help[] = Ngt(
 "export variables as environment variables"
@@ -1998,7 +2235,7 @@ const char local_help[] = Ngt(
 "set or print local variables"
 );
 const char local_syntax[] = Ngt(
-"\tlocal [-prxX] [name[=value]...]\n"
+"\tlocal [-iprxX] [name[=value]...]\n"
 );
 const char readonly_help[] = Ngt(
 "make variables read-only"
@@ -68,6 +68,7 @@ extern char **environ;
 #define VAR_TERM                      "TERM"
 #define VAR_WORDS                     "WORDS"
 #define VAR_YASH_AFTER_CD             "YASH_AFTER_CD"
+#define VAR_YASH_GLOB_THREADS         "YASH_GLOB_THREADS"
 #define VAR_YASH_LE_TIMEOUT           "YASH_LE_TIMEOUT"
 #define VAR_YASH_LOADPATH             "YASH_LOADPATH"
 #define VAR_YASH_VERSION              "YASH_VERSION"
@@ -94,6 +95,9 @@ typedef enum scope_T {
 extern _Bool set_variable(
         const wchar_t *name, wchar_t *value, scope_T scope, _Bool export)
     __attribute__((nonnull(1)));
+extern _Bool set_variable_long(
+        const wchar_t *name, long value, scope_T scope, _Bool export)
+    __attribute__((nonnull));
 extern struct variable_T *set_array(
         const wchar_t *name, size_t count, void **values,
         scope_T scope, _Bool export)
@@ -114,6 +118,9 @@ struct get_variable_T {
 };
 extern const wchar_t *getvar(const wchar_t *name)
     __attribute__((pure,nonnull));
+extern _Bool getvar_long(
+        const wchar_t *name, long *valuep, const wchar_t **stringp)
+    __attribute__((nonnull));
 extern struct get_variable_T get_variable(const wchar_t *name)
     __attribute__((nonnull,warn_unused_result));
 extern void save_get_variable_values(struct get_variable_T *gv)
@@ -147,7 +154,7 @@ extern const char typeset_help[], typeset_syntax[], export_help[],
        export_syntax[], local_help[], local_syntax[], readonly_help[],
        readonly_syntax[];
 #endif
-extern const struct xgetopt_T typeset_options[];
+extern const struct xgetopt_T typeset_options[], export_options[];
 #define local_options (&typeset_options[2])
 
 extern int array_builtin(int argc, void **argv)
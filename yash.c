@@ -504,6 +504,39 @@ void exec_input(int fd, const char *name, exec_input_options_T options)
     free(inputinfo);
 }
 
+/* Parses the specified multibyte string and executes commands.
+ * `options' are the same as those of `exec_input' except that XIO_INTERACTIVE
+ * is not allowed.
+ * If there are no commands in the string, `laststatus' is set to zero. */
+void exec_mbs(const char *code, const char *name, exec_input_options_T options)
+{
+    assert(!(options & XIO_INTERACTIVE));
+
+    wchar_t *wcode = malloc_mbstowcs(code);
+    if (wcode == NULL) {
+        xerror(EILSEQ, Ngt("unexpected error"));
+        laststatus = Exit_ERROR;
+        return;
+    }
+
+    struct input_wcs_info_T iinfo = {
+        .src = wcode,
+    };
+    struct parseparam_T pinfo = {
+        .print_errmsg = true,
+        .enable_verbose = true,
+        .enable_alias = options & XIO_SUBST_ALIAS,
+        .filename = name,
+        .lineno = 1,
+        .input = input_wcs,
+        .inputinfo = &iinfo,
+        .interactive = false,
+    };
+
+    parse_and_exec(&pinfo, options & XIO_FINALLY_EXIT);
+    free(wcode);
+}
+
 /* Parses the input using the specified `parseparam_T' and executes commands.
  * If no commands were executed, `laststatus' is set to Exit_SUCCESS. */
 void parse_and_exec(parseparam_T *pinfo, bool finally_exit)
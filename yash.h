@@ -46,6 +46,9 @@ typedef enum exec_input_options_T {
 } exec_input_options_T;
 
 extern void exec_input(int fd, const char *name, exec_input_options_T options);
+extern void exec_mbs(
+        const char *code, const char *name, exec_input_options_T options)
+    __attribute__((nonnull(1)));
 
 
 extern _Bool nextforceexit;